@@ -144,54 +144,21 @@ float HydroponicsController::readPHSensor(uint8_t index)
         return -1.0f; // Invalid sensor index
     }
 
-    float sum = 0;
-    int validReadings = 0;
-    const int MIN_VALID_READINGS = 3; // Minimum readings required for valid result
-
+    int samples[PH_SAMPLES];
     for (int i = 0; i < PH_SAMPLES; i++)
     {
-        int rawValue = analogRead(phPins[index]);
-
-        // Check for invalid/disconnected sensor readings
-        if (rawValue == 0 || rawValue == 1023 || rawValue < 100)
-        {
-            continue; // Skip clearly invalid readings
-        }
-
-        float voltage = (float)rawValue * 5.0f / 1023.0f;
-
-        // Validate voltage is in reasonable range (0.5V-4.5V typical for pH sensors)
-        if (voltage < 0.5f || voltage > 4.5f)
-        {
-            continue;
-        }
-
-        float ph = 7.0f + ((2.5f - voltage) / 0.18f) * phCalibration[index];
-
-        // Validate pH value is in reasonable range
-        if (ph >= 0.0f && ph <= 14.0f)
-        {
-            sum += ph;
-            validReadings++;
-        }
-
+        samples[i] = analogRead(phPins[index]);
         delay(10);
     }
 
-    // Return -1 if we didn't get enough valid readings
-    if (validReadings < MIN_VALID_READINGS)
-    {
-        return -1.0f;
-    }
-
-    return sum / validReadings;
+    // skip invalid readings and convert the rest, -1 if too few are valid
+    return hydroponics_ph_from_samples(samples, PH_SAMPLES, phCalibration[index]);
 }
 
 // read light level
 float HydroponicsController::readLightLevel()
 {
-    int rawValue = analogRead(LDR_PIN);
-    return (float)rawValue * 100.0 / 1023.0;
+    return hydroponics_light_level(analogRead(LDR_PIN));
 }
 
 // toggle relay state
@@ -284,28 +251,35 @@ void HydroponicsController::saveCalibration()
     }
 }
 
+// command actions for hydroponics_handle_command()
+static void toggleRelayAction(void *context, uint32_t index)
+{
+    static_cast<HydroponicsController *>(context)->toggleRelay(index);
+}
+
+static void calibratePHAction(void *context, uint32_t index, float value)
+{
+    static_cast<HydroponicsController *>(context)->calibratePHSensor(index, value);
+}
+
 // handle incoming commands
 void HydroponicsController::handleCommand(const Command &cmd)
 {
-    switch (cmd.type)
-    {
-    case Command_CommandType_TOGGLE_RELAY:
-        toggleRelay(cmd.relay_index);
-        break;
-    case Command_CommandType_CALIBRATE_PH:
-        calibratePHSensor(cmd.ph_sensor_index, cmd.ph_calibration_value);
-        break;
-    default:
-        // Serial.println("Unknown command type");
-        break;
-    }
+    hydroponics_handler_t handler;
+    handler.toggle_relay = toggleRelayAction;
+    handler.calibrate_ph = calibratePHAction;
+    handler.context = this;
+
+    // unknown commands and out of range arguments are ignored
+    hydroponics_handle_command(&handler, &cmd);
 }
 
 void HydroponicsController::sendSensorData(const uint8_t* buffer, uint16_t length) {
-    Serial.write(0xFF);  // Start marker
-    Serial.write(0xFE);
-    Serial.write((uint8_t*)&length, 2);  // Length prefix
-    Serial.write(buffer, length);
-    Serial.write(0xFD);  // End marker
-    Serial.write(0xFC);
+    // start marker, length prefix, payload and end marker
+    uint8_t frame[128 + HYDROPONICS_FRAME_OVERHEAD];
+    size_t frame_length = hydroponics_frame(frame, sizeof(frame), buffer, length);
+    if (frame_length > 0)
+    {
+        Serial.write(frame, frame_length);
+    }
 }
\ No newline at end of file
@@ -5,6 +5,7 @@
 #include <DHT.h>
 #include <EEPROM.h>
 #include "hydroponics.pb.h"
+#include "hydroponics_logic.h"
 
 // pin definitions
 #define DHT_PIN 2
@@ -12,11 +13,8 @@
 #define PH_PINS {A1, A2, A3, A4, A5}
 #define RELAY_PINS {3, 4, 5, 6, 7}
 
-// constants
-#define NUM_PH_SENSORS 5
-#define NUM_RELAYS 5
+// constants, sensor and relay counts are in hydroponics_logic.h
 #define SAMPLE_INTERVAL 1000 // 1 second
-#define PH_SAMPLES 10
 #define EEPROM_PH_OFFSET 0
 
 class HydroponicsController
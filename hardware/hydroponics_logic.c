@@ -0,0 +1,80 @@
+#include <string.h>
+#include "hydroponics_logic.h"
+
+float hydroponics_ph_from_samples(const int *raw, int count, float calibration)
+{
+    float sum = 0;
+    int valid = 0;
+    int i;
+
+    for (i = 0; i < count; i++)
+    {
+        float voltage, ph;
+
+        /* Skip disconnected sensor readings */
+        if (raw[i] == 0 || raw[i] == 1023 || raw[i] < 100)
+            continue;
+
+        /* 0.5V-4.5V is the typical range of pH sensors */
+        voltage = (float)raw[i] * 5.0f / 1023.0f;
+        if (voltage < 0.5f || voltage > 4.5f)
+            continue;
+
+        ph = 7.0f + ((2.5f - voltage) / 0.18f) * calibration;
+        if (ph >= 0.0f && ph <= 14.0f)
+        {
+            sum += ph;
+            valid++;
+        }
+    }
+
+    if (valid < 3)
+        return -1.0f;
+
+    return sum / (float)valid;
+}
+
+float hydroponics_light_level(int raw)
+{
+    return (float)raw * 100.0f / 1023.0f;
+}
+
+size_t hydroponics_frame(pb_byte_t *frame, size_t frame_size,
+                         const pb_byte_t *payload, size_t length)
+{
+    if (length > 0xFFFF || length + HYDROPONICS_FRAME_OVERHEAD > frame_size)
+        return 0;
+
+    frame[0] = 0xFF;
+    frame[1] = 0xFE;
+    frame[2] = (pb_byte_t)(length & 0xFF);
+    frame[3] = (pb_byte_t)(length >> 8);
+    memcpy(frame + 4, payload, length);
+    frame[length + 4] = 0xFD;
+    frame[length + 5] = 0xFC;
+    return length + HYDROPONICS_FRAME_OVERHEAD;
+}
+
+bool hydroponics_handle_command(const hydroponics_handler_t *handler, const Command *cmd)
+{
+    switch (cmd->type)
+    {
+        case Command_CommandType_TOGGLE_RELAY:
+            if (cmd->relay_index >= NUM_RELAYS)
+                return false;
+
+            handler->toggle_relay(handler->context, cmd->relay_index);
+            return true;
+
+        case Command_CommandType_CALIBRATE_PH:
+            if (cmd->ph_sensor_index >= NUM_PH_SENSORS ||
+                cmd->ph_calibration_value <= 0 || cmd->ph_calibration_value > 14)
+                return false;
+
+            handler->calibrate_ph(handler->context, cmd->ph_sensor_index, cmd->ph_calibration_value);
+            return true;
+
+        default:
+            return false;
+    }
+}
@@ -0,0 +1,55 @@
+/* Hardware independent parts of the hydroponics controller: pH and light
+ * level conversion, serial framing of SensorData and command dispatch.
+ * Used by HydroponicsController in hydroponics.cpp and by the AVR cycle
+ * benchmark in lib/tests/avr_cycles, so that both run the same code.
+ */
+
+#ifndef HYDROPONICS_LOGIC_H
+#define HYDROPONICS_LOGIC_H
+
+#include "pb.h"
+#include "hydroponics.pb.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define NUM_PH_SENSORS 5
+#define NUM_RELAYS 5
+#define PH_SAMPLES 10
+
+/* Start marker, 16-bit little endian length and end marker around the
+ * encoded SensorData */
+#define HYDROPONICS_FRAME_OVERHEAD 6
+
+/* Average the valid pH values of count raw analog samples (0-1023).
+ * Disconnected readings and values outside the sensor range are skipped.
+ * Returns -1 if fewer than 3 samples are valid. */
+float hydroponics_ph_from_samples(const int *raw, int count, float calibration);
+
+/* Convert a raw analog light sensor sample to percent */
+float hydroponics_light_level(int raw);
+
+/* Write the payload to frame with the start marker, length and end
+ * marker. Returns the frame length, or 0 if it does not fit in frame_size. */
+size_t hydroponics_frame(pb_byte_t *frame, size_t frame_size,
+                         const pb_byte_t *payload, size_t length);
+
+/* Actions of the commands, called with the context pointer. The relay and
+ * sensor indexes and the calibration value have been range checked. */
+typedef struct {
+    void (*toggle_relay)(void *context, uint32_t index);
+    void (*calibrate_ph)(void *context, uint32_t index, float value);
+    void *context;
+} hydroponics_handler_t;
+
+/* Check the arguments of cmd and call the matching action of handler.
+ * Returns false if the command type is unknown or an argument is out of
+ * range. */
+bool hydroponics_handle_command(const hydroponics_handler_t *handler, const Command *cmd);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif
@@ -13,6 +13,37 @@
 /* Enable support for dynamically allocated fields */
 /* #define PB_ENABLE_MALLOC 1 */
 
+/* Allow decoding pointer fields into a caller-supplied pb_arena_t
+ * instead of individual pb_realloc() calls. Requires PB_ENABLE_MALLOC. */
+/* #define PB_ENABLE_ARENA 1 */
+
+/* Add a skip callback to pb_istream_t, so that callback streams can skip
+ * unknown and unused fields without reading them, e.g. by seeking. */
+/* #define PB_ENABLE_SKIP_CALLBACK 1 */
+
+/* Enable pb_istream_buffered() and pb_ostream_buffered(), which read
+ * and write callback streams in blocks. */
+/* #define PB_ENABLE_BUFFERED_STREAM 1 */
+
+/* Enable pb_ostream_iovec(), which collects the output as a list of
+ * segments for writev(). */
+/* #define PB_ENABLE_IOVEC_STREAM 1 */
+
+/* Enable pb_ring_t and the streams that write to and read from it. */
+/* #define PB_ENABLE_RING_STREAM 1 */
+
+/* Enable pb_ostream_tee(), which writes the same output to several
+ * streams. */
+/* #define PB_ENABLE_TEE_STREAM 1 */
+
+/* Count fields, bytes, sizing passes and callbacks in the global
+ * pb_stats structure, see pb_common.h. */
+/* #define PB_ENABLE_STATS 1 */
+
+/* Keep the spare capacity of repeated pointer fields after decoding,
+ * instead of reallocating them to the exact size at the end. */
+/* #define PB_NO_SHRINK_TO_FIT 1 */
+
 /* Define this if your CPU / compiler combination does not support
  * unaligned memory access to packed structures. Note that packed
  * structures are only used when requested in .proto options. */
@@ -22,6 +53,15 @@
  * A compiler warning will tell if you need this. */
 /* #define PB_MAX_REQUIRED_FIELDS 256 */
 
+/* Increase the number of fields per message that pb_decode_tracked()
+ * can keep track of. Fields beyond the limit are always reinitialized. */
+/* #define PB_MAX_TRACKED_FIELDS 256 */
+
+/* Increase the number of arrays per message whose entries pb_validate()
+ * counts over the whole message. Further arrays are counted only while
+ * their entries are consecutive. */
+/* #define PB_VALIDATE_MAX_ARRAYS 32 */
+
 /* Add support for tag numbers > 65536 and fields larger than 65536 bytes. */
 /* #define PB_FIELD_32BIT 1 */
 
@@ -51,6 +91,14 @@
  * the string processing slightly and slightly increases code size. */
 /* #define PB_VALIDATE_UTF8 1 */
 
+/* Enable pb_push_decoder_t, which decodes messages from input that
+ * arrives in arbitrary sized pieces. */
+/* #define PB_ENABLE_PUSH_DECODER 1 */
+
+/* Enable pb_pull_encoder_t, which produces the encoded message in
+ * pieces of caller-chosen size. */
+/* #define PB_ENABLE_PULL_ENCODER 1 */
+
 /* This can be defined if the platform is little-endian and has 8-bit bytes.
  * Normally it is automatically detected based on __BYTE_ORDER__ macro. */
 /* #define PB_LITTLE_ENDIAN_8BIT 1 */
@@ -224,6 +272,16 @@ PB_STATIC_ASSERT(1, STATIC_ASSERT_IS_NOT_WORKING)
 #error You should not lower PB_MAX_REQUIRED_FIELDS from the default value (64).
 #endif
 
+/* Number of fields per message tracked by pb_decode_tracked(). */
+#ifndef PB_MAX_TRACKED_FIELDS
+#define PB_MAX_TRACKED_FIELDS 64
+#endif
+
+/* Number of arrays per message counted by pb_validate(). */
+#ifndef PB_VALIDATE_MAX_ARRAYS
+#define PB_VALIDATE_MAX_ARRAYS 8
+#endif
+
 #ifdef PB_WITHOUT_64BIT
 #ifdef PB_CONVERT_DOUBLE_FLOAT
 /* Cannot use doubles without 64-bit types */
@@ -289,8 +347,12 @@ typedef pb_byte_t pb_type_t;
  * pb_byte_t[data_size] rather than pb_bytes_array_t. */
 #define PB_LTYPE_FIXED_LENGTH_BYTES 0x0BU
 
+/* String or bytes stored as a pb_view_t pointing into the input buffer.
+ * Decoding requires a stream created with pb_istream_from_buffer(). */
+#define PB_LTYPE_VIEW 0x0CU
+
 /* Number of declared LTYPES */
-#define PB_LTYPES_COUNT 0x0CU
+#define PB_LTYPES_COUNT 0x0DU
 #define PB_LTYPE_MASK 0x0FU
 
 /**** Field repetition rules ****/
@@ -398,6 +460,64 @@ struct pb_bytes_array_s {
 };
 typedef struct pb_bytes_array_s pb_bytes_array_t;
 
+/* This structure is used for 'string' and 'bytes' fields with the
+ * generator option (nanopb).view = true. Instead of copying the data,
+ * the decoder stores a pointer to it inside the input buffer, so the
+ * buffer must stay valid as long as the message is used. Strings are
+ * not null terminated.
+ */
+typedef struct {
+    const pb_byte_t *ptr;
+    size_t len;
+} pb_view_t;
+
+#ifdef PB_ENABLE_RING_STREAM
+/* Circular buffer for streams created by pb_ostream_from_ring() and
+ * pb_istream_from_ring(), for example a UART transmit queue or a shared
+ * memory log. The size must be a power of two. head and tail are free
+ * running byte counters: the producer only updates head, and the
+ * consumer only updates tail, so one of them can be an interrupt handler.
+ * The counters are read and written inside PB_RING_ATOMIC().
+ */
+typedef struct pb_ring_s pb_ring_t;
+struct pb_ring_s {
+    pb_byte_t *buf;
+    size_t mask; /* Size of buf minus one */
+    volatile size_t head; /* Total bytes written */
+    volatile size_t tail; /* Total bytes consumed */
+};
+
+/* Position of an unfinished read or write in a ring buffer */
+typedef struct {
+    pb_ring_t *ring;
+    size_t pos;
+} pb_ring_cursor_t;
+
+/* Memory barrier used when publishing new head or tail of a ring buffer,
+ * so that the data is visible before the index on multicore systems. */
+#ifndef PB_RING_BARRIER
+#if defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 7))
+#define PB_RING_BARRIER() __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#else
+#define PB_RING_BARRIER()
+#endif
+#endif
+
+/* Wrapper for the statements that read or write head and tail, so that
+ * an interrupt handler on the other side of the ring does not see a
+ * partially updated counter. On AVR, size_t takes two instructions to
+ * access, so interrupts are disabled around them. Elsewhere size_t is
+ * accessed atomically. Define this to use a lock, for example. */
+#ifndef PB_RING_ATOMIC
+#ifdef __AVR__
+#include <util/atomic.h>
+#define PB_RING_ATOMIC(statements) ATOMIC_BLOCK(ATOMIC_RESTORESTATE) { statements; }
+#else
+#define PB_RING_ATOMIC(statements) { statements; }
+#endif
+#endif
+#endif
+
 /* This structure is used for giving the callback function.
  * It is stored in the message structure and filled in by the method that
  * calls pb_decode.
@@ -744,6 +864,7 @@ struct pb_extension_s {
 #define PB_SI_PB_LTYPE_UINT64(t)
 #define PB_SI_PB_LTYPE_EXTENSION(t)
 #define PB_SI_PB_LTYPE_FIXED_LENGTH_BYTES(t)
+#define PB_SI_PB_LTYPE_VIEW(t)
 #define PB_SUBMSG_DESCRIPTOR(t)    &(t ## _msg),
 
 /* The field descriptors use a variable width format, with width of either
@@ -863,6 +984,7 @@ struct pb_extension_s {
 #define PB_FI_WIDTH_PB_LTYPE_UINT64    1
 #define PB_FI_WIDTH_PB_LTYPE_EXTENSION 1
 #define PB_FI_WIDTH_PB_LTYPE_FIXED_LENGTH_BYTES 2
+#define PB_FI_WIDTH_PB_LTYPE_VIEW      2
 
 /* The mapping from protobuf types to LTYPEs is done using these macros. */
 #define PB_LTYPE_MAP_BOOL               PB_LTYPE_BOOL
@@ -886,6 +1008,7 @@ struct pb_extension_s {
 #define PB_LTYPE_MAP_UINT64             PB_LTYPE_UVARINT
 #define PB_LTYPE_MAP_EXTENSION          PB_LTYPE_EXTENSION
 #define PB_LTYPE_MAP_FIXED_LENGTH_BYTES PB_LTYPE_FIXED_LENGTH_BYTES
+#define PB_LTYPE_MAP_VIEW               PB_LTYPE_VIEW
 
 /* These macros are used for giving out error messages.
  * They are mostly a debugging aid; the main error information
@@ -36,6 +36,57 @@ bool pb_field_iter_find(pb_field_iter_t *iter, uint32_t tag);
  * There can be only one extension range field per message. */
 bool pb_field_iter_find_extension(pb_field_iter_t *iter);
 
+/* Check if the field is a repeated field without a count field in the
+ * struct, i.e. a fixed count array. Works also for iterators that were
+ * started without a message. */
+bool pb_field_iter_is_fixed_count(const pb_field_iter_t *iter);
+
+#ifdef PB_ENABLE_RING_STREAM
+/* Set up a ring buffer of size bytes at buf. Returns false if size is
+ * not a power of two. */
+bool pb_ring_init(pb_ring_t *ring, pb_byte_t *buf, size_t size);
+#endif
+
+#ifdef PB_ENABLE_STATS
+/* Codec statistics, counted by the encoder and decoder for all streams.
+ * Streams that write to or read from other streams, such as buffered and
+ * tee streams, count the data at each level. The counters are not
+ * protected by locks, so they are only exact in single threaded use. */
+typedef struct pb_stats_s pb_stats_t;
+struct pb_stats_s
+{
+    uint32_t fields_decoded[8]; /* Field tags read, by wire type */
+    uint32_t fields_encoded[8]; /* Field tags written, by wire type */
+    uint32_t varint_bytes;      /* Bytes of varints read or written */
+    uint32_t bytes_skipped;     /* Bytes skipped without reading them to memory */
+    uint32_t bytes_copied;      /* Bytes read with pb_read() or written with pb_write() */
+    uint32_t sizing_passes;     /* Messages encoded only to compute their size */
+    uint32_t callbacks;         /* Calls to field callbacks */
+    uint32_t iter_steps;        /* Steps of the field descriptor iterator */
+    uint32_t submsg_depth;      /* Current submessage nesting level */
+    uint32_t max_submsg_depth;  /* Deepest nesting level seen */
+};
+
+extern pb_stats_t pb_stats;
+
+/* Copy the current counters to dest. */
+void pb_stats_get(pb_stats_t *dest);
+
+/* Set all counters to zero. */
+void pb_stats_reset(void);
+
+#define PB_STATS_ADD(counter, n) (pb_stats.counter += (uint32_t)(n))
+#define PB_STATS_ENTER_SUBMSG() do { \
+        if (++pb_stats.submsg_depth > pb_stats.max_submsg_depth) \
+            pb_stats.max_submsg_depth = pb_stats.submsg_depth; \
+    } while (0)
+#define PB_STATS_LEAVE_SUBMSG() do { pb_stats.submsg_depth--; } while (0)
+#else
+#define PB_STATS_ADD(counter, n)
+#define PB_STATS_ENTER_SUBMSG()
+#define PB_STATS_LEAVE_SUBMSG()
+#endif
+
 #ifdef PB_VALIDATE_UTF8
 /* Validate UTF-8 text string */
 bool pb_validate_utf8(const char *s);
@@ -22,10 +22,19 @@
  * Declarations internal to this file *
  **************************************/
 
+typedef struct pb_tag_set_s pb_tag_set_t;
+
 static bool checkreturn buf_read(pb_istream_t *stream, pb_byte_t *buf, size_t count);
+#if !defined(PB_BUFFER_ONLY) && defined(PB_ENABLE_BUFFERED_STREAM)
+static bool checkreturn buffered_read(pb_istream_t *stream, pb_byte_t *buf, size_t count);
+#endif
+#if !defined(PB_BUFFER_ONLY) && defined(PB_ENABLE_RING_STREAM)
+static bool checkreturn ring_read(pb_istream_t *stream, pb_byte_t *buf, size_t count);
+#endif
 static bool checkreturn pb_decode_varint32_eof(pb_istream_t *stream, uint32_t *dest, bool *eof);
 static bool checkreturn read_raw_value(pb_istream_t *stream, pb_wire_type_t wire_type, pb_byte_t *buf, size_t *size);
 static bool checkreturn decode_basic_field(pb_istream_t *stream, pb_wire_type_t wire_type, pb_field_iter_t *field);
+static bool select_oneof_field(pb_field_iter_t *field);
 static bool checkreturn decode_static_field(pb_istream_t *stream, pb_wire_type_t wire_type, pb_field_iter_t *field);
 static bool checkreturn decode_pointer_field(pb_istream_t *stream, pb_wire_type_t wire_type, pb_field_iter_t *field);
 static bool checkreturn decode_callback_field(pb_istream_t *stream, pb_wire_type_t wire_type, pb_field_iter_t *field);
@@ -33,21 +42,43 @@ static bool checkreturn decode_field(pb_istream_t *stream, pb_wire_type_t wire_t
 static bool checkreturn default_extension_decoder(pb_istream_t *stream, pb_extension_t *extension, uint32_t tag, pb_wire_type_t wire_type);
 static bool checkreturn decode_extension(pb_istream_t *stream, uint32_t tag, pb_wire_type_t wire_type, pb_extension_t *extension);
 static bool pb_field_set_to_default(pb_field_iter_t *field);
-static bool pb_message_set_to_defaults(pb_field_iter_t *iter);
+static bool pb_message_set_to_defaults(pb_field_iter_t *iter, const uint32_t *clean, const pb_tag_set_t *projection);
+static bool required_fields_present(const pb_msgdesc_t *fields, const uint32_t *bitfield);
+static bool tag_selected(const pb_tag_set_t *projection, uint32_t tag);
+static bool checkreturn decode_message(pb_istream_t *stream, const pb_msgdesc_t *fields, void *dest_struct, unsigned int flags, pb_field_tracker_t *tracker, const pb_tag_set_t *projection);
+static bool checkreturn enter_frame(pb_istream_t *stream, pb_decode_frame_t *frame, const pb_msgdesc_t *fields, void *dest_struct, unsigned int flags, pb_field_iter_t *iter);
+static bool checkreturn leave_frame(pb_istream_t *stream, pb_decode_frame_t *frame);
+static bool checkreturn prepare_submessage(pb_istream_t *stream, pb_field_iter_t *field, unsigned int *flags, pb_decode_frame_t *frame);
+static bool checkreturn decode_iterative(pb_istream_t *stream, const pb_msgdesc_t *fields, void *dest_struct, unsigned int flags, pb_decode_frame_t *frames, pb_size_t frame_count);
+typedef struct pb_depth_path_s pb_depth_path_t;
+typedef struct pb_array_counts_s pb_array_counts_t;
+static bool message_depth(const pb_msgdesc_t *fields, const pb_depth_path_t *parent, pb_size_t max_depth, pb_size_t *depth);
+static bool checkreturn read_record(const pb_byte_t *buf, size_t size, size_t *pos, pb_view_t *record);
+static bool checkreturn validate_basic_field(pb_istream_t *stream, pb_wire_type_t wire_type, const pb_field_iter_t *field);
+static bool checkreturn validate_field(pb_istream_t *stream, pb_wire_type_t wire_type, const pb_field_iter_t *field, pb_size_t *count);
+static pb_size_t *count_array(pb_array_counts_t *arrays, pb_size_t index);
+static bool checkreturn validate_message(pb_istream_t *stream, const pb_msgdesc_t *fields);
 static bool checkreturn pb_dec_bool(pb_istream_t *stream, const pb_field_iter_t *field);
 static bool checkreturn pb_dec_varint(pb_istream_t *stream, const pb_field_iter_t *field);
 static bool checkreturn pb_dec_bytes(pb_istream_t *stream, const pb_field_iter_t *field);
 static bool checkreturn pb_dec_string(pb_istream_t *stream, const pb_field_iter_t *field);
 static bool checkreturn pb_dec_submessage(pb_istream_t *stream, const pb_field_iter_t *field);
 static bool checkreturn pb_dec_fixed_length_bytes(pb_istream_t *stream, const pb_field_iter_t *field);
+static bool checkreturn pb_dec_view(pb_istream_t *stream, const pb_field_iter_t *field);
 static bool checkreturn pb_skip_varint(pb_istream_t *stream);
 static bool checkreturn pb_skip_string(pb_istream_t *stream);
 
 #ifdef PB_ENABLE_MALLOC
 static bool checkreturn allocate_field(pb_istream_t *stream, void *pData, size_t data_size, size_t array_size);
+static bool checkreturn decode_pointer_array(pb_istream_t *stream, pb_wire_type_t wire_type, pb_field_iter_t *field, pb_array_growth_t *growth);
+static bool checkreturn track_pointer_array(pb_istream_t *stream, pb_field_iter_t *field, pb_array_growth_t *growth);
+static bool checkreturn reserve_array_entry(pb_istream_t *stream, pb_field_iter_t *field, pb_array_growth_t *growth);
+static bool checkreturn finish_pointer_array(pb_istream_t *stream, pb_array_growth_t *growth);
 static void initialize_pointer_field(void *pItem, pb_field_iter_t *field);
 static bool checkreturn pb_release_union_field(pb_istream_t *stream, pb_field_iter_t *field);
-static void pb_release_single_field(pb_field_iter_t *field);
+static void pb_release_single_field(pb_field_iter_t *field, bool free_memory);
+static void pb_release_message(const pb_msgdesc_t *fields, void *dest_struct, bool free_memory);
+static bool stream_frees_memory(const pb_istream_t *stream);
 #endif
 
 #ifdef PB_WITHOUT_64BIT
@@ -62,6 +93,29 @@ typedef struct {
     uint32_t bitfield[(PB_MAX_REQUIRED_FIELDS + 31) / 32];
 } pb_fields_seen_t;
 
+/* Tags selected for pb_decode_projection() */
+struct pb_tag_set_s {
+    const uint32_t *tags;
+    pb_size_t count;
+};
+
+/* Entry counts of the arrays in a message, for pb_validate() */
+struct pb_array_counts_s {
+    pb_size_t used;
+    pb_size_t fields[PB_VALIDATE_MAX_ARRAYS];
+    pb_size_t counts[PB_VALIDATE_MAX_ARRAYS];
+    pb_size_t extra_field; /* Array beyond the limit that is being read */
+    pb_size_t extra_count;
+};
+
+/* Message types from the top-level message down to the current one,
+ * for finding recursion in pb_decode_depth() */
+struct pb_depth_path_s {
+    const pb_msgdesc_t *descriptor;
+    const pb_depth_path_t *parent;
+};
+
+
 /*******************************
  * pb_istream_t implementation *
  *******************************/
@@ -79,13 +133,51 @@ static bool checkreturn buf_read(pb_istream_t *stream, pb_byte_t *buf, size_t co
     return true;
 }
 
+#ifndef PB_BUFFER_ONLY
+/* Check if the stream callback can skip data when called with buf == NULL.
+ * Only the streams that are in use are compared, so that the others are
+ * not linked in. */
+static bool callback_can_skip(const pb_istream_t *stream)
+{
+    if (stream->callback == buf_read)
+        return true;
+
+#ifdef PB_ENABLE_BUFFERED_STREAM
+    if (stream->callback == buffered_read)
+        return true;
+#endif
+
+#ifdef PB_ENABLE_RING_STREAM
+    if (stream->callback == ring_read)
+        return true;
+#endif
+
+    return false;
+}
+#endif
+
 bool checkreturn pb_read(pb_istream_t *stream, pb_byte_t *buf, size_t count)
 {
     if (count == 0)
         return true;
 
+#if !defined(PB_BUFFER_ONLY) && defined(PB_ENABLE_SKIP_CALLBACK)
+    if (buf == NULL && stream->skip != NULL)
+    {
+        if (stream->bytes_left < count)
+            PB_RETURN_ERROR(stream, "end-of-stream");
+
+        if (!stream->skip(stream, count))
+            PB_RETURN_ERROR(stream, "io error");
+
+        stream->bytes_left -= count;
+        PB_STATS_ADD(bytes_skipped, count);
+        return true;
+    }
+#endif
+
 #ifndef PB_BUFFER_ONLY
-	if (buf == NULL && stream->callback != buf_read)
+	if (buf == NULL && !callback_can_skip(stream))
 	{
 		/* Skip input bytes */
 		pb_byte_t tmp[16];
@@ -117,6 +209,8 @@ bool checkreturn pb_read(pb_istream_t *stream, pb_byte_t *buf, size_t count)
     else
         stream->bytes_left -= count;
 
+    PB_STATS_ADD(bytes_copied, buf != NULL ? count : 0);
+    PB_STATS_ADD(bytes_skipped, buf == NULL ? count : 0);
     return true;
 }
 
@@ -160,10 +254,175 @@ pb_istream_t pb_istream_from_buffer(const pb_byte_t *buf, size_t msglen)
     stream.bytes_left = msglen;
 #ifndef PB_NO_ERRMSG
     stream.errmsg = NULL;
+#endif
+#ifdef PB_ENABLE_ARENA
+    stream.arena = NULL;
+#endif
+#ifdef PB_ENABLE_SKIP_CALLBACK
+    stream.skip = NULL;
+#endif
+    return stream;
+}
+
+#if !defined(PB_BUFFER_ONLY) && defined(PB_ENABLE_BUFFERED_STREAM)
+static bool checkreturn buffered_read(pb_istream_t *stream, pb_byte_t *buf, size_t count)
+{
+    pb_istream_buffer_t *state = (pb_istream_buffer_t*)stream->state;
+    pb_istream_t *source = state->source;
+
+    while (count > 0)
+    {
+        size_t avail = state->end - state->pos;
+
+        if (avail == 0)
+        {
+            /* Large skips go directly to the source, others refill
+             * the buffer with as much as the source has left. */
+            size_t fill = source->bytes_left;
+            bool skip = (buf == NULL && count >= state->size && state->refill == NULL);
+
+            if (skip)
+                fill = count;
+            else if (fill > state->size)
+                fill = state->size;
+
+            if (fill > 0 && state->refill != NULL)
+            {
+                /* The source returns what it has, which can be less */
+                fill = state->refill(source, state->buf, fill);
+                source->bytes_left -= fill;
+            }
+            else if (fill > 0 && !pb_read(source, skip ? NULL : state->buf, fill))
+            {
+                fill = 0;
+            }
+
+            if (fill == 0)
+            {
+                /* Let the decoder see the end of the source data */
+                if (source->bytes_left == 0)
+                    stream->bytes_left = 0;
+
+#ifndef PB_NO_ERRMSG
+                stream->errmsg = source->errmsg;
+#endif
+                return false;
+            }
+
+            if (skip)
+                return true;
+
+            state->pos = 0;
+            state->end = fill;
+            avail = fill;
+        }
+
+        if (avail > count)
+            avail = count;
+
+        if (buf != NULL)
+        {
+            memcpy(buf, state->buf + state->pos, avail);
+            buf += avail;
+        }
+
+        state->pos += avail;
+        count -= avail;
+    }
+
+    return true;
+}
+
+pb_istream_t pb_istream_buffered(pb_istream_buffer_t *state, pb_istream_t *source, pb_byte_t *buf, size_t size)
+{
+    return pb_istream_buffered_partial(state, source, NULL, buf, size);
+}
+
+pb_istream_t pb_istream_buffered_partial(pb_istream_buffer_t *state, pb_istream_t *source, pb_istream_refill_t refill, pb_byte_t *buf, size_t size)
+{
+    pb_istream_t stream;
+
+    state->source = source;
+    state->refill = refill;
+    state->buf = buf;
+    state->size = size;
+    state->pos = 0;
+    state->end = 0;
+
+    stream.callback = &buffered_read;
+    stream.state = state;
+    stream.bytes_left = source->bytes_left;
+#ifndef PB_NO_ERRMSG
+    stream.errmsg = NULL;
+#endif
+#ifdef PB_ENABLE_ARENA
+    stream.arena = source->arena;
+#endif
+#ifdef PB_ENABLE_SKIP_CALLBACK
+    /* Skips are handled by buffered_read() */
+    stream.skip = NULL;
+#endif
+    return stream;
+}
+#endif
+
+#if !defined(PB_BUFFER_ONLY) && defined(PB_ENABLE_RING_STREAM)
+static bool checkreturn ring_read(pb_istream_t *stream, pb_byte_t *buf, size_t count)
+{
+    pb_ring_cursor_t *cursor = (pb_ring_cursor_t*)stream->state;
+    pb_ring_t *ring = cursor->ring;
+    size_t start = cursor->pos & ring->mask;
+    size_t first = ring->mask + 1 - start;
+
+    if (buf != NULL)
+    {
+        if (first > count)
+            first = count;
+
+        memcpy(buf, ring->buf + start, first);
+        memcpy(buf + first, ring->buf, count - first);
+    }
+
+    cursor->pos += count;
+    return true;
+}
+
+pb_istream_t pb_istream_from_ring(pb_ring_cursor_t *cursor, pb_ring_t *ring)
+{
+    pb_istream_t stream;
+    size_t tail, head;
+
+    PB_RING_ATOMIC(tail = ring->tail; head = ring->head);
+
+    /* The data must not be read before head */
+    PB_RING_BARRIER();
+
+    cursor->ring = ring;
+    cursor->pos = tail;
+
+    stream.callback = &ring_read;
+    stream.state = cursor;
+    stream.bytes_left = head - tail;
+#ifndef PB_NO_ERRMSG
+    stream.errmsg = NULL;
+#endif
+#ifdef PB_ENABLE_ARENA
+    stream.arena = NULL;
+#endif
+#ifdef PB_ENABLE_SKIP_CALLBACK
+    /* Skips are handled by ring_read() */
+    stream.skip = NULL;
 #endif
     return stream;
 }
 
+void pb_ring_consume(pb_ring_cursor_t *cursor)
+{
+    PB_RING_BARRIER();
+    PB_RING_ATOMIC(cursor->ring->tail = cursor->pos);
+}
+#endif
+
 /********************
  * Helper functions *
  ********************/
@@ -185,6 +444,8 @@ static bool checkreturn pb_decode_varint32_eof(pb_istream_t *stream, uint32_t *d
 
         return false;
     }
+
+    PB_STATS_ADD(varint_bytes, 1);
     
     if ((byte & 0x80) == 0)
     {
@@ -201,6 +462,8 @@ static bool checkreturn pb_decode_varint32_eof(pb_istream_t *stream, uint32_t *d
         {
             if (!pb_readbyte(stream, &byte))
                 return false;
+
+            PB_STATS_ADD(varint_bytes, 1);
             
             if (bitpos >= 32)
             {
@@ -251,6 +514,8 @@ bool checkreturn pb_decode_varint(pb_istream_t *stream, uint64_t *dest)
         if (!pb_readbyte(stream, &byte))
             return false;
 
+        PB_STATS_ADD(varint_bytes, 1);
+
         if (bitpos >= 63 && (byte & 0xFE) != 0)
             PB_RETURN_ERROR(stream, "varint overflow");
 
@@ -470,11 +735,51 @@ static bool checkreturn decode_basic_field(pb_istream_t *stream, pb_wire_type_t
 
             return pb_dec_fixed_length_bytes(stream, field);
 
+        case PB_LTYPE_VIEW:
+            if (wire_type != PB_WT_STRING)
+                PB_RETURN_ERROR(stream, "wrong wire type");
+
+            return pb_dec_view(stream, field);
+
         default:
             PB_RETURN_ERROR(stream, "invalid field type");
     }
 }
 
+/* Set the which_ field of a oneof to point to this field. If the
+ * oneof previously held a different submessage, clear the union and
+ * set the default values of the new submessage. */
+static bool select_oneof_field(pb_field_iter_t *field)
+{
+    if (PB_LTYPE_IS_SUBMSG(field->type) &&
+        *(pb_size_t*)field->pSize != field->tag)
+    {
+        /* We memset to zero so that any callbacks are set to NULL.
+         * This is because the callbacks might otherwise have values
+         * from some other union field.
+         * If callbacks are needed inside oneof field, use .proto
+         * option submsg_callback to have a separate callback function
+         * that can set the fields before submessage is decoded.
+         * pb_dec_submessage() will set any default values. */
+        memset(field->pData, 0, (size_t)field->data_size);
+
+        /* Set default values for the submessage fields. */
+        if (field->submsg_desc->default_value != NULL ||
+            field->submsg_desc->field_callback != NULL ||
+            field->submsg_desc->submsg_info[0] != NULL)
+        {
+            pb_field_iter_t submsg_iter;
+            if (pb_field_iter_begin(&submsg_iter, field->submsg_desc, field->pData))
+            {
+                if (!pb_message_set_to_defaults(&submsg_iter, NULL, NULL))
+                    return false;
+            }
+        }
+    }
+    *(pb_size_t*)field->pSize = field->tag;
+    return true;
+}
+
 static bool checkreturn decode_static_field(pb_istream_t *stream, pb_wire_type_t wire_type, pb_field_iter_t *field)
 {
     switch (PB_HTYPE(field->type))
@@ -531,32 +836,8 @@ static bool checkreturn decode_static_field(pb_istream_t *stream, pb_wire_type_t
             }
 
         case PB_HTYPE_ONEOF:
-            if (PB_LTYPE_IS_SUBMSG(field->type) &&
-                *(pb_size_t*)field->pSize != field->tag)
-            {
-                /* We memset to zero so that any callbacks are set to NULL.
-                 * This is because the callbacks might otherwise have values
-                 * from some other union field.
-                 * If callbacks are needed inside oneof field, use .proto
-                 * option submsg_callback to have a separate callback function
-                 * that can set the fields before submessage is decoded.
-                 * pb_dec_submessage() will set any default values. */
-                memset(field->pData, 0, (size_t)field->data_size);
-
-                /* Set default values for the submessage fields. */
-                if (field->submsg_desc->default_value != NULL ||
-                    field->submsg_desc->field_callback != NULL ||
-                    field->submsg_desc->submsg_info[0] != NULL)
-                {
-                    pb_field_iter_t submsg_iter;
-                    if (pb_field_iter_begin(&submsg_iter, field->submsg_desc, field->pData))
-                    {
-                        if (!pb_message_set_to_defaults(&submsg_iter))
-                            PB_RETURN_ERROR(stream, "failed to set defaults");
-                    }
-                }
-            }
-            *(pb_size_t*)field->pSize = field->tag;
+            if (!select_oneof_field(field))
+                PB_RETURN_ERROR(stream, "failed to set defaults");
 
             return decode_basic_field(stream, wire_type, field);
 
@@ -607,9 +888,20 @@ static bool checkreturn allocate_field(pb_istream_t *stream, void *pData, size_t
     /* Allocate new or expand previous allocation */
     /* Note: on failure the old pointer will remain in the structure,
      * the message must be freed by caller also on error return. */
-    ptr = pb_realloc(ptr, array_size * data_size);
-    if (ptr == NULL)
-        PB_RETURN_ERROR(stream, "realloc failed");
+#ifdef PB_ENABLE_ARENA
+    if (stream->arena != NULL)
+    {
+        ptr = pb_arena_realloc(stream->arena, ptr, array_size * data_size);
+        if (ptr == NULL)
+            PB_RETURN_ERROR(stream, "arena full");
+    }
+    else
+#endif
+    {
+        ptr = pb_realloc(ptr, array_size * data_size);
+        if (ptr == NULL)
+            PB_RETURN_ERROR(stream, "realloc failed");
+    }
     
     *(void**)pData = ptr;
     return true;
@@ -632,6 +924,183 @@ static void initialize_pointer_field(void *pItem, pb_field_iter_t *field)
 }
 #endif
 
+#ifdef PB_ENABLE_MALLOC
+/* Decode entries of a repeated pointer field. With growth, the array
+ * capacity is remembered between calls and grown geometrically. Without
+ * it, the array is reallocated to the exact size needed. */
+static bool checkreturn decode_pointer_array(pb_istream_t *stream, pb_wire_type_t wire_type, pb_field_iter_t *field, pb_array_growth_t *growth)
+{
+    pb_size_t *size = (pb_size_t*)field->pSize;
+    size_t allocated_size = *size;
+
+    if (growth != NULL)
+    {
+        if (!track_pointer_array(stream, field, growth))
+            return false;
+
+        allocated_size = growth->capacity;
+    }
+
+    if (wire_type == PB_WT_STRING
+        && PB_LTYPE(field->type) <= PB_LTYPE_LAST_PACKABLE)
+    {
+        /* Packed array, multiple items come in at once. */
+        bool status = true;
+        pb_istream_t substream;
+        
+        if (!pb_make_string_substream(stream, &substream))
+            return false;
+        
+        while (substream.bytes_left)
+        {
+            if (*size == PB_SIZE_MAX)
+            {
+#ifndef PB_NO_ERRMSG
+                stream->errmsg = "too many array entries";
+#endif
+                status = false;
+                break;
+            }
+
+            if ((size_t)*size + 1 > allocated_size)
+            {
+                /* Allocate more storage. This tries to guess the
+                 * number of remaining entries. Round the division
+                 * upwards. The guess is low for varints, so grow
+                 * at least by the current size when tracking it
+                 * and the guess has already fallen short. */
+                size_t remain = (substream.bytes_left - 1) / field->data_size + 1;
+                if (growth != NULL && *size > growth->start && remain < allocated_size)
+                    remain = allocated_size;
+
+                if (remain < PB_SIZE_MAX - allocated_size)
+                    allocated_size += remain;
+                else
+                    allocated_size += 1;
+                
+                if (!allocate_field(&substream, field->pField, field->data_size, allocated_size))
+                {
+                    status = false;
+                    break;
+                }
+
+                if (growth != NULL)
+                    growth->capacity = allocated_size;
+            }
+
+            /* Decode the array entry */
+            field->pData = *(char**)field->pField + field->data_size * (*size);
+            if (field->pData == NULL)
+            {
+                /* Shouldn't happen, but satisfies static analyzers */
+                status = false;
+                break;
+            }
+            initialize_pointer_field(field->pData, field);
+            if (!decode_basic_field(&substream, PB_WT_PACKED, field))
+            {
+                status = false;
+                break;
+            }
+            
+            (*size)++;
+        }
+        if (!pb_close_string_substream(stream, &substream))
+            return false;
+        
+        return status;
+    }
+    else
+    {
+        /* Normal repeated field, i.e. only one item at a time. */
+        if (!reserve_array_entry(stream, field, growth))
+            return false;
+    
+        field->pData = *(char**)field->pField + field->data_size * (*size);
+        (*size)++;
+        initialize_pointer_field(field->pData, field);
+        return decode_basic_field(stream, wire_type, field);
+    }
+}
+
+/* Start tracking the capacity of field in growth, unless it is the
+ * array that received the previous entries. The previous array is
+ * shrunk, so its capacity does not need to be remembered. */
+static bool checkreturn track_pointer_array(pb_istream_t *stream, pb_field_iter_t *field, pb_array_growth_t *growth)
+{
+    if (growth->array != field->pField)
+    {
+        if (!finish_pointer_array(stream, growth))
+            return false;
+
+        growth->array = field->pField;
+        growth->count = (pb_size_t*)field->pSize;
+        growth->start = *growth->count;
+        growth->item_size = field->data_size;
+        growth->capacity = *growth->count;
+    }
+
+    return true;
+}
+
+/* Make sure that a repeated pointer field has room for one more entry.
+ * Without growth, the array is reallocated to the exact size needed.
+ * With it, the capacity is doubled once the array has received entries
+ * in a row. The first entry after another field only gets the exact
+ * size, so fields that alternate are not doubled and shrunk back on
+ * every entry. */
+static bool checkreturn reserve_array_entry(pb_istream_t *stream, pb_field_iter_t *field, pb_array_growth_t *growth)
+{
+    pb_size_t *size = (pb_size_t*)field->pSize;
+    size_t allocated_size = (growth != NULL) ? growth->capacity : *size;
+
+    if (*size == PB_SIZE_MAX)
+        PB_RETURN_ERROR(stream, "too many array entries");
+
+    if ((size_t)*size + 1 > allocated_size)
+    {
+        /* Double the capacity when tracking it, so that long arrays
+         * take O(log n) reallocations instead of O(n). */
+        allocated_size = (size_t)*size + 1;
+        if (growth != NULL && *size > growth->start)
+        {
+            if (*size < PB_SIZE_MAX / 2)
+                allocated_size = (size_t)*size * 2;
+            else
+                allocated_size = PB_SIZE_MAX;
+        }
+
+        if (!allocate_field(stream, field->pField, field->data_size, allocated_size))
+            return false;
+
+        if (growth != NULL)
+            growth->capacity = allocated_size;
+    }
+
+    return true;
+}
+
+/* Stop tracking the capacity of the array in growth, and release the
+ * unused capacity unless PB_NO_SHRINK_TO_FIT is defined. */
+static bool checkreturn finish_pointer_array(pb_istream_t *stream, pb_array_growth_t *growth)
+{
+#ifndef PB_NO_SHRINK_TO_FIT
+    /* Arena memory is not reclaimed by shrinking, skip the copy. */
+    if (growth->array != NULL && *growth->count > 0
+        && growth->capacity > *growth->count && stream_frees_memory(stream))
+    {
+        if (!allocate_field(stream, growth->array, growth->item_size, *growth->count))
+            return false;
+    }
+#else
+    PB_UNUSED(stream);
+#endif
+
+    growth->array = NULL;
+    return true;
+}
+#endif
+
 static bool checkreturn decode_pointer_field(pb_istream_t *stream, pb_wire_type_t wire_type, pb_field_iter_t *field)
 {
 #ifndef PB_ENABLE_MALLOC
@@ -648,7 +1117,7 @@ static bool checkreturn decode_pointer_field(pb_istream_t *stream, pb_wire_type_
             {
                 /* Duplicate field, have to release the old allocation first. */
                 /* FIXME: Does this work correctly for oneofs? */
-                pb_release_single_field(field);
+                pb_release_single_field(field, stream_frees_memory(stream));
             }
         
             if (PB_HTYPE(field->type) == PB_HTYPE_ONEOF)
@@ -674,96 +1143,20 @@ static bool checkreturn decode_pointer_field(pb_istream_t *stream, pb_wire_type_
             }
     
         case PB_HTYPE_REPEATED:
-            if (wire_type == PB_WT_STRING
-                && PB_LTYPE(field->type) <= PB_LTYPE_LAST_PACKABLE)
-            {
-                /* Packed array, multiple items come in at once. */
-                bool status = true;
-                pb_size_t *size = (pb_size_t*)field->pSize;
-                size_t allocated_size = *size;
-                pb_istream_t substream;
-                
-                if (!pb_make_string_substream(stream, &substream))
-                    return false;
-                
-                while (substream.bytes_left)
-                {
-                    if (*size == PB_SIZE_MAX)
-                    {
-#ifndef PB_NO_ERRMSG
-                        stream->errmsg = "too many array entries";
+            /* Extensions and fixed count arrays come here. They are
+             * not tracked, and grow by one entry at a time. */
+            return decode_pointer_array(stream, wire_type, field, NULL);
+
+        default:
+            PB_RETURN_ERROR(stream, "invalid field type");
+    }
 #endif
-                        status = false;
-                        break;
-                    }
+}
 
-                    if ((size_t)*size + 1 > allocated_size)
-                    {
-                        /* Allocate more storage. This tries to guess the
-                         * number of remaining entries. Round the division
-                         * upwards. */
-                        size_t remain = (substream.bytes_left - 1) / field->data_size + 1;
-                        if (remain < PB_SIZE_MAX - allocated_size)
-                            allocated_size += remain;
-                        else
-                            allocated_size += 1;
-                        
-                        if (!allocate_field(&substream, field->pField, field->data_size, allocated_size))
-                        {
-                            status = false;
-                            break;
-                        }
-                    }
-
-                    /* Decode the array entry */
-                    field->pData = *(char**)field->pField + field->data_size * (*size);
-                    if (field->pData == NULL)
-                    {
-                        /* Shouldn't happen, but satisfies static analyzers */
-                        status = false;
-                        break;
-                    }
-                    initialize_pointer_field(field->pData, field);
-                    if (!decode_basic_field(&substream, PB_WT_PACKED, field))
-                    {
-                        status = false;
-                        break;
-                    }
-                    
-                    (*size)++;
-                }
-                if (!pb_close_string_substream(stream, &substream))
-                    return false;
-                
-                return status;
-            }
-            else
-            {
-                /* Normal repeated field, i.e. only one item at a time. */
-                pb_size_t *size = (pb_size_t*)field->pSize;
-
-                if (*size == PB_SIZE_MAX)
-                    PB_RETURN_ERROR(stream, "too many array entries");
-                
-                if (!allocate_field(stream, field->pField, field->data_size, (size_t)(*size + 1)))
-                    return false;
-            
-                field->pData = *(char**)field->pField + field->data_size * (*size);
-                (*size)++;
-                initialize_pointer_field(field->pData, field);
-                return decode_basic_field(stream, wire_type, field);
-            }
-
-        default:
-            PB_RETURN_ERROR(stream, "invalid field type");
-    }
-#endif
-}
-
-static bool checkreturn decode_callback_field(pb_istream_t *stream, pb_wire_type_t wire_type, pb_field_iter_t *field)
-{
-    if (!field->descriptor->field_callback)
-        return pb_skip_field(stream, wire_type);
+static bool checkreturn decode_callback_field(pb_istream_t *stream, pb_wire_type_t wire_type, pb_field_iter_t *field)
+{
+    if (!field->descriptor->field_callback)
+        return pb_skip_field(stream, wire_type);
 
     if (wire_type == PB_WT_STRING)
     {
@@ -776,6 +1169,7 @@ static bool checkreturn decode_callback_field(pb_istream_t *stream, pb_wire_type
         do
         {
             prev_bytes_left = substream.bytes_left;
+            PB_STATS_ADD(callbacks, 1);
             if (!field->descriptor->field_callback(&substream, NULL, field))
             {
                 PB_SET_ERROR(stream, substream.errmsg ? substream.errmsg : "callback failed");
@@ -802,6 +1196,7 @@ static bool checkreturn decode_callback_field(pb_istream_t *stream, pb_wire_type
             return false;
         substream = pb_istream_from_buffer(buffer, size);
         
+        PB_STATS_ADD(callbacks, 1);
         return field->descriptor->field_callback(&substream, NULL, field);
     }
 }
@@ -891,7 +1286,7 @@ static bool pb_field_set_to_default(pb_field_iter_t *field)
             if (pb_field_iter_begin_extension(&ext_iter, ext))
             {
                 ext->found = false;
-                if (!pb_message_set_to_defaults(&ext_iter))
+                if (!pb_message_set_to_defaults(&ext_iter, NULL, NULL))
                     return false;
             }
             ext = ext->next;
@@ -928,7 +1323,7 @@ static bool pb_field_set_to_default(pb_field_iter_t *field)
                 pb_field_iter_t submsg_iter;
                 if (pb_field_iter_begin(&submsg_iter, field->submsg_desc, field->pData))
                 {
-                    if (!pb_message_set_to_defaults(&submsg_iter))
+                    if (!pb_message_set_to_defaults(&submsg_iter, NULL, NULL))
                         return false;
                 }
             }
@@ -959,7 +1354,34 @@ static bool pb_field_set_to_default(pb_field_iter_t *field)
     return true;
 }
 
-static bool pb_message_set_to_defaults(pb_field_iter_t *iter)
+/* Check if a field is marked clean in a pb_field_tracker_t bitmap */
+static bool field_is_clean(const uint32_t *clean, pb_size_t index)
+{
+    return index < PB_MAX_TRACKED_FIELDS &&
+           (clean[index >> 5] & ((uint32_t)1 << (index & 31))) != 0;
+}
+
+/* Check if tag is in the projection. NULL projection selects all tags. */
+static bool tag_selected(const pb_tag_set_t *projection, uint32_t tag)
+{
+    pb_size_t i;
+
+    if (projection == NULL)
+        return true;
+
+    for (i = 0; i < projection->count; i++)
+    {
+        if (projection->tags[i] == tag)
+            return true;
+    }
+
+    return false;
+}
+
+/* Initialize message fields to default values. If clean is not NULL,
+ * fields marked in it are skipped. Extensions are always initialized.
+ * If projection is not NULL, only the fields in it are initialized. */
+static bool pb_message_set_to_defaults(pb_field_iter_t *iter, const uint32_t *clean, const pb_tag_set_t *projection)
 {
     pb_istream_t defstream = PB_ISTREAM_EMPTY;
     uint32_t tag = 0;
@@ -975,19 +1397,34 @@ static bool pb_message_set_to_defaults(pb_field_iter_t *iter)
 
     do
     {
-        if (!pb_field_set_to_default(iter))
+        bool reset = (clean == NULL || PB_LTYPE(iter->type) == PB_LTYPE_EXTENSION ||
+                      !field_is_clean(clean, iter->index));
+
+        if (projection != NULL)
+            reset = reset && PB_LTYPE(iter->type) != PB_LTYPE_EXTENSION &&
+                    tag_selected(projection, iter->tag);
+
+        if (reset && !pb_field_set_to_default(iter))
             return false;
 
         if (tag != 0 && iter->tag == tag)
         {
             /* We have a default value for this field in the defstream */
-            if (!decode_field(&defstream, wire_type, iter))
+            if (reset)
+            {
+                if (!decode_field(&defstream, wire_type, iter))
+                    return false;
+
+                if (iter->pSize)
+                    *(bool*)iter->pSize = false;
+            }
+            else if (!pb_skip_field(&defstream, wire_type))
+            {
                 return false;
+            }
+
             if (!pb_decode_tag(&defstream, &wire_type, &tag, &eof))
                 return false;
-
-            if (iter->pSize)
-                *(bool*)iter->pSize = false;
         }
     } while (pb_field_iter_next(iter));
 
@@ -998,7 +1435,41 @@ static bool pb_message_set_to_defaults(pb_field_iter_t *iter)
  * Decode all fields *
  *********************/
 
-static bool checkreturn pb_decode_inner(pb_istream_t *stream, const pb_msgdesc_t *fields, void *dest_struct, unsigned int flags)
+/* Check the bitmap of seen required fields against the message descriptor. */
+static bool required_fields_present(const pb_msgdesc_t *fields, const uint32_t *bitfield)
+{
+    const uint32_t allbits = ~(uint32_t)0;
+    pb_size_t req_field_count = fields->required_field_count;
+
+    if (req_field_count > 0)
+    {
+        pb_size_t i;
+
+        if (req_field_count > PB_MAX_REQUIRED_FIELDS)
+            req_field_count = PB_MAX_REQUIRED_FIELDS;
+
+        /* Check the whole words */
+        for (i = 0; i < (req_field_count >> 5); i++)
+        {
+            if (bitfield[i] != allbits)
+                return false;
+        }
+
+        /* Check the remaining bits (if any) */
+        if ((req_field_count & 31) != 0)
+        {
+            if (bitfield[req_field_count >> 5] !=
+                (allbits >> (uint_least8_t)(32 - (req_field_count & 31))))
+            {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+static bool checkreturn pb_decode_inner(pb_istream_t *stream, const pb_msgdesc_t *fields, void *dest_struct, unsigned int flags, pb_field_tracker_t *tracker, const pb_tag_set_t *projection)
 {
     uint32_t extension_range_start = 0;
     pb_extension_t *extensions = NULL;
@@ -1012,15 +1483,23 @@ static bool checkreturn pb_decode_inner(pb_istream_t *stream, const pb_msgdesc_t
     pb_size_t fixed_count_total_size = 0;
 
     pb_fields_seen_t fields_seen = {{0, 0}};
-    const uint32_t allbits = ~(uint32_t)0;
     pb_field_iter_t iter;
 
+#ifdef PB_ENABLE_MALLOC
+    /* 'growth' tracks the capacity of the last repeated pointer field, so
+     * that consecutive entries do not need a reallocation each. */
+    pb_array_growth_t growth = {NULL, NULL, 0, 0, 0};
+#endif
+
     if (pb_field_iter_begin(&iter, fields, dest_struct))
     {
         if ((flags & PB_DECODE_NOINIT) == 0)
         {
-            if (!pb_message_set_to_defaults(&iter))
+            if (!pb_message_set_to_defaults(&iter, tracker ? tracker->clean : NULL, projection))
                 PB_RETURN_ERROR(stream, "failed to set defaults");
+
+            if (tracker)
+                memset(tracker->clean, 0xFF, sizeof(tracker->clean));
         }
     }
 
@@ -1050,6 +1529,16 @@ static bool checkreturn pb_decode_inner(pb_istream_t *stream, const pb_msgdesc_t
           }
         }
 
+        PB_STATS_ADD(fields_decoded[wire_type], 1);
+
+        if (!tag_selected(projection, tag))
+        {
+            /* Not projected, leave the struct field untouched */
+            if (!pb_skip_field(stream, wire_type))
+                return false;
+            continue;
+        }
+
         if (!pb_field_iter_find(&iter, tag) || PB_LTYPE(iter.type) == PB_LTYPE_EXTENSION)
         {
             /* No match found, check if it matches an extension. */
@@ -1118,10 +1607,32 @@ static bool checkreturn pb_decode_inner(pb_istream_t *stream, const pb_msgdesc_t
             fields_seen.bitfield[iter.required_field_index >> 5] |= tmp;
         }
 
+        if (tracker && iter.index < PB_MAX_TRACKED_FIELDS)
+        {
+            uint32_t tmp = ((uint32_t)1 << (iter.index & 31));
+            tracker->clean[iter.index >> 5] &= ~tmp;
+        }
+
+#ifdef PB_ENABLE_MALLOC
+        if (PB_ATYPE(iter.type) == PB_ATYPE_POINTER
+            && PB_HTYPE(iter.type) == PB_HTYPE_REPEATED
+            && iter.pSize != &fixed_count_size)
+        {
+            if (!decode_pointer_array(stream, wire_type, &iter, &growth))
+                return false;
+            continue;
+        }
+#endif
+
         if (!decode_field(stream, wire_type, &iter))
             return false;
     }
 
+#ifdef PB_ENABLE_MALLOC
+    if (!finish_pointer_array(stream, &growth))
+        return false;
+#endif
+
     /* Check that all elements of the last decoded fixed count field were present. */
     if (fixed_count_field != PB_SIZE_MAX &&
         fixed_count_size != fixed_count_total_size)
@@ -1129,46 +1640,27 @@ static bool checkreturn pb_decode_inner(pb_istream_t *stream, const pb_msgdesc_t
         PB_RETURN_ERROR(stream, "wrong size for fixed count field");
     }
 
-    /* Check that all required fields were present. */
-    {
-        pb_size_t req_field_count = iter.descriptor->required_field_count;
-
-        if (req_field_count > 0)
-        {
-            pb_size_t i;
-
-            if (req_field_count > PB_MAX_REQUIRED_FIELDS)
-                req_field_count = PB_MAX_REQUIRED_FIELDS;
-
-            /* Check the whole words */
-            for (i = 0; i < (req_field_count >> 5); i++)
-            {
-                if (fields_seen.bitfield[i] != allbits)
-                    PB_RETURN_ERROR(stream, "missing required field");
-            }
-
-            /* Check the remaining bits (if any) */
-            if ((req_field_count & 31) != 0)
-            {
-                if (fields_seen.bitfield[req_field_count >> 5] !=
-                    (allbits >> (uint_least8_t)(32 - (req_field_count & 31))))
-                {
-                    PB_RETURN_ERROR(stream, "missing required field");
-                }
-            }
-        }
-    }
+    /* Check that all required fields were present. With a projection,
+     * the rest of the fields were not decoded so they are not checked. */
+    if (projection == NULL && !required_fields_present(iter.descriptor, fields_seen.bitfield))
+        PB_RETURN_ERROR(stream, "missing required field");
 
     return true;
 }
 
 bool checkreturn pb_decode_ex(pb_istream_t *stream, const pb_msgdesc_t *fields, void *dest_struct, unsigned int flags)
+{
+    return pb_decode_tracked(stream, fields, dest_struct, flags, NULL);
+}
+
+/* Decode the top-level message, handling PB_DECODE_DELIMITED */
+static bool checkreturn decode_message(pb_istream_t *stream, const pb_msgdesc_t *fields, void *dest_struct, unsigned int flags, pb_field_tracker_t *tracker, const pb_tag_set_t *projection)
 {
     bool status;
 
     if ((flags & PB_DECODE_DELIMITED) == 0)
     {
-      status = pb_decode_inner(stream, fields, dest_struct, flags);
+      status = pb_decode_inner(stream, fields, dest_struct, flags, tracker, projection);
     }
     else
     {
@@ -1176,564 +1668,2173 @@ bool checkreturn pb_decode_ex(pb_istream_t *stream, const pb_msgdesc_t *fields,
       if (!pb_make_string_substream(stream, &substream))
         return false;
 
-      status = pb_decode_inner(&substream, fields, dest_struct, flags);
+      status = pb_decode_inner(&substream, fields, dest_struct, flags, tracker, projection);
 
       if (!pb_close_string_substream(stream, &substream))
         return false;
     }
+
+    return status;
+}
+
+bool checkreturn pb_decode_tracked(pb_istream_t *stream, const pb_msgdesc_t *fields, void *dest_struct, unsigned int flags, pb_field_tracker_t *tracker)
+{
+    bool status = decode_message(stream, fields, dest_struct, flags, tracker, NULL);
     
 #ifdef PB_ENABLE_MALLOC
     if (!status)
-        pb_release(fields, dest_struct);
+        pb_release_message(fields, dest_struct, stream_frees_memory(stream));
 #endif
     
     return status;
 }
 
-bool checkreturn pb_decode(pb_istream_t *stream, const pb_msgdesc_t *fields, void *dest_struct)
+bool checkreturn pb_decode_projection(pb_istream_t *stream, const pb_msgdesc_t *fields, void *dest_struct, unsigned int flags, const uint32_t *tags, pb_size_t tag_count)
 {
+    pb_tag_set_t projection;
     bool status;
 
-    status = pb_decode_inner(stream, fields, dest_struct, 0);
+    projection.tags = tags;
+    projection.count = tag_count;
+    status = decode_message(stream, fields, dest_struct, flags, NULL, &projection);
 
 #ifdef PB_ENABLE_MALLOC
     if (!status)
-        pb_release(fields, dest_struct);
+    {
+        /* Release only the projected fields, others may be in use */
+        pb_field_iter_t iter;
+        pb_size_t i;
+
+        for (i = 0; i < tag_count; i++)
+        {
+            if (pb_field_iter_begin(&iter, fields, dest_struct) &&
+                pb_field_iter_find(&iter, tags[i]))
+            {
+                pb_release_single_field(&iter, stream_frees_memory(stream));
+            }
+        }
+    }
 #endif
 
     return status;
 }
 
+bool checkreturn pb_decode(pb_istream_t *stream, const pb_msgdesc_t *fields, void *dest_struct)
+{
+    bool status;
+
+    status = pb_decode_inner(stream, fields, dest_struct, 0, NULL, NULL);
+
 #ifdef PB_ENABLE_MALLOC
-/* Given an oneof field, if there has already been a field inside this oneof,
- * release it before overwriting with a different one. */
-static bool pb_release_union_field(pb_istream_t *stream, pb_field_iter_t *field)
+    if (!status)
+        pb_release_message(fields, dest_struct, stream_frees_memory(stream));
+#endif
+
+    return status;
+}
+
+bool checkreturn pb_decode_lazy(const pb_view_t *data, const pb_msgdesc_t *fields, void *dest_struct)
 {
-    pb_field_iter_t old_field = *field;
-    pb_size_t old_tag = *(pb_size_t*)field->pSize; /* Previous which_ value */
-    pb_size_t new_tag = field->tag; /* New which_ value */
+    pb_istream_t stream = pb_istream_from_buffer(data->ptr, data->len);
+    return pb_decode(&stream, fields, dest_struct);
+}
 
-    if (old_tag == 0)
-        return true; /* Ok, no old data in union */
+/**********************************
+ * Decode submessages iteratively *
+ **********************************/
 
-    if (old_tag == new_tag)
-        return true; /* Ok, old data is of same type => merge */
+/* Start decoding a message at the nesting level of frame */
+static bool checkreturn enter_frame(pb_istream_t *stream, pb_decode_frame_t *frame, const pb_msgdesc_t *fields, void *dest_struct, unsigned int flags, pb_field_iter_t *iter)
+{
+    frame->descriptor = fields;
+    frame->message = dest_struct;
+    memset(frame->fields_seen, 0, sizeof(frame->fields_seen));
+    frame->fixed_count_field = PB_SIZE_MAX;
+    frame->fixed_count_size = 0;
+    frame->fixed_count_total_size = 0;
+#ifdef PB_ENABLE_MALLOC
+    frame->growth.array = NULL;
+#endif
 
-    /* Release old data. The find can fail if the message struct contains
-     * invalid data. */
-    if (!pb_field_iter_find(&old_field, old_tag))
-        PB_RETURN_ERROR(stream, "invalid union tag");
+    if (pb_field_iter_begin(iter, fields, dest_struct) && (flags & PB_DECODE_NOINIT) == 0)
+    {
+        if (!pb_message_set_to_defaults(iter, NULL, NULL))
+            PB_RETURN_ERROR(stream, "failed to set defaults");
+    }
 
-    pb_release_single_field(&old_field);
+    return true;
+}
 
-    if (PB_ATYPE(field->type) == PB_ATYPE_POINTER)
+/* Check the message at the nesting level of frame after its last field */
+static bool checkreturn leave_frame(pb_istream_t *stream, pb_decode_frame_t *frame)
+{
+#ifdef PB_ENABLE_MALLOC
+    if (!finish_pointer_array(stream, &frame->growth))
+        return false;
+#endif
+
+    if (frame->fixed_count_field != PB_SIZE_MAX &&
+        frame->fixed_count_size != frame->fixed_count_total_size)
     {
-        /* Initialize the pointer to NULL to make sure it is valid
-         * even in case of error return. */
-        *(void**)field->pField = NULL;
-        field->pData = NULL;
+        PB_RETURN_ERROR(stream, "wrong size for fixed count field");
     }
 
+    if (!required_fields_present(frame->descriptor, frame->fields_seen))
+        PB_RETURN_ERROR(stream, "missing required field");
+
     return true;
 }
 
-static void pb_release_single_field(pb_field_iter_t *field)
+/* Do what decode_field() does before the submessage contents are
+ * decoded: set has_ fields and array counts, select the oneof member
+ * and allocate pointer fields. Repeated pointer fields grow like in
+ * pb_decode_inner(), with the capacity tracked in the frame of the
+ * enclosing message. Afterwards field->pData points to the submessage
+ * struct, and flags tell whether it is already initialized. */
+static bool checkreturn prepare_submessage(pb_istream_t *stream, pb_field_iter_t *field, unsigned int *flags, pb_decode_frame_t *frame)
 {
-    pb_type_t type;
-    type = field->type;
+    pb_size_t *size = (pb_size_t*)field->pSize;
 
-    if (PB_HTYPE(type) == PB_HTYPE_ONEOF)
+#ifdef PB_ENABLE_MALLOC
+    if (PB_HTYPE(field->type) == PB_HTYPE_ONEOF)
     {
-        if (*(pb_size_t*)field->pSize != field->tag)
-            return; /* This is not the current field in the union */
+        if (!pb_release_union_field(stream, field))
+            return false;
     }
+#else
+    PB_UNUSED(frame);
+#endif
 
-    /* Release anything contained inside an extension or submsg.
-     * This has to be done even if the submsg itself is statically
-     * allocated. */
-    if (PB_LTYPE(type) == PB_LTYPE_EXTENSION)
+    /* Static required/optional fields are already initialized by the
+     * parent message, like in pb_dec_submessage(). */
+    *flags = PB_DECODE_NOINIT;
+
+    if (PB_ATYPE(field->type) == PB_ATYPE_STATIC)
     {
-        /* Release fields from all extensions in the linked list */
-        pb_extension_t *ext = *(pb_extension_t**)field->pData;
-        while (ext != NULL)
+        switch (PB_HTYPE(field->type))
         {
-            pb_field_iter_t ext_iter;
-            if (pb_field_iter_begin_extension(&ext_iter, ext))
-            {
-                pb_release_single_field(&ext_iter);
-            }
-            ext = ext->next;
+            case PB_HTYPE_REQUIRED:
+                return true;
+
+            case PB_HTYPE_OPTIONAL:
+                if (field->pSize != NULL)
+                    *(bool*)field->pSize = true;
+                return true;
+
+            case PB_HTYPE_REPEATED:
+                if (*size >= field->array_size)
+                    PB_RETURN_ERROR(stream, "array overflow");
+
+                field->pData = (char*)field->pField + field->data_size * (*size);
+                (*size)++;
+                *flags = 0;
+                return true;
+
+            case PB_HTYPE_ONEOF:
+                if (!select_oneof_field(field))
+                    PB_RETURN_ERROR(stream, "failed to set defaults");
+                return true;
+
+            default:
+                PB_RETURN_ERROR(stream, "invalid field type");
         }
     }
-    else if (PB_LTYPE_IS_SUBMSG(type) && PB_ATYPE(type) != PB_ATYPE_CALLBACK)
+
+#ifdef PB_ENABLE_MALLOC
+    if (PB_ATYPE(field->type) == PB_ATYPE_POINTER)
     {
-        /* Release fields in submessage or submsg array */
-        pb_size_t count = 1;
-        
-        if (PB_ATYPE(type) == PB_ATYPE_POINTER)
+        *flags = 0;
+
+        if (PB_HTYPE(field->type) == PB_HTYPE_REPEATED)
         {
-            field->pData = *(void**)field->pField;
+            if (!track_pointer_array(stream, field, &frame->growth) ||
+                !reserve_array_entry(stream, field, &frame->growth))
+            {
+                return false;
+            }
+
+            field->pData = *(char**)field->pField + field->data_size * (*size);
+            (*size)++;
         }
         else
         {
-            field->pData = field->pField;
-        }
-        
-        if (PB_HTYPE(type) == PB_HTYPE_REPEATED)
-        {
-            count = *(pb_size_t*)field->pSize;
-
-            if (PB_ATYPE(type) == PB_ATYPE_STATIC && count > field->array_size)
+            if (*(void**)field->pField != NULL)
             {
-                /* Protect against corrupted _count fields */
-                count = field->array_size;
+                /* Duplicate field, have to release the old allocation first. */
+                pb_release_single_field(field, stream_frees_memory(stream));
             }
-        }
-        
-        if (field->pData)
-        {
-            for (; count > 0; count--)
+
+            if (PB_HTYPE(field->type) == PB_HTYPE_ONEOF)
             {
-                pb_release(field->submsg_desc, field->pData);
-                field->pData = (char*)field->pData + field->data_size;
+                *size = field->tag;
             }
+
+            if (!allocate_field(stream, field->pField, field->data_size, 1))
+                return false;
+
+            field->pData = *(void**)field->pField;
         }
+
+        initialize_pointer_field(field->pData, field);
+        return true;
     }
-    
-    if (PB_ATYPE(type) == PB_ATYPE_POINTER)
-    {
-        if (PB_HTYPE(type) == PB_HTYPE_REPEATED &&
-            (PB_LTYPE(type) == PB_LTYPE_STRING ||
-             PB_LTYPE(type) == PB_LTYPE_BYTES))
-        {
-            /* Release entries in repeated string or bytes array */
+#endif
+
+    PB_RETURN_ERROR(stream, "invalid field type");
+}
+
+static bool checkreturn decode_iterative(pb_istream_t *stream, const pb_msgdesc_t *fields, void *dest_struct, unsigned int flags, pb_decode_frame_t *frames, pb_size_t frame_count)
+{
+    pb_decode_frame_t *frame = frames;
+    pb_size_t depth = 0;
+    uint32_t extension_range_start = 0;
+    pb_extension_t *extensions = NULL;
+    pb_field_iter_t iter;
+
+    if (frame_count == 0)
+        PB_RETURN_ERROR(stream, "max depth exceeded");
+
+    if (!enter_frame(stream, frame, fields, dest_struct, flags, &iter))
+        return false;
+
+    for (;;)
+    {
+        uint32_t tag = 0;
+        pb_wire_type_t wire_type = PB_WT_VARINT;
+        bool eof;
+
+        if (stream->bytes_left > 0)
+        {
+            if (!pb_decode_tag(stream, &wire_type, &tag, &eof))
+            {
+                if (!eof)
+                    return false;
+            }
+            else if (tag == 0 && (depth > 0 || (flags & PB_DECODE_NULLTERMINATED) == 0))
+            {
+                PB_RETURN_ERROR(stream, "zero tag");
+            }
+        }
+
+        if (tag == 0)
+        {
+            /* End of the message at this level, continue with the
+             * enclosing message after it. */
+            if (!leave_frame(stream, frame))
+                return false;
+
+            if (depth == 0)
+                return true;
+
+            stream->bytes_left = frame->parent_bytes_left;
+            frame--;
+            depth--;
+            PB_STATS_LEAVE_SUBMSG();
+
+            (void)pb_field_iter_begin(&iter, frame->descriptor, frame->message);
+            extension_range_start = 0;
+            extensions = NULL;
+            continue;
+        }
+
+        PB_STATS_ADD(fields_decoded[wire_type], 1);
+
+        if (!pb_field_iter_find(&iter, tag) || PB_LTYPE(iter.type) == PB_LTYPE_EXTENSION)
+        {
+            /* No match found, check if it matches an extension. */
+            if (extension_range_start == 0)
+            {
+                if (pb_field_iter_find_extension(&iter))
+                {
+                    extensions = *(pb_extension_t* const *)iter.pData;
+                    extension_range_start = iter.tag;
+                }
+
+                if (!extensions)
+                {
+                    extension_range_start = (uint32_t)-1;
+                }
+            }
+
+            if (tag >= extension_range_start)
+            {
+                size_t pos = stream->bytes_left;
+
+                if (!decode_extension(stream, tag, wire_type, extensions))
+                    return false;
+
+                if (pos != stream->bytes_left)
+                {
+                    /* The field was handled */
+                    continue;
+                }
+            }
+
+            /* No match found, skip data */
+            if (!pb_skip_field(stream, wire_type))
+                return false;
+            continue;
+        }
+
+        /* Repeated fixed count fields are counted in the frame, as in
+         * pb_decode_inner(). */
+        if (PB_HTYPE(iter.type) == PB_HTYPE_REPEATED && iter.pSize == &iter.array_size)
+        {
+            if (frame->fixed_count_field != iter.index)
+            {
+                if (frame->fixed_count_field != PB_SIZE_MAX &&
+                    frame->fixed_count_size != frame->fixed_count_total_size)
+                {
+                    PB_RETURN_ERROR(stream, "wrong size for fixed count field");
+                }
+
+                frame->fixed_count_field = iter.index;
+                frame->fixed_count_size = 0;
+                frame->fixed_count_total_size = iter.array_size;
+            }
+
+            iter.pSize = &frame->fixed_count_size;
+        }
+
+        if (PB_HTYPE(iter.type) == PB_HTYPE_REQUIRED
+            && iter.required_field_index < PB_MAX_REQUIRED_FIELDS)
+        {
+            uint32_t tmp = ((uint32_t)1 << (iter.required_field_index & 31));
+            frame->fields_seen[iter.required_field_index >> 5] |= tmp;
+        }
+
+        if (PB_LTYPE_IS_SUBMSG(iter.type) && PB_ATYPE(iter.type) != PB_ATYPE_CALLBACK)
+        {
+            pb_istream_t substream;
+            unsigned int subflags;
+
+            if (wire_type != PB_WT_STRING)
+                PB_RETURN_ERROR(stream, "wrong wire type");
+
+            if (iter.submsg_desc == NULL)
+                PB_RETURN_ERROR(stream, "invalid field descriptor");
+
+            if (!prepare_submessage(stream, &iter, &subflags, frame))
+                return false;
+
+            if (!pb_make_string_substream(stream, &substream))
+                return false;
+
+            /* Message-level callback, see pb_dec_submessage() */
+            if (PB_LTYPE(iter.type) == PB_LTYPE_SUBMSG_W_CB && iter.pSize != NULL)
+            {
+                pb_callback_t *callback = (pb_callback_t*)iter.pSize - 1;
+                if (callback->funcs.decode)
+                {
+                    bool status;
+                    PB_STATS_ADD(callbacks, 1);
+                    status = callback->funcs.decode(&substream, &iter, &callback->arg);
+
+                    if (!status || substream.bytes_left == 0)
+                    {
+                        if (!pb_close_string_substream(stream, &substream))
+                            return false;
+
+                        if (!status)
+                            return false;
+
+                        continue;
+                    }
+                }
+            }
+
+            if (depth + 1 >= frame_count)
+                PB_RETURN_ERROR(stream, "max depth exceeded");
+
+            /* Continue reading the same stream, limited to the submessage.
+             * The rest of the enclosing message is restored at its end. */
+            frame++;
+            depth++;
+            frame->parent_bytes_left = stream->bytes_left;
+            *stream = substream;
+            PB_STATS_ENTER_SUBMSG();
+
+            if (!enter_frame(stream, frame, iter.submsg_desc, iter.pData, subflags, &iter))
+                return false;
+
+            extension_range_start = 0;
+            extensions = NULL;
+            continue;
+        }
+
+#ifdef PB_ENABLE_MALLOC
+        if (PB_ATYPE(iter.type) == PB_ATYPE_POINTER
+            && PB_HTYPE(iter.type) == PB_HTYPE_REPEATED
+            && iter.pSize != &frame->fixed_count_size)
+        {
+            if (!decode_pointer_array(stream, wire_type, &iter, &frame->growth))
+                return false;
+            continue;
+        }
+#endif
+
+        if (!decode_field(stream, wire_type, &iter))
+            return false;
+    }
+}
+
+bool checkreturn pb_decode_iterative(pb_istream_t *stream, const pb_msgdesc_t *fields, void *dest_struct, unsigned int flags, pb_decode_frame_t *frames, pb_size_t frame_count)
+{
+    bool status;
+
+    if ((flags & PB_DECODE_DELIMITED) == 0)
+    {
+        status = decode_iterative(stream, fields, dest_struct, flags, frames, frame_count);
+    }
+    else
+    {
+        pb_istream_t substream;
+        if (!pb_make_string_substream(stream, &substream))
+            return false;
+
+        status = decode_iterative(&substream, fields, dest_struct, flags, frames, frame_count);
+
+        if (!pb_close_string_substream(stream, &substream))
+            status = false;
+    }
+
+#ifdef PB_ENABLE_MALLOC
+    if (!status)
+        pb_release_message(fields, dest_struct, stream_frees_memory(stream));
+#endif
+
+    return status;
+}
+
+static bool message_depth(const pb_msgdesc_t *fields, const pb_depth_path_t *parent, pb_size_t max_depth, pb_size_t *depth)
+{
+    pb_depth_path_t path;
+    const pb_depth_path_t *p;
+    pb_field_iter_t iter;
+    pb_size_t deepest = 0;
+
+    if (max_depth == 0)
+        return false;
+
+    for (p = parent; p != NULL; p = p->parent)
+    {
+        /* Recursive message type, the nesting has no bound */
+        if (p->descriptor == fields)
+            return false;
+    }
+
+    path.descriptor = fields;
+    path.parent = parent;
+
+    if (pb_field_iter_begin(&iter, fields, NULL))
+    {
+        do
+        {
+            pb_size_t subdepth;
+
+            if (!PB_LTYPE_IS_SUBMSG(iter.type) || PB_ATYPE(iter.type) == PB_ATYPE_CALLBACK)
+                continue;
+
+            if (!message_depth(iter.submsg_desc, &path, (pb_size_t)(max_depth - 1), &subdepth))
+                return false;
+
+            if (subdepth > deepest)
+                deepest = subdepth;
+        } while (pb_field_iter_next(&iter));
+    }
+
+    *depth = (pb_size_t)(deepest + 1);
+    return true;
+}
+
+bool pb_decode_depth(const pb_msgdesc_t *fields, pb_size_t max_depth, pb_size_t *depth)
+{
+    return message_depth(fields, NULL, max_depth, depth);
+}
+
+/* Read one length-delimited record at *pos. The length prefix is read
+ * directly from the buffer, without the overhead of a stream. Lengths
+ * over 32 bits are rejected. */
+static bool checkreturn read_record(const pb_byte_t *buf, size_t size, size_t *pos, pb_view_t *record)
+{
+    size_t p = *pos;
+    uint32_t len = 0;
+    unsigned int bitpos = 0;
+    pb_byte_t byte;
+
+    do
+    {
+        if (p >= size || bitpos > 28)
+            return false;
+
+        byte = buf[p++];
+        if (bitpos == 28 && (byte & 0xF0) != 0)
+            return false;
+
+        len |= (uint32_t)(byte & 0x7F) << bitpos;
+        bitpos += 7;
+    } while (byte & 0x80);
+
+    if (len > size - p)
+        return false;
+
+    record->ptr = buf + p;
+    record->len = len;
+    *pos = p + len;
+    return true;
+}
+
+bool checkreturn pb_index_delimited(const pb_byte_t *buf, size_t size,
+    pb_view_t *records, size_t max_records, size_t *count)
+{
+    size_t pos = 0;
+    size_t n = 0;
+
+    while (pos < size)
+    {
+        pb_view_t record;
+
+        if (!read_record(buf, size, &pos, &record))
+            return false;
+
+        if (records != NULL)
+        {
+            if (n >= max_records)
+                return false;
+
+            records[n] = record;
+        }
+
+        n++;
+    }
+
+    *count = n;
+    return true;
+}
+
+void pb_record_iter_init(pb_record_iter_t *iter, const pb_byte_t *buf, size_t size, size_t offset)
+{
+    iter->buf = buf;
+    iter->size = size;
+    iter->offset = (offset < size) ? offset : size;
+}
+
+bool checkreturn pb_record_next(pb_record_iter_t *iter, pb_view_t *record)
+{
+    size_t pos = iter->offset;
+
+    if (pos >= iter->size || !read_record(iter->buf, iter->size, &pos, record))
+        return false;
+
+    iter->offset = pos;
+    return true;
+}
+
+/******************************
+ * Validation without decoding *
+ ******************************/
+
+/* Check one value against the field type, without storing it. Scalars
+ * are decoded into a temporary to check their range, strings and bytes
+ * are only checked for length. */
+static bool checkreturn validate_basic_field(pb_istream_t *stream, pb_wire_type_t wire_type, const pb_field_iter_t *field)
+{
+    bool packable = (PB_LTYPE(field->type) <= PB_LTYPE_LAST_PACKABLE);
+    uint32_t size = 0;
+    union {
+        bool b;
+        pb_uint64_t u;
+        uint32_t u32;
+    } tmp;
+
+    if (packable)
+    {
+        pb_wire_type_t expected = PB_WT_VARINT;
+        if (PB_LTYPE(field->type) == PB_LTYPE_FIXED32)
+            expected = PB_WT_32BIT;
+        else if (PB_LTYPE(field->type) == PB_LTYPE_FIXED64)
+            expected = PB_WT_64BIT;
+
+        if (wire_type != expected && wire_type != PB_WT_PACKED)
+            PB_RETURN_ERROR(stream, "wrong wire type");
+    }
+    else
+    {
+        if (wire_type != PB_WT_STRING)
+            PB_RETURN_ERROR(stream, "wrong wire type");
+
+        if (!PB_LTYPE_IS_SUBMSG(field->type) && !pb_decode_varint32(stream, &size))
+            return false;
+    }
+
+    switch (PB_LTYPE(field->type))
+    {
+        case PB_LTYPE_BOOL:
+            return pb_decode_bool(stream, &tmp.b);
+
+        case PB_LTYPE_UVARINT:
+            if (!pb_decode_varint(stream, &tmp.u))
+                return false;
+
+            /* Same overflow check as in pb_dec_varint() */
+            if (field->data_size < sizeof(pb_uint64_t) &&
+                (tmp.u >> (field->data_size * 8)) != 0)
+                PB_RETURN_ERROR(stream, "integer too large");
+            return true;
+
+        case PB_LTYPE_VARINT:
+        case PB_LTYPE_SVARINT:
+        {
+            pb_int64_t svalue;
+
+            if (PB_LTYPE(field->type) == PB_LTYPE_SVARINT)
+            {
+                if (!pb_decode_svarint(stream, &svalue))
+                    return false;
+            }
+            else
+            {
+                if (!pb_decode_varint(stream, &tmp.u))
+                    return false;
+
+                if (field->data_size == sizeof(pb_int64_t))
+                    svalue = (pb_int64_t)tmp.u;
+                else
+                    svalue = (int32_t)tmp.u;
+            }
+
+            if (field->data_size < sizeof(int32_t))
+            {
+                pb_int64_t limit = (pb_int64_t)1 << (field->data_size * 8 - 1);
+                if (svalue < -limit || svalue >= limit)
+                    PB_RETURN_ERROR(stream, "integer too large");
+            }
+            else if (field->data_size == sizeof(int32_t) && (int32_t)svalue != svalue)
+            {
+                PB_RETURN_ERROR(stream, "integer too large");
+            }
+            return true;
+        }
+
+        case PB_LTYPE_FIXED32:
+            return pb_decode_fixed32(stream, &tmp.u32);
+
+        case PB_LTYPE_FIXED64:
+#ifdef PB_CONVERT_DOUBLE_FLOAT
+            if (field->data_size == sizeof(float))
+            {
+                return pb_read(stream, NULL, 8);
+            }
+#endif
+
+#ifdef PB_WITHOUT_64BIT
+            PB_RETURN_ERROR(stream, "invalid data_size");
+#else
+            return pb_read(stream, NULL, 8);
+#endif
+
+        case PB_LTYPE_BYTES:
+            if (size > PB_SIZE_MAX)
+                PB_RETURN_ERROR(stream, "bytes overflow");
+
+            if (PB_ATYPE(field->type) == PB_ATYPE_STATIC &&
+                PB_BYTES_ARRAY_T_ALLOCSIZE(size) > field->data_size)
+                PB_RETURN_ERROR(stream, "bytes overflow");
+            break;
+
+        case PB_LTYPE_STRING:
+            if (size == (uint32_t)-1)
+                PB_RETURN_ERROR(stream, "size too large");
+
+            if (PB_ATYPE(field->type) == PB_ATYPE_STATIC &&
+                (size_t)size + 1 > field->data_size)
+                PB_RETURN_ERROR(stream, "string overflow");
+            break;
+
+        case PB_LTYPE_SUBMESSAGE:
+        case PB_LTYPE_SUBMSG_W_CB:
+        {
+            bool status;
+            pb_istream_t substream;
+
+            if (field->submsg_desc == NULL)
+                PB_RETURN_ERROR(stream, "invalid field descriptor");
+
+            if (!pb_make_string_substream(stream, &substream))
+                return false;
+
+            status = validate_message(&substream, field->submsg_desc);
+
+            if (!pb_close_string_substream(stream, &substream))
+                return false;
+
+            return status;
+        }
+
+        case PB_LTYPE_FIXED_LENGTH_BYTES:
+            if (size != 0 && size != field->data_size)
+                PB_RETURN_ERROR(stream, "incorrect fixed length bytes size");
+            break;
+
+        case PB_LTYPE_VIEW:
+#ifndef PB_BUFFER_ONLY
+            if (stream->callback != &buf_read)
+                PB_RETURN_ERROR(stream, "view requires buffer stream");
+#endif
+            break;
+
+        default:
+            PB_RETURN_ERROR(stream, "invalid field type");
+    }
+
+    return pb_read(stream, NULL, (size_t)size);
+}
+
+/* Find the entry count of an array field, or start counting it */
+static pb_size_t *count_array(pb_array_counts_t *arrays, pb_size_t index)
+{
+    pb_size_t i;
+
+    for (i = 0; i < arrays->used; i++)
+    {
+        if (arrays->fields[i] == index)
+            return &arrays->counts[i];
+    }
+
+    if (arrays->used < PB_VALIDATE_MAX_ARRAYS)
+    {
+        arrays->fields[arrays->used] = index;
+        arrays->counts[arrays->used] = 0;
+        return &arrays->counts[arrays->used++];
+    }
+
+    if (arrays->extra_field != index)
+    {
+        arrays->extra_field = index;
+        arrays->extra_count = 0;
+    }
+
+    return &arrays->extra_count;
+}
+
+/* Check a field occurrence, and count the entries of arrays. pSize is
+ * set by validate_message() only for fixed count arrays. */
+static bool checkreturn validate_field(pb_istream_t *stream, pb_wire_type_t wire_type, const pb_field_iter_t *field, pb_size_t *count)
+{
+    pb_size_t max_count = PB_SIZE_MAX;
+
+    if (PB_ATYPE(field->type) == PB_ATYPE_CALLBACK)
+        return pb_skip_field(stream, wire_type);
+
+#ifndef PB_ENABLE_MALLOC
+    if (PB_ATYPE(field->type) == PB_ATYPE_POINTER)
+        PB_RETURN_ERROR(stream, "no malloc support");
+#endif
+
+    if (PB_HTYPE(field->type) != PB_HTYPE_REPEATED)
+        return validate_basic_field(stream, wire_type, field);
+
+    if (PB_ATYPE(field->type) == PB_ATYPE_STATIC || field->pSize != NULL)
+        max_count = field->array_size;
+
+    if (wire_type == PB_WT_STRING && PB_LTYPE(field->type) <= PB_LTYPE_LAST_PACKABLE)
+    {
+        bool status = true;
+        pb_istream_t substream;
+
+        if (!pb_make_string_substream(stream, &substream))
+            return false;
+
+        while (substream.bytes_left > 0)
+        {
+            if (*count >= max_count)
+            {
+#ifndef PB_NO_ERRMSG
+                stream->errmsg = (max_count == PB_SIZE_MAX) ? "too many array entries" : "array overflow";
+#endif
+                status = false;
+                break;
+            }
+
+            if (!validate_basic_field(&substream, PB_WT_PACKED, field))
+            {
+                status = false;
+                break;
+            }
+
+            (*count)++;
+        }
+
+        if (!pb_close_string_substream(stream, &substream))
+            return false;
+
+        return status;
+    }
+    else
+    {
+        if (*count >= max_count)
+            PB_RETURN_ERROR(stream, (max_count == PB_SIZE_MAX) ? "too many array entries" : "array overflow");
+
+        (*count)++;
+        return validate_basic_field(stream, wire_type, field);
+    }
+}
+
+static bool checkreturn validate_message(pb_istream_t *stream, const pb_msgdesc_t *fields)
+{
+    pb_fields_seen_t fields_seen = {{0, 0}};
+    pb_field_iter_t iter;
+
+    pb_array_counts_t arrays;
+
+    /* Fixed count arrays are counted like in pb_decode_inner() */
+    pb_size_t fixed_count_field = PB_SIZE_MAX;
+    pb_size_t fixed_count_size = 0;
+    pb_size_t fixed_count_total_size = 0;
+
+    (void)pb_field_iter_begin(&iter, fields, NULL);
+    arrays.used = 0;
+    arrays.extra_field = PB_SIZE_MAX;
+    arrays.extra_count = 0;
+
+    while (stream->bytes_left)
+    {
+        uint32_t tag;
+        pb_wire_type_t wire_type;
+        bool eof;
+        pb_size_t *count = NULL;
+
+        if (!pb_decode_tag(stream, &wire_type, &tag, &eof))
+        {
+            if (eof)
+                break;
+            else
+                return false;
+        }
+
+        if (tag == 0)
+            PB_RETURN_ERROR(stream, "zero tag");
+
+        if (!pb_field_iter_find(&iter, tag) || PB_LTYPE(iter.type) == PB_LTYPE_EXTENSION)
+        {
+            /* Unknown fields and extensions are skipped */
+            if (!pb_skip_field(stream, wire_type))
+                return false;
+            continue;
+        }
+
+        if (PB_HTYPE(iter.type) == PB_HTYPE_REQUIRED
+            && iter.required_field_index < PB_MAX_REQUIRED_FIELDS)
+        {
+            uint32_t tmp = ((uint32_t)1 << (iter.required_field_index & 31));
+            fields_seen.bitfield[iter.required_field_index >> 5] |= tmp;
+        }
+
+        if (PB_HTYPE(iter.type) == PB_HTYPE_REPEATED && pb_field_iter_is_fixed_count(&iter))
+        {
+            if (fixed_count_field != iter.index)
+            {
+                if (fixed_count_field != PB_SIZE_MAX &&
+                    fixed_count_size != fixed_count_total_size)
+                {
+                    PB_RETURN_ERROR(stream, "wrong size for fixed count field");
+                }
+
+                fixed_count_field = iter.index;
+                fixed_count_size = 0;
+                fixed_count_total_size = iter.array_size;
+            }
+
+            iter.pSize = &fixed_count_size;
+            count = &fixed_count_size;
+        }
+        else if (PB_HTYPE(iter.type) == PB_HTYPE_REPEATED)
+        {
+            count = count_array(&arrays, iter.index);
+        }
+
+        if (!validate_field(stream, wire_type, &iter, count))
+            return false;
+    }
+
+    /* Check that all elements of the last fixed count field were present */
+    if (fixed_count_field != PB_SIZE_MAX &&
+        fixed_count_size != fixed_count_total_size)
+    {
+        PB_RETURN_ERROR(stream, "wrong size for fixed count field");
+    }
+
+    if (!required_fields_present(fields, fields_seen.bitfield))
+        PB_RETURN_ERROR(stream, "missing required field");
+
+    return true;
+}
+
+bool checkreturn pb_validate(pb_istream_t *stream, const pb_msgdesc_t *fields)
+{
+    return validate_message(stream, fields);
+}
+
+#ifdef PB_ENABLE_MALLOC
+/* Given an oneof field, if there has already been a field inside this oneof,
+ * release it before overwriting with a different one. */
+static bool pb_release_union_field(pb_istream_t *stream, pb_field_iter_t *field)
+{
+    pb_field_iter_t old_field = *field;
+    pb_size_t old_tag = *(pb_size_t*)field->pSize; /* Previous which_ value */
+    pb_size_t new_tag = field->tag; /* New which_ value */
+
+    if (old_tag == 0)
+        return true; /* Ok, no old data in union */
+
+    if (old_tag == new_tag)
+        return true; /* Ok, old data is of same type => merge */
+
+    /* Release old data. The find can fail if the message struct contains
+     * invalid data. */
+    if (!pb_field_iter_find(&old_field, old_tag))
+        PB_RETURN_ERROR(stream, "invalid union tag");
+
+    pb_release_single_field(&old_field, stream_frees_memory(stream));
+
+    if (PB_ATYPE(field->type) == PB_ATYPE_POINTER)
+    {
+        /* Initialize the pointer to NULL to make sure it is valid
+         * even in case of error return. */
+        *(void**)field->pField = NULL;
+        field->pData = NULL;
+    }
+
+    return true;
+}
+
+/* Check whether memory released during decoding should be freed.
+ * Allocations from an arena are only reclaimed by pb_arena_reset(). */
+static bool stream_frees_memory(const pb_istream_t *stream)
+{
+#ifdef PB_ENABLE_ARENA
+    return stream->arena == NULL;
+#else
+    PB_UNUSED(stream);
+    return true;
+#endif
+}
+
+static void pb_release_single_field(pb_field_iter_t *field, bool free_memory)
+{
+    pb_type_t type;
+    type = field->type;
+
+    if (PB_HTYPE(type) == PB_HTYPE_ONEOF)
+    {
+        if (*(pb_size_t*)field->pSize != field->tag)
+            return; /* This is not the current field in the union */
+    }
+
+    /* Release anything contained inside an extension or submsg.
+     * This has to be done even if the submsg itself is statically
+     * allocated. */
+    if (PB_LTYPE(type) == PB_LTYPE_EXTENSION)
+    {
+        /* Release fields from all extensions in the linked list */
+        pb_extension_t *ext = *(pb_extension_t**)field->pData;
+        while (ext != NULL)
+        {
+            pb_field_iter_t ext_iter;
+            if (pb_field_iter_begin_extension(&ext_iter, ext))
+            {
+                pb_release_single_field(&ext_iter, free_memory);
+            }
+            ext = ext->next;
+        }
+    }
+    else if (PB_LTYPE_IS_SUBMSG(type) && PB_ATYPE(type) != PB_ATYPE_CALLBACK)
+    {
+        /* Release fields in submessage or submsg array */
+        pb_size_t count = 1;
+        
+        if (PB_ATYPE(type) == PB_ATYPE_POINTER)
+        {
+            field->pData = *(void**)field->pField;
+        }
+        else
+        {
+            field->pData = field->pField;
+        }
+        
+        if (PB_HTYPE(type) == PB_HTYPE_REPEATED)
+        {
+            count = *(pb_size_t*)field->pSize;
+
+            if (PB_ATYPE(type) == PB_ATYPE_STATIC && count > field->array_size)
+            {
+                /* Protect against corrupted _count fields */
+                count = field->array_size;
+            }
+        }
+        
+        if (field->pData)
+        {
+            for (; count > 0; count--)
+            {
+                pb_release_message(field->submsg_desc, field->pData, free_memory);
+                field->pData = (char*)field->pData + field->data_size;
+            }
+        }
+    }
+    
+    if (PB_ATYPE(type) == PB_ATYPE_POINTER)
+    {
+        if (PB_HTYPE(type) == PB_HTYPE_REPEATED &&
+            (PB_LTYPE(type) == PB_LTYPE_STRING ||
+             PB_LTYPE(type) == PB_LTYPE_BYTES))
+        {
+            /* Release entries in repeated string or bytes array */
             void **pItem = *(void***)field->pField;
             pb_size_t count = *(pb_size_t*)field->pSize;
             for (; count > 0; count--)
             {
-                pb_free(*pItem);
-                *pItem++ = NULL;
+                if (free_memory)
+                    pb_free(*pItem);
+                *pItem++ = NULL;
+            }
+        }
+        
+        if (PB_HTYPE(type) == PB_HTYPE_REPEATED)
+        {
+            /* We are going to release the array, so set the size to 0 */
+            *(pb_size_t*)field->pSize = 0;
+        }
+        
+        /* Release main pointer */
+        if (free_memory)
+            pb_free(*(void**)field->pField);
+        *(void**)field->pField = NULL;
+    }
+}
+
+/* Release all pointer fields of a message. Without free_memory the
+ * pointers are only cleared, which is used for arena allocations. */
+static void pb_release_message(const pb_msgdesc_t *fields, void *dest_struct, bool free_memory)
+{
+    pb_field_iter_t iter;
+    
+    if (!dest_struct)
+        return; /* Ignore NULL pointers, similar to free() */
+
+    if (!pb_field_iter_begin(&iter, fields, dest_struct))
+        return; /* Empty message type */
+    
+    do
+    {
+        pb_release_single_field(&iter, free_memory);
+    } while (pb_field_iter_next(&iter));
+}
+
+void pb_release(const pb_msgdesc_t *fields, void *dest_struct)
+{
+    pb_release_message(fields, dest_struct, true);
+}
+
+#ifdef PB_ENABLE_ARENA
+void pb_arena_init(pb_arena_t *arena, void *buf, size_t size)
+{
+    arena->buf = (pb_byte_t*)buf;
+    arena->size = size;
+    pb_arena_reset(arena);
+}
+
+void pb_arena_reset(pb_arena_t *arena)
+{
+    arena->used = 0;
+    arena->last = 0;
+}
+
+void *pb_arena_realloc(pb_arena_t *arena, void *ptr, size_t size)
+{
+    pb_byte_t *old = (pb_byte_t*)ptr;
+    pb_byte_t *dest;
+    size_t start;
+
+    if (old != NULL)
+    {
+        size_t offset;
+
+        if (old < arena->buf || old >= arena->buf + arena->used)
+            return NULL; /* Not allocated from this arena */
+
+        offset = (size_t)(old - arena->buf);
+        if (offset == arena->last)
+        {
+            /* Latest allocation can be resized in place */
+            if (size > arena->size - offset)
+                return NULL;
+
+            arena->used = offset + size;
+            return old;
+        }
+    }
+
+    start = (arena->used + (PB_ARENA_ALIGN - 1)) & ~(size_t)(PB_ARENA_ALIGN - 1);
+    if (start < arena->used || start > arena->size || size > arena->size - start)
+        return NULL;
+
+    dest = arena->buf + start;
+
+    if (old != NULL)
+    {
+        /* The old size is not stored, but the allocation cannot extend
+         * past the used part of the arena. Growing copies some extra bytes
+         * from the allocations after it, the caller initializes those. */
+        size_t copy = (size_t)(arena->buf + arena->used - old);
+        if (copy > size)
+            copy = size;
+        memcpy(dest, old, copy);
+    }
+
+    arena->last = start;
+    arena->used = start + size;
+    return dest;
+}
+#endif
+#else
+void pb_release(const pb_msgdesc_t *fields, void *dest_struct)
+{
+    /* Nothing to release without PB_ENABLE_MALLOC. */
+    PB_UNUSED(fields);
+    PB_UNUSED(dest_struct);
+}
+#endif
+
+/* Field decoders */
+
+bool pb_decode_bool(pb_istream_t *stream, bool *dest)
+{
+    uint32_t value;
+    if (!pb_decode_varint32(stream, &value))
+        return false;
+
+    *(bool*)dest = (value != 0);
+    return true;
+}
+
+bool pb_decode_svarint(pb_istream_t *stream, pb_int64_t *dest)
+{
+    pb_uint64_t value;
+    if (!pb_decode_varint(stream, &value))
+        return false;
+    
+    if (value & 1)
+        *dest = (pb_int64_t)(~(value >> 1));
+    else
+        *dest = (pb_int64_t)(value >> 1);
+    
+    return true;
+}
+
+bool pb_decode_fixed32(pb_istream_t *stream, void *dest)
+{
+    union {
+        uint32_t fixed32;
+        pb_byte_t bytes[4];
+    } u;
+
+    if (!pb_read(stream, u.bytes, 4))
+        return false;
+
+#if defined(PB_LITTLE_ENDIAN_8BIT) && PB_LITTLE_ENDIAN_8BIT == 1
+    /* fast path - if we know that we're on little endian, assign directly */
+    *(uint32_t*)dest = u.fixed32;
+#else
+    *(uint32_t*)dest = ((uint32_t)u.bytes[0] << 0) |
+                       ((uint32_t)u.bytes[1] << 8) |
+                       ((uint32_t)u.bytes[2] << 16) |
+                       ((uint32_t)u.bytes[3] << 24);
+#endif
+    return true;
+}
+
+#ifndef PB_WITHOUT_64BIT
+bool pb_decode_fixed64(pb_istream_t *stream, void *dest)
+{
+    union {
+        uint64_t fixed64;
+        pb_byte_t bytes[8];
+    } u;
+
+    if (!pb_read(stream, u.bytes, 8))
+        return false;
+
+#if defined(PB_LITTLE_ENDIAN_8BIT) && PB_LITTLE_ENDIAN_8BIT == 1
+    /* fast path - if we know that we're on little endian, assign directly */
+    *(uint64_t*)dest = u.fixed64;
+#else
+    *(uint64_t*)dest = ((uint64_t)u.bytes[0] << 0) |
+                       ((uint64_t)u.bytes[1] << 8) |
+                       ((uint64_t)u.bytes[2] << 16) |
+                       ((uint64_t)u.bytes[3] << 24) |
+                       ((uint64_t)u.bytes[4] << 32) |
+                       ((uint64_t)u.bytes[5] << 40) |
+                       ((uint64_t)u.bytes[6] << 48) |
+                       ((uint64_t)u.bytes[7] << 56);
+#endif
+    return true;
+}
+#endif
+
+static bool checkreturn pb_dec_bool(pb_istream_t *stream, const pb_field_iter_t *field)
+{
+    return pb_decode_bool(stream, (bool*)field->pData);
+}
+
+static bool checkreturn pb_dec_varint(pb_istream_t *stream, const pb_field_iter_t *field)
+{
+    if (PB_LTYPE(field->type) == PB_LTYPE_UVARINT)
+    {
+        pb_uint64_t value, clamped;
+        if (!pb_decode_varint(stream, &value))
+            return false;
+
+        /* Cast to the proper field size, while checking for overflows */
+        if (field->data_size == sizeof(pb_uint64_t))
+            clamped = *(pb_uint64_t*)field->pData = value;
+        else if (field->data_size == sizeof(uint32_t))
+            clamped = *(uint32_t*)field->pData = (uint32_t)value;
+        else if (field->data_size == sizeof(uint_least16_t))
+            clamped = *(uint_least16_t*)field->pData = (uint_least16_t)value;
+        else if (field->data_size == sizeof(uint_least8_t))
+            clamped = *(uint_least8_t*)field->pData = (uint_least8_t)value;
+        else
+            PB_RETURN_ERROR(stream, "invalid data_size");
+
+        if (clamped != value)
+            PB_RETURN_ERROR(stream, "integer too large");
+
+        return true;
+    }
+    else
+    {
+        pb_uint64_t value;
+        pb_int64_t svalue;
+        pb_int64_t clamped;
+
+        if (PB_LTYPE(field->type) == PB_LTYPE_SVARINT)
+        {
+            if (!pb_decode_svarint(stream, &svalue))
+                return false;
+        }
+        else
+        {
+            if (!pb_decode_varint(stream, &value))
+                return false;
+
+            /* See issue 97: Google's C++ protobuf allows negative varint values to
+            * be cast as int32_t, instead of the int64_t that should be used when
+            * encoding. Nanopb versions before 0.2.5 had a bug in encoding. In order to
+            * not break decoding of such messages, we cast <=32 bit fields to
+            * int32_t first to get the sign correct.
+            */
+            if (field->data_size == sizeof(pb_int64_t))
+                svalue = (pb_int64_t)value;
+            else
+                svalue = (int32_t)value;
+        }
+
+        /* Cast to the proper field size, while checking for overflows */
+        if (field->data_size == sizeof(pb_int64_t))
+            clamped = *(pb_int64_t*)field->pData = svalue;
+        else if (field->data_size == sizeof(int32_t))
+            clamped = *(int32_t*)field->pData = (int32_t)svalue;
+        else if (field->data_size == sizeof(int_least16_t))
+            clamped = *(int_least16_t*)field->pData = (int_least16_t)svalue;
+        else if (field->data_size == sizeof(int_least8_t))
+            clamped = *(int_least8_t*)field->pData = (int_least8_t)svalue;
+        else
+            PB_RETURN_ERROR(stream, "invalid data_size");
+
+        if (clamped != svalue)
+            PB_RETURN_ERROR(stream, "integer too large");
+
+        return true;
+    }
+}
+
+static bool checkreturn pb_dec_bytes(pb_istream_t *stream, const pb_field_iter_t *field)
+{
+    uint32_t size;
+    size_t alloc_size;
+    pb_bytes_array_t *dest;
+    
+    if (!pb_decode_varint32(stream, &size))
+        return false;
+    
+    if (size > PB_SIZE_MAX)
+        PB_RETURN_ERROR(stream, "bytes overflow");
+    
+    alloc_size = PB_BYTES_ARRAY_T_ALLOCSIZE(size);
+    if (size > alloc_size)
+        PB_RETURN_ERROR(stream, "size too large");
+    
+    if (PB_ATYPE(field->type) == PB_ATYPE_POINTER)
+    {
+#ifndef PB_ENABLE_MALLOC
+        PB_RETURN_ERROR(stream, "no malloc support");
+#else
+        if (stream->bytes_left < size)
+            PB_RETURN_ERROR(stream, "end-of-stream");
+
+        if (!allocate_field(stream, field->pData, alloc_size, 1))
+            return false;
+        dest = *(pb_bytes_array_t**)field->pData;
+#endif
+    }
+    else
+    {
+        if (alloc_size > field->data_size)
+            PB_RETURN_ERROR(stream, "bytes overflow");
+        dest = (pb_bytes_array_t*)field->pData;
+    }
+
+    dest->size = (pb_size_t)size;
+    return pb_read(stream, dest->bytes, (size_t)size);
+}
+
+static bool checkreturn pb_dec_string(pb_istream_t *stream, const pb_field_iter_t *field)
+{
+    uint32_t size;
+    size_t alloc_size;
+    pb_byte_t *dest = (pb_byte_t*)field->pData;
+
+    if (!pb_decode_varint32(stream, &size))
+        return false;
+
+    if (size == (uint32_t)-1)
+        PB_RETURN_ERROR(stream, "size too large");
+
+    /* Space for null terminator */
+    alloc_size = (size_t)(size + 1);
+
+    if (alloc_size < size)
+        PB_RETURN_ERROR(stream, "size too large");
+
+    if (PB_ATYPE(field->type) == PB_ATYPE_POINTER)
+    {
+#ifndef PB_ENABLE_MALLOC
+        PB_RETURN_ERROR(stream, "no malloc support");
+#else
+        if (stream->bytes_left < size)
+            PB_RETURN_ERROR(stream, "end-of-stream");
+
+        if (!allocate_field(stream, field->pData, alloc_size, 1))
+            return false;
+        dest = *(pb_byte_t**)field->pData;
+#endif
+    }
+    else
+    {
+        if (alloc_size > field->data_size)
+            PB_RETURN_ERROR(stream, "string overflow");
+    }
+    
+    dest[size] = 0;
+
+    if (!pb_read(stream, dest, (size_t)size))
+        return false;
+
+#ifdef PB_VALIDATE_UTF8
+    if (!pb_validate_utf8((const char*)dest))
+        PB_RETURN_ERROR(stream, "invalid utf8");
+#endif
+
+    return true;
+}
+
+static bool checkreturn pb_dec_submessage(pb_istream_t *stream, const pb_field_iter_t *field)
+{
+    bool status = true;
+    bool submsg_consumed = false;
+    pb_istream_t substream;
+
+    if (!pb_make_string_substream(stream, &substream))
+        return false;
+    
+    if (field->submsg_desc == NULL)
+        PB_RETURN_ERROR(stream, "invalid field descriptor");
+    
+    /* Submessages can have a separate message-level callback that is called
+     * before decoding the message. Typically it is used to set callback fields
+     * inside oneofs. */
+    if (PB_LTYPE(field->type) == PB_LTYPE_SUBMSG_W_CB && field->pSize != NULL)
+    {
+        /* Message callback is stored right before pSize. */
+        pb_callback_t *callback = (pb_callback_t*)field->pSize - 1;
+        if (callback->funcs.decode)
+        {
+            PB_STATS_ADD(callbacks, 1);
+            status = callback->funcs.decode(&substream, field, &callback->arg);
+
+            if (substream.bytes_left == 0)
+            {
+                submsg_consumed = true;
             }
         }
-        
-        if (PB_HTYPE(type) == PB_HTYPE_REPEATED)
+    }
+
+    /* Now decode the submessage contents */
+    if (status && !submsg_consumed)
+    {
+        unsigned int flags = 0;
+
+        /* Static required/optional fields are already initialized by top-level
+         * pb_decode(), no need to initialize them again. */
+        if (PB_ATYPE(field->type) == PB_ATYPE_STATIC &&
+            PB_HTYPE(field->type) != PB_HTYPE_REPEATED)
+        {
+            flags = PB_DECODE_NOINIT;
+        }
+
+        PB_STATS_ENTER_SUBMSG();
+        status = pb_decode_inner(&substream, field->submsg_desc, field->pData, flags, NULL, NULL);
+        PB_STATS_LEAVE_SUBMSG();
+    }
+    
+    if (!pb_close_string_substream(stream, &substream))
+        return false;
+
+    return status;
+}
+
+static bool checkreturn pb_dec_fixed_length_bytes(pb_istream_t *stream, const pb_field_iter_t *field)
+{
+    uint32_t size;
+
+    if (!pb_decode_varint32(stream, &size))
+        return false;
+
+    if (size > PB_SIZE_MAX)
+        PB_RETURN_ERROR(stream, "bytes overflow");
+
+    if (size == 0)
+    {
+        /* As a special case, treat empty bytes string as all zeros for fixed_length_bytes. */
+        memset(field->pData, 0, (size_t)field->data_size);
+        return true;
+    }
+
+    if (size != field->data_size)
+        PB_RETURN_ERROR(stream, "incorrect fixed length bytes size");
+
+    return pb_read(stream, (pb_byte_t*)field->pData, (size_t)field->data_size);
+}
+
+static bool checkreturn pb_dec_view(pb_istream_t *stream, const pb_field_iter_t *field)
+{
+    uint32_t size;
+    pb_view_t *dest = (pb_view_t*)field->pData;
+
+    if (!pb_decode_varint32(stream, &size))
+        return false;
+
+#ifndef PB_BUFFER_ONLY
+    /* The data must stay in memory, so only buffer streams can be used. */
+    if (stream->callback != &buf_read)
+        PB_RETURN_ERROR(stream, "view requires buffer stream");
+#endif
+
+    if (stream->bytes_left < size)
+        PB_RETURN_ERROR(stream, "end-of-stream");
+
+    dest->ptr = (const pb_byte_t*)stream->state;
+    dest->len = (size_t)size;
+    return pb_read(stream, NULL, (size_t)size);
+}
+
+#ifdef PB_CONVERT_DOUBLE_FLOAT
+bool pb_decode_double_as_float(pb_istream_t *stream, float *dest)
+{
+    uint_least8_t sign;
+    int exponent;
+    uint32_t mantissa;
+    uint64_t value;
+    union { float f; uint32_t i; } out;
+
+    if (!pb_decode_fixed64(stream, &value))
+        return false;
+
+    /* Decompose input value */
+    sign = (uint_least8_t)((value >> 63) & 1);
+    exponent = (int)((value >> 52) & 0x7FF) - 1023;
+    mantissa = (value >> 28) & 0xFFFFFF; /* Highest 24 bits */
+
+    /* Figure if value is in range representable by floats. */
+    if (exponent == 1024)
+    {
+        /* Special value */
+        exponent = 128;
+        mantissa >>= 1;
+    }
+    else
+    {
+        if (exponent > 127)
+        {
+            /* Too large, convert to infinity */
+            exponent = 128;
+            mantissa = 0;
+        }
+        else if (exponent < -150)
+        {
+            /* Too small, convert to zero */
+            exponent = -127;
+            mantissa = 0;
+        }
+        else if (exponent < -126)
         {
-            /* We are going to release the array, so set the size to 0 */
-            *(pb_size_t*)field->pSize = 0;
+            /* Denormalized */
+            mantissa |= 0x1000000;
+            mantissa >>= (-126 - exponent);
+            exponent = -127;
+        }
+
+        /* Round off mantissa */
+        mantissa = (mantissa + 1) >> 1;
+
+        /* Check if mantissa went over 2.0 */
+        if (mantissa & 0x800000)
+        {
+            exponent += 1;
+            mantissa &= 0x7FFFFF;
+            mantissa >>= 1;
         }
-        
-        /* Release main pointer */
-        pb_free(*(void**)field->pField);
-        *(void**)field->pField = NULL;
     }
-}
 
-void pb_release(const pb_msgdesc_t *fields, void *dest_struct)
-{
-    pb_field_iter_t iter;
-    
-    if (!dest_struct)
-        return; /* Ignore NULL pointers, similar to free() */
+    /* Combine fields */
+    out.i = mantissa;
+    out.i |= (uint32_t)(exponent + 127) << 23;
+    out.i |= (uint32_t)sign << 31;
 
-    if (!pb_field_iter_begin(&iter, fields, dest_struct))
-        return; /* Empty message type */
-    
-    do
-    {
-        pb_release_single_field(&iter);
-    } while (pb_field_iter_next(&iter));
-}
-#else
-void pb_release(const pb_msgdesc_t *fields, void *dest_struct)
-{
-    /* Nothing to release without PB_ENABLE_MALLOC. */
-    PB_UNUSED(fields);
-    PB_UNUSED(dest_struct);
+    *dest = out.f;
+    return true;
 }
 #endif
 
-/* Field decoders */
-
-bool pb_decode_bool(pb_istream_t *stream, bool *dest)
+#ifdef PB_ENABLE_PUSH_DECODER
+/********************************
+ * Incremental (push) decoding  *
+ ********************************/
+
+/* Parser states of pb_push_decoder_t */
+#define PB_PUSH_ST_TAG          0  /* Reading field tag */
+#define PB_PUSH_ST_PREFIX       1  /* Reading length prefix of delimited message */
+#define PB_PUSH_ST_LENGTH       2  /* Reading length of a length-delimited field */
+#define PB_PUSH_ST_VALUE        3  /* Reading varint or fixed-size field value */
+#define PB_PUSH_ST_PACKED       4  /* Reading items of a packed array */
+#define PB_PUSH_ST_COPY         5  /* Copying string or bytes contents */
+#define PB_PUSH_ST_SKIP_LENGTH  6  /* Reading length of an unknown field */
+#define PB_PUSH_ST_SKIP_VARINT  7  /* Skipping varint of an unknown field */
+#define PB_PUSH_ST_SKIP         8  /* Skipping data of an unknown field */
+#define PB_PUSH_ST_DONE         9
+#define PB_PUSH_ST_ERROR        10
+
+/* Switch to a new state. value_len is the number of bytes to collect to
+ * decoder->buf, or 0 for a varint. */
+static void push_set_state(pb_push_decoder_t *decoder, uint_least8_t state, uint_least8_t value_len)
 {
-    uint32_t value;
-    if (!pb_decode_varint32(stream, &value))
-        return false;
+    decoder->state = state;
+    decoder->value_len = value_len;
+    decoder->buf_len = 0;
+}
 
-    *(bool*)dest = (value != 0);
-    return true;
+static bool push_stream_error(pb_push_decoder_t *decoder, const pb_istream_t *stream)
+{
+    PB_SET_ERROR(decoder, PB_GET_ERROR(stream));
+    PB_UNUSED(stream);
+    return false;
 }
 
-bool pb_decode_svarint(pb_istream_t *stream, pb_int64_t *dest)
+/* Decode a varint from the bytes collected to decoder->buf. */
+static bool checkreturn push_collected_varint32(pb_push_decoder_t *decoder, uint32_t *value)
 {
-    pb_uint64_t value;
-    if (!pb_decode_varint(stream, &value))
-        return false;
-    
-    if (value & 1)
-        *dest = (pb_int64_t)(~(value >> 1));
-    else
-        *dest = (pb_int64_t)(value >> 1);
-    
+    pb_istream_t stream = pb_istream_from_buffer(decoder->buf, decoder->buf_len);
+    if (!pb_decode_varint32(&stream, value))
+        return push_stream_error(decoder, &stream);
     return true;
 }
 
-bool pb_decode_fixed32(pb_istream_t *stream, void *dest)
+static bool checkreturn push_enter_message(pb_push_decoder_t *decoder, const pb_msgdesc_t *fields,
+                                           void *dest_struct, size_t end, bool init)
 {
-    union {
-        uint32_t fixed32;
-        pb_byte_t bytes[4];
-    } u;
+    pb_push_frame_t *frame;
 
-    if (!pb_read(stream, u.bytes, 4))
-        return false;
+    if (decoder->depth >= PB_PUSH_MAX_DEPTH)
+        PB_RETURN_ERROR(decoder, "max depth exceeded");
 
-#if defined(PB_LITTLE_ENDIAN_8BIT) && PB_LITTLE_ENDIAN_8BIT == 1
-    /* fast path - if we know that we're on little endian, assign directly */
-    *(uint32_t*)dest = u.fixed32;
-#else
-    *(uint32_t*)dest = ((uint32_t)u.bytes[0] << 0) |
-                       ((uint32_t)u.bytes[1] << 8) |
-                       ((uint32_t)u.bytes[2] << 16) |
-                       ((uint32_t)u.bytes[3] << 24);
-#endif
+    frame = &decoder->frames[decoder->depth++];
+    frame->descriptor = fields;
+    frame->message = dest_struct;
+    frame->end = end;
+    frame->fixed_count_field = PB_SIZE_MAX;
+    frame->fixed_count_size = 0;
+    frame->fixed_count_total_size = 0;
+    memset(frame->fields_seen, 0, sizeof(frame->fields_seen));
+
+    if (pb_field_iter_begin(&decoder->iter, fields, dest_struct) && init)
+    {
+        if (!pb_message_set_to_defaults(&decoder->iter, NULL, NULL))
+            PB_RETURN_ERROR(decoder, "failed to set defaults");
+    }
+
+    push_set_state(decoder, PB_PUSH_ST_TAG, 0);
     return true;
 }
 
-#ifndef PB_WITHOUT_64BIT
-bool pb_decode_fixed64(pb_istream_t *stream, void *dest)
+static bool checkreturn push_leave_message(pb_push_decoder_t *decoder)
 {
-    union {
-        uint64_t fixed64;
-        pb_byte_t bytes[8];
-    } u;
+    pb_push_frame_t *frame = &decoder->frames[decoder->depth - 1];
 
-    if (!pb_read(stream, u.bytes, 8))
-        return false;
+    /* Check that all elements of the last decoded fixed count field were present. */
+    if (frame->fixed_count_field != PB_SIZE_MAX &&
+        frame->fixed_count_size != frame->fixed_count_total_size)
+    {
+        PB_RETURN_ERROR(decoder, "wrong size for fixed count field");
+    }
+
+    if (!required_fields_present(frame->descriptor, frame->fields_seen))
+        PB_RETURN_ERROR(decoder, "missing required field");
+
+    decoder->depth--;
+    if (decoder->depth > 0)
+    {
+        frame--;
+        (void)pb_field_iter_begin(&decoder->iter, frame->descriptor, frame->message);
+    }
 
-#if defined(PB_LITTLE_ENDIAN_8BIT) && PB_LITTLE_ENDIAN_8BIT == 1
-    /* fast path - if we know that we're on little endian, assign directly */
-    *(uint64_t*)dest = u.fixed64;
-#else
-    *(uint64_t*)dest = ((uint64_t)u.bytes[0] << 0) |
-                       ((uint64_t)u.bytes[1] << 8) |
-                       ((uint64_t)u.bytes[2] << 16) |
-                       ((uint64_t)u.bytes[3] << 24) |
-                       ((uint64_t)u.bytes[4] << 32) |
-                       ((uint64_t)u.bytes[5] << 40) |
-                       ((uint64_t)u.bytes[6] << 48) |
-                       ((uint64_t)u.bytes[7] << 56);
-#endif
     return true;
 }
-#endif
 
-static bool checkreturn pb_dec_bool(pb_istream_t *stream, const pb_field_iter_t *field)
+static bool checkreturn push_skip_field(pb_push_decoder_t *decoder, pb_wire_type_t wire_type)
 {
-    return pb_decode_bool(stream, (bool*)field->pData);
+    switch (wire_type)
+    {
+        case PB_WT_VARINT: push_set_state(decoder, PB_PUSH_ST_SKIP_VARINT, 0); break;
+        case PB_WT_64BIT: push_set_state(decoder, PB_PUSH_ST_SKIP, 0); decoder->remaining = 8; break;
+        case PB_WT_STRING: push_set_state(decoder, PB_PUSH_ST_SKIP_LENGTH, 0); break;
+        case PB_WT_32BIT: push_set_state(decoder, PB_PUSH_ST_SKIP, 0); decoder->remaining = 4; break;
+        default: PB_RETURN_ERROR(decoder, "invalid wire_type");
+    }
+    return true;
 }
 
-static bool checkreturn pb_dec_varint(pb_istream_t *stream, const pb_field_iter_t *field)
+/* Number of bytes in a packed array item, or 0 for varints. */
+static uint_least8_t push_packed_item_len(pb_type_t type)
 {
-    if (PB_LTYPE(field->type) == PB_LTYPE_UVARINT)
-    {
-        pb_uint64_t value, clamped;
-        if (!pb_decode_varint(stream, &value))
-            return false;
+    if (PB_LTYPE(type) == PB_LTYPE_FIXED32)
+        return 4;
+    else if (PB_LTYPE(type) == PB_LTYPE_FIXED64)
+        return 8;
+    else
+        return 0;
+}
 
-        /* Cast to the proper field size, while checking for overflows */
-        if (field->data_size == sizeof(pb_uint64_t))
-            clamped = *(pb_uint64_t*)field->pData = value;
-        else if (field->data_size == sizeof(uint32_t))
-            clamped = *(uint32_t*)field->pData = (uint32_t)value;
-        else if (field->data_size == sizeof(uint_least16_t))
-            clamped = *(uint_least16_t*)field->pData = (uint_least16_t)value;
-        else if (field->data_size == sizeof(uint_least8_t))
-            clamped = *(uint_least8_t*)field->pData = (uint_least8_t)value;
-        else
-            PB_RETURN_ERROR(stream, "invalid data_size");
+/* Handle a field tag. This mirrors the field lookup in pb_decode_inner(). */
+static bool checkreturn push_begin_field(pb_push_decoder_t *decoder, uint32_t tag, pb_wire_type_t wire_type)
+{
+    pb_push_frame_t *frame = &decoder->frames[decoder->depth - 1];
+    pb_field_iter_t *iter = &decoder->iter;
 
-        if (clamped != value)
-            PB_RETURN_ERROR(stream, "integer too large");
+    decoder->wire_type = wire_type;
 
-        return true;
-    }
-    else
+    if (!pb_field_iter_find(iter, tag) || PB_LTYPE(iter->type) == PB_LTYPE_EXTENSION)
     {
-        pb_uint64_t value;
-        pb_int64_t svalue;
-        pb_int64_t clamped;
+        /* Extension fields would need the stream-based decoder */
+        if (pb_field_iter_find_extension(iter) &&
+            tag >= iter->tag &&
+            *(pb_extension_t* const *)iter->pData != NULL)
+        {
+            PB_RETURN_ERROR(decoder, "extensions not supported");
+        }
 
-        if (PB_LTYPE(field->type) == PB_LTYPE_SVARINT)
+        return push_skip_field(decoder, wire_type);
+    }
+
+    if (PB_ATYPE(iter->type) == PB_ATYPE_CALLBACK)
+    {
+        if (iter->descriptor->field_callback == NULL ||
+            (iter->descriptor->field_callback == &pb_default_field_callback &&
+             ((pb_callback_t*)iter->pData)->funcs.decode == NULL))
         {
-            if (!pb_decode_svarint(stream, &svalue))
-                return false;
+            return push_skip_field(decoder, wire_type);
         }
-        else
+
+        PB_RETURN_ERROR(decoder, "callback fields not supported");
+    }
+    else if (PB_ATYPE(iter->type) != PB_ATYPE_STATIC)
+    {
+        PB_RETURN_ERROR(decoder, "pointer fields not supported");
+    }
+
+    /* If a repeated fixed count field was found, get size from
+     * 'fixed_count_field' as there is no counter contained in the struct.
+     */
+    if (PB_HTYPE(iter->type) == PB_HTYPE_REPEATED && iter->pSize == &iter->array_size)
+    {
+        if (frame->fixed_count_field != iter->index)
         {
-            if (!pb_decode_varint(stream, &value))
-                return false;
+            if (frame->fixed_count_field != PB_SIZE_MAX &&
+                frame->fixed_count_size != frame->fixed_count_total_size)
+            {
+                PB_RETURN_ERROR(decoder, "wrong size for fixed count field");
+            }
 
-            /* See issue 97: Google's C++ protobuf allows negative varint values to
-            * be cast as int32_t, instead of the int64_t that should be used when
-            * encoding. Nanopb versions before 0.2.5 had a bug in encoding. In order to
-            * not break decoding of such messages, we cast <=32 bit fields to
-            * int32_t first to get the sign correct.
-            */
-            if (field->data_size == sizeof(pb_int64_t))
-                svalue = (pb_int64_t)value;
-            else
-                svalue = (int32_t)value;
+            frame->fixed_count_field = iter->index;
+            frame->fixed_count_size = 0;
+            frame->fixed_count_total_size = iter->array_size;
         }
 
-        /* Cast to the proper field size, while checking for overflows */
-        if (field->data_size == sizeof(pb_int64_t))
-            clamped = *(pb_int64_t*)field->pData = svalue;
-        else if (field->data_size == sizeof(int32_t))
-            clamped = *(int32_t*)field->pData = (int32_t)svalue;
-        else if (field->data_size == sizeof(int_least16_t))
-            clamped = *(int_least16_t*)field->pData = (int_least16_t)svalue;
-        else if (field->data_size == sizeof(int_least8_t))
-            clamped = *(int_least8_t*)field->pData = (int_least8_t)svalue;
-        else
-            PB_RETURN_ERROR(stream, "invalid data_size");
+        iter->pSize = &frame->fixed_count_size;
+    }
 
-        if (clamped != svalue)
-            PB_RETURN_ERROR(stream, "integer too large");
+    if (PB_HTYPE(iter->type) == PB_HTYPE_REQUIRED
+        && iter->required_field_index < PB_MAX_REQUIRED_FIELDS)
+    {
+        uint32_t tmp = ((uint32_t)1 << (iter->required_field_index & 31));
+        frame->fields_seen[iter->required_field_index >> 5] |= tmp;
+    }
 
-        return true;
+    switch (wire_type)
+    {
+        case PB_WT_VARINT: push_set_state(decoder, PB_PUSH_ST_VALUE, 0); break;
+        case PB_WT_64BIT: push_set_state(decoder, PB_PUSH_ST_VALUE, 8); break;
+        case PB_WT_STRING: push_set_state(decoder, PB_PUSH_ST_LENGTH, 0); break;
+        case PB_WT_32BIT: push_set_state(decoder, PB_PUSH_ST_VALUE, 4); break;
+        default: PB_RETURN_ERROR(decoder, "wrong wire type");
     }
+    return true;
 }
 
-static bool checkreturn pb_dec_bytes(pb_istream_t *stream, const pb_field_iter_t *field)
+/* Handle the length prefix of a known length-delimited field. The checks
+ * mirror decode_static_field() and the pb_dec_*() functions. */
+static bool checkreturn push_begin_delimited(pb_push_decoder_t *decoder, uint32_t size)
 {
-    uint32_t size;
-    size_t alloc_size;
-    pb_bytes_array_t *dest;
-    
-    if (!pb_decode_varint32(stream, &size))
-        return false;
-    
-    if (size > PB_SIZE_MAX)
-        PB_RETURN_ERROR(stream, "bytes overflow");
-    
-    alloc_size = PB_BYTES_ARRAY_T_ALLOCSIZE(size);
-    if (size > alloc_size)
-        PB_RETURN_ERROR(stream, "size too large");
-    
-    if (PB_ATYPE(field->type) == PB_ATYPE_POINTER)
+    pb_push_frame_t *frame = &decoder->frames[decoder->depth - 1];
+    pb_field_iter_t *field = &decoder->iter;
+
+    if (frame->end - decoder->position < size)
+        PB_RETURN_ERROR(decoder, "parent stream too short");
+
+    decoder->remaining = (size_t)size;
+
+    if (PB_HTYPE(field->type) == PB_HTYPE_REPEATED
+        && PB_LTYPE(field->type) <= PB_LTYPE_LAST_PACKABLE)
     {
-#ifndef PB_ENABLE_MALLOC
-        PB_RETURN_ERROR(stream, "no malloc support");
-#else
-        if (stream->bytes_left < size)
-            PB_RETURN_ERROR(stream, "end-of-stream");
+        push_set_state(decoder, PB_PUSH_ST_PACKED, push_packed_item_len(field->type));
+        if (size == 0)
+            push_set_state(decoder, PB_PUSH_ST_TAG, 0);
+        return true;
+    }
 
-        if (!allocate_field(stream, field->pData, alloc_size, 1))
-            return false;
-        dest = *(pb_bytes_array_t**)field->pData;
-#endif
+    switch (PB_LTYPE(field->type))
+    {
+        case PB_LTYPE_BYTES:
+        case PB_LTYPE_STRING:
+        case PB_LTYPE_SUBMESSAGE:
+        case PB_LTYPE_SUBMSG_W_CB:
+        case PB_LTYPE_FIXED_LENGTH_BYTES:
+            break;
+
+        case PB_LTYPE_VIEW:
+            /* Input chunks are not kept, so there is nothing to point to. */
+            PB_RETURN_ERROR(decoder, "view fields not supported");
+
+        default:
+            PB_RETURN_ERROR(decoder, "wrong wire type");
     }
-    else
+
+    switch (PB_HTYPE(field->type))
     {
-        if (alloc_size > field->data_size)
-            PB_RETURN_ERROR(stream, "bytes overflow");
-        dest = (pb_bytes_array_t*)field->pData;
+        case PB_HTYPE_OPTIONAL:
+            if (field->pSize != NULL)
+                *(bool*)field->pSize = true;
+            break;
+
+        case PB_HTYPE_REPEATED:
+        {
+            pb_size_t *count = (pb_size_t*)field->pSize;
+            field->pData = (char*)field->pField + field->data_size * (*count);
+
+            if ((*count)++ >= field->array_size)
+                PB_RETURN_ERROR(decoder, "array overflow");
+            break;
+        }
+
+        case PB_HTYPE_ONEOF:
+            if (!select_oneof_field(field))
+                PB_RETURN_ERROR(decoder, "failed to set defaults");
+            break;
+
+        default:
+            break;
     }
 
-    dest->size = (pb_size_t)size;
-    return pb_read(stream, dest->bytes, (size_t)size);
-}
+    push_set_state(decoder, PB_PUSH_ST_COPY, 0);
 
-static bool checkreturn pb_dec_string(pb_istream_t *stream, const pb_field_iter_t *field)
-{
-    uint32_t size;
-    size_t alloc_size;
-    pb_byte_t *dest = (pb_byte_t*)field->pData;
+    if (PB_LTYPE(field->type) == PB_LTYPE_STRING)
+    {
+        if (size == (uint32_t)-1 || (size_t)(size + 1) < size)
+            PB_RETURN_ERROR(decoder, "size too large");
 
-    if (!pb_decode_varint32(stream, &size))
-        return false;
+        if ((size_t)(size + 1) > field->data_size)
+            PB_RETURN_ERROR(decoder, "string overflow");
 
-    if (size == (uint32_t)-1)
-        PB_RETURN_ERROR(stream, "size too large");
+        decoder->dest = (pb_byte_t*)field->pData;
+        decoder->dest[size] = 0;
+    }
+    else if (PB_LTYPE(field->type) == PB_LTYPE_BYTES)
+    {
+        pb_bytes_array_t *dest = (pb_bytes_array_t*)field->pData;
+        size_t alloc_size;
 
-    /* Space for null terminator */
-    alloc_size = (size_t)(size + 1);
+        if (size > PB_SIZE_MAX)
+            PB_RETURN_ERROR(decoder, "bytes overflow");
 
-    if (alloc_size < size)
-        PB_RETURN_ERROR(stream, "size too large");
+        alloc_size = PB_BYTES_ARRAY_T_ALLOCSIZE(size);
+        if (size > alloc_size)
+            PB_RETURN_ERROR(decoder, "size too large");
 
-    if (PB_ATYPE(field->type) == PB_ATYPE_POINTER)
+        if (alloc_size > field->data_size)
+            PB_RETURN_ERROR(decoder, "bytes overflow");
+
+        dest->size = (pb_size_t)size;
+        decoder->dest = dest->bytes;
+    }
+    else if (PB_LTYPE(field->type) == PB_LTYPE_FIXED_LENGTH_BYTES)
     {
-#ifndef PB_ENABLE_MALLOC
-        PB_RETURN_ERROR(stream, "no malloc support");
-#else
-        if (stream->bytes_left < size)
-            PB_RETURN_ERROR(stream, "end-of-stream");
+        if (size > PB_SIZE_MAX)
+            PB_RETURN_ERROR(decoder, "bytes overflow");
 
-        if (!allocate_field(stream, field->pData, alloc_size, 1))
-            return false;
-        dest = *(pb_byte_t**)field->pData;
-#endif
+        if (size == 0)
+        {
+            /* As a special case, treat empty bytes string as all zeros for fixed_length_bytes. */
+            memset(field->pData, 0, (size_t)field->data_size);
+        }
+        else if (size != field->data_size)
+        {
+            PB_RETURN_ERROR(decoder, "incorrect fixed length bytes size");
+        }
+
+        decoder->dest = (pb_byte_t*)field->pData;
     }
     else
     {
-        if (alloc_size > field->data_size)
-            PB_RETURN_ERROR(stream, "string overflow");
-    }
-    
-    dest[size] = 0;
+        /* Submessage */
+        if (field->submsg_desc == NULL)
+            PB_RETURN_ERROR(decoder, "invalid field descriptor");
 
-    if (!pb_read(stream, dest, (size_t)size))
-        return false;
+        if (PB_LTYPE(field->type) == PB_LTYPE_SUBMSG_W_CB && field->pSize != NULL)
+        {
+            /* Message callback is stored right before pSize. */
+            pb_callback_t *callback = (pb_callback_t*)field->pSize - 1;
+            if (callback->funcs.decode)
+                PB_RETURN_ERROR(decoder, "callback fields not supported");
+        }
 
-#ifdef PB_VALIDATE_UTF8
-    if (!pb_validate_utf8((const char*)dest))
-        PB_RETURN_ERROR(stream, "invalid utf8");
-#endif
+        /* Static required/optional fields are already initialized by the
+         * parent message, only repeated items need their defaults set. */
+        return push_enter_message(decoder, field->submsg_desc, field->pData,
+                                  decoder->position + (size_t)size,
+                                  PB_HTYPE(field->type) == PB_HTYPE_REPEATED);
+    }
+
+    if (size == 0)
+        push_set_state(decoder, PB_PUSH_ST_TAG, 0);
 
     return true;
 }
 
-static bool checkreturn pb_dec_submessage(pb_istream_t *stream, const pb_field_iter_t *field)
+/* Called when the current state has received all the bytes it needs. */
+static bool checkreturn push_complete(pb_push_decoder_t *decoder)
 {
-    bool status = true;
-    bool submsg_consumed = false;
-    pb_istream_t substream;
+    uint32_t value;
 
-    if (!pb_make_string_substream(stream, &substream))
-        return false;
-    
-    if (field->submsg_desc == NULL)
-        PB_RETURN_ERROR(stream, "invalid field descriptor");
-    
-    /* Submessages can have a separate message-level callback that is called
-     * before decoding the message. Typically it is used to set callback fields
-     * inside oneofs. */
-    if (PB_LTYPE(field->type) == PB_LTYPE_SUBMSG_W_CB && field->pSize != NULL)
+    switch (decoder->state)
     {
-        /* Message callback is stored right before pSize. */
-        pb_callback_t *callback = (pb_callback_t*)field->pSize - 1;
-        if (callback->funcs.decode)
-        {
-            status = callback->funcs.decode(&substream, field, &callback->arg);
+        case PB_PUSH_ST_TAG:
+            if (!push_collected_varint32(decoder, &value))
+                return false;
 
-            if (substream.bytes_left == 0)
+            if ((value >> 3) == 0)
             {
-                submsg_consumed = true;
+                if ((decoder->flags & PB_DECODE_NULLTERMINATED) && decoder->depth == 1)
+                {
+                    if (!push_leave_message(decoder))
+                        return false;
+
+                    push_set_state(decoder, PB_PUSH_ST_DONE, 0);
+                    return true;
+                }
+
+                PB_RETURN_ERROR(decoder, "zero tag");
             }
-        }
-    }
 
-    /* Now decode the submessage contents */
-    if (status && !submsg_consumed)
-    {
-        unsigned int flags = 0;
+            return push_begin_field(decoder, value >> 3, (pb_wire_type_t)(value & 7));
 
-        /* Static required/optional fields are already initialized by top-level
-         * pb_decode(), no need to initialize them again. */
-        if (PB_ATYPE(field->type) == PB_ATYPE_STATIC &&
-            PB_HTYPE(field->type) != PB_HTYPE_REPEATED)
+        case PB_PUSH_ST_PREFIX:
+            if (!push_collected_varint32(decoder, &value))
+                return false;
+
+            if ((size_t)value != value)
+                PB_RETURN_ERROR(decoder, "size too large");
+
+            decoder->frames[0].end = decoder->position + (size_t)value;
+            push_set_state(decoder, PB_PUSH_ST_TAG, 0);
+            return true;
+
+        case PB_PUSH_ST_LENGTH:
+            if (!push_collected_varint32(decoder, &value))
+                return false;
+
+            return push_begin_delimited(decoder, value);
+
+        case PB_PUSH_ST_SKIP_LENGTH:
+            if (!push_collected_varint32(decoder, &value))
+                return false;
+
+            if (decoder->frames[decoder->depth - 1].end - decoder->position < value)
+                PB_RETURN_ERROR(decoder, "end-of-stream");
+
+            push_set_state(decoder, (value > 0) ? PB_PUSH_ST_SKIP : PB_PUSH_ST_TAG, 0);
+            decoder->remaining = (size_t)value;
+            return true;
+
+        case PB_PUSH_ST_VALUE:
         {
-            flags = PB_DECODE_NOINIT;
+            pb_istream_t stream = pb_istream_from_buffer(decoder->buf, decoder->buf_len);
+            if (!decode_static_field(&stream, decoder->wire_type, &decoder->iter))
+                return push_stream_error(decoder, &stream);
+
+            push_set_state(decoder, PB_PUSH_ST_TAG, 0);
+            return true;
         }
 
-        status = pb_decode_inner(&substream, field->submsg_desc, field->pData, flags);
-    }
-    
-    if (!pb_close_string_substream(stream, &substream))
-        return false;
+        case PB_PUSH_ST_PACKED:
+        {
+            pb_field_iter_t *field = &decoder->iter;
+            pb_size_t *size = (pb_size_t*)field->pSize;
+            pb_istream_t stream = pb_istream_from_buffer(decoder->buf, decoder->buf_len);
+
+            field->pData = (char*)field->pField + field->data_size * (*size);
+            if (!decode_basic_field(&stream, PB_WT_PACKED, field))
+                return push_stream_error(decoder, &stream);
+            (*size)++;
+
+            decoder->buf_len = 0;
+            if (decoder->remaining == 0)
+                push_set_state(decoder, PB_PUSH_ST_TAG, 0);
+            return true;
+        }
 
-    return status;
+        case PB_PUSH_ST_COPY:
+#ifdef PB_VALIDATE_UTF8
+            if (PB_LTYPE(decoder->iter.type) == PB_LTYPE_STRING &&
+                !pb_validate_utf8((const char*)decoder->iter.pData))
+            {
+                PB_RETURN_ERROR(decoder, "invalid utf8");
+            }
+#endif
+            push_set_state(decoder, PB_PUSH_ST_TAG, 0);
+            return true;
+
+        default:
+            push_set_state(decoder, PB_PUSH_ST_TAG, 0);
+            return true;
+    }
 }
 
-static bool checkreturn pb_dec_fixed_length_bytes(pb_istream_t *stream, const pb_field_iter_t *field)
+/* Consume input bytes for the current state. Returns the number of bytes
+ * used and sets *complete if the state has got all the data it needs. */
+static size_t push_consume(pb_push_decoder_t *decoder, const pb_byte_t *buf, size_t count, bool *complete)
 {
-    uint32_t size;
+    size_t used = 0;
+    *complete = false;
 
-    if (!pb_decode_varint32(stream, &size))
-        return false;
+    switch (decoder->state)
+    {
+        case PB_PUSH_ST_COPY:
+            used = (count < decoder->remaining) ? count : decoder->remaining;
+            memcpy(decoder->dest, buf, used);
+            decoder->dest += used;
+            decoder->remaining -= used;
+            *complete = (decoder->remaining == 0);
+            break;
 
-    if (size > PB_SIZE_MAX)
-        PB_RETURN_ERROR(stream, "bytes overflow");
+        case PB_PUSH_ST_SKIP:
+            used = (count < decoder->remaining) ? count : decoder->remaining;
+            decoder->remaining -= used;
+            *complete = (decoder->remaining == 0);
+            break;
 
-    if (size == 0)
-    {
-        /* As a special case, treat empty bytes string as all zeros for fixed_length_bytes. */
-        memset(field->pData, 0, (size_t)field->data_size);
-        return true;
-    }
+        case PB_PUSH_ST_SKIP_VARINT:
+            while (used < count && !*complete)
+            {
+                *complete = ((buf[used++] & 0x80) == 0);
+            }
+            break;
 
-    if (size != field->data_size)
-        PB_RETURN_ERROR(stream, "incorrect fixed length bytes size");
+        default:
+            /* Collect a varint or a fixed-size value to decoder->buf */
+            if (decoder->state == PB_PUSH_ST_PACKED && count > decoder->remaining)
+                count = decoder->remaining;
 
-    return pb_read(stream, (pb_byte_t*)field->pData, (size_t)field->data_size);
+            while (used < count && !*complete)
+            {
+                pb_byte_t byte = buf[used++];
+                decoder->buf[decoder->buf_len++] = byte;
+
+                if (decoder->value_len == 0)
+                    *complete = ((byte & 0x80) == 0 || decoder->buf_len == sizeof(decoder->buf));
+                else
+                    *complete = (decoder->buf_len == decoder->value_len);
+            }
+
+            if (decoder->state == PB_PUSH_ST_PACKED)
+                decoder->remaining -= used;
+            break;
+    }
+
+    decoder->position += used;
+    return used;
 }
 
-#ifdef PB_CONVERT_DOUBLE_FLOAT
-bool pb_decode_double_as_float(pb_istream_t *stream, float *dest)
+bool pb_push_decoder_init(pb_push_decoder_t *decoder, const pb_msgdesc_t *fields, void *dest_struct, unsigned int flags)
 {
-    uint_least8_t sign;
-    int exponent;
-    uint32_t mantissa;
-    uint64_t value;
-    union { float f; uint32_t i; } out;
+    decoder->depth = 0;
+    decoder->position = 0;
+    decoder->remaining = 0;
+    decoder->dest = NULL;
+    decoder->flags = (uint_least8_t)flags;
+#ifndef PB_NO_ERRMSG
+    decoder->errmsg = NULL;
+#endif
 
-    if (!pb_decode_fixed64(stream, &value))
+    if (!push_enter_message(decoder, fields, dest_struct, (size_t)-1,
+                            (flags & PB_DECODE_NOINIT) == 0))
+    {
+        decoder->state = PB_PUSH_ST_ERROR;
         return false;
+    }
 
-    /* Decompose input value */
-    sign = (uint_least8_t)((value >> 63) & 1);
-    exponent = (int)((value >> 52) & 0x7FF) - 1023;
-    mantissa = (value >> 28) & 0xFFFFFF; /* Highest 24 bits */
+    if (flags & PB_DECODE_DELIMITED)
+        push_set_state(decoder, PB_PUSH_ST_PREFIX, 0);
 
-    /* Figure if value is in range representable by floats. */
-    if (exponent == 1024)
-    {
-        /* Special value */
-        exponent = 128;
-        mantissa >>= 1;
-    }
-    else
+    return true;
+}
+
+pb_push_status_t pb_push_decode(pb_push_decoder_t *decoder, const pb_byte_t *buf, size_t count, size_t *consumed)
+{
+    size_t used = 0;
+    bool status = true;
+
+    while (status && decoder->state != PB_PUSH_ST_DONE && decoder->state != PB_PUSH_ST_ERROR)
     {
-        if (exponent > 127)
+        size_t avail;
+        bool complete;
+
+        if (decoder->state == PB_PUSH_ST_TAG && decoder->buf_len == 0)
         {
-            /* Too large, convert to infinity */
-            exponent = 128;
-            mantissa = 0;
+            /* Close all the messages that end at this position */
+            while (status && decoder->depth > 0 &&
+                   decoder->position == decoder->frames[decoder->depth - 1].end)
+            {
+                status = push_leave_message(decoder);
+            }
+
+            if (!status)
+                break;
+
+            if (decoder->depth == 0)
+            {
+                push_set_state(decoder, PB_PUSH_ST_DONE, 0);
+                break;
+            }
         }
-        else if (exponent < -150)
+
+        /* Don't read past the end of the current message */
+        avail = count - used;
+        if (avail > decoder->frames[decoder->depth - 1].end - decoder->position)
+            avail = decoder->frames[decoder->depth - 1].end - decoder->position;
+
+        if (avail == 0)
         {
-            /* Too small, convert to zero */
-            exponent = -127;
-            mantissa = 0;
+            if (used < count)
+            {
+                PB_SET_ERROR(decoder, "end-of-stream");
+                status = false;
+            }
+            break;
         }
-        else if (exponent < -126)
+
+        if (decoder->state == PB_PUSH_ST_PACKED && decoder->buf_len == 0 &&
+            *(pb_size_t*)decoder->iter.pSize >= decoder->iter.array_size)
         {
-            /* Denormalized */
-            mantissa |= 0x1000000;
-            mantissa >>= (-126 - exponent);
-            exponent = -127;
+            PB_SET_ERROR(decoder, "array overflow");
+            status = false;
+            break;
         }
 
-        /* Round off mantissa */
-        mantissa = (mantissa + 1) >> 1;
+        used += push_consume(decoder, buf + used, avail, &complete);
 
-        /* Check if mantissa went over 2.0 */
-        if (mantissa & 0x800000)
+        if (complete)
         {
-            exponent += 1;
-            mantissa &= 0x7FFFFF;
-            mantissa >>= 1;
+            if (decoder->value_len == 0 && decoder->buf_len == sizeof(decoder->buf) &&
+                (decoder->buf[sizeof(decoder->buf) - 1] & 0x80))
+            {
+                PB_SET_ERROR(decoder, "varint overflow");
+                status = false;
+            }
+            else
+            {
+                status = push_complete(decoder);
+            }
+        }
+        else if (decoder->state == PB_PUSH_ST_PACKED && decoder->remaining == 0)
+        {
+            PB_SET_ERROR(decoder, "end-of-stream");
+            status = false;
         }
     }
 
-    /* Combine fields */
-    out.i = mantissa;
-    out.i |= (uint32_t)(exponent + 127) << 23;
-    out.i |= (uint32_t)sign << 31;
+    if (consumed)
+        *consumed = used;
 
-    *dest = out.f;
-    return true;
+    if (!status)
+        decoder->state = PB_PUSH_ST_ERROR;
+
+    if (decoder->state == PB_PUSH_ST_DONE)
+        return PB_PUSH_DONE;
+    else if (decoder->state == PB_PUSH_ST_ERROR)
+        return PB_PUSH_ERROR;
+    else
+        return PB_PUSH_NEED_MORE;
+}
+
+pb_push_status_t pb_push_decode_finish(pb_push_decoder_t *decoder)
+{
+    if (decoder->state == PB_PUSH_ST_TAG && decoder->buf_len == 0 &&
+        decoder->depth == 1 && decoder->frames[0].end == (size_t)-1)
+    {
+        if (push_leave_message(decoder))
+            decoder->state = PB_PUSH_ST_DONE;
+        else
+            decoder->state = PB_PUSH_ST_ERROR;
+    }
+    else if (decoder->state != PB_PUSH_ST_DONE && decoder->state != PB_PUSH_ST_ERROR)
+    {
+        PB_SET_ERROR(decoder, "end-of-stream");
+        decoder->state = PB_PUSH_ST_ERROR;
+    }
+
+    if (decoder->state == PB_PUSH_ST_DONE)
+        return PB_PUSH_DONE;
+    else
+        return PB_PUSH_ERROR;
 }
 #endif
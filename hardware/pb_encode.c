@@ -22,7 +22,24 @@
  * Declarations internal to this file *
  **************************************/
 static bool checkreturn buf_write(pb_ostream_t *stream, const pb_byte_t *buf, size_t count);
+#if !defined(PB_BUFFER_ONLY) && defined(PB_ENABLE_BUFFERED_STREAM)
+static bool checkreturn buffered_write(pb_ostream_t *stream, const pb_byte_t *buf, size_t count);
+#endif
+#if !defined(PB_BUFFER_ONLY) && defined(PB_ENABLE_IOVEC_STREAM)
+static bool checkreturn iovec_write(pb_ostream_t *stream, const pb_byte_t *buf, size_t count);
+static bool checkreturn iovec_reference(pb_ostream_t *stream, const pb_byte_t *buf, size_t count);
+#endif
+#if !defined(PB_BUFFER_ONLY) && defined(PB_ENABLE_RING_STREAM)
+static bool checkreturn ring_write(pb_ostream_t *stream, const pb_byte_t *buf, size_t count);
+#endif
+#if !defined(PB_BUFFER_ONLY) && defined(PB_ENABLE_TEE_STREAM)
+static bool checkreturn tee_write(pb_ostream_t *stream, const pb_byte_t *buf, size_t count);
+#endif
+static bool checkreturn encode_field_data(pb_ostream_t *stream, const pb_byte_t *buffer, size_t size);
 static bool checkreturn encode_array(pb_ostream_t *stream, pb_field_iter_t *field);
+#ifndef PB_ENCODE_ARRAYS_UNPACKED
+static bool checkreturn packed_array_size(pb_ostream_t *stream, pb_field_iter_t *field, pb_size_t count, size_t *size);
+#endif
 static bool checkreturn pb_check_proto3_default_value(const pb_field_iter_t *field);
 static bool checkreturn encode_basic_field(pb_ostream_t *stream, const pb_field_iter_t *field);
 static bool checkreturn encode_callback_field(pb_ostream_t *stream, const pb_field_iter_t *field);
@@ -37,6 +54,7 @@ static bool checkreturn pb_enc_bytes(pb_ostream_t *stream, const pb_field_iter_t
 static bool checkreturn pb_enc_string(pb_ostream_t *stream, const pb_field_iter_t *field);
 static bool checkreturn pb_enc_submessage(pb_ostream_t *stream, const pb_field_iter_t *field);
 static bool checkreturn pb_enc_fixed_length_bytes(pb_ostream_t *stream, const pb_field_iter_t *field);
+static bool checkreturn pb_enc_view(pb_ostream_t *stream, const pb_field_iter_t *field);
 
 #ifdef PB_WITHOUT_64BIT
 #define pb_int64_t int32_t
@@ -98,12 +116,243 @@ bool checkreturn pb_write(pb_ostream_t *stream, const pb_byte_t *buf, size_t cou
         if (!stream->callback(stream, buf, count))
             PB_RETURN_ERROR(stream, "io error");
 #endif
+
+        PB_STATS_ADD(bytes_copied, count);
     }
     
     stream->bytes_written += count;
     return true;
 }
 
+#if !defined(PB_BUFFER_ONLY) && defined(PB_ENABLE_BUFFERED_STREAM)
+static bool checkreturn buffered_write(pb_ostream_t *stream, const pb_byte_t *buf, size_t count)
+{
+    pb_ostream_buffer_t *state = (pb_ostream_buffer_t*)stream->state;
+
+    if (count > state->size - state->used)
+    {
+        bool status = pb_ostream_buffer_flush(state);
+
+        /* Data that does not fit in the buffer is written directly */
+        if (status && count >= state->size)
+            status = pb_write(state->dest, buf, count);
+
+        if (!status)
+        {
+#ifndef PB_NO_ERRMSG
+            stream->errmsg = state->dest->errmsg;
+#endif
+            return false;
+        }
+
+        if (count >= state->size)
+            return true;
+    }
+
+    memcpy(state->buf + state->used, buf, count);
+    state->used += count;
+    return true;
+}
+
+pb_ostream_t pb_ostream_buffered(pb_ostream_buffer_t *state, pb_ostream_t *dest, pb_byte_t *buf, size_t size)
+{
+    pb_ostream_t stream;
+
+    state->dest = dest;
+    state->buf = buf;
+    state->size = size;
+    state->used = 0;
+
+    stream.callback = &buffered_write;
+    stream.state = state;
+    stream.max_size = (dest->max_size > dest->bytes_written) ? dest->max_size - dest->bytes_written : 0;
+    stream.bytes_written = 0;
+#ifndef PB_NO_ERRMSG
+    stream.errmsg = NULL;
+#endif
+    return stream;
+}
+
+bool checkreturn pb_ostream_buffer_flush(pb_ostream_buffer_t *state)
+{
+    if (!pb_write(state->dest, state->buf, state->used))
+        return false;
+
+    state->used = 0;
+    return true;
+}
+#endif
+
+#if !defined(PB_BUFFER_ONLY) && defined(PB_ENABLE_IOVEC_STREAM)
+/* Copy small writes to the scratch buffer, extending the last segment
+ * if it ends where the new data starts. */
+static bool checkreturn iovec_write(pb_ostream_t *stream, const pb_byte_t *buf, size_t count)
+{
+    pb_ostream_iovec_t *state = (pb_ostream_iovec_t*)stream->state;
+    pb_byte_t *dest = state->scratch + state->scratch_used;
+    pb_view_t *last = (state->count > 0) ? &state->segments[state->count - 1] : NULL;
+
+    if (count > state->scratch_size - state->scratch_used)
+        PB_RETURN_ERROR(stream, "iovec scratch full");
+
+    if (last == NULL || last->ptr + last->len != dest)
+    {
+        if (state->count >= state->max_segments)
+            PB_RETURN_ERROR(stream, "too many segments");
+
+        last = &state->segments[state->count++];
+        last->ptr = dest;
+        last->len = 0;
+    }
+
+    memcpy(dest, buf, count);
+    state->scratch_used += count;
+    last->len += count;
+    return true;
+}
+
+/* Add a segment that points to data in the message structure */
+static bool checkreturn iovec_reference(pb_ostream_t *stream, const pb_byte_t *buf, size_t count)
+{
+    pb_ostream_iovec_t *state = (pb_ostream_iovec_t*)stream->state;
+
+    if (stream->bytes_written + count < stream->bytes_written ||
+        stream->bytes_written + count > stream->max_size)
+    {
+        PB_RETURN_ERROR(stream, "stream full");
+    }
+
+    if (state->count >= state->max_segments)
+        PB_RETURN_ERROR(stream, "too many segments");
+
+    state->segments[state->count].ptr = buf;
+    state->segments[state->count].len = count;
+    state->count++;
+    stream->bytes_written += count;
+    return true;
+}
+
+pb_ostream_t pb_ostream_iovec(pb_ostream_iovec_t *state, pb_view_t *segments, size_t max_segments, pb_byte_t *scratch, size_t scratch_size)
+{
+    pb_ostream_t stream;
+
+    state->segments = segments;
+    state->max_segments = max_segments;
+    state->count = 0;
+    state->scratch = scratch;
+    state->scratch_size = scratch_size;
+    state->scratch_used = 0;
+
+    stream.callback = &iovec_write;
+    stream.state = state;
+    stream.max_size = (size_t)-1;
+    stream.bytes_written = 0;
+#ifndef PB_NO_ERRMSG
+    stream.errmsg = NULL;
+#endif
+    return stream;
+}
+#endif
+
+#if !defined(PB_BUFFER_ONLY) && defined(PB_ENABLE_RING_STREAM)
+static bool checkreturn ring_write(pb_ostream_t *stream, const pb_byte_t *buf, size_t count)
+{
+    pb_ring_cursor_t *cursor = (pb_ring_cursor_t*)stream->state;
+    pb_ring_t *ring = cursor->ring;
+    size_t start = cursor->pos & ring->mask;
+    size_t first = ring->mask + 1 - start;
+
+    if (first > count)
+        first = count;
+
+    memcpy(ring->buf + start, buf, first);
+    memcpy(ring->buf, buf + first, count - first);
+    cursor->pos += count;
+    return true;
+}
+
+pb_ostream_t pb_ostream_from_ring(pb_ring_cursor_t *cursor, pb_ring_t *ring)
+{
+    pb_ostream_t stream;
+    size_t head, tail;
+
+    PB_RING_ATOMIC(head = ring->head; tail = ring->tail);
+
+    cursor->ring = ring;
+    cursor->pos = head;
+
+    stream.callback = &ring_write;
+    stream.state = cursor;
+    stream.max_size = ring->mask + 1 - (head - tail);
+    stream.bytes_written = 0;
+#ifndef PB_NO_ERRMSG
+    stream.errmsg = NULL;
+#endif
+    return stream;
+}
+
+void pb_ring_commit(pb_ring_cursor_t *cursor)
+{
+    PB_RING_BARRIER();
+    PB_RING_ATOMIC(cursor->ring->head = cursor->pos);
+}
+#endif
+
+#if !defined(PB_BUFFER_ONLY) && defined(PB_ENABLE_TEE_STREAM)
+
+static bool checkreturn tee_write(pb_ostream_t *stream, const pb_byte_t *buf, size_t count)
+{
+    pb_ostream_tee_t *state = (pb_ostream_tee_t*)stream->state;
+    bool status = false;
+    pb_size_t i;
+
+    if (state->count == 0)
+        PB_RETURN_ERROR(stream, "no tee sinks");
+
+    if (state->count > PB_TEE_MAX_SINKS)
+        PB_RETURN_ERROR(stream, "too many tee sinks");
+
+    for (i = 0; i < state->count; i++)
+    {
+        uint32_t bit = (uint32_t)1 << i;
+
+        if (state->failed & bit)
+            continue;
+
+        if (pb_write(&state->sinks[i], buf, count))
+            status = true;
+        else
+            state->failed |= bit;
+    }
+
+#ifndef PB_NO_ERRMSG
+    /* Report the error of the first sink when all of them have failed */
+    if (!status)
+        stream->errmsg = state->sinks[0].errmsg;
+#endif
+
+    return status;
+}
+
+pb_ostream_t pb_ostream_tee(pb_ostream_tee_t *state, pb_ostream_t *sinks, pb_size_t count)
+{
+    pb_ostream_t stream;
+
+    state->sinks = sinks;
+    state->count = count;
+    state->failed = 0;
+
+    stream.callback = &tee_write;
+    stream.state = state;
+    stream.max_size = (size_t)-1;
+    stream.bytes_written = 0;
+#ifndef PB_NO_ERRMSG
+    stream.errmsg = NULL;
+#endif
+    return stream;
+}
+#endif
+
 /*************************
  * Encode a single field *
  *************************/
@@ -124,6 +373,37 @@ static bool safe_read_bool(const void *pSize)
     return false;
 }
 
+#ifndef PB_ENCODE_ARRAYS_UNPACKED
+/* Determine the total size of packed array. */
+static bool checkreturn packed_array_size(pb_ostream_t *stream, pb_field_iter_t *field, pb_size_t count, size_t *size)
+{
+    if (PB_LTYPE(field->type) == PB_LTYPE_FIXED32)
+    {
+        *size = 4 * (size_t)count;
+    }
+    else if (PB_LTYPE(field->type) == PB_LTYPE_FIXED64)
+    {
+        *size = 8 * (size_t)count;
+    }
+    else
+    { 
+        pb_ostream_t sizestream = PB_OSTREAM_SIZING;
+        void *pData_orig = field->pData;
+        pb_size_t i;
+        for (i = 0; i < count; i++)
+        {
+            if (!pb_enc_varint(&sizestream, field))
+                PB_RETURN_ERROR(stream, PB_GET_ERROR(&sizestream));
+            field->pData = (char*)field->pData + field->data_size;
+        }
+        field->pData = pData_orig;
+        *size = sizestream.bytes_written;
+    }
+
+    return true;
+}
+#endif
+
 /* Encode a static array. Handles the size calculations and possible packing. */
 static bool checkreturn encode_array(pb_ostream_t *stream, pb_field_iter_t *field)
 {
@@ -148,28 +428,8 @@ static bool checkreturn encode_array(pb_ostream_t *stream, pb_field_iter_t *fiel
         if (!pb_encode_tag(stream, PB_WT_STRING, field->tag))
             return false;
         
-        /* Determine the total size of packed array. */
-        if (PB_LTYPE(field->type) == PB_LTYPE_FIXED32)
-        {
-            size = 4 * (size_t)count;
-        }
-        else if (PB_LTYPE(field->type) == PB_LTYPE_FIXED64)
-        {
-            size = 8 * (size_t)count;
-        }
-        else
-        { 
-            pb_ostream_t sizestream = PB_OSTREAM_SIZING;
-            void *pData_orig = field->pData;
-            for (i = 0; i < count; i++)
-            {
-                if (!pb_enc_varint(&sizestream, field))
-                    PB_RETURN_ERROR(stream, PB_GET_ERROR(&sizestream));
-                field->pData = (char*)field->pData + field->data_size;
-            }
-            field->pData = pData_orig;
-            size = sizestream.bytes_written;
-        }
+        if (!packed_array_size(stream, field, count, &size))
+            return false;
         
         if (!pb_encode_varint(stream, (pb_uint64_t)size))
             return false;
@@ -310,6 +570,10 @@ static bool checkreturn pb_check_proto3_default_value(const pb_field_iter_t *fie
              * it anyway. */
             return field->data_size == 0;
         }
+        else if (PB_LTYPE(type) == PB_LTYPE_VIEW)
+        {
+            return ((const pb_view_t*)field->pData)->len == 0;
+        }
         else if (PB_LTYPE_IS_SUBMSG(type))
         {
             /* Check all fields in the submessage to find if any of them
@@ -397,6 +661,9 @@ static bool checkreturn encode_basic_field(pb_ostream_t *stream, const pb_field_
         case PB_LTYPE_FIXED_LENGTH_BYTES:
             return pb_enc_fixed_length_bytes(stream, field);
 
+        case PB_LTYPE_VIEW:
+            return pb_enc_view(stream, field);
+
         default:
             PB_RETURN_ERROR(stream, "invalid field type");
     }
@@ -408,6 +675,7 @@ static bool checkreturn encode_callback_field(pb_ostream_t *stream, const pb_fie
 {
     if (field->descriptor->field_callback != NULL)
     {
+        PB_STATS_ADD(callbacks, 1);
         if (!field->descriptor->field_callback(NULL, stream, field))
             PB_RETURN_ERROR(stream, "callback error");
     }
@@ -557,6 +825,8 @@ bool checkreturn pb_encode_ex(pb_ostream_t *stream, const pb_msgdesc_t *fields,
 bool pb_get_encoded_size(size_t *size, const pb_msgdesc_t *fields, const void *src_struct)
 {
     pb_ostream_t stream = PB_OSTREAM_SIZING;
+
+    PB_STATS_ADD(sizing_passes, 1);
     
     if (!pb_encode(&stream, fields, src_struct))
         return false;
@@ -601,6 +871,7 @@ static bool checkreturn pb_encode_varint_32(pb_ostream_t *stream, uint32_t low,
 
     buffer[i++] = byte;
 
+    PB_STATS_ADD(varint_bytes, stream->callback != NULL ? i : 0);
     return pb_write(stream, buffer, i);
 }
 
@@ -610,6 +881,7 @@ bool checkreturn pb_encode_varint(pb_ostream_t *stream, pb_uint64_t value)
     {
         /* Fast path: single byte */
         pb_byte_t byte = (pb_byte_t)value;
+        PB_STATS_ADD(varint_bytes, stream->callback != NULL);
         return pb_write(stream, &byte, 1);
     }
     else
@@ -675,6 +947,7 @@ bool checkreturn pb_encode_fixed64(pb_ostream_t *stream, const void *value)
 bool checkreturn pb_encode_tag(pb_ostream_t *stream, pb_wire_type_t wiretype, uint32_t field_number)
 {
     pb_uint64_t tag = ((pb_uint64_t)field_number << 3) | wiretype;
+    PB_STATS_ADD(fields_encoded[wiretype & 7], stream->callback != NULL);
     return pb_encode_varint(stream, tag);
 }
 
@@ -703,6 +976,7 @@ bool pb_encode_tag_for_field ( pb_ostream_t* stream, const pb_field_iter_t* fiel
         case PB_LTYPE_SUBMESSAGE:
         case PB_LTYPE_SUBMSG_W_CB:
         case PB_LTYPE_FIXED_LENGTH_BYTES:
+        case PB_LTYPE_VIEW:
             wiretype = PB_WT_STRING;
             break;
         
@@ -721,6 +995,22 @@ bool checkreturn pb_encode_string(pb_ostream_t *stream, const pb_byte_t *buffer,
     return pb_write(stream, buffer, size);
 }
 
+/* Encode the contents of a string or bytes field. The data is stored in
+ * the message structure, so an iovec stream can refer to it instead of
+ * copying it. */
+static bool checkreturn encode_field_data(pb_ostream_t *stream, const pb_byte_t *buffer, size_t size)
+{
+#if !defined(PB_BUFFER_ONLY) && defined(PB_ENABLE_IOVEC_STREAM)
+    if (stream->callback == &iovec_write && size >= PB_IOVEC_MIN_REFERENCE)
+    {
+        return pb_encode_varint(stream, (pb_uint64_t)size) &&
+               iovec_reference(stream, buffer, size);
+    }
+#endif
+
+    return pb_encode_string(stream, buffer, size);
+}
+
 bool checkreturn pb_encode_submessage(pb_ostream_t *stream, const pb_msgdesc_t *fields, const void *src_struct)
 {
     /* First calculate the message size using a non-writing substream. */
@@ -729,6 +1019,8 @@ bool checkreturn pb_encode_submessage(pb_ostream_t *stream, const pb_msgdesc_t *
     bool status;
     size_t size;
 #endif
+
+    PB_STATS_ADD(sizing_passes, 1);
     
     if (!pb_encode(&substream, fields, src_struct))
     {
@@ -867,7 +1159,7 @@ static bool checkreturn pb_enc_bytes(pb_ostream_t *stream, const pb_field_iter_t
     if (bytes == NULL)
     {
         /* Treat null pointer as an empty bytes field */
-        return pb_encode_string(stream, NULL, 0);
+        return encode_field_data(stream, NULL, 0);
     }
     
     if (PB_ATYPE(field->type) == PB_ATYPE_STATIC &&
@@ -876,7 +1168,7 @@ static bool checkreturn pb_enc_bytes(pb_ostream_t *stream, const pb_field_iter_t
         PB_RETURN_ERROR(stream, "bytes size exceeded");
     }
     
-    return pb_encode_string(stream, bytes->bytes, (size_t)bytes->size);
+    return encode_field_data(stream, bytes->bytes, (size_t)bytes->size);
 }
 
 static bool checkreturn pb_enc_string(pb_ostream_t *stream, const pb_field_iter_t *field)
@@ -929,11 +1221,13 @@ static bool checkreturn pb_enc_string(pb_ostream_t *stream, const pb_field_iter_
         PB_RETURN_ERROR(stream, "invalid utf8");
 #endif
 
-    return pb_encode_string(stream, (const pb_byte_t*)str, size);
+    return encode_field_data(stream, (const pb_byte_t*)str, size);
 }
 
 static bool checkreturn pb_enc_submessage(pb_ostream_t *stream, const pb_field_iter_t *field)
 {
+    bool status;
+
     if (field->submsg_desc == NULL)
         PB_RETURN_ERROR(stream, "invalid field descriptor");
 
@@ -943,17 +1237,31 @@ static bool checkreturn pb_enc_submessage(pb_ostream_t *stream, const pb_field_i
         pb_callback_t *callback = (pb_callback_t*)field->pSize - 1;
         if (callback->funcs.encode)
         {
+            PB_STATS_ADD(callbacks, 1);
             if (!callback->funcs.encode(stream, field, &callback->arg))
                 return false;
         }
     }
     
-    return pb_encode_submessage(stream, field->submsg_desc, field->pData);
+    PB_STATS_ENTER_SUBMSG();
+    status = pb_encode_submessage(stream, field->submsg_desc, field->pData);
+    PB_STATS_LEAVE_SUBMSG();
+    return status;
 }
 
 static bool checkreturn pb_enc_fixed_length_bytes(pb_ostream_t *stream, const pb_field_iter_t *field)
 {
-    return pb_encode_string(stream, (const pb_byte_t*)field->pData, (size_t)field->data_size);
+    return encode_field_data(stream, (const pb_byte_t*)field->pData, (size_t)field->data_size);
+}
+
+static bool checkreturn pb_enc_view(pb_ostream_t *stream, const pb_field_iter_t *field)
+{
+    const pb_view_t *view = (const pb_view_t*)field->pData;
+
+    if (view->ptr == NULL && view->len > 0)
+        PB_RETURN_ERROR(stream, "invalid view");
+
+    return encode_field_data(stream, view->ptr, view->len);
 }
 
 #ifdef PB_CONVERT_DOUBLE_FLOAT
@@ -1004,3 +1312,391 @@ bool pb_encode_float_as_double(pb_ostream_t *stream, float value)
     return pb_encode_fixed64(stream, &mantissa);
 }
 #endif
+
+#ifdef PB_ENABLE_PULL_ENCODER
+/*********************************
+ * Incremental (pull) encoding   *
+ *********************************/
+
+/* States of pb_pull_encoder_t */
+#define PB_PULL_ST_RUNNING  0
+#define PB_PULL_ST_DONE     1
+#define PB_PULL_ST_ERROR    2
+
+/* Stream callback for staging the next piece of output. Small writes are
+ * copied to encoder->buf. A write that does not fit there is the contents
+ * of a string or bytes field, which is copied out directly from the
+ * source struct later. */
+static bool checkreturn pull_stage_write(pb_ostream_t *stream, const pb_byte_t *buf, size_t count)
+{
+    pb_pull_encoder_t *encoder = (pb_pull_encoder_t*)stream->state;
+
+    if (encoder->remaining == 0 && count <= sizeof(encoder->buf) - encoder->buf_len)
+    {
+        memcpy(encoder->buf + encoder->buf_len, buf, count);
+        encoder->buf_len = (uint_least8_t)(encoder->buf_len + count);
+        return true;
+    }
+    else if (encoder->remaining == 0)
+    {
+        encoder->src = buf;
+        encoder->remaining = count;
+        return true;
+    }
+
+    return false;
+}
+
+static pb_ostream_t pull_stage_stream(pb_pull_encoder_t *encoder)
+{
+    pb_ostream_t stream;
+    stream.callback = &pull_stage_write;
+    stream.state = encoder;
+    stream.max_size = (size_t)-1;
+    stream.bytes_written = 0;
+#ifndef PB_NO_ERRMSG
+    stream.errmsg = NULL;
+#endif
+    return stream;
+}
+
+static bool pull_stream_error(pb_pull_encoder_t *encoder, const pb_ostream_t *stream)
+{
+    PB_SET_ERROR(encoder, PB_GET_ERROR(stream));
+    PB_UNUSED(stream);
+    return false;
+}
+
+static bool checkreturn pull_enter_message(pb_pull_encoder_t *encoder, const pb_msgdesc_t *fields, const void *src_struct)
+{
+    pb_pull_frame_t *frame;
+
+    if (encoder->depth >= PB_PULL_MAX_DEPTH)
+        PB_RETURN_ERROR(encoder, "max depth exceeded");
+
+    frame = &encoder->frames[encoder->depth++];
+    frame->item = 0;
+    frame->in_field = false;
+    frame->finished = !pb_field_iter_begin_const(&frame->iter, fields, src_struct);
+    return true;
+}
+
+static void pull_next_field(pb_pull_frame_t *frame)
+{
+    frame->in_field = false;
+    frame->finished = !pb_field_iter_next(&frame->iter);
+}
+
+static bool pull_is_packed(const pb_field_iter_t *field)
+{
+#ifndef PB_ENCODE_ARRAYS_UNPACKED
+    return PB_HTYPE(field->type) == PB_HTYPE_REPEATED &&
+           PB_LTYPE(field->type) <= PB_LTYPE_LAST_PACKABLE;
+#else
+    PB_UNUSED(field);
+    return false;
+#endif
+}
+
+/* Check whether the field has data to encode. This mirrors the checks in
+ * encode_field() and encode_array(). */
+static bool checkreturn pull_field_present(pb_pull_encoder_t *encoder, const pb_field_iter_t *field, bool *present)
+{
+    *present = false;
+
+    if (PB_LTYPE(field->type) == PB_LTYPE_EXTENSION)
+    {
+        if (*(const pb_extension_t* const *)field->pData != NULL)
+            PB_RETURN_ERROR(encoder, "extensions not supported");
+        return true;
+    }
+    else if (PB_ATYPE(field->type) == PB_ATYPE_CALLBACK)
+    {
+        if (!pb_check_proto3_default_value(field))
+            PB_RETURN_ERROR(encoder, "callback fields not supported");
+        return true;
+    }
+    else if (PB_ATYPE(field->type) != PB_ATYPE_STATIC)
+    {
+        if (field->pData != NULL)
+            PB_RETURN_ERROR(encoder, "pointer fields not supported");
+        if (PB_HTYPE(field->type) == PB_HTYPE_REQUIRED)
+            PB_RETURN_ERROR(encoder, "missing required field");
+        return true;
+    }
+
+    if (PB_HTYPE(field->type) == PB_HTYPE_ONEOF)
+    {
+        if (*(const pb_size_t*)field->pSize != field->tag)
+            return true;
+    }
+    else if (PB_HTYPE(field->type) == PB_HTYPE_OPTIONAL)
+    {
+        if (field->pSize)
+        {
+            if (safe_read_bool(field->pSize) == false)
+                return true;
+        }
+        else if (pb_check_proto3_default_value(field))
+        {
+            return true;
+        }
+    }
+    else if (PB_HTYPE(field->type) == PB_HTYPE_REPEATED)
+    {
+        pb_size_t count = *(const pb_size_t*)field->pSize;
+
+        if (count == 0)
+            return true;
+
+        if (count > field->array_size)
+            PB_RETURN_ERROR(encoder, "array max size exceeded");
+    }
+
+    *present = true;
+    return true;
+}
+
+/* Stage the tag and contents of a single field value. For submessages,
+ * only the header is staged and a new frame is entered. */
+static bool checkreturn pull_stage_value(pb_pull_encoder_t *encoder, const pb_field_iter_t *field)
+{
+    pb_ostream_t stream = pull_stage_stream(encoder);
+
+    if (PB_LTYPE_IS_SUBMSG(field->type))
+    {
+        pb_ostream_t sizestream = PB_OSTREAM_SIZING;
+
+        if (field->submsg_desc == NULL)
+            PB_RETURN_ERROR(encoder, "invalid field descriptor");
+
+        if (PB_LTYPE(field->type) == PB_LTYPE_SUBMSG_W_CB && field->pSize != NULL)
+        {
+            /* Message callback is stored right before pSize. */
+            pb_callback_t *callback = (pb_callback_t*)field->pSize - 1;
+            if (callback->funcs.encode)
+                PB_RETURN_ERROR(encoder, "callback fields not supported");
+        }
+
+        if (!pb_encode(&sizestream, field->submsg_desc, field->pData))
+            return pull_stream_error(encoder, &sizestream);
+
+        if (!pb_encode_tag_for_field(&stream, field) ||
+            !pb_encode_varint(&stream, (pb_uint64_t)sizestream.bytes_written))
+        {
+            return pull_stream_error(encoder, &stream);
+        }
+
+        return pull_enter_message(encoder, field->submsg_desc, field->pData);
+    }
+
+    if (!encode_basic_field(&stream, field))
+        return pull_stream_error(encoder, &stream);
+
+    return true;
+}
+
+/* Advance the encoder until the next piece of output has been staged,
+ * or the end of the message has been reached. */
+static bool checkreturn pull_next(pb_pull_encoder_t *encoder)
+{
+    while (encoder->buf_len == 0 && encoder->remaining == 0)
+    {
+        pb_pull_frame_t *frame;
+        pb_field_iter_t *field;
+
+        if (encoder->depth == 0)
+        {
+            encoder->state = PB_PULL_ST_DONE;
+            return true;
+        }
+
+        frame = &encoder->frames[encoder->depth - 1];
+        field = &frame->iter;
+
+        if (frame->finished)
+        {
+            encoder->depth--;
+
+            if (encoder->depth == 0 && (encoder->flags & PB_ENCODE_NULLTERMINATED))
+                encoder->buf[encoder->buf_len++] = 0;
+
+            continue;
+        }
+
+        if (!frame->in_field)
+        {
+            bool present;
+            if (!pull_field_present(encoder, field, &present))
+                return false;
+
+            if (!present)
+            {
+                pull_next_field(frame);
+                continue;
+            }
+
+            frame->in_field = true;
+            frame->item = 0;
+
+#ifndef PB_ENCODE_ARRAYS_UNPACKED
+            if (pull_is_packed(field))
+            {
+                pb_ostream_t stream = pull_stage_stream(encoder);
+                size_t size;
+
+                if (!pb_encode_tag(&stream, PB_WT_STRING, field->tag) ||
+                    !packed_array_size(&stream, field, *(const pb_size_t*)field->pSize, &size) ||
+                    !pb_encode_varint(&stream, (pb_uint64_t)size))
+                {
+                    return pull_stream_error(encoder, &stream);
+                }
+                continue;
+            }
+#endif
+        }
+
+        if (PB_HTYPE(field->type) == PB_HTYPE_REPEATED)
+        {
+            if (frame->item >= *(const pb_size_t*)field->pSize)
+            {
+                pull_next_field(frame);
+                continue;
+            }
+
+            field->pData = (char*)field->pField + field->data_size * frame->item;
+            frame->item++;
+
+            if (pull_is_packed(field))
+            {
+                pb_ostream_t stream = pull_stage_stream(encoder);
+                bool status;
+
+                if (PB_LTYPE(field->type) == PB_LTYPE_FIXED32 || PB_LTYPE(field->type) == PB_LTYPE_FIXED64)
+                    status = pb_enc_fixed(&stream, field);
+                else
+                    status = pb_enc_varint(&stream, field);
+
+                if (!status)
+                    return pull_stream_error(encoder, &stream);
+            }
+            else if (!pull_stage_value(encoder, field))
+            {
+                return false;
+            }
+        }
+        else
+        {
+            if (!pull_stage_value(encoder, field))
+                return false;
+
+            pull_next_field(frame);
+        }
+    }
+
+    return true;
+}
+
+bool pb_pull_encoder_init(pb_pull_encoder_t *encoder, const pb_msgdesc_t *fields, const void *src_struct, unsigned int flags)
+{
+    encoder->depth = 0;
+    encoder->src = NULL;
+    encoder->remaining = 0;
+    encoder->state = PB_PULL_ST_RUNNING;
+    encoder->flags = (uint_least8_t)flags;
+    encoder->buf_pos = 0;
+    encoder->buf_len = 0;
+#ifndef PB_NO_ERRMSG
+    encoder->errmsg = NULL;
+#endif
+
+    if ((flags & PB_ENCODE_DELIMITED) != 0)
+    {
+        pb_ostream_t sizestream = PB_OSTREAM_SIZING;
+        pb_ostream_t stream = pull_stage_stream(encoder);
+
+        if (!pb_encode(&sizestream, fields, src_struct))
+        {
+            encoder->state = PB_PULL_ST_ERROR;
+            return pull_stream_error(encoder, &sizestream);
+        }
+
+        if (!pb_encode_varint(&stream, (pb_uint64_t)sizestream.bytes_written))
+        {
+            encoder->state = PB_PULL_ST_ERROR;
+            return pull_stream_error(encoder, &stream);
+        }
+    }
+
+    if (!pull_enter_message(encoder, fields, src_struct))
+    {
+        encoder->state = PB_PULL_ST_ERROR;
+        return false;
+    }
+
+    return true;
+}
+
+pb_pull_status_t pb_pull_encode(pb_pull_encoder_t *encoder, pb_byte_t *buf, size_t count, size_t *written)
+{
+    size_t used = 0;
+
+    while (encoder->state != PB_PULL_ST_ERROR)
+    {
+        size_t n;
+
+        if (encoder->buf_pos == encoder->buf_len)
+        {
+            encoder->buf_pos = encoder->buf_len = 0;
+        }
+
+        if (encoder->buf_len == 0 && encoder->remaining == 0)
+        {
+            /* Stage the next piece, so that PB_PULL_DONE is reported as
+             * soon as the last byte has been written out. */
+            if (encoder->state == PB_PULL_ST_DONE)
+                break;
+
+            if (!pull_next(encoder))
+                encoder->state = PB_PULL_ST_ERROR;
+
+            continue;
+        }
+
+        if (used == count)
+            break;
+
+        if (encoder->buf_len > 0)
+        {
+            n = (size_t)(encoder->buf_len - encoder->buf_pos);
+            if (n > count - used)
+                n = count - used;
+
+            memcpy(buf + used, encoder->buf + encoder->buf_pos, n);
+            encoder->buf_pos = (uint_least8_t)(encoder->buf_pos + n);
+        }
+        else
+        {
+            n = encoder->remaining;
+            if (n > count - used)
+                n = count - used;
+
+            memcpy(buf + used, encoder->src, n);
+            encoder->src += n;
+            encoder->remaining -= n;
+        }
+
+        used += n;
+    }
+
+    if (written)
+        *written = used;
+
+    if (encoder->state == PB_PULL_ST_DONE)
+        return PB_PULL_DONE;
+    else if (encoder->state == PB_PULL_ST_ERROR)
+        return PB_PULL_ERROR;
+    else
+        return PB_PULL_MORE;
+}
+#endif
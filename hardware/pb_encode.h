@@ -133,6 +133,136 @@ pb_ostream_t pb_ostream_from_buffer(pb_byte_t *buf, size_t bufsize);
  */
 bool pb_write(pb_ostream_t *stream, const pb_byte_t *buf, size_t count);
 
+#if !defined(PB_BUFFER_ONLY) && defined(PB_ENABLE_BUFFERED_STREAM)
+/* State of a buffered output stream. The fields are private. */
+typedef struct pb_ostream_buffer_s pb_ostream_buffer_t;
+struct pb_ostream_buffer_s
+{
+    pb_ostream_t *dest;
+    pb_byte_t *buf;
+    size_t size;
+    size_t used;
+};
+
+/* Create an output stream that collects the data in buf and writes it to
+ * another stream in blocks of up to size bytes. This reduces the number
+ * of calls to the callback of the destination stream, which otherwise
+ * happen for each field. max_size is taken from the space left in dest.
+ *
+ * The data is not written to dest until the buffer is full or
+ * pb_ostream_buffer_flush() is called, which must be done at the end.
+ * If writing fails, the error message is in dest->errmsg.
+ *
+ * Example usage:
+ *    pb_ostream_t uart_stream = {&uart_write, NULL, SIZE_MAX, 0};
+ *    pb_ostream_buffer_t state;
+ *    pb_byte_t buf[64];
+ *    pb_ostream_t stream = pb_ostream_buffered(&state, &uart_stream, buf, sizeof(buf));
+ *    pb_encode(&stream, MyMessage_fields, &msg) && pb_ostream_buffer_flush(&state);
+ */
+pb_ostream_t pb_ostream_buffered(pb_ostream_buffer_t *state, pb_ostream_t *dest, pb_byte_t *buf, size_t size);
+
+/* Write out the data collected in a buffered stream. */
+bool pb_ostream_buffer_flush(pb_ostream_buffer_t *state);
+#endif
+
+#if !defined(PB_BUFFER_ONLY) && defined(PB_ENABLE_IOVEC_STREAM)
+/* Minimum size of string and bytes fields that an iovec stream refers
+ * to in place. Shorter data is copied to the scratch buffer. */
+#ifndef PB_IOVEC_MIN_REFERENCE
+#define PB_IOVEC_MIN_REFERENCE 32
+#endif
+
+/* State of an iovec stream. The segments array and count can be read
+ * after encoding, the other fields are private. */
+typedef struct pb_ostream_iovec_s pb_ostream_iovec_t;
+struct pb_ostream_iovec_s
+{
+    pb_view_t *segments;
+    size_t max_segments;
+    size_t count;
+    pb_byte_t *scratch;
+    size_t scratch_size;
+    size_t scratch_used;
+};
+
+/* Create an output stream that collects a list of segments for
+ * scatter-gather output, such as writev(). Contents of string and bytes
+ * fields of at least PB_IOVEC_MIN_REFERENCE bytes become segments that
+ * point into the message structure, so they are not copied. All other
+ * data, such as tags, lengths and headers written with pb_write(), is
+ * copied to the scratch buffer, and consecutive writes share a segment.
+ *
+ * The message structure and the scratch buffer must stay valid until the
+ * segments have been written out. Encoding fails if the segments or the
+ * scratch buffer run out.
+ *
+ * Example usage:
+ *    pb_view_t segments[16];
+ *    pb_byte_t scratch[64];
+ *    pb_ostream_iovec_t state;
+ *    pb_ostream_t stream = pb_ostream_iovec(&state, segments, 16, scratch, sizeof(scratch));
+ *    pb_write(&stream, header, sizeof(header));
+ *    pb_encode(&stream, MyMessage_fields, &msg);
+ *    for (i = 0; i < state.count; i++)
+ *        iov[i].iov_base = (void*)segments[i].ptr, iov[i].iov_len = segments[i].len;
+ *    writev(fd, iov, state.count);
+ */
+pb_ostream_t pb_ostream_iovec(pb_ostream_iovec_t *state, pb_view_t *segments, size_t max_segments, pb_byte_t *scratch, size_t scratch_size);
+#endif
+
+#if !defined(PB_BUFFER_ONLY) && defined(PB_ENABLE_RING_STREAM)
+/* Create an output stream that writes to a ring buffer, wrapping around
+ * at the end. max_size is set to the free space in the ring. The data
+ * is not visible to the consumer until pb_ring_commit() is called, so a
+ * frame that fails to encode or does not fit leaves the ring unchanged.
+ * Only one producer may write to a ring at a time.
+ *
+ * Example usage:
+ *    pb_ring_cursor_t cursor;
+ *    pb_ostream_t stream = pb_ostream_from_ring(&cursor, &uart_tx_ring);
+ *    if (pb_encode_ex(&stream, MyMessage_fields, &msg, PB_ENCODE_DELIMITED))
+ *        pb_ring_commit(&cursor);
+ */
+pb_ostream_t pb_ostream_from_ring(pb_ring_cursor_t *cursor, pb_ring_t *ring);
+
+/* Publish the data written through the cursor to the consumer. */
+void pb_ring_commit(pb_ring_cursor_t *cursor);
+#endif
+
+#if !defined(PB_BUFFER_ONLY) && defined(PB_ENABLE_TEE_STREAM)
+/* Maximum number of child streams of a tee stream */
+#define PB_TEE_MAX_SINKS 32
+
+/* State of a tee stream. Bit i of failed is set when writing to sinks[i]
+ * has failed, the other fields are private. */
+typedef struct pb_ostream_tee_s pb_ostream_tee_t;
+struct pb_ostream_tee_s
+{
+    pb_ostream_t *sinks;
+    pb_size_t count;
+    uint32_t failed;
+};
+
+/* Create an output stream that writes the same data to each of count
+ * streams in the sinks array, so that a message is encoded only once for
+ * all of them. Each sink keeps its own max_size, bytes_written and errmsg.
+ * When a sink fails, it is left out of the remaining writes and the other
+ * sinks continue. Writing to the tee stream fails only when all of the
+ * sinks have failed. count must be from 1 to PB_TEE_MAX_SINKS, otherwise
+ * every write to the tee stream fails.
+ *
+ * Example usage:
+ *    pb_ostream_t sinks[3] = {uart_stream, log_stream, debug_stream};
+ *    pb_ostream_tee_t state;
+ *    pb_ostream_t stream = pb_ostream_tee(&state, sinks, 3);
+ *    pb_encode_ex(&stream, MyMessage_fields, &msg, PB_ENCODE_DELIMITED);
+ *    if (state.failed & 2)
+ *        printf("Log failed: %s\n", PB_GET_ERROR(&sinks[1]));
+ */
+pb_ostream_t pb_ostream_tee(pb_ostream_tee_t *state, pb_ostream_t *sinks, pb_size_t count);
+#endif
+
 
 /************************************************
  * Helper functions for writing field callbacks *
@@ -188,6 +318,88 @@ bool pb_encode_float_as_double(pb_ostream_t *stream, float value);
  */
 bool pb_encode_submessage(pb_ostream_t *stream, const pb_msgdesc_t *fields, const void *src_struct);
 
+#ifdef PB_ENABLE_PULL_ENCODER
+/*********************************
+ * Incremental (pull) encoding   *
+ *********************************/
+
+#ifdef PB_BUFFER_ONLY
+#error PB_ENABLE_PULL_ENCODER cannot be used together with PB_BUFFER_ONLY
+#endif
+
+/* Maximum nesting depth handled by the pull encoder, counting the
+ * top-level message. Each level takes one pb_pull_frame_t of memory. */
+#ifndef PB_PULL_MAX_DEPTH
+#define PB_PULL_MAX_DEPTH 8
+#endif
+
+typedef enum {
+    PB_PULL_MORE = 0,  /* Output buffer filled, more data remains */
+    PB_PULL_DONE = 1,  /* Whole message has been written */
+    PB_PULL_ERROR = 2  /* Encoding failed, see errmsg */
+} pb_pull_status_t;
+
+/* Encoding state of one (sub)message. */
+typedef struct {
+    pb_field_iter_t iter;
+    pb_size_t item;   /* Next item of a repeated field */
+    bool in_field;    /* Encoding of the field in iter has started */
+    bool finished;    /* All fields have been encoded */
+} pb_pull_frame_t;
+
+/* State object for producing an encoded message a few bytes at a time,
+ * for example to fill whatever space there is in an UART transmit buffer
+ * without staging the whole message in RAM. The contents are private,
+ * use the functions below.
+ *
+ * Only statically allocated fields are supported. Callback fields
+ * without an encode function are skipped, other callback and pointer
+ * fields and extensions cause an error.
+ *
+ * Submessage sizes are calculated when the encoder reaches them, so the
+ * source struct must not be modified until encoding has finished.
+ */
+typedef struct pb_pull_encoder_s pb_pull_encoder_t;
+struct pb_pull_encoder_s
+{
+    pb_pull_frame_t frames[PB_PULL_MAX_DEPTH];
+    const pb_byte_t *src;
+    size_t remaining;
+    pb_size_t depth;
+    uint_least8_t state;
+    uint_least8_t flags;
+    uint_least8_t buf_pos;
+    uint_least8_t buf_len;
+    pb_byte_t buf[16];
+
+#ifndef PB_NO_ERRMSG
+    /* Pointer to constant (ROM) string when encoding has failed */
+    const char *errmsg;
+#endif
+};
+
+/* Prepare the encoder for a new message. Flags are the same as for
+ * pb_encode_ex(). */
+bool pb_pull_encoder_init(pb_pull_encoder_t *encoder, const pb_msgdesc_t *fields, const void *src_struct, unsigned int flags);
+
+/* Write up to count bytes of the encoded message to buf. The buffer is
+ * always filled completely unless the end of the message is reached.
+ * The number of bytes written is stored to *written, if it is not NULL.
+ *
+ * Example usage:
+ *    pb_pull_encoder_init(&encoder, MyMessage_fields, &msg, 0);
+ *
+ *    do {
+ *        uint8_t chunk[16];
+ *        size_t space = Serial.availableForWrite();
+ *        if (space > sizeof(chunk)) space = sizeof(chunk);
+ *        status = pb_pull_encode(&encoder, chunk, space, &len);
+ *        Serial.write(chunk, len);
+ *    } while (status == PB_PULL_MORE);
+ */
+pb_pull_status_t pb_pull_encode(pb_pull_encoder_t *encoder, pb_byte_t *buf, size_t count, size_t *written);
+#endif
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif
@@ -0,0 +1,302 @@
+/* pb_batch.c -- process arrays of records with multiple threads
+ *
+ * Each thread owns a range of record indexes, and takes small chunks
+ * from the start of it. When its own range is empty, the thread steals
+ * the upper half of the range of another thread. The results are stored
+ * by index, so the order of the records does not depend on the threads.
+ */
+
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200112L
+#endif
+
+#include <pthread.h>
+#include "pb_batch.h"
+
+/* Function called for each record. Returns false if the record failed. */
+typedef bool (*batch_job_t)(void *ctx, size_t index);
+
+typedef struct {
+    pthread_mutex_t lock;
+    size_t next;
+    size_t end;
+} batch_range_t;
+
+typedef struct {
+    batch_job_t job;
+    void *ctx;
+    size_t count;
+    unsigned int workers;
+    batch_range_t ranges[PB_BATCH_MAX_THREADS];
+    pthread_mutex_t result_lock;
+    size_t failed_index; /* Equal to count if nothing has failed */
+} batch_pool_t;
+
+typedef struct {
+    batch_pool_t *pool;
+    unsigned int id;
+} batch_worker_t;
+
+/* Take the next chunk from the start of a range */
+static bool take_chunk(batch_range_t *range, size_t *begin, size_t *end)
+{
+    pthread_mutex_lock(&range->lock);
+    *begin = range->next;
+    *end = range->end;
+    if (*end - *begin > PB_BATCH_CHUNK)
+        *end = *begin + PB_BATCH_CHUNK;
+    range->next = *end;
+    pthread_mutex_unlock(&range->lock);
+
+    return *begin < *end;
+}
+
+/* Move the upper half of the range of some other worker to our range */
+static bool steal_range(batch_pool_t *pool, unsigned int id)
+{
+    unsigned int i;
+
+    for (i = 1; i < pool->workers; i++)
+    {
+        batch_range_t *victim = &pool->ranges[(id + i) % pool->workers];
+        batch_range_t *own = &pool->ranges[id];
+        size_t begin, end;
+
+        pthread_mutex_lock(&victim->lock);
+        begin = victim->next + (victim->end - victim->next) / 2;
+        end = victim->end;
+        victim->end = begin;
+        pthread_mutex_unlock(&victim->lock);
+
+        if (begin < end)
+        {
+            pthread_mutex_lock(&own->lock);
+            own->next = begin;
+            own->end = end;
+            pthread_mutex_unlock(&own->lock);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void *batch_worker(void *arg)
+{
+    batch_worker_t *worker = (batch_worker_t*)arg;
+    batch_pool_t *pool = worker->pool;
+    size_t failed_index = pool->count;
+    size_t begin, end, i;
+
+    for (;;)
+    {
+        if (!take_chunk(&pool->ranges[worker->id], &begin, &end))
+        {
+            if (!steal_range(pool, worker->id))
+                break;
+            continue;
+        }
+
+        for (i = begin; i < end; i++)
+        {
+            if (!pool->job(pool->ctx, i) && i < failed_index)
+                failed_index = i;
+        }
+    }
+
+    pthread_mutex_lock(&pool->result_lock);
+    if (failed_index < pool->failed_index)
+        pool->failed_index = failed_index;
+    pthread_mutex_unlock(&pool->result_lock);
+
+    return NULL;
+}
+
+/* Call job for indexes 0 to count - 1 using thread_count threads.
+ * Returns false if any of the calls failed. */
+static bool run_batch(batch_job_t job, void *ctx, size_t count,
+                      unsigned int thread_count, size_t *failed_index)
+{
+    batch_pool_t pool;
+    batch_worker_t workers[PB_BATCH_MAX_THREADS];
+    pthread_t threads[PB_BATCH_MAX_THREADS];
+    bool started[PB_BATCH_MAX_THREADS];
+    size_t per_worker, extra;
+    unsigned int i;
+
+    if (thread_count == 0)
+        thread_count = 1;
+    if (thread_count > PB_BATCH_MAX_THREADS)
+        thread_count = PB_BATCH_MAX_THREADS;
+    if (thread_count > count)
+        thread_count = (count > 0) ? (unsigned int)count : 1;
+
+    pool.job = job;
+    pool.ctx = ctx;
+    pool.count = count;
+    pool.workers = thread_count;
+    pool.failed_index = count;
+    pthread_mutex_init(&pool.result_lock, NULL);
+
+    /* Give each worker an equal share to start with */
+    per_worker = count / thread_count;
+    extra = count % thread_count;
+    for (i = 0; i < thread_count; i++)
+    {
+        batch_range_t *range = &pool.ranges[i];
+        pthread_mutex_init(&range->lock, NULL);
+        range->next = i * per_worker + (i < extra ? i : extra);
+        range->end = range->next + per_worker + (i < extra ? 1 : 0);
+        workers[i].pool = &pool;
+        workers[i].id = i;
+    }
+
+    /* If a thread cannot be started, the others will steal its work. */
+    for (i = 1; i < thread_count; i++)
+    {
+        started[i] = (pthread_create(&threads[i], NULL, batch_worker, &workers[i]) == 0);
+    }
+
+    batch_worker(&workers[0]);
+
+    for (i = 1; i < thread_count; i++)
+    {
+        if (started[i])
+            pthread_join(threads[i], NULL);
+    }
+
+    for (i = 0; i < thread_count; i++)
+    {
+        pthread_mutex_destroy(&pool.ranges[i].lock);
+    }
+    pthread_mutex_destroy(&pool.result_lock);
+
+    if (pool.failed_index < count)
+    {
+        if (failed_index)
+            *failed_index = pool.failed_index;
+        return false;
+    }
+
+    return true;
+}
+
+/*************************
+ * Batch decoding        *
+ *************************/
+
+typedef struct {
+    const pb_view_t *records;
+    const pb_msgdesc_t *fields;
+    pb_byte_t *dest;
+    size_t struct_size;
+    unsigned int flags;
+} decode_batch_t;
+
+static bool decode_record(void *ctx, size_t index)
+{
+    decode_batch_t *batch = (decode_batch_t*)ctx;
+    const pb_view_t *record = &batch->records[index];
+    pb_istream_t stream = pb_istream_from_buffer(record->ptr, record->len);
+
+    return pb_decode_ex(&stream, batch->fields,
+                        batch->dest + index * batch->struct_size, batch->flags);
+}
+
+bool pb_decode_batch(const pb_view_t *records, size_t count,
+                     const pb_msgdesc_t *fields, void *dest, size_t struct_size,
+                     unsigned int flags, unsigned int thread_count,
+                     size_t *failed_index)
+{
+    decode_batch_t batch;
+    batch.records = records;
+    batch.fields = fields;
+    batch.dest = (pb_byte_t*)dest;
+    batch.struct_size = struct_size;
+    batch.flags = flags;
+
+    return run_batch(decode_record, &batch, count, thread_count, failed_index);
+}
+
+/*************************
+ * Batch encoding        *
+ *************************/
+
+typedef struct {
+    const pb_byte_t *src;
+    size_t struct_size;
+    const pb_msgdesc_t *fields;
+    pb_view_t *records;
+    pb_byte_t *buf;
+} encode_batch_t;
+
+static size_t varint_size(size_t value)
+{
+    size_t size = 1;
+    while (value > 0x7F)
+    {
+        value >>= 7;
+        size++;
+    }
+    return size;
+}
+
+static bool size_record(void *ctx, size_t index)
+{
+    encode_batch_t *batch = (encode_batch_t*)ctx;
+    batch->records[index].ptr = NULL;
+    return pb_get_encoded_size(&batch->records[index].len, batch->fields,
+                               batch->src + index * batch->struct_size);
+}
+
+static bool encode_record(void *ctx, size_t index)
+{
+    encode_batch_t *batch = (encode_batch_t*)ctx;
+    const pb_view_t *record = &batch->records[index];
+    size_t prefix = varint_size(record->len);
+    pb_byte_t *start = batch->buf + (record->ptr - batch->buf) - prefix;
+    pb_ostream_t stream = pb_ostream_from_buffer(start, prefix + record->len);
+
+    /* The buffer has exactly the computed size, so a callback that
+     * writes more data the second time fails. Less data is checked. */
+    return pb_encode_varint(&stream, record->len) &&
+           pb_encode(&stream, batch->fields, batch->src + index * batch->struct_size) &&
+           stream.bytes_written == prefix + record->len;
+}
+
+bool pb_encode_batch(const void *src, size_t count, size_t struct_size,
+                     const pb_msgdesc_t *fields, pb_byte_t *buf, size_t bufsize,
+                     pb_view_t *records, unsigned int thread_count,
+                     size_t *bytes_written)
+{
+    encode_batch_t batch;
+    size_t offset = 0;
+    size_t i;
+
+    batch.src = (const pb_byte_t*)src;
+    batch.struct_size = struct_size;
+    batch.fields = fields;
+    batch.records = records;
+    batch.buf = buf;
+
+    *bytes_written = 0;
+    if (!run_batch(size_record, &batch, count, thread_count, NULL))
+        return false;
+
+    for (i = 0; i < count; i++)
+    {
+        size_t len = records[i].len;
+        offset += varint_size(len);
+        if (buf != NULL && offset <= bufsize)
+            records[i].ptr = buf + offset;
+        offset += len;
+    }
+
+    *bytes_written = offset;
+    if (buf == NULL)
+        return true;
+    if (offset > bufsize)
+        return false;
+
+    return run_batch(encode_record, &batch, count, thread_count, NULL);
+}
@@ -0,0 +1,88 @@
+/* pb_batch.h: Processing arrays of records with multiple threads.
+ *
+ * These functions are meant for host-side tools, such as replaying
+ * telemetry logs, and need POSIX threads. They are not part of the
+ * nanopb core: to use them, add pb_batch.c to your build, add the extra
+ * folder to your include path and link with -pthread.
+ */
+
+#ifndef PB_BATCH_H_INCLUDED
+#define PB_BATCH_H_INCLUDED
+
+#include "pb_decode.h"
+#include "pb_encode.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Upper limit for the number of threads used by one call. */
+#ifndef PB_BATCH_MAX_THREADS
+#define PB_BATCH_MAX_THREADS 64
+#endif
+
+/* Number of records that a thread takes at a time. Smaller values
+ * balance the load better, larger values reduce locking. */
+#ifndef PB_BATCH_CHUNK
+#define PB_BATCH_CHUNK 64
+#endif
+
+/* Decode records[i] into the structure at dest + i * struct_size, for
+ * each i from 0 to count - 1. The records are divided between
+ * thread_count threads, one of which is the calling thread. Threads that
+ * run out of work take the remaining records from the others, so the
+ * load is balanced even when the records differ in size.
+ *
+ * The flags are the same as for pb_decode_ex(). The records must not
+ * contain the length prefix, so PB_DECODE_DELIMITED is not used; the
+ * views given by pb_index_delimited() are suitable as such.
+ *
+ * All records are decoded even if some of them fail. Returns false if
+ * any record failed, and stores the lowest failed index in *failed_index
+ * if it is not NULL. Like with pb_decode(), a failed record has already
+ * been released.
+ *
+ * If PB_ENABLE_MALLOC is used, pb_realloc() and pb_free() must be
+ * thread safe. Arenas cannot be used, as there is no input stream to
+ * attach them to.
+ *
+ * Example usage:
+ *    pb_index_delimited(buf, size, records, max, &count);
+ *    pb_decode_batch(records, count, SensorData_fields, msgs,
+ *                    sizeof(SensorData), 0, 4, &failed);
+ */
+bool pb_decode_batch(const pb_view_t *records, size_t count,
+                     const pb_msgdesc_t *fields, void *dest, size_t struct_size,
+                     unsigned int flags, unsigned int thread_count,
+                     size_t *failed_index);
+
+/* Encode the structures at src + i * struct_size, for each i from 0 to
+ * count - 1, into buf as length-delimited records. The output is the
+ * same as from calling pb_encode_ex() with PB_ENCODE_DELIMITED for each
+ * structure in turn.
+ *
+ * The sizes of all records are first computed in parallel, which gives
+ * the position of each record in the output. The records are then
+ * encoded in parallel directly into their final positions. A view of
+ * the message data of each record is stored in records, which must have
+ * room for count items.
+ *
+ * *bytes_written is set to the total size of the output. If buf is NULL,
+ * only the size is computed. Returns false if bufsize is too small or
+ * any record fails to encode. Field callbacks must be thread safe.
+ *
+ * Example usage:
+ *    pb_encode_batch(msgs, count, sizeof(SensorData), SensorData_fields,
+ *                    buf, sizeof(buf), records, 4, &size);
+ *    fwrite(buf, 1, size, logfile);
+ */
+bool pb_encode_batch(const void *src, size_t count, size_t struct_size,
+                     const pb_msgdesc_t *fields, pb_byte_t *buf, size_t bufsize,
+                     pb_view_t *records, unsigned int thread_count,
+                     size_t *bytes_written);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif
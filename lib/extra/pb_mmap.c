@@ -0,0 +1,75 @@
+/* pb_mmap.c -- read protocol buffers from memory-mapped files */
+
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200112L
+#endif
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "pb_mmap.h"
+
+bool pb_mmap_open(pb_mmap_file_t *file, const char *path)
+{
+    struct stat st;
+    void *data;
+    int fd;
+
+    file->data = NULL;
+    file->size = 0;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    if (fstat(fd, &st) != 0 || st.st_size < 0)
+    {
+        close(fd);
+        return false;
+    }
+
+    /* mmap() does not accept zero length */
+    if (st.st_size == 0)
+    {
+        close(fd);
+        return true;
+    }
+
+    data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    /* The mapping stays valid after the file is closed */
+    close(fd);
+
+    if (data == MAP_FAILED)
+        return false;
+
+    /* Logs are usually read from start to end */
+    posix_madvise(data, (size_t)st.st_size, POSIX_MADV_SEQUENTIAL);
+
+    file->data = (const pb_byte_t*)data;
+    file->size = (size_t)st.st_size;
+    return true;
+}
+
+void pb_mmap_close(pb_mmap_file_t *file)
+{
+    if (file->data != NULL)
+        munmap((void*)(size_t)file->data, file->size);
+
+    file->data = NULL;
+    file->size = 0;
+}
+
+pb_istream_t pb_istream_from_mmap(const pb_mmap_file_t *file, size_t offset)
+{
+    if (file->data == NULL || offset > file->size)
+        return pb_istream_from_buffer(NULL, 0);
+
+    return pb_istream_from_buffer(file->data + offset, file->size - offset);
+}
+
+void pb_record_iter_mmap(pb_record_iter_t *iter, const pb_mmap_file_t *file, size_t offset)
+{
+    pb_record_iter_init(iter, file->data, file->size, offset);
+}
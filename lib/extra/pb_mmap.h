@@ -0,0 +1,54 @@
+/* pb_mmap.h: Reading protocol buffers from memory-mapped files.
+ *
+ * The file is mapped read-only into memory, and decoded with the normal
+ * buffer streams, so there are no read() calls or copies. Records can be
+ * accessed in any order by their byte offset. This needs a POSIX system
+ * with mmap(). To use it, add pb_mmap.c to your build and the extra
+ * folder to your include path.
+ */
+
+#ifndef PB_MMAP_H_INCLUDED
+#define PB_MMAP_H_INCLUDED
+
+#include "pb_decode.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* A file mapped into memory. The fields are read-only. */
+typedef struct {
+    const pb_byte_t *data;
+    size_t size;
+} pb_mmap_file_t;
+
+/* Map the whole file at path. Returns false if the file cannot be
+ * opened or mapped. An empty file gives a NULL data with size 0.
+ * The data remains valid until pb_mmap_close(). */
+bool pb_mmap_open(pb_mmap_file_t *file, const char *path);
+
+/* Unmap the file. Streams, views and decoded pb_view_t fields that point
+ * to the file must not be used afterwards. */
+void pb_mmap_close(pb_mmap_file_t *file);
+
+/* Create an input stream that reads the file starting from a byte
+ * offset, up to the end of the file. */
+pb_istream_t pb_istream_from_mmap(const pb_mmap_file_t *file, size_t offset);
+
+/* Start iterating the length-delimited records of the file, starting
+ * from the record at offset.
+ *
+ * Example usage:
+ *    pb_mmap_open(&file, "telemetry.log");
+ *    pb_record_iter_mmap(&iter, &file, 0);
+ *    while (pb_record_next(&iter, &record))
+ *        pb_decode_lazy(&record, SensorData_fields, &msg);
+ *    pb_mmap_close(&file);
+ */
+void pb_record_iter_mmap(pb_record_iter_t *iter, const pb_mmap_file_t *file, size_t offset);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif
@@ -605,6 +605,7 @@ class Field(ProtoElement):
         self.data_item_size = None
         self.ctype = None
         self.fixed_count = False
+        self.lazy_submsg = None
         self.callback_datatype = field_options.callback_datatype
         self.math_include_required = False
         self.sort_by_tag = field_options.sort_by_tag
@@ -672,10 +673,25 @@ class Field(ProtoElement):
 
         # Check if the field can be implemented with static allocation
         # i.e. whether the data size is known.
-        if desc.type == FieldD.TYPE_STRING and self.max_size is None:
+        if field_options.view:
+            if desc.type not in (FieldD.TYPE_STRING, FieldD.TYPE_BYTES):
+                raise Exception("Field '%s' is defined as view, but it is "
+                                "not a string or bytes field." % self.name)
+
+            if field_options.type not in (nanopb_pb2.FT_DEFAULT, nanopb_pb2.FT_STATIC):
+                raise Exception("Field '%s' is defined as view, which requires "
+                                "static allocation." % self.name)
+        elif field_options.lazy:
+            if desc.type != FieldD.TYPE_MESSAGE:
+                raise Exception("Field '%s' is defined as lazy, but it is "
+                                "not a submessage field." % self.name)
+
+            if field_options.type not in (nanopb_pb2.FT_DEFAULT, nanopb_pb2.FT_STATIC):
+                raise Exception("Field '%s' is defined as lazy, which requires "
+                                "static allocation." % self.name)
+        elif desc.type == FieldD.TYPE_STRING and self.max_size is None:
             can_be_static = False
-
-        if desc.type == FieldD.TYPE_BYTES and self.max_size is None:
+        elif desc.type == FieldD.TYPE_BYTES and self.max_size is None:
             can_be_static = False
 
         # Decide how the field data will be allocated
@@ -719,6 +735,21 @@ class Field(ProtoElement):
             if self.default is not None:
                 self.default = self.ctype + self.default
             self.enc_size = None # Needs to be filled in when enum values are known
+        elif field_options.view:
+            # Pointer and length into the input buffer, the encoded size
+            # depends only on the data given at runtime.
+            self.pbtype = 'VIEW'
+            self.ctype = 'pb_view_t'
+            self.data_item_size = 16
+            self.view_of_string = (desc.type == FieldD.TYPE_STRING)
+        elif field_options.lazy:
+            # Encoded submessage is kept as a view, and decoded later
+            # through the accessor macro.
+            self.pbtype = 'VIEW'
+            self.ctype = 'pb_view_t'
+            self.data_item_size = 16
+            self.view_of_string = False
+            self.lazy_submsg = names_from_type_name(desc.type_name)
         elif desc.type == FieldD.TYPE_STRING:
             self.pbtype = 'STRING'
             self.ctype = 'char'
@@ -848,6 +879,8 @@ class Field(ProtoElement):
                 inner_init = '{0, {0}}'
             elif self.pbtype == 'FIXED_LENGTH_BYTES':
                 inner_init = '{0}'
+            elif self.pbtype == 'VIEW':
+                inner_init = '{NULL, 0}'
             elif self.pbtype in ('ENUM', 'UENUM'):
                 inner_init = '_%s_MIN' % Globals.naming_style.define_name(self.ctype)
             else:
@@ -863,6 +896,16 @@ class Field(ProtoElement):
                     inner_init = '{0, {0}}'
                 else:
                     inner_init = '{%d, {%s}}' % (len(data), ','.join(data))
+            elif self.pbtype == 'VIEW':
+                if self.view_of_string:
+                    data = self.default.encode('utf-8')
+                else:
+                    data = codecs.escape_decode(self.default)[0]
+                if len(data) == 0:
+                    inner_init = '{NULL, 0}'
+                else:
+                    literal = codecs.escape_encode(data)[0].decode('ascii').replace('"', '\\"')
+                    inner_init = '{(const pb_byte_t*)"%s", %d}' % (literal, len(data))
             elif self.pbtype == 'FIXED_LENGTH_BYTES':
                 data = codecs.escape_decode(self.default)[0]
                 data = ["0x%02x" % c for c in bytearray(data)]
@@ -1017,7 +1060,7 @@ class Field(ProtoElement):
         including the field tag. If the size cannot be determined, returns
         None.'''
 
-        if self.allocation != 'STATIC':
+        if self.allocation != 'STATIC' or self.pbtype == 'VIEW':
             return None
 
         if self.pbtype in ['MESSAGE', 'MSG_W_CB']:
@@ -1201,6 +1244,10 @@ class OneOf(Field):
         self.has_msg_cb = False
 
     def add_field(self, field):
+        if field.lazy_submsg is not None:
+            raise Exception("Field '%s' is defined as lazy, which is not "
+                            "supported inside oneof." % field.name)
+
         field.union_name = self.name
         field.rules = 'ONEOF'
         field.anonymous = self.anonymous
@@ -1531,6 +1578,12 @@ class Message(ProtoElement):
                         Globals.naming_style.var_name(field.name),
                         Globals.naming_style.type_name(field.ctype)
                     )
+            elif getattr(field, 'lazy_submsg', None) is not None:
+                result += "#define %s_%s_MSGTYPE %s\n" % (
+                    Globals.naming_style.type_name(self.name),
+                    Globals.naming_style.var_name(field.name),
+                    Globals.naming_style.type_name(field.lazy_submsg)
+                )
 
         return result
 
@@ -1555,6 +1608,24 @@ class Message(ProtoElement):
 
         return result
 
+    def lazy_accessors(self):
+        '''Macros for decoding the lazy submessage fields of this message'''
+        result = ''
+        for field in self.fields:
+            if getattr(field, 'lazy_submsg', None) is None:
+                continue
+
+            name = Globals.naming_style.func_name('%s_decode_%s' % (self.name, field.name))
+            var_name = Globals.naming_style.var_name(field.name)
+            fields = Globals.naming_style.define_name('%s_fields' % field.lazy_submsg)
+            if field.rules in ('REPEATED', 'FIXARRAY'):
+                result += '#define %s(msg, index, dest) pb_decode_lazy(&(msg)->%s[index], %s, dest)\n' % (
+                    name, var_name, fields)
+            else:
+                result += '#define %s(msg, dest) pb_decode_lazy(&(msg)->%s, %s, dest)\n' % (
+                    name, var_name, fields)
+        return result
+
     def fields_declaration_cpp_lookup(self, local_defines):
         result = 'template <>\n'
         result += 'struct MessageDescriptor<%s> {\n' % (self.name)
@@ -1576,6 +1647,66 @@ class Message(ProtoElement):
         result += '};'
         return result
 
+    def cpp_codec_supported(self, dependencies, visited = ()):
+        '''Return True if the templates in pb_codec.h can handle this message.
+        Only statically allocated fields are supported, and all submessages
+        have to be supported also. nanopb::decode() clears the message with
+        memset(), so the default values must be all zeros: no explicit
+        defaults, and no proto2 enums whose first value is non-zero.
+        '''
+        if self.packed or str(self.name) in visited:
+            return False
+
+        if self.default_value(dependencies):
+            return False
+
+        visited = visited + (str(self.name),)
+        for field in self.fields:
+            if isinstance(field, (OneOf, ExtensionRange)):
+                return False
+
+            if field.allocation != 'STATIC':
+                return False
+
+            if field.rules not in ['REQUIRED', 'OPTIONAL', 'SINGULAR', 'REPEATED']:
+                return False
+
+            if field.pbtype in ['MSG_W_CB', 'EXTENSION', 'VIEW']:
+                return False
+
+            if field.pbtype == 'MESSAGE':
+                submsg = dependencies.get(str(field.submsgname))
+                if submsg is None or not submsg.cpp_codec_supported(dependencies, visited):
+                    return False
+
+        return True
+
+    def fields_declaration_cpp_codec(self):
+        '''Return the MessageCodec specialization used by pb_codec.h.'''
+        type_name = Globals.naming_style.type_name(self.name)
+        sorted_fields = sorted(self.all_fields(), key = lambda x: x.tag)
+
+        entries = []
+        for field in sorted_fields:
+            var_name = Globals.naming_style.var_name(field.name)
+            entry = 'Field<%3d, PB_HTYPE_%s | PB_LTYPE_MAP_%s, &%s::%s' % (
+                field.tag, field.rules, field.pbtype, type_name, var_name)
+            if field.rules == 'OPTIONAL':
+                entry += ', &%s::has_%s' % (type_name, var_name)
+            elif field.rules == 'REPEATED':
+                entry += ', &%s::%s_count' % (type_name, var_name)
+            entries.append('        ' + entry + '>')
+
+        result = 'template <>\n'
+        result += 'struct MessageCodec<%s> {\n' % type_name
+        result += '    typedef FieldList<\n'
+        result += ',\n'.join(entries)
+        if entries:
+            result += '\n'
+        result += '    > fields;\n'
+        result += '};'
+        return result
+
     def fields_definition(self, dependencies):
         '''Return the field descriptor definition that goes in .pb.c file.'''
         width = self.required_descriptor_width(dependencies)
@@ -2146,6 +2277,12 @@ class ProtoFile:
                 Globals.naming_style.type_name(msg.name))
             yield '\n'
 
+            lazy_accessors = ''.join(msg.lazy_accessors() for msg in self.messages)
+            if lazy_accessors:
+                yield '/* Decoding of lazy submessage fields */\n'
+                yield lazy_accessors
+                yield '\n'
+
             yield '/* Maximum encoded size of messages (where known) */\n'
             messagesizes = []
             for msg in self.messages:
@@ -2247,6 +2384,24 @@ class ProtoFile:
             yield '#endif  /* __cplusplus */\n'
             yield '\n'
 
+        if options.cpp_codec:
+            codec_msgs = [msg for msg in self.messages if msg.cpp_codec_supported(self.dependencies)]
+            yield '\n'
+            yield '#if defined(__cplusplus) && __cplusplus >= 201703L\n'
+            try:
+                yield options.libformat % ('pb_codec.h')
+            except TypeError:
+                yield options.libformat.replace('pb.h', 'pb_codec.h')
+            yield '\n'
+            yield '/* Compile-time field lists for pb_codec.h */\n'
+            yield 'namespace nanopb {\n'
+            for msg in codec_msgs:
+                yield msg.fields_declaration_cpp_codec() + '\n'
+            yield '}  // namespace nanopb\n'
+            yield '\n'
+            yield '#endif  /* __cplusplus >= 201703L */\n'
+            yield '\n'
+
         if Globals.protoc_insertion_points:
             yield '/* @@protoc_insertion_point(eof) */\n'
 
@@ -2461,6 +2616,8 @@ optparser.add_option("--no-strip-path", dest="strip_path", action="store_false",
     help="Opposite of --strip-path (default since 0.4.0)")
 optparser.add_option("--cpp-descriptors", action="store_true",
     help="Generate C++ descriptors to lookup by type (e.g. pb_field_t for a message)")
+optparser.add_option("--cpp-codec", dest="cpp_codec", action="store_true", default=False,
+    help="Generate compile-time field lists for the header-only C++17 codec in pb_codec.h. Imported .proto files should be generated with this option also.")
 optparser.add_option("-T", "--no-timestamp", dest="notimestamp", action="store_true", default=True,
     help="Don't add timestamp to .pb.h and .pb.c preambles (default since 0.4.0)")
 optparser.add_option("-t", "--timestamp", dest="notimestamp", action="store_false", default=True,
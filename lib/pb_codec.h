@@ -0,0 +1,867 @@
+/* pb_codec.h: Header-only C++17 encoder and decoder for nanopb messages.
+ * Depends on pb_encode.c and pb_decode.c for the low-level stream functions.
+ *
+ * When nanopb_generator.py is run with --cpp-codec, it emits a
+ * nanopb::MessageCodec<> specialization for every message that only has
+ * statically allocated fields and all-zero default values. The
+ * specialization lists the fields as compile-time constants, so the
+ * templates below resolve the field types, tags and offsets at build time
+ * instead of interpreting pb_msgdesc_t at runtime. The wire format is
+ * identical to pb_encode() and pb_decode().
+ * PB_VALIDATE_UTF8 is not applied by these templates.
+ *
+ * Usage:
+ *     pb_ostream_t stream = pb_ostream_from_buffer(buf, sizeof(buf));
+ *     nanopb::encode(&stream, msg);
+ */
+
+#ifndef PB_CODEC_H_INCLUDED
+#define PB_CODEC_H_INCLUDED
+
+#include "pb.h"
+#include "pb_encode.h"
+#include "pb_decode.h"
+
+#if !defined(__cplusplus) || __cplusplus < 201703L
+#error pb_codec.h requires C++17 or newer
+#endif
+
+/* Only the language core is used, no standard library headers, so that the
+ * header works also on toolchains that ship without libstdc++ (e.g. AVR). */
+extern "C++"
+{
+namespace nanopb {
+
+// Specialized by the generator for each message, see --cpp-codec.
+// The specialization contains a single typedef: fields = FieldList<...>.
+template <typename GenMessageT> struct MessageCodec;
+
+// Compile-time description of a single static field.
+// Type is PB_HTYPE_x | PB_LTYPE_x, same as in the FIELDLIST macros.
+// SizeMember points to the has_ field for optional fields and to the
+// _count field for repeated fields.
+template <pb_size_t Tag, pb_type_t Type, auto Member, auto SizeMember = nullptr>
+struct Field;
+
+template <typename... Fields>
+struct FieldList;
+
+namespace detail {
+
+#ifdef PB_WITHOUT_64BIT
+typedef int32_t codec_int_t;
+typedef uint32_t codec_uint_t;
+#else
+typedef int64_t codec_int_t;
+typedef uint64_t codec_uint_t;
+#endif
+
+template <typename A, typename B> struct is_same { static constexpr bool value = false; };
+template <typename A> struct is_same<A, A> { static constexpr bool value = true; };
+
+template <typename T> struct member_traits;
+template <typename C, typename M> struct member_traits<M C::*>
+{
+    typedef C class_type;
+    typedef M value_type;
+};
+
+template <typename T> struct array_traits
+{
+    typedef T item_type;
+    static constexpr pb_size_t count = 1;
+};
+template <typename T, size_t N> struct array_traits<T[N]>
+{
+    typedef T item_type;
+    static constexpr pb_size_t count = (pb_size_t)N;
+};
+
+// Integer types matching the data_size handling in pb_enc_varint()
+template <size_t Size> struct sized_int;
+template <> struct sized_int<1> { typedef int_least8_t s; typedef uint_least8_t u; };
+template <> struct sized_int<2> { typedef int_least16_t s; typedef uint_least16_t u; };
+template <> struct sized_int<4> { typedef int32_t s; typedef uint32_t u; };
+#ifndef PB_WITHOUT_64BIT
+template <> struct sized_int<8> { typedef int64_t s; typedef uint64_t u; };
+#endif
+
+// Field values are accessed through their byte representation, same as the
+// C implementation does. This keeps out-of-range enum values and invalid
+// bool values well defined.
+template <typename T>
+inline codec_int_t load_signed(const T &value)
+{
+    typename sized_int<sizeof(T)>::s tmp;
+    memcpy(&tmp, &value, sizeof(T));
+    return tmp;
+}
+
+template <typename T>
+inline codec_uint_t load_unsigned(const T &value)
+{
+    typename sized_int<sizeof(T)>::u tmp;
+    memcpy(&tmp, &value, sizeof(T));
+    return tmp;
+}
+
+template <typename T>
+inline bool store_signed(T &dest, codec_int_t value)
+{
+    typename sized_int<sizeof(T)>::s tmp = (typename sized_int<sizeof(T)>::s)value;
+    memcpy(&dest, &tmp, sizeof(T));
+    return tmp == value;
+}
+
+template <typename T>
+inline bool store_unsigned(T &dest, codec_uint_t value)
+{
+    typename sized_int<sizeof(T)>::u tmp = (typename sized_int<sizeof(T)>::u)value;
+    memcpy(&dest, &tmp, sizeof(T));
+    return tmp == value;
+}
+
+template <typename T>
+inline bool is_all_zero(const T &value)
+{
+    const char *p = (const char*)&value;
+    for (size_t i = 0; i < sizeof(T); i++)
+    {
+        if (p[i] != 0)
+            return false;
+    }
+    return true;
+}
+
+constexpr pb_wire_type_t wire_type_for(pb_type_t ltype)
+{
+    return (ltype <= PB_LTYPE_SVARINT) ? PB_WT_VARINT :
+           (ltype == PB_LTYPE_FIXED32) ? PB_WT_32BIT :
+           (ltype == PB_LTYPE_FIXED64) ? PB_WT_64BIT :
+           PB_WT_STRING;
+}
+
+// Field tag, pre-encoded as a varint at compile time.
+struct tag_bytes
+{
+    pb_byte_t data[5];
+    pb_size_t size;
+};
+
+constexpr tag_bytes make_tag_bytes(uint32_t tag, pb_wire_type_t wire_type)
+{
+    tag_bytes result = {{0, 0, 0, 0, 0}, 0};
+    uint32_t value = (tag << 3) | (uint32_t)wire_type;
+    while (value > 0x7F)
+    {
+        result.data[result.size++] = (pb_byte_t)((value & 0x7F) | 0x80);
+        value >>= 7;
+    }
+    result.data[result.size++] = (pb_byte_t)value;
+    return result;
+}
+
+template <uint32_t Tag, pb_wire_type_t WireType>
+struct tag_constant
+{
+    static constexpr tag_bytes value = make_tag_bytes(Tag, WireType);
+};
+
+template <uint32_t Tag, pb_wire_type_t WireType>
+inline bool encode_tag(pb_ostream_t *stream)
+{
+    return pb_write(stream, tag_constant<Tag, WireType>::value.data,
+                    tag_constant<Tag, WireType>::value.size);
+}
+
+template <typename MessageT>
+inline bool encode_fields(pb_ostream_t *stream, const MessageT &msg)
+{
+    return MessageCodec<MessageT>::fields::encode(stream, msg);
+}
+
+template <typename MessageT>
+inline bool decode_fields(pb_istream_t *stream, MessageT &msg)
+{
+    return MessageCodec<MessageT>::fields::decode(stream, msg);
+}
+
+#ifdef PB_WITHOUT_64BIT
+/* Negative int32 values are sign-extended to 64 bits on the wire. */
+inline bool encode_negative_varint(pb_ostream_t *stream, uint32_t low)
+{
+    pb_byte_t buffer[10];
+    uint32_t high = 0xFFFFFFFFU;
+    size_t i;
+
+    for (i = 0; i < 4; i++)
+    {
+        buffer[i] = (pb_byte_t)((low & 0x7F) | 0x80);
+        low >>= 7;
+    }
+
+    buffer[i++] = (pb_byte_t)((low & 0x0F) | ((high & 0x07) << 4) | 0x80);
+    high >>= 3;
+
+    while (high > 0x7F)
+    {
+        buffer[i++] = (pb_byte_t)((high & 0x7F) | 0x80);
+        high >>= 7;
+    }
+    buffer[i++] = (pb_byte_t)high;
+
+    return pb_write(stream, buffer, i);
+}
+#endif
+
+template <typename SubmsgT>
+bool encode_submessage(pb_ostream_t *stream, const SubmsgT &msg)
+{
+    /* Same logic as pb_encode_submessage(). */
+    pb_ostream_t substream = PB_OSTREAM_SIZING;
+#if !PB_NO_ENCODE_SIZE_CHECK
+    bool status;
+    size_t size;
+#endif
+
+    if (!encode_fields(&substream, msg))
+    {
+#ifndef PB_NO_ERRMSG
+        stream->errmsg = substream.errmsg;
+#endif
+        return false;
+    }
+
+    if (!pb_encode_varint(stream, (codec_uint_t)substream.bytes_written))
+        return false;
+
+    if (stream->callback == NULL)
+        return pb_write(stream, NULL, substream.bytes_written); /* Just sizing */
+
+    if (stream->bytes_written + substream.bytes_written > stream->max_size)
+        PB_RETURN_ERROR(stream, "stream full");
+
+#if PB_NO_ENCODE_SIZE_CHECK
+    return encode_fields(stream, msg);
+#else
+    size = substream.bytes_written;
+    substream.callback = stream->callback;
+    substream.state = stream->state;
+    substream.max_size = size;
+    substream.bytes_written = 0;
+#ifndef PB_NO_ERRMSG
+    substream.errmsg = NULL;
+#endif
+
+    status = encode_fields(&substream, msg);
+
+    stream->bytes_written += substream.bytes_written;
+    stream->state = substream.state;
+#ifndef PB_NO_ERRMSG
+    stream->errmsg = substream.errmsg;
+#endif
+
+    if (substream.bytes_written != size)
+        PB_RETURN_ERROR(stream, "submsg size changed");
+
+    return status;
+#endif
+}
+
+template <pb_type_t LType, typename T>
+inline bool encode_value(pb_ostream_t *stream, const T &value)
+{
+    if constexpr (LType == PB_LTYPE_BOOL)
+    {
+        return pb_encode_varint(stream, is_all_zero(value) ? 0U : 1U);
+    }
+    else if constexpr (LType == PB_LTYPE_UVARINT)
+    {
+        return pb_encode_varint(stream, load_unsigned(value));
+    }
+    else if constexpr (LType == PB_LTYPE_SVARINT)
+    {
+        return pb_encode_svarint(stream, load_signed(value));
+    }
+    else if constexpr (LType == PB_LTYPE_VARINT)
+    {
+        codec_int_t svalue = load_signed(value);
+#ifdef PB_WITHOUT_64BIT
+        if (svalue < 0)
+            return encode_negative_varint(stream, (uint32_t)svalue);
+#endif
+        return pb_encode_varint(stream, (codec_uint_t)svalue);
+    }
+    else if constexpr (LType == PB_LTYPE_FIXED32)
+    {
+        static_assert(sizeof(T) == 4, "invalid data_size");
+        return pb_encode_fixed32(stream, &value);
+    }
+    else if constexpr (LType == PB_LTYPE_FIXED64)
+    {
+#ifdef PB_CONVERT_DOUBLE_FLOAT
+        if constexpr (sizeof(T) == sizeof(float))
+            return pb_encode_float_as_double(stream, value);
+        else
+#endif
+        {
+#ifdef PB_WITHOUT_64BIT
+            static_assert(sizeof(T) == 0, "64-bit field in PB_WITHOUT_64BIT build");
+            return false;
+#else
+            static_assert(sizeof(T) == 8, "invalid data_size");
+            return pb_encode_fixed64(stream, &value);
+#endif
+        }
+    }
+    else if constexpr (LType == PB_LTYPE_STRING)
+    {
+        /* Same checks as pb_enc_string() for static fields */
+        constexpr size_t max_size = sizeof(T) - 1;
+        size_t size = 0;
+        const char *p = value;
+        while (size < max_size && *p != '\0')
+        {
+            size++;
+            p++;
+        }
+
+        if (*p != '\0')
+            PB_RETURN_ERROR(stream, "unterminated string");
+
+        return pb_encode_string(stream, (const pb_byte_t*)value, size);
+    }
+    else if constexpr (LType == PB_LTYPE_BYTES)
+    {
+        if (value.size > sizeof(value.bytes))
+            PB_RETURN_ERROR(stream, "bytes size exceeded");
+
+        return pb_encode_string(stream, value.bytes, (size_t)value.size);
+    }
+    else if constexpr (LType == PB_LTYPE_FIXED_LENGTH_BYTES)
+    {
+        return pb_encode_string(stream, value, sizeof(T));
+    }
+    else
+    {
+        static_assert(LType == PB_LTYPE_SUBMESSAGE, "unsupported field type");
+        return encode_submessage(stream, value);
+    }
+}
+
+// Equivalent of pb_check_proto3_default_value() for static fields.
+template <typename F, typename MessageT>
+inline bool field_is_default(const MessageT &msg)
+{
+    typedef typename F::value_type T;
+    const T &value = msg.*F::member;
+
+    if constexpr (F::htype == PB_HTYPE_REQUIRED)
+    {
+        return false;
+    }
+    else if constexpr (F::htype == PB_HTYPE_REPEATED)
+    {
+        return msg.*F::size_member == 0;
+    }
+    else if constexpr (F::has_size)
+    {
+        return !(msg.*F::size_member);
+    }
+    else if constexpr (F::ltype == PB_LTYPE_STRING)
+    {
+        return value[0] == '\0';
+    }
+    else if constexpr (F::ltype == PB_LTYPE_BYTES)
+    {
+        return value.size == 0;
+    }
+    else if constexpr (F::ltype == PB_LTYPE_FIXED_LENGTH_BYTES)
+    {
+        return sizeof(T) == 0;
+    }
+    else if constexpr (F::ltype == PB_LTYPE_SUBMESSAGE)
+    {
+        return MessageCodec<T>::fields::is_default(value);
+    }
+    else
+    {
+        return is_all_zero(value);
+    }
+}
+
+template <typename F, typename MessageT>
+inline bool encode_field(pb_ostream_t *stream, const MessageT &msg)
+{
+    typedef typename F::value_type T;
+    constexpr pb_type_t ltype = F::ltype;
+    const T &value = msg.*F::member;
+
+    if constexpr (F::htype == PB_HTYPE_REPEATED)
+    {
+        typedef typename array_traits<T>::item_type item_type;
+        constexpr pb_size_t array_size = array_traits<T>::count;
+        pb_size_t count = msg.*F::size_member;
+        pb_size_t i;
+
+        if (count == 0)
+            return true;
+
+        if (count > array_size)
+            PB_RETURN_ERROR(stream, "array max size exceeded");
+
+#ifndef PB_ENCODE_ARRAYS_UNPACKED
+        if constexpr (ltype <= PB_LTYPE_LAST_PACKABLE)
+        {
+            /* Same logic as encode_array() for packed fields */
+            size_t size;
+
+            if (!encode_tag<F::tag, PB_WT_STRING>(stream))
+                return false;
+
+            if constexpr (ltype == PB_LTYPE_FIXED32)
+            {
+                size = 4 * (size_t)count;
+            }
+            else if constexpr (ltype == PB_LTYPE_FIXED64)
+            {
+                size = 8 * (size_t)count;
+            }
+            else
+            {
+                pb_ostream_t sizestream = PB_OSTREAM_SIZING;
+                for (i = 0; i < count; i++)
+                {
+                    if (!encode_value<ltype, item_type>(&sizestream, value[i]))
+                        PB_RETURN_ERROR(stream, PB_GET_ERROR(&sizestream));
+                }
+                size = sizestream.bytes_written;
+            }
+
+            if (!pb_encode_varint(stream, (codec_uint_t)size))
+                return false;
+
+            if (stream->callback == NULL)
+                return pb_write(stream, NULL, size); /* Just sizing.. */
+
+            for (i = 0; i < count; i++)
+            {
+                if (!encode_value<ltype, item_type>(stream, value[i]))
+                    return false;
+            }
+            return true;
+        }
+        else
+#endif
+        {
+            for (i = 0; i < count; i++)
+            {
+                if (!encode_tag<F::tag, wire_type_for(ltype)>(stream))
+                    return false;
+
+                if (!encode_value<ltype, item_type>(stream, value[i]))
+                    return false;
+            }
+            return true;
+        }
+    }
+    else
+    {
+        if constexpr (F::htype != PB_HTYPE_REQUIRED)
+        {
+            if (field_is_default<F>(msg))
+                return true;
+        }
+
+        if (!encode_tag<F::tag, wire_type_for(ltype)>(stream))
+            return false;
+
+        return encode_value<ltype, T>(stream, value);
+    }
+}
+
+template <pb_type_t LType, typename T>
+inline bool decode_value(pb_istream_t *stream, pb_wire_type_t wire_type, T &value)
+{
+    if constexpr (LType <= PB_LTYPE_SVARINT)
+    {
+        if (wire_type != PB_WT_VARINT && wire_type != PB_WT_PACKED)
+            PB_RETURN_ERROR(stream, "wrong wire type");
+
+        if constexpr (LType == PB_LTYPE_BOOL)
+        {
+            return pb_decode_bool(stream, &value);
+        }
+        else if constexpr (LType == PB_LTYPE_UVARINT)
+        {
+            codec_uint_t raw;
+            if (!pb_decode_varint(stream, &raw))
+                return false;
+
+            if (!store_unsigned(value, raw))
+                PB_RETURN_ERROR(stream, "integer too large");
+
+            return true;
+        }
+        else
+        {
+            /* Same logic as pb_dec_varint() */
+            codec_int_t svalue;
+
+            if constexpr (LType == PB_LTYPE_SVARINT)
+            {
+                if (!pb_decode_svarint(stream, &svalue))
+                    return false;
+            }
+            else
+            {
+                codec_uint_t raw;
+                if (!pb_decode_varint(stream, &raw))
+                    return false;
+
+                if constexpr (sizeof(T) == sizeof(codec_int_t))
+                    svalue = (codec_int_t)raw;
+                else
+                    svalue = (int32_t)raw;
+            }
+
+            if (!store_signed(value, svalue))
+                PB_RETURN_ERROR(stream, "integer too large");
+
+            return true;
+        }
+    }
+    else if constexpr (LType == PB_LTYPE_FIXED32)
+    {
+        if (wire_type != PB_WT_32BIT && wire_type != PB_WT_PACKED)
+            PB_RETURN_ERROR(stream, "wrong wire type");
+
+        static_assert(sizeof(T) == 4, "invalid data_size");
+        return pb_decode_fixed32(stream, &value);
+    }
+    else if constexpr (LType == PB_LTYPE_FIXED64)
+    {
+        if (wire_type != PB_WT_64BIT && wire_type != PB_WT_PACKED)
+            PB_RETURN_ERROR(stream, "wrong wire type");
+
+#ifdef PB_CONVERT_DOUBLE_FLOAT
+        if constexpr (sizeof(T) == sizeof(float))
+            return pb_decode_double_as_float(stream, &value);
+        else
+#endif
+        {
+#ifdef PB_WITHOUT_64BIT
+            static_assert(sizeof(T) == 0, "64-bit field in PB_WITHOUT_64BIT build");
+            return false;
+#else
+            static_assert(sizeof(T) == 8, "invalid data_size");
+            return pb_decode_fixed64(stream, &value);
+#endif
+        }
+    }
+    else
+    {
+        uint32_t size;
+
+        if (wire_type != PB_WT_STRING)
+            PB_RETURN_ERROR(stream, "wrong wire type");
+
+        if constexpr (LType == PB_LTYPE_STRING)
+        {
+            if (!pb_decode_varint32(stream, &size))
+                return false;
+
+            if (size >= sizeof(T))
+                PB_RETURN_ERROR(stream, "string overflow");
+
+            value[size] = 0;
+
+            if (!pb_read(stream, (pb_byte_t*)value, (size_t)size))
+                return false;
+
+            return true;
+        }
+        else if constexpr (LType == PB_LTYPE_BYTES)
+        {
+            if (!pb_decode_varint32(stream, &size))
+                return false;
+
+            if (size > sizeof(value.bytes))
+                PB_RETURN_ERROR(stream, "bytes overflow");
+
+            value.size = (pb_size_t)size;
+            return pb_read(stream, value.bytes, (size_t)size);
+        }
+        else if constexpr (LType == PB_LTYPE_FIXED_LENGTH_BYTES)
+        {
+            if (!pb_decode_varint32(stream, &size))
+                return false;
+
+            if (size == 0)
+            {
+                /* As a special case, treat empty bytes string as all zeros for fixed_length_bytes. */
+                memset(value, 0, sizeof(T));
+                return true;
+            }
+
+            if (size != sizeof(T))
+                PB_RETURN_ERROR(stream, "incorrect fixed length bytes size");
+
+            return pb_read(stream, value, sizeof(T));
+        }
+        else
+        {
+            static_assert(LType == PB_LTYPE_SUBMESSAGE, "unsupported field type");
+
+            pb_istream_t substream;
+            bool status;
+
+            if (!pb_make_string_substream(stream, &substream))
+                return false;
+
+            status = decode_fields(&substream, value);
+
+            if (!pb_close_string_substream(stream, &substream))
+                return false;
+
+            return status;
+        }
+    }
+}
+
+template <typename F, typename MessageT>
+inline bool decode_field(pb_istream_t *stream, pb_wire_type_t wire_type, MessageT &msg)
+{
+    typedef typename F::value_type T;
+    constexpr pb_type_t ltype = F::ltype;
+    T &value = msg.*F::member;
+
+    if constexpr (F::htype == PB_HTYPE_REPEATED)
+    {
+        typedef typename array_traits<T>::item_type item_type;
+        constexpr pb_size_t array_size = array_traits<T>::count;
+        pb_size_t &count = msg.*F::size_member;
+
+        if constexpr (ltype <= PB_LTYPE_LAST_PACKABLE)
+        {
+            if (wire_type == PB_WT_STRING)
+            {
+                /* Packed array, same logic as decode_static_field() */
+                bool status = true;
+                pb_istream_t substream;
+
+                if (!pb_make_string_substream(stream, &substream))
+                    return false;
+
+                while (substream.bytes_left > 0 && count < array_size)
+                {
+                    if (!decode_value<ltype, item_type>(&substream, PB_WT_PACKED, value[count]))
+                    {
+                        status = false;
+                        break;
+                    }
+                    count++;
+                }
+
+                if (substream.bytes_left != 0)
+                    PB_RETURN_ERROR(stream, "array overflow");
+                if (!pb_close_string_substream(stream, &substream))
+                    return false;
+
+                return status;
+            }
+        }
+
+        if (count >= array_size)
+            PB_RETURN_ERROR(stream, "array overflow");
+
+        item_type &item = value[count++];
+        if constexpr (ltype == PB_LTYPE_SUBMESSAGE)
+        {
+            /* Each array item starts from default values */
+            memset(&item, 0, sizeof(item));
+        }
+
+        return decode_value<ltype, item_type>(stream, wire_type, item);
+    }
+    else
+    {
+        if constexpr (F::has_size)
+        {
+            msg.*F::size_member = true;
+        }
+
+        return decode_value<ltype, T>(stream, wire_type, value);
+    }
+}
+
+} // namespace detail
+
+template <pb_size_t Tag, pb_type_t Type, auto Member, auto SizeMember>
+struct Field
+{
+    typedef typename detail::member_traits<decltype(Member)>::class_type message_type;
+    typedef typename detail::member_traits<decltype(Member)>::value_type value_type;
+
+    static constexpr pb_size_t tag = Tag;
+    static constexpr pb_type_t htype = PB_HTYPE(Type);
+    static constexpr pb_type_t ltype = PB_LTYPE(Type);
+    static constexpr auto member = Member;
+    static constexpr auto size_member = SizeMember;
+    static constexpr bool has_size = !detail::is_same<decltype(SizeMember), decltype(nullptr)>::value;
+
+    static_assert(PB_ATYPE(Type) == PB_ATYPE_STATIC,
+                  "only statically allocated fields are supported");
+    static_assert(htype != PB_HTYPE_ONEOF && ltype != PB_LTYPE_SUBMSG_W_CB &&
+                  ltype != PB_LTYPE_EXTENSION,
+                  "oneofs, submessage callbacks and extensions are not supported");
+    static_assert(htype != PB_HTYPE_REPEATED || has_size,
+                  "repeated field needs a _count member, fixed_count is not supported");
+    static_assert(htype != PB_HTYPE_REQUIRED || !has_size,
+                  "required field cannot have a has_ member");
+};
+
+template <typename... Fields>
+struct FieldList
+{
+    static constexpr pb_size_t field_count = sizeof...(Fields);
+    static constexpr pb_size_t required_field_count =
+        (0 + ... + (Fields::htype == PB_HTYPE_REQUIRED ? 1 : 0));
+
+    template <typename MessageT>
+    static constexpr bool belongs_to()
+    {
+        return (true && ... && detail::is_same<typename Fields::message_type, MessageT>::value);
+    }
+
+    template <typename MessageT>
+    static bool is_default(const MessageT &msg)
+    {
+        return (true && ... && detail::field_is_default<Fields>(msg));
+    }
+
+    template <typename MessageT>
+    static bool encode(pb_ostream_t *stream, const MessageT &msg)
+    {
+        static_assert(belongs_to<MessageT>(), "field list does not match the message type");
+        return (true && ... && detail::encode_field<Fields>(stream, msg));
+    }
+
+    template <typename MessageT>
+    static bool decode(pb_istream_t *stream, MessageT &msg)
+    {
+        static_assert(belongs_to<MessageT>(), "field list does not match the message type");
+
+        uint32_t fields_seen[(required_field_count + 31) / 32 + 1] = {0};
+        PB_UNUSED(fields_seen);
+
+        while (stream->bytes_left)
+        {
+            uint32_t tag;
+            pb_wire_type_t wire_type;
+            bool eof;
+            bool matched = false;
+            bool status = true;
+
+            if (!pb_decode_tag(stream, &wire_type, &tag, &eof))
+            {
+                if (eof)
+                    break;
+                else
+                    return false;
+            }
+
+            /* Fields are sorted by tag, so the compiler can turn this into
+             * a jump table or binary search. */
+            (void)(false || ... || (tag == Fields::tag &&
+                (matched = true,
+                 status = decode_and_mark<Fields>(stream, wire_type, msg, fields_seen),
+                 true)));
+
+            if (!matched)
+            {
+                if (!pb_skip_field(stream, wire_type))
+                    return false;
+            }
+            else if (!status)
+            {
+                return false;
+            }
+        }
+
+        if constexpr (required_field_count > 0)
+        {
+            /* Check that all required fields have been seen */
+            pb_size_t i;
+            for (i = 0; i < required_field_count; i++)
+            {
+                if (!(fields_seen[i >> 5] & (1U << (i & 31))))
+                    PB_RETURN_ERROR(stream, "missing required field");
+            }
+        }
+
+        return true;
+    }
+
+private:
+    template <pb_size_t Tag>
+    static constexpr pb_size_t required_index()
+    {
+        return (0 + ... + (Fields::tag < Tag && Fields::htype == PB_HTYPE_REQUIRED ? 1 : 0));
+    }
+
+    template <typename F, typename MessageT>
+    static bool decode_and_mark(pb_istream_t *stream, pb_wire_type_t wire_type,
+                                MessageT &msg, uint32_t *fields_seen)
+    {
+        if constexpr (F::htype == PB_HTYPE_REQUIRED)
+        {
+            constexpr pb_size_t index = required_index<F::tag>();
+            fields_seen[index >> 5] |= (uint32_t)(1U << (index & 31));
+        }
+        else
+        {
+            PB_UNUSED(fields_seen);
+        }
+
+        return detail::decode_field<F>(stream, wire_type, msg);
+    }
+};
+
+/* Encode a message with a generated MessageCodec<> specialization.
+ * Produces the same output as pb_encode(stream, MessageT_fields, &msg).
+ */
+template <typename MessageT>
+inline bool encode(pb_ostream_t *stream, const MessageT &msg)
+{
+    return detail::encode_fields(stream, msg);
+}
+
+/* Decode a message with a generated MessageCodec<> specialization.
+ * Same semantics as pb_decode(): the message is cleared first, then
+ * merged with the contents of the stream.
+ */
+template <typename MessageT>
+inline bool decode(pb_istream_t *stream, MessageT &msg)
+{
+    memset(&msg, 0, sizeof(msg));
+    return detail::decode_fields(stream, msg);
+}
+
+/* Compute the encoded size of a message, see pb_get_encoded_size(). */
+template <typename MessageT>
+inline bool get_encoded_size(size_t *size, const MessageT &msg)
+{
+    pb_ostream_t stream = PB_OSTREAM_SIZING;
+
+    if (!encode(&stream, msg))
+        return false;
+
+    *size = stream.bytes_written;
+    return true;
+}
+
+} // namespace nanopb
+}
+
+#endif
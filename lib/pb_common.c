@@ -121,6 +121,7 @@ static bool load_descriptor_values(pb_field_iter_t *iter)
 
 static void advance_iterator(pb_field_iter_t *iter)
 {
+    PB_STATS_ADD(iter_steps, 1);
     iter->index++;
 
     if (iter->index >= iter->descriptor->field_count)
@@ -274,6 +275,39 @@ bool pb_field_iter_find_extension(pb_field_iter_t *iter)
     }
 }
 
+bool pb_field_iter_is_fixed_count(const pb_field_iter_t *iter)
+{
+    uint32_t word0;
+    uint32_t size_offset;
+
+    if (PB_HTYPE(iter->type) != PB_HTYPE_REPEATED ||
+        (PB_ATYPE(iter->type) != PB_ATYPE_STATIC &&
+         PB_ATYPE(iter->type) != PB_ATYPE_POINTER))
+    {
+        return false;
+    }
+
+    /* Read the size offset from the descriptor, like in
+     * load_descriptor_values(), as pSize is not set without a message. */
+    word0 = PB_PROGMEM_READU32(iter->descriptor->field_info[iter->field_info_index]);
+    switch (word0 & 3)
+    {
+        case 0:
+            size_offset = (word0 >> 24) & 0x0F;
+            break;
+
+        case 1:
+            size_offset = (word0 >> 28) & 0x0F;
+            break;
+
+        default:
+            size_offset = PB_PROGMEM_READU32(iter->descriptor->field_info[iter->field_info_index + 1]) & 0xFF;
+            break;
+    }
+
+    return size_offset == 0;
+}
+
 static void *pb_const_cast(const void *p)
 {
     /* Note: this casts away const, in order to use the common field iterator
@@ -321,6 +355,33 @@ bool pb_default_field_callback(pb_istream_t *istream, pb_ostream_t *ostream, con
 
 }
 
+#ifdef PB_ENABLE_RING_STREAM
+bool pb_ring_init(pb_ring_t *ring, pb_byte_t *buf, size_t size)
+{
+    if (size == 0 || (size & (size - 1)) != 0)
+        return false;
+
+    ring->buf = buf;
+    ring->mask = size - 1;
+    PB_RING_ATOMIC(ring->head = 0; ring->tail = 0);
+    return true;
+}
+#endif
+
+#ifdef PB_ENABLE_STATS
+pb_stats_t pb_stats;
+
+void pb_stats_get(pb_stats_t *dest)
+{
+    *dest = pb_stats;
+}
+
+void pb_stats_reset(void)
+{
+    memset(&pb_stats, 0, sizeof(pb_stats));
+}
+#endif
+
 #ifdef PB_VALIDATE_UTF8
 
 /* This function checks whether a string is valid UTF-8 text.
@@ -12,6 +12,35 @@
 extern "C" {
 #endif
 
+#ifdef PB_ENABLE_ARENA
+#ifndef PB_ENABLE_MALLOC
+#error PB_ENABLE_ARENA requires PB_ENABLE_MALLOC
+#endif
+
+/* Alignment of allocations from an arena. Must be a power of two. */
+#ifndef PB_ARENA_ALIGN
+#define PB_ARENA_ALIGN 8
+#endif
+
+/* Bump allocator for pointer fields. When pb_istream_t.arena is set, the
+ * decoder takes all memory for pointer fields from the arena instead of
+ * pb_realloc(). Nothing is freed individually: the messages are released
+ * all at once by pb_arena_reset(), and must not be passed to pb_release().
+ *
+ * The buffer given to pb_arena_init() should be aligned to PB_ARENA_ALIGN.
+ * The contents are private, except that used tells the number of bytes
+ * allocated so far.
+ */
+typedef struct pb_arena_s pb_arena_t;
+struct pb_arena_s
+{
+    pb_byte_t *buf;
+    size_t size;
+    size_t used;
+    size_t last; /* Offset of the latest allocation */
+};
+#endif
+
 /* Structure for defining custom input streams. You will need to provide
  * a callback function to read the bytes from your storage, which can be
  * for example a file or a network socket.
@@ -54,14 +83,43 @@ struct pb_istream_s
     /* Pointer to constant (ROM) string when decoding function returns error */
     const char *errmsg;
 #endif
+
+#ifdef PB_ENABLE_ARENA
+    /* Arena to allocate pointer fields from, or NULL to use pb_realloc().
+     * Substreams inherit it. pb_istream_from_buffer() sets it to NULL. */
+    pb_arena_t *arena;
+#endif
+
+#ifdef PB_ENABLE_SKIP_CALLBACK
+    /* Optional callback for skipping count bytes without reading them,
+     * for example by seeking in a file. It is used for unknown fields,
+     * fields left out by pb_decode_projection() and pb_read() with NULL
+     * buf. If NULL, the data is read into a temporary buffer instead.
+     * Substreams inherit it. pb_istream_from_buffer() sets it to NULL. */
+    bool (*skip)(pb_istream_t *stream, size_t count);
+#endif
 };
 
 #ifndef PB_NO_ERRMSG
-#define PB_ISTREAM_EMPTY {0,0,0,0}
+#define PB_ISTREAM_ERRMSG_INIT ,0
 #else
-#define PB_ISTREAM_EMPTY {0,0,0}
+#define PB_ISTREAM_ERRMSG_INIT
 #endif
 
+#ifdef PB_ENABLE_ARENA
+#define PB_ISTREAM_ARENA_INIT ,0
+#else
+#define PB_ISTREAM_ARENA_INIT
+#endif
+
+#ifdef PB_ENABLE_SKIP_CALLBACK
+#define PB_ISTREAM_SKIP_INIT ,0
+#else
+#define PB_ISTREAM_SKIP_INIT
+#endif
+
+#define PB_ISTREAM_EMPTY {0,0,0 PB_ISTREAM_ERRMSG_INIT PB_ISTREAM_ARENA_INIT PB_ISTREAM_SKIP_INIT}
+
 /***************************
  * Main decoding functions *
  ***************************/
@@ -112,6 +170,193 @@ bool pb_decode(pb_istream_t *stream, const pb_msgdesc_t *fields, void *dest_stru
 #define PB_DECODE_NULLTERMINATED  0x04U
 bool pb_decode_ex(pb_istream_t *stream, const pb_msgdesc_t *fields, void *dest_struct, unsigned int flags);
 
+/* State for pb_decode_tracked(). A set bit means that the field with
+ * that index is known to still hold its default value. */
+typedef struct {
+    uint32_t clean[(PB_MAX_TRACKED_FIELDS + 31) / 32];
+} pb_field_tracker_t;
+
+/* Like pb_decode_ex(), but for decoding repeatedly into the same struct.
+ * The tracker records which top-level fields were written, and the next
+ * call resets only those to defaults, instead of initializing the whole
+ * struct. This saves time with large messages that have only a few
+ * fields present at a time.
+ *
+ * Zero-initialize the tracker before the first call, and again if the
+ * struct is modified by anything else than pb_decode_tracked().
+ * With PB_DECODE_NOINIT, nothing is reset and the written fields are
+ * added to the tracker. The tracker can be NULL, which equals
+ * pb_decode_ex().
+ *
+ * Example usage:
+ *    MyMessage msg;
+ *    pb_field_tracker_t tracker = {{0}};
+ *
+ *    for (;;)
+ *    {
+ *        pb_istream_t stream = pb_istream_from_buffer(buffer, read_frame(buffer));
+ *        pb_decode_tracked(&stream, MyMessage_fields, &msg, 0, &tracker);
+ *        // ... use msg ...
+ *    }
+ */
+bool pb_decode_tracked(pb_istream_t *stream, const pb_msgdesc_t *fields, void *dest_struct, unsigned int flags, pb_field_tracker_t *tracker);
+
+/* Decode only the top-level fields whose tags are listed, and skip the
+ * rest of the input. Fields that are not listed are not touched in the
+ * struct, not even initialized to defaults. Extensions are skipped, and
+ * required fields are not checked. The tag list is searched linearly,
+ * so it should be short.
+ *
+ * If decoding fails, pointer fields that were listed are released.
+ *
+ * Example usage:
+ *    static const uint32_t tags[] = {Reading_ph_tag};
+ *    pb_decode_projection(&stream, Reading_fields, &msg, 0, tags, 1);
+ */
+bool pb_decode_projection(pb_istream_t *stream, const pb_msgdesc_t *fields, void *dest_struct, unsigned int flags, const uint32_t *tags, pb_size_t tag_count);
+
+#ifdef PB_ENABLE_MALLOC
+/* Allocated capacity of the repeated pointer field that received the
+ * latest entries. The struct only stores the entry count, so capacity
+ * beyond it is known only while entries keep arriving to the same field.
+ * The contents are internal to the decoder. */
+typedef struct pb_array_growth_s pb_array_growth_t;
+struct pb_array_growth_s {
+    void *array;      /* Address of the array pointer, or NULL */
+    pb_size_t *count;
+    pb_size_t start;  /* Count when tracking started */
+    size_t item_size;
+    size_t capacity;
+};
+#endif
+
+/* State of one message nesting level in pb_decode_iterative().
+ * The contents are internal to the decoder. */
+typedef struct {
+    const pb_msgdesc_t *descriptor;
+    void *message;
+    size_t parent_bytes_left; /* Bytes left in the enclosing message */
+    uint32_t fields_seen[(PB_MAX_REQUIRED_FIELDS + 31) / 32];
+    pb_size_t fixed_count_field;
+    pb_size_t fixed_count_size;
+    pb_size_t fixed_count_total_size;
+#ifdef PB_ENABLE_MALLOC
+    pb_array_growth_t growth;
+#endif
+} pb_decode_frame_t;
+
+/* Like pb_decode_ex(), but static and pointer submessages are decoded
+ * in a loop instead of by recursion. The state of each nesting level is
+ * kept in the frames array given by the caller, and the message itself
+ * takes the first frame. Input nested deeper than frame_count levels
+ * fails with "max depth exceeded", so the stack usage does not depend
+ * on the input. Submessages in callback and extension fields are
+ * decoded as in pb_decode().
+ *
+ * Setting the default values still descends into static submessages,
+ * which is bounded by the nesting in the descriptors. It is skipped
+ * with PB_DECODE_NOINIT.
+ *
+ * Example usage:
+ *    pb_decode_frame_t frames[4];
+ *    pb_decode_iterative(&stream, MyMessage_fields, &msg, 0, frames, 4);
+ */
+bool pb_decode_iterative(pb_istream_t *stream, const pb_msgdesc_t *fields, void *dest_struct, unsigned int flags, pb_decode_frame_t *frames, pb_size_t frame_count);
+
+/* Get the number of frames that pb_decode_iterative() needs for any
+ * input of the message type, from the deepest nesting of static and
+ * pointer submessages in the descriptors. Returns false if the nesting
+ * is deeper than max_depth, which is always the case for recursive
+ * pointer fields. The descriptors are walked recursively, at most
+ * max_depth levels deep.
+ *
+ * Example usage:
+ *    if (!pb_decode_depth(MyMessage_fields, 4, &depth))
+ *        // ... 4 frames are not enough for all inputs ...
+ */
+bool pb_decode_depth(const pb_msgdesc_t *fields, pb_size_t max_depth, pb_size_t *depth);
+
+/* Check that the stream contains a valid message, without storing the
+ * field values anywhere. The same checks are done as in pb_decode():
+ * wire types, lengths, integer ranges, string and array sizes and
+ * required fields. Field callbacks are not called, their data and
+ * unknown fields are only skipped. UTF-8 is not checked. Like the
+ * decoder, this reads the whole stream.
+ *
+ * The first PB_VALIDATE_MAX_ARRAYS arrays of each message are counted
+ * over the whole message. Entries of further arrays are counted only
+ * while they are consecutive, so if such an array is split by other
+ * fields, it can pass here but overflow in pb_decode().
+ *
+ * Example usage:
+ *    stream = pb_istream_from_buffer(frame, count);
+ *    if (pb_validate(&stream, MyMessage_fields))
+ *        mqtt_publish(frame, count);
+ */
+bool pb_validate(pb_istream_t *stream, const pb_msgdesc_t *fields);
+
+/* Decode a submessage that was stored as encoded data in a pb_view_t.
+ * This is used by the accessor macros generated for fields with the
+ * (nanopb).lazy option:
+ *
+ *    Envelope env;
+ *    Payload payload;
+ *    pb_decode(&stream, Envelope_fields, &env);
+ *    if (env.has_payload && Envelope_decode_payload(&env, &payload))
+ *        ...
+ *
+ * The input buffer of the outer message must remain valid until then.
+ *
+ * Unlike normal decoding, a singular lazy field that occurs more than once
+ * in the input is not merged: the view keeps only the last occurrence.
+ * Encoders write each submessage once, so this matters only for messages
+ * that were concatenated or merged on the wire.
+ */
+bool pb_decode_lazy(const pb_view_t *data, const pb_msgdesc_t *fields, void *dest_struct);
+
+/* Find the records in a buffer of length-delimited messages, such as
+ * written by pb_encode_ex() with PB_ENCODE_DELIMITED. Only the length
+ * prefixes are read, the message data is not checked. For each record,
+ * a view of the message data without the prefix is stored in records,
+ * and *count is set to the number of records found.
+ *
+ * If records is NULL, the records are only counted, which can be used
+ * to size the array. Returns false if the buffer ends in the middle of
+ * a record or there are more than max_records records.
+ *
+ * Example usage:
+ *    pb_index_delimited(buf, size, NULL, 0, &count);
+ *    records = malloc(count * sizeof(pb_view_t));
+ *    pb_index_delimited(buf, size, records, count, &count);
+ *    for (i = 0; i < count; i++)
+ *        pb_decode_lazy(&records[i], SensorData_fields, &msgs[i]);
+ */
+bool pb_index_delimited(const pb_byte_t *buf, size_t size, pb_view_t *records, size_t max_records, size_t *count);
+
+/* Iterator over the length-delimited records in a buffer. Unlike
+ * pb_index_delimited(), this needs no array, and can start from any
+ * record: offset is the byte offset of a length prefix, for example one
+ * saved earlier from the offset field. The fields are read-only.
+ */
+typedef struct {
+    const pb_byte_t *buf;
+    size_t size;
+    size_t offset; /* Offset of the next record */
+} pb_record_iter_t;
+
+void pb_record_iter_init(pb_record_iter_t *iter, const pb_byte_t *buf, size_t size, size_t offset);
+
+/* Get a view of the message data of the next record. Returns false at
+ * the end of the buffer, or if the record is truncated or its length is
+ * invalid. The two cases can be told apart by iter->offset == iter->size.
+ *
+ * Example usage:
+ *    pb_record_iter_init(&iter, buf, size, 0);
+ *    while (pb_record_next(&iter, &record))
+ *        pb_decode_lazy(&record, SensorData_fields, &msg);
+ */
+bool pb_record_next(pb_record_iter_t *iter, pb_view_t *record);
+
 /* Defines for backwards compatibility with code written before nanopb-0.4.0 */
 #define pb_decode_noinit(s,f,d) pb_decode_ex(s,f,d, PB_DECODE_NOINIT)
 #define pb_decode_delimited(s,f,d) pb_decode_ex(s,f,d, PB_DECODE_DELIMITED)
@@ -124,6 +369,38 @@ bool pb_decode_ex(pb_istream_t *stream, const pb_msgdesc_t *fields, void *dest_s
  */
 void pb_release(const pb_msgdesc_t *fields, void *dest_struct);
 
+#ifdef PB_ENABLE_ARENA
+/* Set up an arena using size bytes at buf.
+ *
+ * Example usage:
+ *    static uint64_t storage[256];
+ *    pb_arena_t arena;
+ *    pb_arena_init(&arena, storage, sizeof(storage));
+ *
+ *    for (;;)
+ *    {
+ *        pb_istream_t stream = pb_istream_from_buffer(buffer, count);
+ *        stream.arena = &arena;
+ *        pb_decode(&stream, MyMessage_fields, &msg);
+ *        // ... use msg ...
+ *        pb_arena_reset(&arena);
+ *    }
+ *
+ * If decoding fails, the pointer fields are cleared but the arena space
+ * stays in use. To reclaim it without a full reset, save a copy of the
+ * pb_arena_t before decoding and restore it afterwards.
+ */
+void pb_arena_init(pb_arena_t *arena, void *buf, size_t size);
+
+/* Release all memory allocated from the arena at once. */
+void pb_arena_reset(pb_arena_t *arena);
+
+/* Allocate size bytes from the arena, like realloc(). Only the latest
+ * allocation can grow in place, others are copied. Returns NULL if the
+ * arena is full or ptr is not from this arena. */
+void *pb_arena_realloc(pb_arena_t *arena, void *ptr, size_t size);
+#endif
+
 /**************************************
  * Functions for manipulating streams *
  **************************************/
@@ -143,6 +420,80 @@ pb_istream_t pb_istream_from_buffer(const pb_byte_t *buf, size_t msglen);
  */
 bool pb_read(pb_istream_t *stream, pb_byte_t *buf, size_t count);
 
+#if !defined(PB_BUFFER_ONLY) && defined(PB_ENABLE_BUFFERED_STREAM)
+/* Reads up to count bytes from source to buf, and returns the number of
+ * bytes read. It should return as soon as some data is available, so a
+ * short read is not an error. Returns 0 on error, or at the end of the
+ * data after setting source->bytes_left to 0. */
+typedef size_t (*pb_istream_refill_t)(pb_istream_t *source, pb_byte_t *buf, size_t count);
+
+/* State of a buffered input stream. The fields are private. */
+typedef struct pb_istream_buffer_s pb_istream_buffer_t;
+struct pb_istream_buffer_s
+{
+    pb_istream_t *source;
+    pb_istream_refill_t refill;
+    pb_byte_t *buf;
+    size_t size;
+    size_t pos;
+    size_t end;
+};
+
+/* Create an input stream that reads from another stream in blocks of up
+ * to size bytes, using buf as the storage. This reduces the number of
+ * calls to the callback of the source stream, which otherwise happen for
+ * each byte of varints and tags.
+ *
+ * The source stream is read ahead, but never past its bytes_left, so it
+ * should be set to the amount of data that is actually available. For
+ * serial ports and sockets, where it is not known, use
+ * pb_istream_buffered_partial() instead. The buffered stream starts with
+ * the same bytes_left, and must be used for all reading until it is no
+ * longer needed.
+ *
+ * Example usage:
+ *    pb_istream_t file_stream = {&file_read, file, file_size};
+ *    pb_istream_buffer_t state;
+ *    pb_byte_t buf[256];
+ *    pb_istream_t stream = pb_istream_buffered(&state, &file_stream, buf, sizeof(buf));
+ *    pb_decode(&stream, MyMessage_fields, &msg);
+ */
+pb_istream_t pb_istream_buffered(pb_istream_buffer_t *state, pb_istream_t *source, pb_byte_t *buf, size_t size);
+
+/* Like pb_istream_buffered(), but the buffer is filled by calling refill
+ * on the source instead of its stream callback. refill can return less
+ * than the buffer size, so the source can have bytes_left = SIZE_MAX and
+ * the decoder does not wait for data beyond the end of the message.
+ *
+ * Example usage:
+ *    pb_istream_t uart_stream = {NULL, &uart, SIZE_MAX};
+ *    pb_istream_buffer_t state;
+ *    pb_byte_t buf[64];
+ *    pb_istream_t stream = pb_istream_buffered_partial(&state, &uart_stream, &uart_refill, buf, sizeof(buf));
+ *    pb_decode_ex(&stream, MyMessage_fields, &msg, PB_DECODE_DELIMITED);
+ */
+pb_istream_t pb_istream_buffered_partial(pb_istream_buffer_t *state, pb_istream_t *source, pb_istream_refill_t refill, pb_byte_t *buf, size_t size);
+#endif
+
+#if !defined(PB_BUFFER_ONLY) && defined(PB_ENABLE_RING_STREAM)
+/* Create an input stream that reads the data currently in a ring buffer.
+ * bytes_left is set to the amount of data available. The space is not
+ * released to the producer until pb_ring_consume() is called, so an
+ * incomplete frame can be left in the ring and decoded again later.
+ * Only one consumer may read from a ring at a time.
+ *
+ * Example usage:
+ *    pb_ring_cursor_t cursor;
+ *    pb_istream_t stream = pb_istream_from_ring(&cursor, &rx_ring);
+ *    if (pb_decode_ex(&stream, MyMessage_fields, &msg, PB_DECODE_DELIMITED))
+ *        pb_ring_consume(&cursor);
+ */
+pb_istream_t pb_istream_from_ring(pb_ring_cursor_t *cursor, pb_ring_t *ring);
+
+/* Release the data read through the cursor back to the producer. */
+void pb_ring_consume(pb_ring_cursor_t *cursor);
+#endif
+
 
 /************************************************
  * Helper functions for writing field callbacks *
@@ -197,6 +548,100 @@ bool pb_decode_double_as_float(pb_istream_t *stream, float *dest);
 bool pb_make_string_substream(pb_istream_t *stream, pb_istream_t *substream);
 bool pb_close_string_substream(pb_istream_t *stream, pb_istream_t *substream);
 
+#ifdef PB_ENABLE_PUSH_DECODER
+/********************************
+ * Incremental (push) decoding  *
+ ********************************/
+
+/* Maximum nesting depth handled by the push decoder, counting the
+ * top-level message. Each level takes one pb_push_frame_t of memory. */
+#ifndef PB_PUSH_MAX_DEPTH
+#define PB_PUSH_MAX_DEPTH 8
+#endif
+
+typedef enum {
+    PB_PUSH_NEED_MORE = 0, /* All input consumed, message not yet complete */
+    PB_PUSH_DONE = 1,      /* Message fully decoded */
+    PB_PUSH_ERROR = 2      /* Decoding failed, see errmsg */
+} pb_push_status_t;
+
+/* Decoding state of one (sub)message. */
+typedef struct {
+    const pb_msgdesc_t *descriptor;
+    void *message;
+    size_t end; /* Input position where the message ends, or (size_t)-1 */
+    pb_size_t fixed_count_field;
+    pb_size_t fixed_count_size;
+    pb_size_t fixed_count_total_size;
+    uint32_t fields_seen[(PB_MAX_REQUIRED_FIELDS + 31) / 32];
+} pb_push_frame_t;
+
+/* State object for decoding a message from input that arrives in pieces,
+ * for example bytes from an UART interrupt or chunks read from a socket.
+ * The decoder keeps its position between calls, including in the middle
+ * of a varint, a string or a submessage, so the full message never needs
+ * to be buffered. The contents are private, use the functions below.
+ *
+ * Only statically allocated fields are supported. Callback fields
+ * without a decode function are skipped, other callback and pointer
+ * fields and registered extensions cause an error.
+ *
+ * The decoder holds pointers to itself, so it must not be copied or
+ * moved while decoding is in progress.
+ */
+typedef struct pb_push_decoder_s pb_push_decoder_t;
+struct pb_push_decoder_s
+{
+    pb_push_frame_t frames[PB_PUSH_MAX_DEPTH];
+    pb_field_iter_t iter;
+    size_t position;
+    size_t remaining;
+    pb_byte_t *dest;
+    pb_size_t depth;
+    uint_least8_t state;
+    uint_least8_t flags;
+    pb_wire_type_t wire_type;
+    uint_least8_t value_len;
+    uint_least8_t buf_len;
+    pb_byte_t buf[10];
+
+#ifndef PB_NO_ERRMSG
+    /* Pointer to constant (ROM) string when decoding has failed */
+    const char *errmsg;
+#endif
+};
+
+/* Prepare the decoder for a new message. Flags are the same as for
+ * pb_decode_ex(). With PB_DECODE_DELIMITED or PB_DECODE_NULLTERMINATED,
+ * the decoder detects the end of the message by itself. Otherwise the
+ * caller signals the end by calling pb_push_decode_finish().
+ *
+ * Call this again to decode the next message.
+ */
+bool pb_push_decoder_init(pb_push_decoder_t *decoder, const pb_msgdesc_t *fields, void *dest_struct, unsigned int flags);
+
+/* Feed count bytes of input to the decoder. Returns PB_PUSH_DONE once the
+ * message end has been reached; any bytes after it are left unconsumed.
+ * The number of bytes used is stored to *consumed, if it is not NULL.
+ *
+ * Example usage:
+ *    pb_push_decoder_t decoder;
+ *    pb_push_status_t status;
+ *    pb_push_decoder_init(&decoder, MyMessage_fields, &msg, PB_DECODE_DELIMITED);
+ *
+ *    do
+ *    {
+ *        pb_byte_t byte = uart_read_byte();
+ *        status = pb_push_decode(&decoder, &byte, 1, NULL);
+ *    } while (status == PB_PUSH_NEED_MORE);
+ */
+pb_push_status_t pb_push_decode(pb_push_decoder_t *decoder, const pb_byte_t *buf, size_t count, size_t *consumed);
+
+/* Signal that no more input will follow. For messages without a delimiter
+ * this checks that the message ended cleanly and returns PB_PUSH_DONE. */
+pb_push_status_t pb_push_decode_finish(pb_push_decoder_t *decoder);
+#endif
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif
@@ -6,6 +6,10 @@
 #include "test_helpers.h"
 #include "unittests.h"
 
+#ifdef PB_ENABLE_ARENA
+#include <arena_wrappers.h>
+#endif
+
 /* This function is called once from main(), it handles
    the decoding and checks the fields. */
 bool check_alltypes(pb_istream_t *stream, int mode)
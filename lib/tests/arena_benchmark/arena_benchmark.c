@@ -0,0 +1,102 @@
+/* Decode the same message repeatedly, first with pointer fields allocated
+ * by malloc() and released by pb_release(), then from an arena that is
+ * reset after each message. Prints the time taken by both methods.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pb_decode.h>
+#include "alltypes.pb.h"
+#include "test_helpers.h"
+
+#define ITERATIONS 20000
+
+static uint64_t g_arena_storage[4096];
+
+static bool decode_malloc(const uint8_t *buffer, size_t count)
+{
+    AllTypes msg = AllTypes_init_zero;
+    pb_istream_t stream = pb_istream_from_buffer(buffer, count);
+    bool status = pb_decode(&stream, AllTypes_fields, &msg);
+
+    if (!status)
+        fprintf(stderr, "malloc decode failed: %s\n", PB_GET_ERROR(&stream));
+
+    pb_release(AllTypes_fields, &msg);
+    return status;
+}
+
+static bool decode_arena(pb_arena_t *arena, const uint8_t *buffer, size_t count)
+{
+    AllTypes msg = AllTypes_init_zero;
+    pb_istream_t stream = pb_istream_from_buffer(buffer, count);
+    bool status;
+
+    stream.arena = arena;
+    status = pb_decode(&stream, AllTypes_fields, &msg);
+
+    if (!status)
+        fprintf(stderr, "arena decode failed: %s\n", PB_GET_ERROR(&stream));
+
+    pb_arena_reset(arena);
+    return status;
+}
+
+static double elapsed_us(clock_t start, long iterations)
+{
+    return (double)(clock() - start) * 1e6 / CLOCKS_PER_SEC / (double)iterations;
+}
+
+int main(int argc, char **argv)
+{
+    uint8_t buffer[1024];
+    size_t count;
+    long iterations = (argc > 1) ? atol(argv[1]) : ITERATIONS;
+    long i;
+    size_t arena_bytes;
+    pb_arena_t arena;
+    clock_t start;
+    double malloc_us, arena_us;
+
+    SET_BINARY_MODE(stdin);
+    count = fread(buffer, 1, sizeof(buffer), stdin);
+
+    pb_arena_init(&arena, g_arena_storage, sizeof(g_arena_storage));
+
+    /* Check that both methods work and measure arena usage */
+    {
+        AllTypes msg = AllTypes_init_zero;
+        pb_istream_t stream = pb_istream_from_buffer(buffer, count);
+        stream.arena = &arena;
+        if (!decode_malloc(buffer, count) || !pb_decode(&stream, AllTypes_fields, &msg))
+            return 1;
+
+        arena_bytes = arena.used;
+        pb_arena_reset(&arena);
+    }
+
+    start = clock();
+    for (i = 0; i < iterations; i++)
+    {
+        if (!decode_malloc(buffer, count))
+            return 1;
+    }
+    malloc_us = elapsed_us(start, iterations);
+
+    start = clock();
+    for (i = 0; i < iterations; i++)
+    {
+        if (!decode_arena(&arena, buffer, count))
+            return 1;
+    }
+    arena_us = elapsed_us(start, iterations);
+
+    printf("Message size: %u bytes, arena usage: %u bytes\n",
+           (unsigned)count, (unsigned)arena_bytes);
+    printf("malloc: %8.3f us per decode\n", malloc_us);
+    printf("arena:  %8.3f us per decode\n", arena_us);
+
+    return 0;
+}
@@ -0,0 +1,232 @@
+/* Count CPU cycles of the hydroponics message codecs and control loop on
+ * the simulated AVR. Timer1 runs at the CPU clock, and its overflows are
+ * counted in an interrupt to extend it to 32 bits.
+ *
+ * Prints one line of JSON per result:
+ * {"op": "encode", "message": "SensorData", "bytes": 37, "cycles": 4211}
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <pb_encode.h>
+#include <pb_decode.h>
+#include "unittests.h"
+#include "control_loop.h"
+
+/* Each measurement is repeated and the smallest count is reported */
+#define ROUNDS 4
+
+static volatile uint16_t g_overflows;
+
+ISR(TIMER1_OVF_vect)
+{
+    g_overflows++;
+}
+
+static void cycle_counter_init(void)
+{
+    TCCR1A = 0;
+    TCCR1B = _BV(CS10); /* No prescaler */
+    TIMSK1 = _BV(TOIE1);
+    sei();
+}
+
+static uint32_t cycle_counter_read(void)
+{
+    uint8_t sreg = SREG;
+    uint16_t low, high;
+
+    cli();
+    low = TCNT1;
+    high = g_overflows;
+
+    /* Overflow happened after cli(), but its interrupt has not run yet */
+    if ((TIFR1 & _BV(TOV1)) && low < 0x8000)
+        high++;
+
+    SREG = sreg;
+    return ((uint32_t)high << 16) | low;
+}
+
+typedef struct {
+    control_state_t control;
+    SensorData sensors;
+    Command command;
+    pb_byte_t sensors_buf[SensorData_size];
+    size_t sensors_len;
+    pb_byte_t command_buf[Command_size];
+    size_t command_len;
+    pb_byte_t rx[Command_size + 2];
+    size_t rx_len;
+    pb_byte_t tx[CONTROL_BUFFER_SIZE + HYDROPONICS_FRAME_OVERHEAD];
+    size_t tx_len;
+} bench_state_t;
+
+static bool op_nothing(bench_state_t *state)
+{
+    (void)state;
+    return true;
+}
+
+static bool op_encode_sensors(bench_state_t *state)
+{
+    pb_ostream_t stream = pb_ostream_from_buffer(state->sensors_buf, sizeof(state->sensors_buf));
+    return pb_encode(&stream, SensorData_fields, &state->sensors);
+}
+
+static bool op_decode_sensors(bench_state_t *state)
+{
+    SensorData msg;
+    pb_istream_t stream = pb_istream_from_buffer(state->sensors_buf, state->sensors_len);
+    return pb_decode(&stream, SensorData_fields, &msg);
+}
+
+static bool op_encode_command(bench_state_t *state)
+{
+    pb_ostream_t stream = pb_ostream_from_buffer(state->command_buf, sizeof(state->command_buf));
+    return pb_encode(&stream, Command_fields, &state->command);
+}
+
+static bool op_decode_command(bench_state_t *state)
+{
+    Command msg;
+    pb_istream_t stream = pb_istream_from_buffer(state->command_buf, state->command_len);
+    return pb_decode(&stream, Command_fields, &msg);
+}
+
+static bool op_control_step(bench_state_t *state)
+{
+    return control_step(&state->control, state->rx, state->rx_len,
+                        state->tx, sizeof(state->tx), &state->tx_len);
+}
+
+/* Returns the smallest cycle count of the operation, or 0 on failure */
+static uint32_t measure(bench_state_t *state, bool (*op)(bench_state_t *state))
+{
+    uint32_t best = 0xFFFFFFFFUL;
+    int i;
+
+    for (i = 0; i < ROUNDS; i++)
+    {
+        uint32_t start, cycles;
+
+        start = cycle_counter_read();
+        if (!op(state))
+            return 0;
+        cycles = cycle_counter_read() - start;
+
+        if (cycles < best)
+            best = cycles;
+    }
+
+    return best;
+}
+
+static void report(const char *op, const char *message, size_t bytes, uint32_t cycles)
+{
+    printf("{\"op\": \"%s\", \"message\": \"%s\", \"bytes\": %u, \"cycles\": %lu}\n",
+           op, message, (unsigned)bytes, (unsigned long)cycles);
+}
+
+int main()
+{
+    int status = 0;
+    static bench_state_t state;
+    uint32_t overhead, cycles;
+
+    cycle_counter_init();
+    control_init(&state.control);
+
+    /* Message contents are the ones the controller sends and receives */
+    state.sensors.temperature = 23.5f;
+    state.sensors.humidity = 61.0f;
+    state.sensors.light_level = 68.4f;
+    state.sensors.ph_levels_count = NUM_PH_SENSORS;
+    state.sensors.ph_levels[0] = 6.1f;
+    state.sensors.ph_levels[1] = 6.3f;
+    state.sensors.ph_levels[2] = 5.9f;
+    state.sensors.ph_levels[3] = 6.0f;
+    state.sensors.ph_levels[4] = 6.2f;
+    state.sensors.relay_states_count = NUM_RELAYS;
+    state.sensors.relay_states[1] = true;
+    state.sensors.relay_states[3] = true;
+
+    state.command.type = Command_CommandType_CALIBRATE_PH;
+    state.command.ph_sensor_index = 2;
+    state.command.ph_calibration_value = 7.0f;
+
+    COMMENT("Prepare messages");
+    {
+        pb_ostream_t stream = pb_ostream_from_buffer(state.sensors_buf, sizeof(state.sensors_buf));
+        TEST(pb_encode(&stream, SensorData_fields, &state.sensors));
+        state.sensors_len = stream.bytes_written;
+    }
+    {
+        pb_ostream_t stream = pb_ostream_from_buffer(state.command_buf, sizeof(state.command_buf));
+        TEST(pb_encode(&stream, Command_fields, &state.command));
+        state.command_len = stream.bytes_written;
+    }
+    {
+        /* The control loop receives a relay toggle on every iteration */
+        Command toggle = Command_init_zero;
+        pb_ostream_t stream = pb_ostream_from_buffer(state.rx + 2, sizeof(state.rx) - 2);
+        toggle.type = Command_CommandType_TOGGLE_RELAY;
+        toggle.relay_index = 2;
+        TEST(pb_encode(&stream, Command_fields, &toggle));
+        state.rx[0] = (pb_byte_t)stream.bytes_written;
+        state.rx[1] = 0;
+        state.rx_len = stream.bytes_written + 2;
+    }
+
+    COMMENT("Check control loop output");
+    {
+        SensorData msg = SensorData_init_zero;
+        pb_istream_t stream;
+
+        TEST(op_control_step(&state));
+        TEST(state.tx[0] == 0xFF && state.tx[1] == 0xFE);
+        TEST(state.tx_len == (size_t)state.tx[2] + HYDROPONICS_FRAME_OVERHEAD);
+        stream = pb_istream_from_buffer(state.tx + 4, state.tx[2]);
+        TEST(pb_decode(&stream, SensorData_fields, &msg));
+        TEST(msg.ph_levels_count == NUM_PH_SENSORS);
+        TEST(msg.ph_levels[0] > 6.0f && msg.ph_levels[0] < 8.0f);
+        TEST(!msg.relay_states[2]);
+        TEST(state.control.relay_states[2] && state.control.commands_handled == 1);
+    }
+
+    if (status != 0)
+    {
+        fprintf(stdout, "\n\nSome tests FAILED!\n");
+        return status;
+    }
+
+    COMMENT("Cycle counts");
+    overhead = measure(&state, op_nothing);
+
+    cycles = measure(&state, op_encode_sensors);
+    TEST(cycles > overhead);
+    report("encode", "SensorData", state.sensors_len, cycles - overhead);
+
+    cycles = measure(&state, op_decode_sensors);
+    TEST(cycles > overhead);
+    report("decode", "SensorData", state.sensors_len, cycles - overhead);
+
+    cycles = measure(&state, op_encode_command);
+    TEST(cycles > overhead);
+    report("encode", "Command", state.command_len, cycles - overhead);
+
+    cycles = measure(&state, op_decode_command);
+    TEST(cycles > overhead);
+    report("decode", "Command", state.command_len, cycles - overhead);
+
+    cycles = measure(&state, op_control_step);
+    TEST(cycles > overhead);
+    report("control_loop", "", state.tx_len + state.rx_len, cycles - overhead);
+
+    if (status != 0)
+        fprintf(stdout, "\n\nSome tests FAILED!\n");
+
+    return status;
+}
@@ -0,0 +1,116 @@
+/* Model of the hydroponics control loop, following the structure of
+ * HydroponicsController in hardware/hydroponics.cpp. */
+
+#include <string.h>
+#include <pb_encode.h>
+#include <pb_decode.h>
+#include "control_loop.h"
+
+void control_init(control_state_t *state)
+{
+    int i, j;
+
+    memset(state, 0, sizeof(*state));
+    state->temperature = 23.5f;
+    state->humidity = 61.0f;
+    state->light_raw = 700;
+
+    for (i = 0; i < NUM_PH_SENSORS; i++)
+    {
+        state->ph_calibration[i] = 1.0f;
+        for (j = 0; j < PH_SAMPLES; j++)
+        {
+            /* Readings around 2.4 V, with one disconnected sample */
+            state->ph_raw[i][j] = (j == 3) ? 0 : 480 + 4 * i + (j & 3);
+        }
+    }
+}
+
+static float read_ph_sensor(const control_state_t *state, int index)
+{
+    return hydroponics_ph_from_samples(state->ph_raw[index], PH_SAMPLES,
+                                       state->ph_calibration[index]);
+}
+
+static void get_sensor_data(const control_state_t *state, SensorData *data)
+{
+    int i;
+
+    data->temperature = state->temperature;
+    data->humidity = state->humidity;
+    data->light_level = hydroponics_light_level(state->light_raw);
+
+    data->ph_levels_count = NUM_PH_SENSORS;
+    for (i = 0; i < NUM_PH_SENSORS; i++)
+        data->ph_levels[i] = read_ph_sensor(state, i);
+
+    data->relay_states_count = NUM_RELAYS;
+    for (i = 0; i < NUM_RELAYS; i++)
+        data->relay_states[i] = state->relay_states[i];
+}
+
+static void toggle_relay(void *context, uint32_t index)
+{
+    control_state_t *state = (control_state_t*)context;
+    state->relay_states[index] = !state->relay_states[index];
+}
+
+/* The firmware averages several readings, one is enough here because
+ * the simulated samples do not change. */
+static void calibrate_ph(void *context, uint32_t index, float value)
+{
+    control_state_t *state = (control_state_t*)context;
+    float reading = read_ph_sensor(state, (int)index);
+
+    if (reading > 0)
+        state->ph_calibration[index] = value / reading;
+}
+
+bool control_step(control_state_t *state,
+                  const pb_byte_t *rx, size_t rx_len,
+                  pb_byte_t *tx, size_t tx_size, size_t *tx_len)
+{
+    SensorData data = SensorData_init_zero;
+    hydroponics_handler_t handler;
+    pb_byte_t buffer[CONTROL_BUFFER_SIZE];
+    pb_ostream_t ostream = pb_ostream_from_buffer(buffer, sizeof(buffer));
+    size_t length;
+
+    handler.toggle_relay = &toggle_relay;
+    handler.calibrate_ph = &calibrate_ph;
+    handler.context = state;
+
+    get_sensor_data(state, &data);
+    if (!pb_encode(&ostream, SensorData_fields, &data))
+        return false;
+
+    /* Frame as sendSensorData() does */
+    *tx_len = hydroponics_frame(tx, tx_size, buffer, ostream.bytes_written);
+    if (*tx_len == 0)
+        return false;
+
+    /* Commands are prefixed with a 16-bit little endian length */
+    while (rx_len >= 2)
+    {
+        Command cmd = Command_init_zero;
+        pb_istream_t istream;
+
+        length = (size_t)rx[0] | ((size_t)rx[1] << 8);
+        rx += 2;
+        rx_len -= 2;
+
+        if (length > CONTROL_BUFFER_SIZE || length > rx_len)
+            return false;
+
+        istream = pb_istream_from_buffer(rx, length);
+        if (!pb_decode(&istream, Command_fields, &cmd))
+            return false;
+
+        hydroponics_handle_command(&handler, &cmd);
+        state->commands_handled++;
+        rx += length;
+        rx_len -= length;
+    }
+
+    return true;
+}
@@ -0,0 +1,41 @@
+/* Host-neutral model of one HydroponicsController::update() iteration
+ * from hardware/hydroponics.cpp. The Arduino pin reads are replaced by
+ * fixed sample tables so that every iteration does the same work, the
+ * conversion, framing and command handling come from hydroponics_logic.c.
+ */
+
+#ifndef CONTROL_LOOP_H
+#define CONTROL_LOOP_H
+
+#include <pb.h>
+#include "hydroponics.pb.h"
+#include "hydroponics_logic.h"
+
+/* Buffer size used by the firmware */
+#define CONTROL_BUFFER_SIZE 128
+
+typedef struct {
+    /* Simulated sensor inputs */
+    float temperature;
+    float humidity;
+    int light_raw;
+    int ph_raw[NUM_PH_SENSORS][PH_SAMPLES];
+
+    /* Controller state */
+    float ph_calibration[NUM_PH_SENSORS];
+    bool relay_states[NUM_RELAYS];
+    uint32_t commands_handled;
+} control_state_t;
+
+/* Initialize state with default calibration and plausible sensor values */
+void control_init(control_state_t *state);
+
+/* Sample the sensors, encode and frame SensorData into tx, then decode and
+ * handle the length-prefixed commands in rx. Returns false if encoding
+ * fails or a command does not decode.
+ */
+bool control_step(control_state_t *state,
+                  const pb_byte_t *rx, size_t rx_len,
+                  pb_byte_t *tx, size_t tx_size, size_t *tx_len);
+
+#endif
@@ -0,0 +1,203 @@
+/* Check pb_index_delimited() and pb_decode_batch() against sequential
+ * decoding of a log of delimited records, and print the time taken
+ * with different numbers of threads.
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pb_encode.h>
+#include <pb_decode.h>
+#include <pb_batch.h>
+#include "unittests.h"
+#include "batch_decode.pb.h"
+
+#define RECORDS 200000
+#define ROUNDS 5
+
+static double now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e6 + (double)ts.tv_nsec / 1e3;
+}
+
+static size_t encode_log(pb_byte_t *buffer, size_t size, size_t records)
+{
+    pb_ostream_t stream = pb_ostream_from_buffer(buffer, size);
+    size_t i;
+
+    for (i = 0; i < records; i++)
+    {
+        SensorData msg = SensorData_init_zero;
+        msg.temperature = 20.0f + (float)(i % 50) / 10.0f;
+        msg.humidity = (float)(i % 100);
+        msg.light_level = (float)i;
+        msg.ph_levels_count = (pb_size_t)(i % 6);
+        msg.relay_states_count = (pb_size_t)((i / 6) % 6);
+        if (msg.ph_levels_count > 0)
+            msg.ph_levels[msg.ph_levels_count - 1] = 6.5f;
+        if (msg.relay_states_count > 0)
+            msg.relay_states[0] = true;
+
+        if (!pb_encode_ex(&stream, SensorData_fields, &msg, PB_ENCODE_DELIMITED))
+            return 0;
+    }
+
+    return stream.bytes_written;
+}
+
+/* Time decoding of the whole log and check the result against ref */
+static double bench(const pb_view_t *records, size_t count, SensorData *msgs,
+                    const SensorData *ref, unsigned int threads, bool *ok)
+{
+    double best = 0;
+    int i;
+
+    for (i = 0; i < ROUNDS; i++)
+    {
+        double start, t;
+        memset(msgs, 0, count * sizeof(SensorData));
+        start = now_us();
+        if (!pb_decode_batch(records, count, SensorData_fields, msgs,
+                             sizeof(SensorData), 0, threads, NULL))
+            *ok = false;
+        t = now_us() - start;
+        if (i == 0 || t < best)
+            best = t;
+    }
+
+    if (memcmp(msgs, ref, count * sizeof(SensorData)) != 0)
+        *ok = false;
+
+    return best;
+}
+
+int main(int argc, char **argv)
+{
+    int status = 0;
+    size_t record_count = (argc > 1) ? (size_t)atol(argv[1]) : RECORDS;
+    size_t bufsize = record_count * SensorData_size + 16;
+    pb_byte_t *buffer = malloc(bufsize);
+    pb_view_t *records = malloc(record_count * sizeof(pb_view_t));
+    SensorData *ref = calloc(record_count, sizeof(SensorData));
+    SensorData *msgs = calloc(record_count, sizeof(SensorData));
+    size_t msglen, count = 0;
+    double sequential_us;
+
+    if (!buffer || !records || !ref || !msgs)
+        return 1;
+
+    COMMENT("Encode log");
+    msglen = encode_log(buffer, bufsize, record_count);
+    TEST(msglen > 0);
+
+    {
+        pb_istream_t stream = pb_istream_from_buffer(buffer, msglen);
+        size_t i = 0;
+        double start = now_us();
+
+        COMMENT("Sequential decode");
+        while (i < record_count && pb_decode_ex(&stream, SensorData_fields, &ref[i], PB_DECODE_DELIMITED))
+            i++;
+        sequential_us = now_us() - start;
+        TEST(i == record_count && stream.bytes_left == 0);
+    }
+
+    {
+        COMMENT("Index the records");
+        TEST(pb_index_delimited(buffer, msglen, NULL, 0, &count));
+        TEST(count == record_count);
+        TEST(pb_index_delimited(buffer, msglen, records, record_count, &count));
+        TEST(count == record_count);
+        TEST(records[0].ptr == buffer + 1 && records[count - 1].ptr + records[count - 1].len == buffer + msglen);
+        TEST(!pb_index_delimited(buffer, msglen, records, record_count - 1, &count));
+        TEST(!pb_index_delimited(buffer, msglen - 1, NULL, 0, &count));
+        TEST(count == record_count);
+    }
+
+    {
+        pb_view_t view;
+        const pb_byte_t longest[] = {0xFF, 0xFF, 0xFF, 0xFF, 0x0F};
+        const pb_byte_t toolong[] = {0xFF, 0xFF, 0xFF, 0xFF, 0x1F};
+        const pb_byte_t unterminated[] = {0x80, 0x80};
+        const pb_byte_t empty[] = {0x00, 0x80, 0x00};
+        size_t n = 1;
+
+        COMMENT("Empty and malformed records");
+        TEST(pb_index_delimited(buffer, 0, NULL, 0, &n) && n == 0);
+        TEST(pb_index_delimited(empty, sizeof(empty), NULL, 0, &n) && n == 2);
+        TEST(!pb_index_delimited(longest, sizeof(longest), &view, 1, &n));
+        TEST(!pb_index_delimited(toolong, sizeof(toolong), &view, 1, &n));
+        TEST(!pb_index_delimited(unterminated, sizeof(unterminated), &view, 1, &n));
+    }
+
+    {
+        size_t failed = 0;
+        size_t bad = record_count / 3;
+        bool ok = true;
+        pb_byte_t *first = buffer + (records[bad].ptr - buffer);
+        pb_byte_t *second = buffer + (records[bad + 5].ptr - buffer);
+        pb_byte_t saved1 = *first, saved2 = *second;
+
+        COMMENT("Decode in parallel");
+        TEST(bench(records, count, msgs, ref, 3, &ok) > 0 && ok);
+
+        COMMENT("Report the first failed record");
+        *first = 0x0F; /* Invalid wire type */
+        *second = 0x0F;
+        TEST(!pb_decode_batch(records, count, SensorData_fields, msgs, sizeof(SensorData), 0, 4, &failed));
+        TEST(failed == bad);
+        TEST(memcmp(&msgs[bad + 6], &ref[bad + 6], sizeof(SensorData)) == 0);
+        *first = saved1;
+        *second = saved2;
+    }
+
+    if (status == 0)
+    {
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        unsigned int max_threads = (cores > 4) ? (unsigned int)cores : 4;
+        unsigned int threads;
+        double index_us, single_us = 0;
+        bool ok = true;
+
+        index_us = now_us();
+        if (!pb_index_delimited(buffer, msglen, records, record_count, &count))
+            return 1;
+        index_us = now_us() - index_us;
+
+        if (max_threads > PB_BATCH_MAX_THREADS)
+            max_threads = PB_BATCH_MAX_THREADS;
+
+        printf("%u records, %u bytes, %ld cores\n", (unsigned)count, (unsigned)msglen, cores);
+        printf("sequential:    %10.1f us\n", sequential_us);
+        printf("index:         %10.1f us\n", index_us);
+
+        for (threads = 1; threads <= max_threads; threads *= 2)
+        {
+            double t = bench(records, count, msgs, ref, threads, &ok);
+            if (threads == 1)
+                single_us = t;
+            printf("%3u threads:   %10.1f us, speedup %.2f\n", threads, t, single_us / t);
+
+            if (threads < max_threads && threads * 2 > max_threads)
+                threads = max_threads / 2;
+        }
+
+        TEST(ok);
+    }
+
+    free(buffer);
+    free(records);
+    free(ref);
+    free(msgs);
+
+    if (status != 0)
+        fprintf(stdout, "\n\nSome tests FAILED!\n");
+
+    return status;
+}
@@ -0,0 +1,179 @@
+/* Check that pb_encode_batch() produces the same output as sequential
+ * pb_encode_ex() calls, and print the time taken with different numbers
+ * of threads.
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pb_encode.h>
+#include <pb_decode.h>
+#include <pb_batch.h>
+#include "unittests.h"
+#include "batch_decode.pb.h"
+
+#define RECORDS 200000
+#define ROUNDS 5
+
+static double now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e6 + (double)ts.tv_nsec / 1e3;
+}
+
+static void fill_messages(SensorData *msgs, size_t count)
+{
+    size_t i;
+
+    for (i = 0; i < count; i++)
+    {
+        SensorData *msg = &msgs[i];
+        memset(msg, 0, sizeof(SensorData));
+        msg->temperature = 20.0f + (float)(i % 50) / 10.0f;
+        msg->humidity = (float)(i % 100);
+        msg->light_level = (float)i;
+        msg->ph_levels_count = (pb_size_t)(i % 6);
+        msg->relay_states_count = (pb_size_t)((i / 6) % 6);
+        if (msg->ph_levels_count > 0)
+            msg->ph_levels[msg->ph_levels_count - 1] = 6.5f;
+        if (msg->relay_states_count > 0)
+            msg->relay_states[0] = true;
+    }
+}
+
+/* Time encoding of all messages and check the result against ref */
+static double bench(const SensorData *msgs, size_t count, pb_byte_t *buf,
+                    size_t bufsize, pb_view_t *records, const pb_byte_t *ref,
+                    size_t reflen, unsigned int threads, bool *ok)
+{
+    double best = 0;
+    int i;
+
+    for (i = 0; i < ROUNDS; i++)
+    {
+        double start, t;
+        size_t size = 0;
+        memset(buf, 0, bufsize);
+        start = now_us();
+        if (!pb_encode_batch(msgs, count, sizeof(SensorData), SensorData_fields,
+                             buf, bufsize, records, threads, &size))
+            *ok = false;
+        t = now_us() - start;
+        if (i == 0 || t < best)
+            best = t;
+
+        if (size != reflen || memcmp(buf, ref, reflen) != 0)
+            *ok = false;
+    }
+
+    return best;
+}
+
+int main(int argc, char **argv)
+{
+    int status = 0;
+    size_t record_count = (argc > 1) ? (size_t)atol(argv[1]) : RECORDS;
+    size_t bufsize = record_count * SensorData_size + 16;
+    SensorData *msgs = malloc(record_count * sizeof(SensorData));
+    pb_view_t *records = malloc(record_count * sizeof(pb_view_t));
+    pb_byte_t *ref = malloc(bufsize);
+    pb_byte_t *buf = malloc(bufsize);
+    size_t reflen = 0;
+    double sequential_us;
+
+    if (!msgs || !records || !ref || !buf)
+        return 1;
+
+    fill_messages(msgs, record_count);
+
+    {
+        pb_ostream_t stream = pb_ostream_from_buffer(ref, bufsize);
+        size_t i = 0;
+        double start = now_us();
+
+        COMMENT("Sequential encode");
+        while (i < record_count && pb_encode_ex(&stream, SensorData_fields, &msgs[i], PB_ENCODE_DELIMITED))
+            i++;
+        sequential_us = now_us() - start;
+        reflen = stream.bytes_written;
+        TEST(i == record_count);
+    }
+
+    {
+        size_t size = 0;
+        pb_view_t index[3];
+        size_t count = 0;
+
+        COMMENT("Compute size only");
+        TEST(pb_encode_batch(msgs, record_count, sizeof(SensorData), SensorData_fields,
+                             NULL, 0, records, 2, &size));
+        TEST(size == reflen);
+
+        COMMENT("Output buffer too small");
+        TEST(!pb_encode_batch(msgs, record_count, sizeof(SensorData), SensorData_fields,
+                              buf, reflen - 1, records, 2, &size));
+        TEST(size == reflen);
+
+        COMMENT("Encode a few records");
+        TEST(pb_encode_batch(msgs, 3, sizeof(SensorData), SensorData_fields,
+                             buf, bufsize, records, 4, &size));
+        TEST(memcmp(buf, ref, size) == 0);
+        TEST(pb_index_delimited(buf, size, index, 3, &count) && count == 3);
+        TEST(index[2].ptr == records[2].ptr && index[2].len == records[2].len);
+
+        COMMENT("Encode nothing");
+        TEST(pb_encode_batch(msgs, 0, sizeof(SensorData), SensorData_fields,
+                             buf, bufsize, records, 4, &size));
+        TEST(size == 0);
+    }
+
+    {
+        bool ok = true;
+
+        COMMENT("Encode in parallel");
+        TEST(bench(msgs, record_count, buf, bufsize, records, ref, reflen, 3, &ok) > 0 && ok);
+    }
+
+    if (status == 0)
+    {
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        unsigned int max_threads = (cores > 4) ? (unsigned int)cores : 4;
+        unsigned int threads;
+        double single_us = 0;
+        bool ok = true;
+
+        if (max_threads > PB_BATCH_MAX_THREADS)
+            max_threads = PB_BATCH_MAX_THREADS;
+
+        printf("%u records, %u bytes, %ld cores\n", (unsigned)record_count, (unsigned)reflen, cores);
+        printf("sequential:    %10.1f us\n", sequential_us);
+
+        for (threads = 1; threads <= max_threads; threads *= 2)
+        {
+            double t = bench(msgs, record_count, buf, bufsize, records, ref, reflen, threads, &ok);
+            if (threads == 1)
+                single_us = t;
+            printf("%3u threads:   %10.1f us, speedup %.2f\n", threads, t, single_us / t);
+
+            if (threads < max_threads && threads * 2 > max_threads)
+                threads = max_threads / 2;
+        }
+
+        TEST(ok);
+    }
+
+    free(msgs);
+    free(records);
+    free(ref);
+    free(buf);
+
+    if (status != 0)
+        fprintf(stdout, "\n\nSome tests FAILED!\n");
+
+    return status;
+}
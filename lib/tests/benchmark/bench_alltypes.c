@@ -0,0 +1,11 @@
+/* AllTypes message, with static fields or with pointer fields depending
+ * on which alltypes.pb.h is in the include path. */
+
+#include "benchmark.h"
+#include "alltypes.pb.h"
+
+const bench_case_t bench_cases[] = {
+    {"AllTypes", AllTypes_fields, sizeof(AllTypes), NULL, NULL}
+};
+
+const size_t bench_case_count = sizeof(bench_cases) / sizeof(bench_cases[0]);
@@ -0,0 +1,126 @@
+/* Callback fields, with the same contents as in the callbacks test case.
+ * The decode callbacks read the values but do not store them. */
+
+#include <string.h>
+#include <pb_encode.h>
+#include <pb_decode.h>
+#include "benchmark.h"
+#include "callbacks.pb.h"
+
+static bool encode_string(pb_ostream_t *stream, const pb_field_t *field, void * const *arg)
+{
+    const char *str = "Hello world!";
+    PB_UNUSED(arg);
+    return pb_encode_tag_for_field(stream, field) &&
+           pb_encode_string(stream, (const pb_byte_t*)str, strlen(str));
+}
+
+static bool encode_int32(pb_ostream_t *stream, const pb_field_t *field, void * const *arg)
+{
+    int i;
+    PB_UNUSED(arg);
+    for (i = 0; i < 5; i++)
+    {
+        if (!pb_encode_tag_for_field(stream, field) ||
+            !pb_encode_varint(stream, (uint64_t)(42 + i * 1000)))
+            return false;
+    }
+    return true;
+}
+
+static bool encode_fixed32(pb_ostream_t *stream, const pb_field_t *field, void * const *arg)
+{
+    uint32_t value = 42;
+    PB_UNUSED(arg);
+    return pb_encode_tag_for_field(stream, field) &&
+           pb_encode_fixed32(stream, &value);
+}
+
+static bool encode_fixed64(pb_ostream_t *stream, const pb_field_t *field, void * const *arg)
+{
+    uint64_t value = 42;
+    PB_UNUSED(arg);
+    return pb_encode_tag_for_field(stream, field) &&
+           pb_encode_fixed64(stream, &value);
+}
+
+static bool encode_repeatedstring(pb_ostream_t *stream, const pb_field_t *field, void * const *arg)
+{
+    const char *str[4] = {"Hello world!", "", "Test", "Test2"};
+    int i;
+    PB_UNUSED(arg);
+    for (i = 0; i < 4; i++)
+    {
+        if (!pb_encode_tag_for_field(stream, field) ||
+            !pb_encode_string(stream, (const pb_byte_t*)str[i], strlen(str[i])))
+            return false;
+    }
+    return true;
+}
+
+static bool decode_string(pb_istream_t *stream, const pb_field_t *field, void **arg)
+{
+    pb_byte_t buf[64];
+    PB_UNUSED(field);
+    PB_UNUSED(arg);
+    return stream->bytes_left <= sizeof(buf) && pb_read(stream, buf, stream->bytes_left);
+}
+
+static bool decode_int32(pb_istream_t *stream, const pb_field_t *field, void **arg)
+{
+    uint64_t value;
+    PB_UNUSED(field);
+    PB_UNUSED(arg);
+    return pb_decode_varint(stream, &value);
+}
+
+static bool decode_fixed32(pb_istream_t *stream, const pb_field_t *field, void **arg)
+{
+    uint32_t value;
+    PB_UNUSED(field);
+    PB_UNUSED(arg);
+    return pb_decode_fixed32(stream, &value);
+}
+
+static bool decode_fixed64(pb_istream_t *stream, const pb_field_t *field, void **arg)
+{
+    uint64_t value;
+    PB_UNUSED(field);
+    PB_UNUSED(arg);
+    return pb_decode_fixed64(stream, &value);
+}
+
+static void prepare_encode(void *msg)
+{
+    TestMessage *m = (TestMessage*)msg;
+    m->stringvalue.funcs.encode = &encode_string;
+    m->int32value.funcs.encode = &encode_int32;
+    m->fixed32value.funcs.encode = &encode_fixed32;
+    m->fixed64value.funcs.encode = &encode_fixed64;
+    m->has_submsg = true;
+    m->submsg.stringvalue.funcs.encode = &encode_string;
+    m->submsg.int32value.funcs.encode = &encode_int32;
+    m->submsg.fixed32value.funcs.encode = &encode_fixed32;
+    m->submsg.fixed64value.funcs.encode = &encode_fixed64;
+    m->repeatedstring.funcs.encode = &encode_repeatedstring;
+}
+
+static void prepare_decode(void *msg)
+{
+    TestMessage *m = (TestMessage*)msg;
+    m->stringvalue.funcs.decode = &decode_string;
+    m->int32value.funcs.decode = &decode_int32;
+    m->fixed32value.funcs.decode = &decode_fixed32;
+    m->fixed64value.funcs.decode = &decode_fixed64;
+    m->submsg.stringvalue.funcs.decode = &decode_string;
+    m->submsg.int32value.funcs.decode = &decode_int32;
+    m->submsg.fixed32value.funcs.decode = &decode_fixed32;
+    m->submsg.fixed64value.funcs.decode = &decode_fixed64;
+    m->repeatedstring.funcs.decode = &decode_string;
+}
+
+const bench_case_t bench_cases[] = {
+    {"TestMessage", TestMessage_fields, sizeof(TestMessage), prepare_encode, prepare_decode}
+};
+
+const size_t bench_case_count = sizeof(bench_cases) / sizeof(bench_cases[0]);
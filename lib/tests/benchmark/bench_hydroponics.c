@@ -0,0 +1,11 @@
+/* Messages exchanged with the hydroponics controllers */
+
+#include "benchmark.h"
+#include "hydroponics.pb.h"
+
+const bench_case_t bench_cases[] = {
+    {"SensorData", SensorData_fields, sizeof(SensorData), NULL, NULL},
+    {"Command", Command_fields, sizeof(Command), NULL, NULL}
+};
+
+const size_t bench_case_count = sizeof(bench_cases) / sizeof(bench_cases[0]);
@@ -0,0 +1,10 @@
+/* Map with string keys, encoded as repeated submessages */
+
+#include "benchmark.h"
+#include "map.pb.h"
+
+const bench_case_t bench_cases[] = {
+    {"MyMessage", MyMessage_fields, sizeof(MyMessage), NULL, NULL}
+};
+
+const size_t bench_case_count = sizeof(bench_cases) / sizeof(bench_cases[0]);
@@ -0,0 +1,26 @@
+/* Oneof fields. The generated values select the first member of the
+ * oneof, so the submessage member is filled in separately. */
+
+#include "benchmark.h"
+#include "oneof.pb.h"
+
+static void prepare_submsg(void *msg)
+{
+    OneOfMessage *m = (OneOfMessage*)msg;
+    pb_size_t i;
+
+    m->prefix = 123;
+    m->which_values = OneOfMessage_third_tag;
+    m->values.third.array_count = 8;
+    for (i = 0; i < 8; i++)
+        m->values.third.array[i] = (int32_t)(i * 1000);
+    m->suffix = 321;
+}
+
+const bench_case_t bench_cases[] = {
+    {"OneOfMessage", OneOfMessage_fields, sizeof(OneOfMessage), NULL, NULL},
+    {"OneOfMessage.third", OneOfMessage_fields, sizeof(OneOfMessage), prepare_submsg, NULL},
+    {"PlainOneOfMessage", PlainOneOfMessage_fields, sizeof(PlainOneOfMessage), NULL, NULL}
+};
+
+const size_t bench_case_count = sizeof(bench_cases) / sizeof(bench_cases[0]);
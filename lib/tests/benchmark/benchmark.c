@@ -0,0 +1,481 @@
+/* Throughput benchmark driver. For each message type in bench_cases[],
+ * measures encoding and decoding through buffer streams and callback
+ * streams, and prints one line of JSON per result:
+ *
+ *   {"set": "alltypes", "config": "default", "message": "AllTypes",
+ *    "stream": "buffer", "op": "encode", "bytes": 565,
+ *    "iterations": 65536, "ns_per_op": 812.4, "mb_per_s": 695.5}
+ *
+ * Usage: bench_<set>_<config> <set> <config> [min_time_ms]
+ * The set and config names are only copied to the output.
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pb_encode.h>
+#include <pb_decode.h>
+#include <pb_common.h>
+#include "benchmark.h"
+
+/* Number of entries in generated repeated fields, and length of
+ * generated strings and bytes. */
+#define BENCH_REPEAT 5
+#define BENCH_STRLEN 12
+
+/* Number of times each measurement is repeated */
+#define BENCH_ROUNDS 5
+
+static uint32_t g_seed = 1;
+static const pb_byte_t g_view_data[BENCH_STRLEN] = "view content";
+
+static double g_min_time_ns = 10e6;
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static void *bench_calloc(size_t count, size_t size)
+{
+    void *ptr = calloc(count, size);
+    if (!ptr)
+    {
+        fprintf(stderr, "Out of memory\n");
+        exit(2);
+    }
+    return ptr;
+}
+
+/************************************
+ * Generated values for the message *
+ ************************************/
+
+static void fill_message(const pb_msgdesc_t *fields, void *msg);
+
+/* Integer of size bytes. The values vary in magnitude so that varints
+ * have different lengths, but stay positive. */
+static void fill_number(void *data, size_t size)
+{
+    uint32_t value;
+
+    g_seed = g_seed * 1103515245u + 12345u;
+    value = (g_seed >> 8) >> (g_seed % 24);
+
+    if (size == 1)
+    {
+        uint8_t v = (uint8_t)(value & 0x7F);
+        memcpy(data, &v, 1);
+    }
+    else if (size == 2)
+    {
+        uint16_t v = (uint16_t)(value & 0x7FFF);
+        memcpy(data, &v, 2);
+    }
+    else if (size == 4)
+    {
+        memcpy(data, &value, 4);
+    }
+#ifndef PB_WITHOUT_64BIT
+    else if (size == 8)
+    {
+        uint64_t v = ((uint64_t)value << 20) | value;
+        memcpy(data, &v, 8);
+    }
+#endif
+}
+
+/* Fill one item of a field into data, which has room for size bytes */
+static void fill_value(const pb_field_iter_t *field, void *data, size_t size)
+{
+    switch (PB_LTYPE(field->type))
+    {
+        case PB_LTYPE_BOOL:
+            *(bool*)data = true;
+            break;
+
+        case PB_LTYPE_VARINT:
+        case PB_LTYPE_UVARINT:
+        case PB_LTYPE_SVARINT:
+        case PB_LTYPE_FIXED32:
+        case PB_LTYPE_FIXED64:
+            fill_number(data, field->data_size);
+            break;
+
+        case PB_LTYPE_STRING:
+        {
+            char *str = (char*)data;
+            size_t len = (size - 1 < BENCH_STRLEN) ? size - 1 : BENCH_STRLEN;
+            memcpy(str, "abcdefghijklmnop", len);
+            str[len] = '\0';
+            break;
+        }
+
+        case PB_LTYPE_BYTES:
+        {
+            pb_bytes_array_t *bytes = (pb_bytes_array_t*)data;
+            size_t max = size - offsetof(pb_bytes_array_t, bytes);
+            bytes->size = (pb_size_t)((max < BENCH_STRLEN) ? max : BENCH_STRLEN);
+            memset(bytes->bytes, 0x55, bytes->size);
+            break;
+        }
+
+        case PB_LTYPE_FIXED_LENGTH_BYTES:
+            memset(data, 0xAA, size);
+            break;
+
+        case PB_LTYPE_VIEW:
+            ((pb_view_t*)data)->ptr = g_view_data;
+            ((pb_view_t*)data)->len = BENCH_STRLEN;
+            break;
+
+        case PB_LTYPE_SUBMESSAGE:
+        case PB_LTYPE_SUBMSG_W_CB:
+            fill_message(field->submsg_desc, data);
+            break;
+
+        default:
+            break;
+    }
+}
+
+#ifdef PB_ENABLE_MALLOC
+/* Allocate and fill count items of a pointer field. The memory is
+ * released by pb_release(). */
+static void fill_pointer(const pb_field_iter_t *field, pb_size_t count)
+{
+    bool repeated = PB_HTYPE(field->type) == PB_HTYPE_REPEATED;
+    pb_size_t i;
+
+    if (PB_LTYPE(field->type) == PB_LTYPE_STRING || PB_LTYPE(field->type) == PB_LTYPE_BYTES)
+    {
+        /* Each item is a separate allocation */
+        size_t size = (PB_LTYPE(field->type) == PB_LTYPE_STRING) ?
+                      BENCH_STRLEN + 1 : PB_BYTES_ARRAY_T_ALLOCSIZE(BENCH_STRLEN);
+
+        if (repeated)
+        {
+            void **array = (void**)bench_calloc(count, sizeof(void*));
+            for (i = 0; i < count; i++)
+            {
+                array[i] = bench_calloc(1, size);
+                fill_value(field, array[i], size);
+            }
+            *(void**)field->pField = array;
+        }
+        else
+        {
+            void *item = bench_calloc(1, size);
+            fill_value(field, item, size);
+            *(void**)field->pField = item;
+        }
+    }
+    else
+    {
+        char *array = (char*)bench_calloc(count, field->data_size);
+        for (i = 0; i < count; i++)
+            fill_value(field, array + i * field->data_size, field->data_size);
+        *(void**)field->pField = array;
+    }
+}
+#endif
+
+/* Fill every static and pointer field of the message. Callback fields
+ * and extensions are left empty, and of each oneof the first member is
+ * used. */
+static void fill_message(const pb_msgdesc_t *fields, void *msg)
+{
+    pb_field_iter_t iter;
+
+    if (!pb_field_iter_begin(&iter, fields, msg))
+        return;
+
+    do
+    {
+        pb_size_t count = 1;
+        pb_size_t i;
+
+        if (PB_ATYPE(iter.type) == PB_ATYPE_CALLBACK || PB_LTYPE(iter.type) == PB_LTYPE_EXTENSION)
+            continue;
+
+        if (PB_HTYPE(iter.type) == PB_HTYPE_ONEOF)
+        {
+            if (*(pb_size_t*)iter.pSize != 0)
+                continue;
+            *(pb_size_t*)iter.pSize = iter.tag;
+        }
+        else if (PB_HTYPE(iter.type) == PB_HTYPE_REPEATED)
+        {
+            if (iter.pSize == &iter.array_size)
+            {
+                /* Fixed count array */
+                count = iter.array_size;
+            }
+            else
+            {
+                count = BENCH_REPEAT;
+                if (PB_ATYPE(iter.type) == PB_ATYPE_STATIC && count > iter.array_size)
+                    count = iter.array_size;
+                *(pb_size_t*)iter.pSize = count;
+            }
+        }
+        else if (iter.pSize != NULL)
+        {
+            *(bool*)iter.pSize = true;
+        }
+
+#ifdef PB_ENABLE_MALLOC
+        if (PB_ATYPE(iter.type) == PB_ATYPE_POINTER)
+        {
+            fill_pointer(&iter, count);
+            continue;
+        }
+#endif
+
+        for (i = 0; i < count; i++)
+            fill_value(&iter, (char*)iter.pData + i * iter.data_size, iter.data_size);
+    } while (pb_field_iter_next(&iter));
+}
+
+/*************************************
+ * Callback streams backed by memory *
+ *************************************/
+
+#ifndef PB_BUFFER_ONLY
+static bool mem_write(pb_ostream_t *stream, const pb_byte_t *buf, size_t count)
+{
+    pb_byte_t *dest = (pb_byte_t*)stream->state;
+    memcpy(dest, buf, count);
+    stream->state = dest + count;
+    return true;
+}
+
+static bool mem_read(pb_istream_t *stream, pb_byte_t *buf, size_t count)
+{
+    const pb_byte_t **pos = (const pb_byte_t**)stream->state;
+    if (buf != NULL)
+        memcpy(buf, *pos, count);
+    *pos += count;
+    return true;
+}
+#endif
+
+/****************
+ * Measurements *
+ ****************/
+
+typedef struct {
+    const bench_case_t *bcase;
+    void *msg;
+    void *dest;
+    pb_byte_t *buf;
+    size_t size;
+    bool callback_stream;
+} bench_state_t;
+
+static bool run_encode(bench_state_t *state, unsigned long iterations)
+{
+    unsigned long i;
+    for (i = 0; i < iterations; i++)
+    {
+        pb_ostream_t stream = pb_ostream_from_buffer(state->buf, state->size);
+#ifndef PB_BUFFER_ONLY
+        if (state->callback_stream)
+        {
+            stream.callback = &mem_write;
+            stream.state = state->buf;
+        }
+#endif
+        if (!pb_encode(&stream, state->bcase->fields, state->msg))
+        {
+            fprintf(stderr, "Encoding %s failed: %s\n", state->bcase->name, PB_GET_ERROR(&stream));
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool run_decode(bench_state_t *state, unsigned long iterations)
+{
+    unsigned long i;
+    for (i = 0; i < iterations; i++)
+    {
+        pb_istream_t stream = pb_istream_from_buffer(state->buf, state->size);
+#ifndef PB_BUFFER_ONLY
+        const pb_byte_t *pos = state->buf;
+        if (state->callback_stream)
+        {
+            stream.callback = &mem_read;
+            stream.state = &pos;
+        }
+#endif
+        if (!pb_decode(&stream, state->bcase->fields, state->dest))
+        {
+            fprintf(stderr, "Decoding %s failed: %s\n", state->bcase->name, PB_GET_ERROR(&stream));
+            return false;
+        }
+#ifdef PB_ENABLE_MALLOC
+        pb_release(state->bcase->fields, state->dest);
+#endif
+    }
+    return true;
+}
+
+/* Run the operation with increasing iteration counts until it takes at
+ * least the minimum time. Then repeat it and print the fastest result,
+ * to filter out interruptions by other processes. */
+static bool measure(bench_state_t *state, const char *set, const char *config,
+                    const char *stream_name, const char *op_name,
+                    bool (*op)(bench_state_t *state, unsigned long iterations))
+{
+    unsigned long iterations = 1;
+    double elapsed;
+    int round;
+
+    for (;;)
+    {
+        double start = now_ns();
+        if (!op(state, iterations))
+            return false;
+        elapsed = now_ns() - start;
+
+        if (elapsed >= g_min_time_ns)
+            break;
+
+        if (elapsed * 100 < g_min_time_ns)
+            iterations *= 10;
+        else
+            iterations *= 2;
+    }
+
+    for (round = 1; round < BENCH_ROUNDS; round++)
+    {
+        double start = now_ns();
+        double t;
+        if (!op(state, iterations))
+            return false;
+        t = now_ns() - start;
+        if (t < elapsed)
+            elapsed = t;
+    }
+
+    printf("{\"set\": \"%s\", \"config\": \"%s\", \"message\": \"%s\", "
+           "\"stream\": \"%s\", \"op\": \"%s\", \"bytes\": %lu, "
+           "\"iterations\": %lu, \"ns_per_op\": %.1f, \"mb_per_s\": %.1f}\n",
+           set, config, state->bcase->name, stream_name, op_name,
+           (unsigned long)state->size, iterations, elapsed / (double)iterations,
+           (double)state->size * (double)iterations * 1e3 / elapsed);
+    return true;
+}
+
+/* Check that the message survives decoding and encoding again */
+static bool verify(bench_state_t *state)
+{
+    pb_istream_t istream = pb_istream_from_buffer(state->buf, state->size);
+    pb_byte_t *copy;
+    bool status;
+
+    if (!pb_decode(&istream, state->bcase->fields, state->dest) || istream.bytes_left != 0)
+    {
+        fprintf(stderr, "Decoding %s failed: %s\n", state->bcase->name, PB_GET_ERROR(&istream));
+        return false;
+    }
+
+    /* Callback fields have decode functions now, so they cannot encode */
+    if (state->bcase->prepare_decode != NULL)
+        return true;
+
+    copy = (pb_byte_t*)bench_calloc(1, state->size);
+    {
+        pb_ostream_t ostream = pb_ostream_from_buffer(copy, state->size);
+        status = pb_encode(&ostream, state->bcase->fields, state->dest) &&
+                 ostream.bytes_written == state->size &&
+                 memcmp(copy, state->buf, state->size) == 0;
+    }
+    free(copy);
+
+#ifdef PB_ENABLE_MALLOC
+    pb_release(state->bcase->fields, state->dest);
+#endif
+
+    if (!status)
+        fprintf(stderr, "Encoding %s again gave different result\n", state->bcase->name);
+    return status;
+}
+
+static bool run_case(const bench_case_t *bcase, const char *set, const char *config)
+{
+    bench_state_t state;
+    bool status;
+    int i;
+
+    memset(&state, 0, sizeof(state));
+    state.bcase = bcase;
+    state.msg = bench_calloc(1, bcase->struct_size);
+    state.dest = bench_calloc(1, bcase->struct_size);
+
+    if (bcase->prepare_encode)
+        bcase->prepare_encode(state.msg);
+    else
+        fill_message(bcase->fields, state.msg);
+
+    if (bcase->prepare_decode)
+        bcase->prepare_decode(state.dest);
+
+    status = pb_get_encoded_size(&state.size, bcase->fields, state.msg);
+    if (status)
+    {
+        pb_ostream_t stream;
+        state.buf = (pb_byte_t*)bench_calloc(1, state.size + 1);
+        stream = pb_ostream_from_buffer(state.buf, state.size);
+        status = pb_encode(&stream, bcase->fields, state.msg) && verify(&state);
+    }
+
+    for (i = 0; i < 2 && status; i++)
+    {
+        const char *stream_name = (i == 0) ? "buffer" : "callback";
+        state.callback_stream = (i == 1);
+#ifdef PB_BUFFER_ONLY
+        if (state.callback_stream)
+            break;
+#endif
+        status = measure(&state, set, config, stream_name, "encode", &run_encode) &&
+                 measure(&state, set, config, stream_name, "decode", &run_decode);
+    }
+
+#ifdef PB_ENABLE_MALLOC
+    pb_release(bcase->fields, state.msg);
+#endif
+    free(state.msg);
+    free(state.dest);
+    free(state.buf);
+
+    if (!status)
+        fprintf(stderr, "Benchmark of %s failed\n", bcase->name);
+
+    return status;
+}
+
+int main(int argc, char **argv)
+{
+    const char *set = (argc > 1) ? argv[1] : "unknown";
+    const char *config = (argc > 2) ? argv[2] : "unknown";
+    int status = 0;
+    size_t i;
+
+    if (argc > 3)
+        g_min_time_ns = atof(argv[3]) * 1e6;
+
+    for (i = 0; i < bench_case_count; i++)
+    {
+        if (!run_case(&bench_cases[i], set, config))
+            status = 1;
+    }
+
+    return status;
+}
@@ -0,0 +1,27 @@
+/* Common driver for the throughput benchmarks. Each benchmark program
+ * is linked with one bench_*.c file, which defines the table of message
+ * types to measure.
+ */
+
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <pb.h>
+
+typedef struct {
+    const char *name;
+    const pb_msgdesc_t *fields;
+    size_t struct_size;
+
+    /* Fill in the message to encode. If NULL, every field is filled in
+     * with generated values based on the message descriptor. */
+    void (*prepare_encode)(void *msg);
+
+    /* Set up callbacks in the message before decoding. Can be NULL. */
+    void (*prepare_decode)(void *msg);
+} bench_case_t;
+
+extern const bench_case_t bench_cases[];
+extern const size_t bench_case_count;
+
+#endif
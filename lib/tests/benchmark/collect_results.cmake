@@ -0,0 +1,7 @@
+# Concatenate the benchmark outputs listed in the file INPUTS into OUTPUT
+file(READ ${INPUTS} inputs)
+file(WRITE ${OUTPUT} "")
+foreach(input ${inputs})
+    file(READ ${input} contents)
+    file(APPEND ${OUTPUT} "${contents}")
+endforeach()
@@ -0,0 +1,58 @@
+#!/usr/bin/env python3
+'''Compare two results.jsonl files from the benchmark, for example from
+the build directories of two commits:
+
+    python3 compare.py old/results.jsonl new/results.jsonl
+
+Prints the change in ns/op for each result. Exits with status 1 if any
+result is slower than the threshold.'''
+
+import argparse
+import json
+import sys
+
+def load(path):
+    results = {}
+    with open(path) as f:
+        for line in f:
+            if line.strip():
+                r = json.loads(line)
+                key = (r['set'], r['config'], r['message'], r['stream'], r['op'])
+                results[key] = r
+    return results
+
+def main():
+    parser = argparse.ArgumentParser(description = __doc__.split('\n')[0])
+    parser.add_argument('old')
+    parser.add_argument('new')
+    parser.add_argument('--threshold', type = float, default = 10.0,
+                        help = 'Percentage slowdown reported as regression (default 10)')
+    args = parser.parse_args()
+
+    old = load(args.old)
+    new = load(args.new)
+    regressions = 0
+
+    print('%-50s %12s %12s %8s' % ('result', 'old ns/op', 'new ns/op', 'change'))
+    for key in sorted(set(old) | set(new)):
+        name = '/'.join(key)
+        if key not in old or key not in new:
+            print('%-50s %s' % (name, 'only in ' + ('new' if key in new else 'old')))
+            continue
+
+        before = old[key]['ns_per_op']
+        after = new[key]['ns_per_op']
+        change = (after - before) * 100.0 / before
+        mark = ''
+        if change > args.threshold:
+            mark = '  REGRESSION'
+            regressions += 1
+        print('%-50s %12.1f %12.1f %+7.1f%%%s' % (name, before, after, change, mark))
+
+    if regressions:
+        print('%d results slower by more than %.0f%%' % (regressions, args.threshold))
+        return 1
+    return 0
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,303 @@
+/* Decode and encode the alltypes message through buffered streams on top
+ * of callback streams, and compare the results and the number of
+ * callback calls against the unbuffered streams.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <pb_encode.h>
+#include <pb_decode.h>
+#include "alltypes.pb.h"
+#include "test_helpers.h"
+#include "unittests.h"
+
+/* Memory stream that counts the callback calls, like a file or socket */
+typedef struct {
+    pb_byte_t *data;
+    size_t pos;
+    size_t calls;
+    size_t fail_at; /* Callback fails when pos would pass this */
+} mem_state_t;
+
+static bool mem_read(pb_istream_t *stream, pb_byte_t *buf, size_t count)
+{
+    mem_state_t *state = (mem_state_t*)stream->state;
+    state->calls++;
+    if (state->pos + count > state->fail_at)
+        return false;
+    if (buf != NULL)
+        memcpy(buf, state->data + state->pos, count);
+    state->pos += count;
+    return true;
+}
+
+/* Source of unknown length, like a socket. Returns what it has, at
+ * most 7 bytes per call, and sets bytes_left to 0 at the end. */
+typedef struct {
+    const pb_byte_t *data;
+    size_t pos;
+    size_t len;
+    size_t calls_at_end;
+} socket_state_t;
+
+static size_t socket_refill(pb_istream_t *stream, pb_byte_t *buf, size_t count)
+{
+    socket_state_t *state = (socket_state_t*)stream->state;
+    size_t avail = state->len - state->pos;
+
+    if (avail == 0)
+    {
+        /* A real socket would block here */
+        state->calls_at_end++;
+        stream->bytes_left = 0;
+        return 0;
+    }
+
+    if (count > 7)
+        count = 7;
+    if (count > avail)
+        count = avail;
+
+    memcpy(buf, state->data + state->pos, count);
+    state->pos += count;
+    return count;
+}
+
+static bool mem_write(pb_ostream_t *stream, const pb_byte_t *buf, size_t count)
+{
+    mem_state_t *state = (mem_state_t*)stream->state;
+    state->calls++;
+    if (state->pos + count > state->fail_at)
+        return false;
+    memcpy(state->data + state->pos, buf, count);
+    state->pos += count;
+    return true;
+}
+
+static pb_istream_t mem_istream(mem_state_t *state, pb_byte_t *data, size_t size)
+{
+    pb_istream_t stream = pb_istream_from_buffer(NULL, 0);
+    stream.callback = &mem_read;
+    state->data = data;
+    state->pos = 0;
+    state->calls = 0;
+    state->fail_at = (size_t)-1;
+    stream.state = state;
+    stream.bytes_left = size;
+    return stream;
+}
+
+static pb_ostream_t mem_ostream(mem_state_t *state, pb_byte_t *data, size_t size)
+{
+    pb_ostream_t stream = pb_ostream_from_buffer(NULL, 0);
+    stream.callback = &mem_write;
+    state->data = data;
+    state->pos = 0;
+    state->calls = 0;
+    state->fail_at = (size_t)-1;
+    stream.state = state;
+    stream.max_size = size;
+    return stream;
+}
+
+/* Decode through a buffer of the given size and re-encode, result should
+ * be the same as the input. */
+static bool roundtrip(pb_byte_t *input, size_t len, size_t bufsize, size_t *calls)
+{
+    AllTypes msg = AllTypes_init_zero;
+    pb_byte_t buf[256];
+    pb_byte_t output[1024];
+    mem_state_t state;
+    pb_istream_buffer_t ibuf;
+    pb_istream_t source = mem_istream(&state, input, len);
+    pb_istream_t stream = pb_istream_buffered(&ibuf, &source, buf, bufsize);
+    pb_ostream_t ostream;
+
+    if (!pb_decode(&stream, AllTypes_fields, &msg))
+    {
+        fprintf(stderr, "Decode with buffer %u failed: %s\n", (unsigned)bufsize, PB_GET_ERROR(&stream));
+        return false;
+    }
+
+    *calls = state.calls;
+    ostream = pb_ostream_from_buffer(output, sizeof(output));
+    return stream.bytes_left == 0 && source.bytes_left == 0 &&
+           pb_encode(&ostream, AllTypes_fields, &msg) &&
+           ostream.bytes_written == len && memcmp(output, input, len) == 0;
+}
+
+int main()
+{
+    int status = 0;
+    pb_byte_t input[1024];
+    size_t len;
+    AllTypes msg = AllTypes_init_zero;
+
+    SET_BINARY_MODE(stdin);
+    len = fread(input, 1, sizeof(input), stdin);
+
+    {
+        mem_state_t state;
+        pb_istream_t stream = mem_istream(&state, input, len);
+        size_t unbuffered, buffered, size;
+        bool ok = true;
+
+        COMMENT("Decode through buffered stream");
+        TEST(pb_decode(&stream, AllTypes_fields, &msg));
+        unbuffered = state.calls;
+        TEST(roundtrip(input, len, 256, &buffered));
+        printf("Callback calls: %u unbuffered, %u buffered\n", (unsigned)unbuffered, (unsigned)buffered);
+        TEST(buffered * 10 < unbuffered);
+
+        COMMENT("Small buffer sizes");
+        for (size = 1; size <= 17; size++)
+            ok = ok && roundtrip(input, len, size, &buffered);
+        TEST(ok);
+    }
+
+    {
+        pb_byte_t data[4] = {0x08, 0x01, 0x10, 0x02};
+        pb_byte_t buf[16];
+        mem_state_t state;
+        pb_istream_buffer_t ibuf;
+        pb_istream_t source = mem_istream(&state, data, sizeof(data));
+        pb_istream_t stream = pb_istream_buffered(&ibuf, &source, buf, sizeof(buf));
+        pb_byte_t byte;
+
+        COMMENT("Read ahead stops at bytes_left");
+        source.bytes_left = 3;
+        stream.bytes_left = 3;
+        TEST(pb_read(&stream, &byte, 1) && byte == 0x08);
+        TEST(state.pos == 3 && source.bytes_left == 0);
+        TEST(pb_read(&stream, NULL, 2) && stream.bytes_left == 0);
+        TEST(!pb_read(&stream, &byte, 1));
+    }
+
+    {
+        pb_byte_t big[64];
+        pb_byte_t buf[8];
+        mem_state_t state;
+        pb_istream_buffer_t ibuf;
+        pb_istream_t source, stream;
+        pb_byte_t byte;
+
+        COMMENT("Large skips bypass the buffer");
+        memset(big, 0, sizeof(big));
+        big[40] = 0x55;
+        source = mem_istream(&state, big, sizeof(big));
+        stream = pb_istream_buffered(&ibuf, &source, buf, sizeof(buf));
+        TEST(pb_read(&stream, &byte, 1));
+        TEST(pb_read(&stream, NULL, 39));
+        TEST(pb_read(&stream, &byte, 1) && byte == 0x55);
+        TEST(state.calls == 4); /* The source skips 16 bytes per call */
+        TEST(stream.bytes_left == 23);
+    }
+
+    {
+        mem_state_t state;
+        pb_byte_t buf[16];
+        pb_istream_buffer_t ibuf;
+        pb_istream_t source = mem_istream(&state, input, len);
+        pb_istream_t stream = pb_istream_buffered(&ibuf, &source, buf, sizeof(buf));
+        pb_byte_t byte;
+
+        COMMENT("Read errors are reported");
+        state.fail_at = 4;
+        TEST(!pb_read(&stream, &byte, 1));
+        TEST(strcmp(PB_GET_ERROR(&stream), "io error") == 0);
+        TEST(stream.bytes_left == len);
+    }
+
+    {
+        pb_byte_t data[1024 + 8];
+        pb_byte_t buf[256];
+        socket_state_t state = {NULL, 0, 0, 0};
+        pb_istream_t source = pb_istream_from_buffer(NULL, 0);
+        pb_istream_buffer_t ibuf;
+        pb_istream_t stream;
+        pb_ostream_t ostream = pb_ostream_from_buffer(data, sizeof(data));
+
+        COMMENT("Delimited message from a source of unknown length");
+        TEST(pb_encode_varint(&ostream, len) && pb_write(&ostream, input, len));
+        state.data = data;
+        state.len = ostream.bytes_written;
+        source.callback = NULL;
+        source.state = &state;
+        source.bytes_left = SIZE_MAX;
+        stream = pb_istream_buffered_partial(&ibuf, &source, &socket_refill, buf, sizeof(buf));
+        memset(&msg, 0, sizeof(msg));
+        TEST(pb_decode_ex(&stream, AllTypes_fields, &msg, PB_DECODE_DELIMITED));
+        TEST(state.pos == state.len && state.calls_at_end == 0);
+        TEST(msg.end == 1099);
+
+        COMMENT("Data ends in the middle of the buffer");
+        state.data = input;
+        state.pos = 0;
+        state.len = len;
+        source.bytes_left = SIZE_MAX;
+        stream = pb_istream_buffered_partial(&ibuf, &source, &socket_refill, buf, sizeof(buf));
+        memset(&msg, 0, sizeof(msg));
+        TEST(pb_decode(&stream, AllTypes_fields, &msg));
+        TEST(state.calls_at_end == 1 && stream.bytes_left == 0);
+        TEST(msg.end == 1099);
+    }
+
+    {
+        pb_byte_t reference[1024];
+        pb_byte_t output[1024];
+        pb_byte_t buf[64];
+        pb_ostream_t ref = pb_ostream_from_buffer(reference, sizeof(reference));
+        mem_state_t state;
+        pb_ostream_t dest = mem_ostream(&state, output, sizeof(output));
+        pb_ostream_buffer_t obuf;
+        pb_ostream_t stream;
+        size_t unbuffered;
+        size_t size;
+        bool ok = true;
+
+        COMMENT("Encode through buffered stream");
+        TEST(pb_encode(&ref, AllTypes_fields, &msg));
+        TEST(pb_encode(&dest, AllTypes_fields, &msg));
+        unbuffered = state.calls;
+
+        dest = mem_ostream(&state, output, sizeof(output));
+        stream = pb_ostream_buffered(&obuf, &dest, buf, sizeof(buf));
+        TEST(pb_encode(&stream, AllTypes_fields, &msg));
+        TEST(pb_ostream_buffer_flush(&obuf));
+        TEST(stream.bytes_written == ref.bytes_written && dest.bytes_written == ref.bytes_written);
+        TEST(memcmp(output, reference, ref.bytes_written) == 0);
+        printf("Callback calls: %u unbuffered, %u buffered\n", (unsigned)unbuffered, (unsigned)state.calls);
+        TEST(state.calls * 10 < unbuffered);
+
+        COMMENT("Small buffer sizes");
+        for (size = 1; size <= 17; size++)
+        {
+            memset(output, 0, sizeof(output));
+            dest = mem_ostream(&state, output, sizeof(output));
+            stream = pb_ostream_buffered(&obuf, &dest, buf, size);
+            ok = ok && pb_encode(&stream, AllTypes_fields, &msg) &&
+                 pb_ostream_buffer_flush(&obuf) &&
+                 dest.bytes_written == ref.bytes_written &&
+                 memcmp(output, reference, ref.bytes_written) == 0;
+        }
+        TEST(ok);
+
+        COMMENT("Space is limited by the destination");
+        dest = mem_ostream(&state, output, ref.bytes_written - 1);
+        stream = pb_ostream_buffered(&obuf, &dest, buf, sizeof(buf));
+        TEST(!pb_encode(&stream, AllTypes_fields, &msg));
+        TEST(strcmp(PB_GET_ERROR(&stream), "stream full") == 0);
+
+        COMMENT("Write errors are reported");
+        dest = mem_ostream(&state, output, sizeof(output));
+        state.fail_at = 100;
+        stream = pb_ostream_buffered(&obuf, &dest, buf, sizeof(buf));
+        TEST(!(pb_encode(&stream, AllTypes_fields, &msg) && pb_ostream_buffer_flush(&obuf)));
+        TEST(strcmp(PB_GET_ERROR(&dest), "io error") == 0);
+    }
+
+    if (status != 0)
+        fprintf(stdout, "\n\nSome tests FAILED!\n");
+
+    return status;
+}
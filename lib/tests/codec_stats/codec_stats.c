@@ -0,0 +1,206 @@
+/* Encode and decode a nested message with PB_ENABLE_STATS and check the
+ * counted fields, bytes, sizing passes, callbacks, iterator steps and
+ * nesting depth.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <pb_encode.h>
+#include <pb_decode.h>
+#include <pb_common.h>
+#include "unittests.h"
+#include "codec_stats.pb.h"
+
+static bool encode_label(pb_ostream_t *stream, const pb_field_t *field, void * const *arg)
+{
+    const char *label = "north bed";
+    PB_UNUSED(arg);
+    return pb_encode_tag_for_field(stream, field) &&
+           pb_encode_string(stream, (const pb_byte_t*)label, strlen(label));
+}
+
+static bool decode_label(pb_istream_t *stream, const pb_field_t *field, void **arg)
+{
+    char *label = (char*)*arg;
+    size_t len = stream->bytes_left;
+    PB_UNUSED(field);
+    if (len >= 16 || !pb_read(stream, (pb_byte_t*)label, len))
+        return false;
+    label[len] = '\0';
+    return true;
+}
+
+/* Reads from a memory buffer through the callback interface */
+static bool callback_read(pb_istream_t *stream, pb_byte_t *buf, size_t count)
+{
+    const pb_byte_t *source = (const pb_byte_t*)stream->state;
+    memcpy(buf, source, count);
+    stream->state = (pb_byte_t*)stream->state + count;
+    return true;
+}
+
+static void print_stats(const pb_stats_t *stats)
+{
+    printf("fields: varint %u, 64bit %u, string %u, 32bit %u decoded; "
+           "varint %u, 64bit %u, string %u, 32bit %u encoded\n",
+           (unsigned)stats->fields_decoded[PB_WT_VARINT], (unsigned)stats->fields_decoded[PB_WT_64BIT],
+           (unsigned)stats->fields_decoded[PB_WT_STRING], (unsigned)stats->fields_decoded[PB_WT_32BIT],
+           (unsigned)stats->fields_encoded[PB_WT_VARINT], (unsigned)stats->fields_encoded[PB_WT_64BIT],
+           (unsigned)stats->fields_encoded[PB_WT_STRING], (unsigned)stats->fields_encoded[PB_WT_32BIT]);
+    printf("bytes: %u varint, %u skipped, %u copied; %u sizing passes, %u callbacks, "
+           "%u iterator steps, depth %u\n",
+           (unsigned)stats->varint_bytes, (unsigned)stats->bytes_skipped,
+           (unsigned)stats->bytes_copied, (unsigned)stats->sizing_passes,
+           (unsigned)stats->callbacks, (unsigned)stats->iter_steps,
+           (unsigned)stats->max_submsg_depth);
+}
+
+int main()
+{
+    int status = 0;
+    pb_byte_t buffer[128];
+    size_t msglen;
+    pb_stats_t stats;
+
+    {
+        Root msg = Root_init_zero;
+        pb_ostream_t stream = pb_ostream_from_buffer(buffer, sizeof(buffer));
+
+        COMMENT("Encode nested message");
+        msg.id = 300;
+        msg.branch.leaf.value = -5;
+        msg.branch.leaf.stamp = 0x12345678;
+        msg.branch.label.funcs.encode = &encode_label;
+        msg.has_blob = true;
+        msg.blob.size = 20;
+        memset(msg.blob.bytes, 0x33, 20);
+
+        pb_stats_reset();
+        TEST(pb_encode(&stream, Root_fields, &msg));
+        msglen = stream.bytes_written;
+        pb_stats_get(&stats);
+        print_stats(&stats);
+
+        TEST(stats.fields_encoded[PB_WT_VARINT] == 2);
+        TEST(stats.fields_encoded[PB_WT_32BIT] == 1);
+        TEST(stats.fields_encoded[PB_WT_STRING] == 4);
+        TEST(stats.bytes_copied == msglen);
+        TEST(stats.varint_bytes > 0 && stats.varint_bytes < msglen);
+        TEST(stats.max_submsg_depth == 2 && stats.submsg_depth == 0);
+
+        /* Leaf is sized again for both passes over Branch */
+        TEST(stats.sizing_passes == 3);
+        TEST(stats.callbacks == 2);
+    }
+
+    {
+        Root msg = Root_init_zero;
+        char label[16] = "";
+        pb_istream_t stream = pb_istream_from_buffer(buffer, msglen);
+
+        COMMENT("Decode nested message");
+        msg.branch.label.funcs.decode = &decode_label;
+        msg.branch.label.arg = label;
+
+        pb_stats_reset();
+        TEST(pb_decode(&stream, Root_fields, &msg));
+        TEST(strcmp(label, "north bed") == 0);
+        pb_stats_get(&stats);
+        print_stats(&stats);
+
+        TEST(stats.fields_decoded[PB_WT_VARINT] == 2);
+        TEST(stats.fields_decoded[PB_WT_32BIT] == 1);
+        TEST(stats.fields_decoded[PB_WT_STRING] == 4);
+        TEST(stats.fields_encoded[PB_WT_STRING] == 0);
+        TEST(stats.bytes_skipped == 0);
+        TEST(stats.varint_bytes + stats.bytes_copied == msglen);
+        TEST(stats.max_submsg_depth == 2 && stats.submsg_depth == 0);
+        TEST(stats.sizing_passes == 0);
+        TEST(stats.callbacks == 1);
+        TEST(stats.iter_steps > 0);
+    }
+
+    {
+        RootId msg = RootId_init_zero;
+        pb_istream_t stream = pb_istream_from_buffer(buffer, msglen);
+
+        COMMENT("Unknown fields are skipped");
+        pb_stats_reset();
+        TEST(pb_decode(&stream, RootId_fields, &msg));
+        TEST(msg.id == 300);
+        pb_stats_get(&stats);
+        print_stats(&stats);
+
+        TEST(stats.fields_decoded[PB_WT_VARINT] == 1);
+        TEST(stats.fields_decoded[PB_WT_STRING] == 2);
+        TEST(stats.bytes_skipped > 20);
+        TEST(stats.varint_bytes + stats.bytes_skipped == msglen);
+        TEST(stats.max_submsg_depth == 0);
+    }
+
+    {
+        RootId msg = RootId_init_zero;
+        pb_istream_t stream = pb_istream_from_buffer(buffer, msglen - 5);
+
+        COMMENT("Failed skip is not counted");
+        pb_stats_reset();
+        TEST(!pb_decode(&stream, RootId_fields, &msg));
+        pb_stats_get(&stats);
+        TEST(stats.varint_bytes + stats.bytes_skipped <= msglen - 5);
+    }
+
+    {
+        RootId msg = RootId_init_zero;
+        pb_istream_t stream = {&callback_read, NULL, 0};
+
+        COMMENT("Skip through a temporary buffer is counted as copied");
+        stream.state = buffer;
+        stream.bytes_left = msglen;
+        pb_stats_reset();
+        TEST(pb_decode(&stream, RootId_fields, &msg));
+        TEST(msg.id == 300);
+        pb_stats_get(&stats);
+        TEST(stats.bytes_skipped == 0);
+        TEST(stats.varint_bytes + stats.bytes_copied == msglen);
+    }
+
+    {
+        RootId msg = RootId_init_zero;
+        size_t size;
+
+        COMMENT("Sizing pass");
+        msg.id = 7;
+        pb_stats_reset();
+        TEST(pb_get_encoded_size(&size, RootId_fields, &msg) && size == 2);
+        pb_stats_get(&stats);
+        TEST(stats.sizing_passes == 1);
+        TEST(stats.bytes_copied == 0 && stats.fields_encoded[PB_WT_VARINT] == 0);
+
+        COMMENT("Reset");
+        pb_stats_reset();
+        pb_stats_get(&stats);
+        TEST(stats.sizing_passes == 0 && stats.varint_bytes == 0);
+    }
+
+    {
+        int i;
+
+        COMMENT("Depth macros are single statements");
+        pb_stats_reset();
+        for (i = 0; i < 3; i++)
+        {
+            if (i < 2)
+                PB_STATS_ENTER_SUBMSG();
+            else
+                PB_STATS_LEAVE_SUBMSG();
+        }
+        pb_stats_get(&stats);
+        TEST(stats.submsg_depth == 1 && stats.max_submsg_depth == 2);
+        pb_stats_reset();
+    }
+
+    if (status != 0)
+        fprintf(stdout, "\n\nSome tests FAILED!\n");
+
+    return status;
+}
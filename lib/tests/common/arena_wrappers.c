@@ -0,0 +1,40 @@
+/* Shared arena used by the test cases through arena_wrappers.h */
+
+#define ARENA_WRAPPERS_NO_REDIRECT
+#include "arena_wrappers.h"
+#include "malloc_wrappers.h"
+#include <stdint.h>
+
+#ifndef ARENA_SIZE
+#define ARENA_SIZE 64*1024
+#endif
+
+static uint64_t g_arena_storage[ARENA_SIZE / sizeof(uint64_t)];
+static pb_arena_t g_arena;
+static bool g_arena_initialized = false;
+
+pb_istream_t arena_istream_from_buffer(const pb_byte_t *buf, size_t msglen)
+{
+    pb_istream_t stream = pb_istream_from_buffer(buf, msglen);
+
+    if (!g_arena_initialized)
+    {
+        pb_arena_init(&g_arena, g_arena_storage, sizeof(g_arena_storage));
+        g_arena_initialized = true;
+    }
+
+    stream.arena = &g_arena;
+    return stream;
+}
+
+void arena_release(const pb_msgdesc_t *fields, void *dest_struct)
+{
+    (void)fields;
+    (void)dest_struct;
+    pb_arena_reset(&g_arena);
+}
+
+size_t arena_alloc_count()
+{
+    return get_alloc_count() + g_arena.used;
+}
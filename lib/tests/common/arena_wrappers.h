@@ -0,0 +1,23 @@
+/* Helpers for running the malloc test cases with PB_ENABLE_ARENA.
+ * Include this after pb_decode.h and malloc_wrappers.h. Streams created with
+ * pb_istream_from_buffer() then allocate from a shared arena, pb_release()
+ * resets the arena and get_alloc_count() also counts the bytes used in it,
+ * so the existing leak checks apply to the arena too.
+ */
+
+#ifndef ARENA_WRAPPERS_H
+#define ARENA_WRAPPERS_H
+
+#include <pb_decode.h>
+
+pb_istream_t arena_istream_from_buffer(const pb_byte_t *buf, size_t msglen);
+void arena_release(const pb_msgdesc_t *fields, void *dest_struct);
+size_t arena_alloc_count();
+
+#ifndef ARENA_WRAPPERS_NO_REDIRECT
+#define pb_istream_from_buffer arena_istream_from_buffer
+#define pb_release arena_release
+#define get_alloc_count arena_alloc_count
+#endif
+
+#endif
@@ -25,6 +25,7 @@
 static size_t g_alloc_count = 0;
 static size_t g_alloc_bytes = 0;
 static size_t g_max_alloc_bytes = MAX_ALLOC_BYTES;
+static size_t g_realloc_calls = 0;
 
 #ifdef LLVMFUZZER
 /* LLVM libsanitizer has a realloc() implementation that always copies
@@ -100,6 +101,8 @@ void free_with_check(void *mem)
 /* Reallocate block and check / write guard values */
 void* realloc_with_check(void *ptr, size_t size)
 {
+    g_realloc_calls++;
+
     if (!ptr && size)
     {
         /* Allocate new block and write guard values */
@@ -164,6 +167,12 @@ size_t get_alloc_count()
     return g_alloc_count;
 }
 
+/* Return total number of realloc_with_check() calls so far */
+size_t get_realloc_calls()
+{
+    return g_realloc_calls;
+}
+
 /* Return allocated size for a pointer returned from malloc(). */
 size_t get_allocation_size(const void *mem)
 {
@@ -0,0 +1,332 @@
+/* Checks that the templates in pb_codec.h produce the same results as
+ * pb_encode() / pb_decode(), and reports the relative stack usage and speed.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <assert.h>
+#include <pb_encode.h>
+#include <pb_decode.h>
+#include <pb_codec.h>
+#include "codec.pb.h"
+#include "codec_proto3.pb.h"
+#include "unittests.h"
+
+/* The generator must skip messages that pb_codec.h cannot handle. */
+template <typename T, typename = void>
+struct has_codec { static constexpr bool value = false; };
+template <typename T>
+struct has_codec<T, decltype(void(sizeof(typename nanopb::MessageCodec<T>::fields)))>
+{ static constexpr bool value = true; };
+
+static_assert(has_codec<AllTypes>::value, "AllTypes should have a codec");
+static_assert(has_codec<SensorReport>::value, "SensorReport should have a codec");
+static_assert(!has_codec<WithOneof>::value, "WithOneof should not have a codec");
+static_assert(!has_codec<WithEnumDefault>::value, "WithEnumDefault should not have a codec");
+static_assert(!has_codec<WithDefault>::value, "WithDefault should not have a codec");
+
+static void fill_alltypes(AllTypes *msg)
+{
+    *msg = AllTypes_init_zero;
+    msg->req_int32 = -1234;
+    msg->has_opt_int64 = true; msg->opt_int64 = -9876543210LL;
+    msg->has_opt_uint32 = true; msg->opt_uint32 = 4000000000U;
+    msg->has_opt_uint64 = true; msg->opt_uint64 = 18000000000000000000ULL;
+    msg->has_opt_sint32 = true; msg->opt_sint32 = -12345;
+    msg->has_opt_sint64 = true; msg->opt_sint64 = -123456789012LL;
+    msg->has_opt_bool = true; msg->opt_bool = true;
+    msg->has_opt_fixed32 = true; msg->opt_fixed32 = 0xDEADBEEF;
+    msg->has_opt_sfixed64 = true; msg->opt_sfixed64 = -42;
+    msg->has_opt_float = true; msg->opt_float = 1.5f;
+    msg->has_opt_double = true; msg->opt_double = -2.25;
+    msg->has_opt_string = true; strcpy(msg->opt_string, "hello");
+    msg->has_opt_bytes = true; msg->opt_bytes.size = 3; memcpy(msg->opt_bytes.bytes, "\x01\x00\x02", 3);
+    msg->has_opt_fbytes = true; memcpy(msg->opt_fbytes, "abcd", 4);
+    msg->has_opt_enum = true; msg->opt_enum = Mode_MODE_NEGATIVE;
+    msg->has_opt_inner = true; msg->opt_inner.value = 7;
+    msg->opt_inner.has_name = true; strcpy(msg->opt_inner.name, "inner");
+    msg->has_small_int = true; msg->small_int = -100;
+    msg->rep_int32_count = 3; msg->rep_int32[0] = 1; msg->rep_int32[1] = -1; msg->rep_int32[2] = 300;
+    msg->rep_float_count = 2; msg->rep_float[0] = 0.5f; msg->rep_float[1] = -0.0f;
+    msg->rep_string_count = 2; strcpy(msg->rep_string[0], "a"); strcpy(msg->rep_string[1], "");
+    msg->rep_inner_count = 2; msg->rep_inner[0].value = 1; msg->rep_inner[1].value = 2;
+    msg->rep_enum_count = 2; msg->rep_enum[0] = Mode_MODE_ON; msg->rep_enum[1] = Mode_MODE_NEGATIVE;
+    msg->has_large_tag = true; msg->large_tag = 1000;
+}
+
+static void fill_report(SensorReport *msg)
+{
+    *msg = SensorReport_init_zero;
+    msg->temperature = 23.5f;
+    msg->humidity = 61.25f;
+    msg->light_level = 0.0f;
+    msg->ph_levels_count = 5;
+    for (int i = 0; i < 5; i++)
+        msg->ph_levels[i] = 6.0f + 0.1f * i;
+    msg->relay_states_count = 3;
+    msg->relay_states[0] = true;
+    msg->relay_states[2] = true;
+    msg->has_status = true;
+    msg->singular_status.uptime = 1000;
+    msg->offset = -5;
+}
+
+/* Encode with both implementations and compare the output */
+template <typename T>
+static int check_encode(const T &msg, const pb_msgdesc_t *fields, pb_byte_t *out, size_t *outlen)
+{
+    int status = 0;
+    pb_byte_t buf2[256];
+    pb_ostream_t s1 = pb_ostream_from_buffer(out, 256);
+    pb_ostream_t s2 = pb_ostream_from_buffer(buf2, sizeof(buf2));
+    size_t size1 = 0, size2 = 0;
+
+    TEST(pb_encode(&s1, fields, &msg));
+    TEST(nanopb::encode(&s2, msg));
+    TEST(s1.bytes_written == s2.bytes_written);
+    TEST(memcmp(out, buf2, s1.bytes_written) == 0);
+
+    TEST(pb_get_encoded_size(&size1, fields, &msg));
+    TEST(nanopb::get_encoded_size(&size2, msg));
+    TEST(size1 == size2 && size1 == s1.bytes_written);
+
+    *outlen = s1.bytes_written;
+    return status;
+}
+
+/* Decode with both implementations and compare the structures, and the
+ * output of re-encoding them */
+template <typename T>
+static int check_decode(const pb_byte_t *data, size_t len, const pb_msgdesc_t *fields)
+{
+    int status = 0;
+    T msg1, msg2;
+    pb_byte_t buf1[256], buf2[256];
+    pb_istream_t s1 = pb_istream_from_buffer(data, len);
+    pb_istream_t s2 = pb_istream_from_buffer(data, len);
+    pb_ostream_t o1 = pb_ostream_from_buffer(buf1, sizeof(buf1));
+    pb_ostream_t o2 = pb_ostream_from_buffer(buf2, sizeof(buf2));
+
+    memset(&msg1, 0, sizeof(msg1));
+    memset(&msg2, 0, sizeof(msg2));
+    TEST(pb_decode(&s1, fields, &msg1));
+    TEST(nanopb::decode(&s2, msg2));
+    TEST(s1.bytes_left == 0 && s2.bytes_left == 0);
+    TEST(memcmp(&msg1, &msg2, sizeof(T)) == 0);
+
+    TEST(pb_encode(&o1, fields, &msg1));
+    TEST(pb_encode(&o2, fields, &msg2));
+    TEST(o1.bytes_written == len && o2.bytes_written == len);
+    TEST(memcmp(buf1, data, len) == 0 && memcmp(buf2, data, len) == 0);
+
+    return status;
+}
+
+/* Both implementations should fail on the same input with the same message */
+template <typename T>
+static int check_error(const pb_byte_t *data, size_t len, const pb_msgdesc_t *fields, const char *errmsg)
+{
+    int status = 0;
+    T msg1, msg2;
+    pb_istream_t s1 = pb_istream_from_buffer(data, len);
+    pb_istream_t s2 = pb_istream_from_buffer(data, len);
+
+    TEST(!pb_decode(&s1, fields, &msg1));
+    TEST(!nanopb::decode(&s2, msg2));
+    TEST(strcmp(PB_GET_ERROR(&s1), errmsg) == 0);
+    TEST(strcmp(PB_GET_ERROR(&s2), errmsg) == 0);
+
+    return status;
+}
+
+/* Stack measurement, same technique as in tests/stackusage */
+#define MAX_STACK_ENTRIES 1024
+static uint32_t g_stackbuf[MAX_STACK_ENTRIES];
+static volatile uint32_t *g_stackptr;
+
+static void __attribute__((noinline)) start_stack_measuring()
+{
+    uint32_t i = 0;
+    g_stackptr = (volatile uint32_t*)((uintptr_t)&i - MAX_STACK_ENTRIES * sizeof(uint32_t));
+    for (i = 0; i < MAX_STACK_ENTRIES; i++)
+    {
+        g_stackbuf[i] = g_stackptr[i];
+    }
+}
+
+static int __attribute__((noinline)) end_stack_measuring()
+{
+    uint32_t i = 0;
+    for (i = 0; i < MAX_STACK_ENTRIES; i++)
+    {
+        if (g_stackbuf[i] != g_stackptr[i])
+        {
+            return (int)((MAX_STACK_ENTRIES - i) * sizeof(uint32_t));
+        }
+    }
+    assert(false);
+    return 0;
+}
+
+static SensorReport g_report;
+static pb_byte_t g_buf[128];
+static size_t g_len;
+
+static void __attribute__((noinline)) encode_c()
+{
+    pb_ostream_t stream = pb_ostream_from_buffer(g_buf, sizeof(g_buf));
+    if (!pb_encode(&stream, SensorReport_fields, &g_report)) assert(false);
+    g_len = stream.bytes_written;
+}
+
+static void __attribute__((noinline)) encode_cxx()
+{
+    pb_ostream_t stream = pb_ostream_from_buffer(g_buf, sizeof(g_buf));
+    if (!nanopb::encode(&stream, g_report)) assert(false);
+    g_len = stream.bytes_written;
+}
+
+static void __attribute__((noinline)) decode_c()
+{
+    pb_istream_t stream = pb_istream_from_buffer(g_buf, g_len);
+    if (!pb_decode(&stream, SensorReport_fields, &g_report)) assert(false);
+}
+
+static void __attribute__((noinline)) decode_cxx()
+{
+    pb_istream_t stream = pb_istream_from_buffer(g_buf, g_len);
+    if (!nanopb::decode(&stream, g_report)) assert(false);
+}
+
+static int measure_stack(void (*func)())
+{
+    start_stack_measuring();
+    func();
+    return end_stack_measuring();
+}
+
+static double measure_time(void (*func)())
+{
+    const int iterations = 200000;
+    clock_t start = clock();
+    for (int i = 0; i < iterations; i++)
+        func();
+    return (double)(clock() - start) * 1e9 / CLOCKS_PER_SEC / iterations;
+}
+
+int main()
+{
+    int status = 0;
+
+    {
+        COMMENT("Proto2 message with all supported field types");
+        AllTypes msg;
+        pb_byte_t buf[256];
+        size_t len;
+        fill_alltypes(&msg);
+        status += check_encode(msg, AllTypes_fields, buf, &len);
+        status += check_decode<AllTypes>(buf, len, AllTypes_fields);
+    }
+
+    {
+        COMMENT("Proto2 message with only the required field");
+        AllTypes msg = AllTypes_init_zero;
+        pb_byte_t buf[256];
+        size_t len;
+        status += check_encode(msg, AllTypes_fields, buf, &len);
+        status += check_decode<AllTypes>(buf, len, AllTypes_fields);
+    }
+
+    {
+        COMMENT("Proto3 message");
+        SensorReport msg;
+        pb_byte_t buf[256];
+        size_t len;
+        fill_report(&msg);
+        status += check_encode(msg, SensorReport_fields, buf, &len);
+        status += check_decode<SensorReport>(buf, len, SensorReport_fields);
+    }
+
+    {
+        COMMENT("Unpacked repeated fields and unknown fields are accepted");
+        const pb_byte_t data[] = {0x08, 0x01, 0xA0, 0x01, 0x05, 0xA0, 0x01, 0x06, 0x98, 0x06, 0x02, 0x08, 0x07};
+        AllTypes msg;
+        pb_istream_t stream = pb_istream_from_buffer(data, sizeof(data));
+        TEST(nanopb::decode(&stream, msg));
+        TEST(msg.req_int32 == 7 && msg.rep_int32_count == 2);
+        TEST(msg.rep_int32[0] == 5 && msg.rep_int32[1] == 6);
+    }
+
+    {
+        COMMENT("Error cases match pb_decode()");
+        const pb_byte_t missing_required[] = {0x10, 0x01};
+        const pb_byte_t wrong_wire_type[] = {0x0D, 0x00, 0x00, 0x00, 0x00};
+        const pb_byte_t truncated[] = {0x08, 0x01, 0x62, 0x05, 'a'};
+        const pb_byte_t string_overflow[] = {0x08, 0x01, 0xB2, 0x01, 0x08, 'a', 'b', 'c', 'd', 'e', 'f', 'g', 'h'};
+        const pb_byte_t array_overflow[] = {0x08, 0x01, 0xA2, 0x01, 0x06, 1, 2, 3, 4, 5, 6};
+        const pb_byte_t too_large[] = {0x08, 0x01, 0x88, 0x01, 0x80, 0x02};
+        const pb_byte_t fbytes_size[] = {0x08, 0x01, 0x72, 0x02, 0x01, 0x02};
+        const pb_byte_t inner_missing[] = {0x08, 0x01, 0x82, 0x01, 0x00};
+
+        status += check_error<AllTypes>(missing_required, sizeof(missing_required), AllTypes_fields, "missing required field");
+        status += check_error<AllTypes>(wrong_wire_type, sizeof(wrong_wire_type), AllTypes_fields, "wrong wire type");
+        status += check_error<AllTypes>(truncated, sizeof(truncated), AllTypes_fields, "end-of-stream");
+        status += check_error<AllTypes>(string_overflow, sizeof(string_overflow), AllTypes_fields, "string overflow");
+        status += check_error<AllTypes>(array_overflow, sizeof(array_overflow), AllTypes_fields, "array overflow");
+        status += check_error<AllTypes>(too_large, sizeof(too_large), AllTypes_fields, "integer too large");
+        status += check_error<AllTypes>(fbytes_size, sizeof(fbytes_size), AllTypes_fields, "incorrect fixed length bytes size");
+        status += check_error<AllTypes>(inner_missing, sizeof(inner_missing), AllTypes_fields, "missing required field");
+    }
+
+    {
+        COMMENT("Encoding errors match pb_encode()");
+        AllTypes msg;
+        pb_byte_t buf[8];
+        pb_ostream_t s1 = pb_ostream_from_buffer(buf, sizeof(buf));
+        pb_ostream_t s2 = pb_ostream_from_buffer(buf, sizeof(buf));
+        fill_alltypes(&msg);
+        TEST(!pb_encode(&s1, AllTypes_fields, &msg));
+        TEST(!nanopb::encode(&s2, msg));
+        TEST(s1.bytes_written == s2.bytes_written);
+        TEST(strcmp(PB_GET_ERROR(&s1), PB_GET_ERROR(&s2)) == 0);
+
+        fill_alltypes(&msg);
+        msg.opt_bytes.size = 17;
+        s2 = PB_OSTREAM_SIZING;
+        TEST(!nanopb::encode(&s2, msg));
+        TEST(strcmp(PB_GET_ERROR(&s2), "bytes size exceeded") == 0);
+    }
+
+    if (status == 0)
+    {
+        int stack_enc_c, stack_enc_cxx, stack_dec_c, stack_dec_cxx;
+        double time_enc_c, time_enc_cxx, time_dec_c, time_dec_cxx;
+
+        fill_report(&g_report);
+        stack_enc_c = measure_stack(encode_c);
+        stack_enc_cxx = measure_stack(encode_cxx);
+        stack_dec_c = measure_stack(decode_c);
+        stack_dec_cxx = measure_stack(decode_cxx);
+
+        time_enc_c = measure_time(encode_c);
+        time_enc_cxx = measure_time(encode_cxx);
+        time_dec_c = measure_time(decode_c);
+        time_dec_cxx = measure_time(decode_cxx);
+
+        /* Print machine-readable to stdout and user-readable to stderr */
+        printf("%d %d %d %d %.1f %.1f %.1f %.1f\n",
+               stack_enc_c, stack_enc_cxx, stack_dec_c, stack_dec_cxx,
+               time_enc_c, time_enc_cxx, time_dec_c, time_dec_cxx);
+        fprintf(stderr, "SensorReport, %u bytes:\n", (unsigned)g_len);
+        fprintf(stderr, "  encode: pb_encode %d bytes stack %.1f ns, nanopb::encode %d bytes stack %.1f ns\n",
+                stack_enc_c, time_enc_c, stack_enc_cxx, time_enc_cxx);
+        fprintf(stderr, "  decode: pb_decode %d bytes stack %.1f ns, nanopb::decode %d bytes stack %.1f ns\n",
+                stack_dec_c, time_dec_c, stack_dec_cxx, time_dec_cxx);
+    }
+
+    if (status != 0)
+        fprintf(stdout, "\n\nSome tests FAILED!\n");
+
+    return status;
+}
@@ -0,0 +1,39 @@
+/* Minimal program for comparing the code size of pb_encode() / pb_decode()
+ * against the pb_codec.h templates. Built twice, with and without USE_C_API.
+ */
+
+#include <pb_encode.h>
+#include <pb_decode.h>
+#include "codec_proto3.pb.h"
+
+#ifndef USE_C_API
+#include <pb_codec.h>
+#endif
+
+/* Global with external linkage, so that the compiler cannot constant-fold the contents */
+SensorReport g_msg;
+static pb_byte_t g_buf[SensorReport_size];
+static volatile size_t g_len;
+
+int main()
+{
+    pb_ostream_t ostream = pb_ostream_from_buffer(g_buf, sizeof(g_buf));
+    pb_istream_t istream;
+    bool status;
+
+#ifdef USE_C_API
+    status = pb_encode(&ostream, SensorReport_fields, &g_msg);
+#else
+    status = nanopb::encode(&ostream, g_msg);
+#endif
+    g_len = ostream.bytes_written;
+
+    istream = pb_istream_from_buffer(g_buf, g_len);
+#ifdef USE_C_API
+    status = status && pb_decode(&istream, SensorReport_fields, &g_msg);
+#else
+    status = status && nanopb::decode(&istream, g_msg);
+#endif
+
+    return status ? 0 : 1;
+}
@@ -0,0 +1,245 @@
+/* Test pb_decode_iterative(), which decodes submessages without recursion,
+ * by comparing its results with pb_decode().
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <pb_decode.h>
+#include <pb_encode.h>
+#include "unittests.h"
+#include "decode_iterative.pb.h"
+
+static void fill_leaf(Leaf *leaf, int32_t value)
+{
+    leaf->value = value;
+    leaf->has_name = true;
+    sprintf(leaf->name, "l%d", (int)value);
+}
+
+static void fill_branch(Branch *branch, int32_t value)
+{
+    fill_leaf(&branch->leaf, value);
+    branch->leaves_count = 2;
+    fill_leaf(&branch->leaves[0], value + 1);
+    fill_leaf(&branch->leaves[1], value + 2);
+    fill_leaf(&branch->pair[0], value + 3);
+    fill_leaf(&branch->pair[1], value + 4);
+    branch->which_choice = Branch_left_tag;
+    fill_leaf(&branch->choice.left, value + 5);
+}
+
+static void fill_tree(Tree *msg)
+{
+    Tree empty = Tree_init_default;
+    *msg = empty;
+    msg->id = 42;
+    msg->has_trunk = true;
+    fill_branch(&msg->trunk, 10);
+    msg->branches_count = 2;
+    fill_branch(&msg->branches[0], 20);
+    fill_branch(&msg->branches[1], 30);
+    msg->branches[1].which_choice = Branch_number_tag;
+    msg->branches[1].choice.number = 1234;
+    msg->has_top = true;
+    fill_leaf(&msg->top, 40);
+}
+
+/* Decode with both decoders, and check that the results are the same */
+static bool decode_both(const pb_byte_t *buf, size_t len, unsigned int flags, Tree *msg)
+{
+    Tree expected;
+    pb_decode_frame_t frames[3];
+    pb_istream_t stream = pb_istream_from_buffer(buf, len);
+
+    memset(&expected, 0, sizeof(expected));
+    if (!pb_decode_ex(&stream, Tree_fields, &expected, flags))
+        return false;
+
+    memset(msg, 0, sizeof(*msg));
+    stream = pb_istream_from_buffer(buf, len);
+    if (!pb_decode_iterative(&stream, Tree_fields, msg, flags, frames, 3))
+        return false;
+
+    return memcmp(msg, &expected, sizeof(expected)) == 0;
+}
+
+/* Decode and return the error message */
+static const char *decode_error(const pb_byte_t *buf, size_t len, pb_size_t frame_count)
+{
+    Tree msg;
+    pb_decode_frame_t frames[3];
+    pb_istream_t stream = pb_istream_from_buffer(buf, len);
+
+    if (pb_decode_iterative(&stream, Tree_fields, &msg, 0, frames, frame_count))
+        return "";
+
+    return PB_GET_ERROR(&stream);
+}
+
+int main()
+{
+    int status = 0;
+    pb_byte_t buffer[512];
+    size_t msglen;
+
+    {
+        pb_size_t depth;
+
+        COMMENT("Nesting depth from the descriptors");
+        TEST(pb_decode_depth(Leaf_fields, 1, &depth) && depth == 1);
+        TEST(pb_decode_depth(Branch_fields, 8, &depth) && depth == 2);
+        TEST(pb_decode_depth(Tree_fields, 8, &depth) && depth == 3);
+        TEST(pb_decode_depth(Tree_fields, 3, &depth) && depth == 3);
+        TEST(!pb_decode_depth(Tree_fields, 2, &depth));
+    }
+
+    {
+        Tree msg;
+        pb_ostream_t stream = pb_ostream_from_buffer(buffer, sizeof(buffer));
+
+        COMMENT("Encode test message");
+        fill_tree(&msg);
+        TEST(pb_encode(&stream, Tree_fields, &msg));
+        msglen = stream.bytes_written;
+    }
+
+    {
+        Tree msg;
+        pb_decode_frame_t frames[3];
+        pb_istream_t stream = pb_istream_from_buffer(buffer, msglen);
+
+        COMMENT("Decode all levels");
+        TEST(pb_decode_iterative(&stream, Tree_fields, &msg, 0, frames, 3));
+        TEST(stream.bytes_left == 0);
+        TEST(msg.id == 42);
+        TEST(msg.trunk.leaf.value == 10 && strcmp(msg.trunk.leaf.name, "l10") == 0);
+        TEST(msg.trunk.leaves_count == 2 && msg.trunk.leaves[1].value == 12);
+        TEST(msg.trunk.pair[0].value == 13 && msg.trunk.pair[1].value == 14);
+        TEST(msg.trunk.which_choice == Branch_left_tag && msg.trunk.choice.left.value == 15);
+        TEST(msg.branches_count == 2 && msg.branches[0].leaves[0].value == 21);
+        TEST(msg.branches[1].which_choice == Branch_number_tag);
+        TEST(msg.branches[1].choice.number == 1234);
+        TEST(msg.top.value == 40);
+
+        COMMENT("Same result as pb_decode()");
+        TEST(decode_both(buffer, msglen, 0, &msg));
+    }
+
+    {
+        COMMENT("Input nested deeper than the frames");
+        TEST(strcmp(decode_error(buffer, msglen, 2), "max depth exceeded") == 0);
+        TEST(strcmp(decode_error(buffer, msglen, 0), "max depth exceeded") == 0);
+    }
+
+    {
+        Tree msg = Tree_init_default;
+        pb_decode_frame_t frame;
+        pb_ostream_t ostream = pb_ostream_from_buffer(buffer, sizeof(buffer));
+        pb_istream_t stream;
+
+        COMMENT("One frame is enough without submessages");
+        msg.id = 7;
+        TEST(pb_encode(&ostream, Tree_fields, &msg));
+        stream = pb_istream_from_buffer(buffer, ostream.bytes_written);
+        TEST(pb_decode_iterative(&stream, Tree_fields, &msg, 0, &frame, 1));
+        TEST(msg.id == 7 && !msg.has_trunk && !msg.has_top);
+        TEST(strcmp(msg.top.name, "leaf") == 0);
+    }
+
+    {
+        Tree msg1, msg2, msg;
+        pb_ostream_t stream = pb_ostream_from_buffer(buffer, sizeof(buffer));
+
+        COMMENT("Merge concatenated messages");
+        fill_tree(&msg1);
+        msg1.branches_count = 0;
+        msg1.trunk.leaves_count = 1;
+        msg2 = msg1;
+        msg2.trunk.which_choice = Branch_number_tag;
+        msg2.trunk.choice.number = 5;
+        msg2.trunk.leaf.has_name = false;
+        TEST(pb_encode(&stream, Tree_fields, &msg1));
+        TEST(pb_encode(&stream, Tree_fields, &msg2));
+        TEST(pb_encode(&stream, Tree_fields, &msg1));
+        TEST(decode_both(buffer, stream.bytes_written, 0, &msg));
+        TEST(msg.trunk.leaves_count == 3);
+        TEST(msg.trunk.which_choice == Branch_left_tag);
+        TEST(msg.trunk.choice.left.value == 15);
+    }
+
+    {
+        Tree msg;
+        pb_decode_frame_t frames[3];
+        pb_ostream_t ostream = pb_ostream_from_buffer(buffer, sizeof(buffer));
+        pb_istream_t stream;
+
+        COMMENT("Delimited messages");
+        fill_tree(&msg);
+        TEST(pb_encode_ex(&ostream, Tree_fields, &msg, PB_ENCODE_DELIMITED));
+        msg.id = 43;
+        TEST(pb_encode_ex(&ostream, Tree_fields, &msg, PB_ENCODE_DELIMITED));
+
+        stream = pb_istream_from_buffer(buffer, ostream.bytes_written);
+        TEST(pb_decode_iterative(&stream, Tree_fields, &msg, PB_DECODE_DELIMITED, frames, 3));
+        TEST(msg.id == 42 && msg.top.value == 40);
+        TEST(pb_decode_iterative(&stream, Tree_fields, &msg, PB_DECODE_DELIMITED, frames, 3));
+        TEST(msg.id == 43 && msg.top.value == 40);
+        TEST(stream.bytes_left == 0);
+    }
+
+    {
+        Tree msg;
+        pb_decode_frame_t frames[3];
+        pb_ostream_t ostream = pb_ostream_from_buffer(buffer, sizeof(buffer));
+        pb_istream_t stream;
+
+        COMMENT("Null terminated message");
+        fill_tree(&msg);
+        TEST(pb_encode_ex(&ostream, Tree_fields, &msg, PB_ENCODE_NULLTERMINATED));
+        TEST(pb_write(&ostream, (const pb_byte_t*)"\x08\x01", 2));
+
+        stream = pb_istream_from_buffer(buffer, ostream.bytes_written);
+        TEST(pb_decode_iterative(&stream, Tree_fields, &msg, PB_DECODE_NULLTERMINATED, frames, 3));
+        TEST(msg.id == 42 && stream.bytes_left == 2);
+    }
+
+    {
+        Tree tree;
+        TreeWithoutTop msg;
+        pb_decode_frame_t frames[3];
+        pb_ostream_t ostream = pb_ostream_from_buffer(buffer, sizeof(buffer));
+        pb_istream_t stream;
+
+        COMMENT("Unknown fields are skipped");
+        fill_tree(&tree);
+        TEST(pb_encode(&ostream, Tree_fields, &tree));
+        stream = pb_istream_from_buffer(buffer, ostream.bytes_written);
+        TEST(pb_decode_iterative(&stream, TreeWithoutTop_fields, &msg, 0, frames, 3));
+        TEST(msg.id == 42 && msg.branches[1].choice.number == 1234);
+    }
+
+    {
+        /* Leaf without value */
+        static const pb_byte_t missing[] = {0x08, 0x01, 0x12, 0x05, 0x0A, 0x03, 0x12, 0x01, 'x'};
+        /* Only one entry of the fixed count pair */
+        static const pb_byte_t pair[] = {0x08, 0x01, 0x12, 0x08, 0x0A, 0x02, 0x08, 0x01, 0x1A, 0x02, 0x08, 0x05};
+        /* Zero tag in a submessage */
+        static const pb_byte_t zero[] = {0x08, 0x01, 0x22, 0x02, 0x00, 0x00};
+        /* Submessage longer than the enclosing one */
+        static const pb_byte_t overrun[] = {0x08, 0x01, 0x12, 0x03, 0x0A, 0x05, 0x08, 0x01};
+        /* Leaf as a varint */
+        static const pb_byte_t wiretype[] = {0x08, 0x01, 0x20, 0x01};
+
+        COMMENT("Errors in submessages");
+        TEST(strcmp(decode_error(missing, sizeof(missing), 3), "missing required field") == 0);
+        TEST(strcmp(decode_error(pair, sizeof(pair), 3), "wrong size for fixed count field") == 0);
+        TEST(strcmp(decode_error(zero, sizeof(zero), 3), "zero tag") == 0);
+        TEST(strcmp(decode_error(overrun, sizeof(overrun), 3), "parent stream too short") == 0);
+        TEST(strcmp(decode_error(wiretype, sizeof(wiretype), 3), "wrong wire type") == 0);
+    }
+
+    if (status != 0)
+        fprintf(stdout, "\n\nSome tests FAILED!\n");
+
+    return status;
+}
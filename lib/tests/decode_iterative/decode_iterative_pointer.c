@@ -0,0 +1,161 @@
+/* Test pb_decode_iterative() with a recursive message type,
+ * where the nesting depth is only limited by the frames.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <pb_decode.h>
+#include <pb_encode.h>
+#include <malloc_wrappers.h>
+#include "unittests.h"
+#include "decode_iterative_pointer.pb.h"
+
+#define CHAIN_LENGTH 50
+#define CHILDREN 100
+
+/* Encode a chain of nodes, each the child of the previous one */
+static bool encode_chain(pb_ostream_t *stream, int length)
+{
+    static Node nodes[CHAIN_LENGTH];
+    int i;
+
+    memset(nodes, 0, sizeof(nodes));
+    for (i = 0; i < length; i++)
+    {
+        nodes[i].has_value = true;
+        nodes[i].value = i;
+        if (i + 1 < length)
+            nodes[i].child = &nodes[i + 1];
+    }
+
+    return pb_encode(stream, Node_fields, &nodes[0]);
+}
+
+int main()
+{
+    int status = 0;
+    pb_byte_t buffer[512];
+    size_t msglen;
+
+    {
+        pb_size_t depth;
+
+        COMMENT("Recursive type has no bound");
+        TEST(!pb_decode_depth(Node_fields, 100, &depth));
+    }
+
+    {
+        pb_ostream_t stream = pb_ostream_from_buffer(buffer, sizeof(buffer));
+
+        COMMENT("Encode chain of nodes");
+        TEST(encode_chain(&stream, CHAIN_LENGTH));
+        msglen = stream.bytes_written;
+    }
+
+    {
+        Node msg = Node_init_zero;
+        pb_decode_frame_t frames[CHAIN_LENGTH];
+        pb_istream_t stream = pb_istream_from_buffer(buffer, msglen);
+        Node *node;
+        int count = 0;
+
+        COMMENT("Decode chain with enough frames");
+        TEST(pb_decode_iterative(&stream, Node_fields, &msg, 0, frames, CHAIN_LENGTH));
+        for (node = &msg; node != NULL; node = node->child)
+        {
+            if (node->value != count)
+                break;
+            count++;
+        }
+        TEST(count == CHAIN_LENGTH);
+        TEST(get_alloc_count() == CHAIN_LENGTH - 1);
+        pb_release(Node_fields, &msg);
+        TEST(get_alloc_count() == 0);
+    }
+
+    {
+        Node msg = Node_init_zero;
+        pb_decode_frame_t frames[CHAIN_LENGTH];
+        pb_istream_t stream = pb_istream_from_buffer(buffer, msglen);
+
+        COMMENT("Chain deeper than the frames is released");
+        TEST(!pb_decode_iterative(&stream, Node_fields, &msg, 0, frames, CHAIN_LENGTH - 1));
+        TEST(strcmp(PB_GET_ERROR(&stream), "max depth exceeded") == 0);
+        TEST(msg.child == NULL);
+        TEST(get_alloc_count() == 0);
+    }
+
+    {
+        Node msg = Node_init_zero;
+        Node children[3];
+        Node grandchild = Node_init_zero;
+        pb_decode_frame_t frames[3];
+        pb_ostream_t ostream = pb_ostream_from_buffer(buffer, sizeof(buffer));
+        pb_istream_t stream;
+
+        COMMENT("Repeated pointer submessages");
+        memset(children, 0, sizeof(children));
+        children[0].has_value = true;
+        children[0].value = 1;
+        children[1].child = &grandchild;
+        children[2].has_value = true;
+        children[2].value = 3;
+        grandchild.has_value = true;
+        grandchild.value = 2;
+        msg.children_count = 3;
+        msg.children = children;
+        msg.child = &children[2];
+        TEST(pb_encode(&ostream, Node_fields, &msg));
+
+        memset(&msg, 0, sizeof(msg));
+        stream = pb_istream_from_buffer(buffer, ostream.bytes_written);
+        TEST(pb_decode_iterative(&stream, Node_fields, &msg, 0, frames, 3));
+        TEST(msg.children_count == 3);
+        TEST(msg.children[0].value == 1 && msg.children[2].value == 3);
+        TEST(msg.children[1].child != NULL && msg.children[1].child->value == 2);
+        TEST(msg.child != NULL && msg.child->value == 3);
+        pb_release(Node_fields, &msg);
+        TEST(get_alloc_count() == 0);
+    }
+
+    {
+        static Node children[CHILDREN];
+        Node msg = Node_init_zero;
+        pb_decode_frame_t frames[2];
+        pb_ostream_t ostream = pb_ostream_from_buffer(buffer, sizeof(buffer));
+        pb_istream_t stream;
+        size_t calls;
+        bool ok = true;
+        int i;
+
+        COMMENT("Long array of pointer submessages grows geometrically");
+        memset(children, 0, sizeof(children));
+        for (i = 0; i < CHILDREN; i++)
+        {
+            children[i].has_value = true;
+            children[i].value = i;
+        }
+        msg.children_count = CHILDREN;
+        msg.children = children;
+        TEST(pb_encode(&ostream, Node_fields, &msg));
+
+        memset(&msg, 0, sizeof(msg));
+        calls = get_realloc_calls();
+        stream = pb_istream_from_buffer(buffer, ostream.bytes_written);
+        TEST(pb_decode_iterative(&stream, Node_fields, &msg, 0, frames, 2));
+        calls = get_realloc_calls() - calls;
+        TEST(calls < 20);
+        TEST(msg.children_count == CHILDREN);
+        TEST(get_allocation_size(msg.children) == CHILDREN * sizeof(Node));
+        for (i = 0; i < CHILDREN; i++)
+            ok = ok && msg.children[i].value == i;
+        TEST(ok);
+        pb_release(Node_fields, &msg);
+        TEST(get_alloc_count() == 0);
+    }
+
+    if (status != 0)
+        fprintf(stdout, "\n\nSome tests FAILED!\n");
+
+    return status;
+}
@@ -0,0 +1,117 @@
+#include <stdio.h>
+#include <string.h>
+#include <pb_decode.h>
+#include <pb_encode.h>
+#include "unittests.h"
+#include "decode_projection.pb.h"
+
+static bool encode_record(pb_ostream_t *stream, uint32_t timestamp, float ph)
+{
+    Telemetry msg = Telemetry_init_default;
+    msg.timestamp = timestamp;
+    msg.has_ph = true;
+    msg.ph = ph;
+    msg.samples_count = 3;
+    msg.samples[2] = 99;
+    msg.has_location = true;
+    msg.location.has_rack = true;
+    msg.location.rack = 4;
+    msg.has_note = true;
+    strcpy(msg.note, "calibrated");
+    return pb_encode_ex(stream, Telemetry_fields, &msg, PB_ENCODE_DELIMITED);
+}
+
+int main()
+{
+    int status = 0;
+    pb_byte_t buffer[256];
+    size_t msglen;
+
+    {
+        pb_ostream_t stream = pb_ostream_from_buffer(buffer, sizeof(buffer));
+
+        COMMENT("Encode log of delimited records");
+        TEST(encode_record(&stream, 100, 6.0f));
+        TEST(encode_record(&stream, 200, 6.5f));
+        TEST(encode_record(&stream, 300, 7.0f));
+        msglen = stream.bytes_written;
+    }
+
+    {
+        Telemetry msg;
+        static const uint32_t tags[] = {Telemetry_ph_tag};
+        pb_istream_t stream = pb_istream_from_buffer(buffer, msglen);
+
+        COMMENT("Other fields are not touched");
+        memset(&msg, 0x55, sizeof(msg));
+        TEST(pb_decode_projection(&stream, Telemetry_fields, &msg, PB_DECODE_DELIMITED, tags, 1));
+        TEST(msg.has_ph && msg.ph == 6.0f);
+        TEST(msg.timestamp == 0x55555555);
+        TEST(msg.samples_count == 0x5555);
+        TEST(msg.location.rack == 0x55555555);
+        TEST(msg.note[0] == 0x55);
+    }
+
+    {
+        Telemetry msg;
+        static const uint32_t tags[] = {Telemetry_ph_tag, Telemetry_timestamp_tag};
+        pb_istream_t stream = pb_istream_from_buffer(buffer, msglen);
+        float sum = 0;
+        int count = 0;
+
+        COMMENT("Scan all records");
+        while (stream.bytes_left > 0)
+        {
+            if (!pb_decode_projection(&stream, Telemetry_fields, &msg, PB_DECODE_DELIMITED, tags, 2))
+                break;
+            sum += msg.ph;
+            count++;
+        }
+        TEST(count == 3 && sum == 19.5f);
+        TEST(msg.timestamp == 300);
+    }
+
+    {
+        Telemetry msg;
+        static const uint32_t tags[] = {Telemetry_ec_tag, Telemetry_samples_tag, Telemetry_location_tag};
+        pb_istream_t stream = pb_istream_from_buffer(buffer, msglen);
+
+        COMMENT("Projected fields get defaults");
+        memset(&msg, 0x55, sizeof(msg));
+        TEST(pb_decode_projection(&stream, Telemetry_fields, &msg, PB_DECODE_DELIMITED, tags, 3));
+        TEST(!msg.has_ec && msg.ec == 1.5f);
+        TEST(msg.samples_count == 3 && msg.samples[2] == 99);
+        TEST(msg.has_location && msg.location.rack == 4 && !msg.location.has_slot);
+        TEST(*(pb_byte_t*)&msg.has_ph == 0x55);
+    }
+
+    {
+        Telemetry msg;
+        static const uint32_t tags[] = {Telemetry_note_tag};
+        pb_istream_t stream = pb_istream_from_buffer(buffer, msglen);
+
+        COMMENT("Merge with PB_DECODE_NOINIT");
+        memset(&msg, 0, sizeof(msg));
+        msg.samples_count = 1;
+        TEST(pb_decode_projection(&stream, Telemetry_fields, &msg, PB_DECODE_DELIMITED | PB_DECODE_NOINIT, tags, 1));
+        TEST(strcmp(msg.note, "calibrated") == 0);
+        TEST(msg.samples_count == 1);
+    }
+
+    {
+        Telemetry msg;
+        static const uint32_t tags[] = {Telemetry_ph_tag};
+        pb_istream_t stream = pb_istream_from_buffer(buffer, msglen);
+
+        COMMENT("Skipped data is still checked");
+        TEST(buffer[1] == 0x08);
+        buffer[1] = 0x0F; /* Invalid wire type for timestamp */
+        TEST(!pb_decode_projection(&stream, Telemetry_fields, &msg, PB_DECODE_DELIMITED, tags, 1));
+        buffer[1] = 0x08;
+    }
+
+    if (status != 0)
+        fprintf(stdout, "\n\nSome tests FAILED!\n");
+
+    return status;
+}
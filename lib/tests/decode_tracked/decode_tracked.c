@@ -0,0 +1,149 @@
+#include <stdio.h>
+#include <string.h>
+#include <pb_decode.h>
+#include <pb_encode.h>
+#include "unittests.h"
+#include "decode_tracked.pb.h"
+
+static size_t encode_frame(pb_byte_t *buffer, size_t size, const Frame *msg)
+{
+    pb_ostream_t stream = pb_ostream_from_buffer(buffer, size);
+    if (!pb_encode(&stream, Frame_fields, msg))
+        return 0;
+    return stream.bytes_written;
+}
+
+/* Check that msg equals the result of normal pb_decode() of the data */
+static bool same_as_fresh(const pb_byte_t *data, size_t len, const Frame *msg)
+{
+    Frame fresh;
+    pb_byte_t buf1[512], buf2[512];
+    size_t len1, len2;
+    pb_istream_t stream = pb_istream_from_buffer(data, len);
+
+    if (!pb_decode(&stream, Frame_fields, &fresh))
+        return false;
+
+    len1 = encode_frame(buf1, sizeof(buf1), &fresh);
+    len2 = encode_frame(buf2, sizeof(buf2), msg);
+    return len1 > 0 && len1 == len2 && memcmp(buf1, buf2, len1) == 0;
+}
+
+int main()
+{
+    int status = 0;
+    pb_byte_t full[512], small[64];
+    size_t full_len, small_len;
+    Frame msg;
+    pb_field_tracker_t tracker = {{0}};
+
+    {
+        Frame src = Frame_init_zero;
+        src.has_seq = true;
+        src.seq = 1;
+        src.has_payload = true;
+        src.payload.size = 200;
+        memset(src.payload.bytes, 0xAA, 200);
+        src.has_origin = true;
+        src.origin.has_x = true;
+        src.origin.x = 10;
+        src.points_count = 3;
+        src.points[2].has_y = true;
+        src.points[2].y = 7;
+        src.which_command = Frame_label_tag;
+        strcpy(src.command.label, "go");
+        src.has_name = true;
+        strcpy(src.name, "full");
+        full_len = encode_frame(full, sizeof(full), &src);
+
+        memset(&src, 0, sizeof(src));
+        src.has_seq = true;
+        src.seq = 2;
+        src.which_command = Frame_speed_tag;
+        src.command.speed = 3;
+        small_len = encode_frame(small, sizeof(small), &src);
+    }
+
+    memset(&msg, 0x55, sizeof(msg));
+
+    {
+        pb_istream_t stream = pb_istream_from_buffer(full, full_len);
+
+        COMMENT("First decode initializes the whole struct");
+        TEST(pb_decode_tracked(&stream, Frame_fields, &msg, 0, &tracker));
+        TEST(same_as_fresh(full, full_len, &msg));
+    }
+
+    {
+        pb_istream_t stream = pb_istream_from_buffer(small, small_len);
+
+        COMMENT("Fields of previous message are reset");
+        TEST(pb_decode_tracked(&stream, Frame_fields, &msg, 0, &tracker));
+        TEST(same_as_fresh(small, small_len, &msg));
+        TEST(msg.seq == 2 && msg.which_command == Frame_speed_tag);
+        TEST(!msg.has_payload && msg.payload.size == 0);
+        TEST(!msg.has_origin && msg.origin.x == 5);
+        TEST(msg.points_count == 0);
+        TEST(!msg.has_name && strcmp(msg.name, "unnamed") == 0);
+    }
+
+    {
+        pb_istream_t stream = pb_istream_from_buffer(small, small_len);
+
+        COMMENT("Clean fields are not touched");
+        msg.payload.bytes[5] = 0x11;
+        TEST(pb_decode_tracked(&stream, Frame_fields, &msg, 0, &tracker));
+        TEST(msg.payload.bytes[5] == 0x11);
+        TEST(same_as_fresh(small, small_len, &msg));
+    }
+
+    {
+        pb_istream_t stream = pb_istream_from_buffer(small, small_len);
+
+        COMMENT("Zeroed tracker initializes everything again");
+        memset(&tracker, 0, sizeof(tracker));
+        TEST(pb_decode_tracked(&stream, Frame_fields, &msg, 0, &tracker));
+        TEST(msg.payload.bytes[5] == 0);
+    }
+
+    {
+        pb_istream_t stream = pb_istream_from_buffer(full, full_len);
+
+        COMMENT("Merging with PB_DECODE_NOINIT");
+        TEST(pb_decode_tracked(&stream, Frame_fields, &msg, PB_DECODE_NOINIT, &tracker));
+        TEST(msg.has_payload && msg.seq == 1);
+
+        stream = pb_istream_from_buffer(small, small_len);
+        TEST(pb_decode_tracked(&stream, Frame_fields, &msg, 0, &tracker));
+        TEST(same_as_fresh(small, small_len, &msg));
+    }
+
+    {
+        pb_istream_t stream = pb_istream_from_buffer(full, full_len - 1);
+
+        COMMENT("Fields written by failed decode are reset");
+        TEST(!pb_decode_tracked(&stream, Frame_fields, &msg, 0, &tracker));
+        TEST(msg.has_payload);
+
+        stream = pb_istream_from_buffer(small, small_len);
+        TEST(pb_decode_tracked(&stream, Frame_fields, &msg, 0, &tracker));
+        TEST(same_as_fresh(small, small_len, &msg));
+    }
+
+    {
+        pb_byte_t delimited[64];
+        pb_istream_t stream;
+
+        COMMENT("Delimited decode");
+        delimited[0] = (pb_byte_t)small_len;
+        memcpy(delimited + 1, small, small_len);
+        stream = pb_istream_from_buffer(delimited, small_len + 1);
+        TEST(pb_decode_tracked(&stream, Frame_fields, &msg, PB_DECODE_DELIMITED, &tracker));
+        TEST(same_as_fresh(small, small_len, &msg));
+    }
+
+    if (status != 0)
+        fprintf(stdout, "\n\nSome tests FAILED!\n");
+
+    return status;
+}
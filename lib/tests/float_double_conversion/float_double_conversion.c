@@ -61,6 +61,10 @@ int main()
             TEST(pb_decode(&stream, &FloatMsg_msg, &msg));
             TEST(memcmp(&msg.value, &expected_float, sizeof(float)) == 0);
 
+            /* Validation accepts the same input */
+            stream = pb_istream_from_buffer(buf, msglen);
+            TEST(pb_validate(&stream, &FloatMsg_msg));
+
             /* Re-encode */
             ostream = pb_ostream_from_buffer(buf, sizeof(buf));
             TEST(pb_encode(&ostream, &FloatMsg_msg, &msg));
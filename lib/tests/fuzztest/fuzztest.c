@@ -9,6 +9,7 @@
 
 #include <pb_decode.h>
 #include <pb_encode.h>
+#include <pb_common.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -48,6 +49,62 @@ static size_t g_bufsize = FUZZTEST_BUFSIZE;
 #define FUZZTEST_IO_ERRORS
 #endif
 
+#ifdef FUZZTEST_COMPLEXITY
+/* Performance fuzzing mode: the decoding work is counted with the
+ * PB_ENABLE_STATS counters, and must stay linear in the input length:
+ * FUZZTEST_WORK_PER_BYTE * msglen + FUZZTEST_WORK_INIT * field_count.
+ * The second term covers initializing the message to its default values.
+ * The per byte limit does not scale with the number of fields, so input
+ * that makes every field lookup walk the whole descriptor exceeds it once
+ * the message type has more than about 2 * FUZZTEST_WORK_PER_BYTE fields.
+ */
+#ifndef PB_ENABLE_STATS
+#error FUZZTEST_COMPLEXITY requires PB_ENABLE_STATS
+#endif
+
+#ifndef FUZZTEST_WORK_PER_BYTE
+#define FUZZTEST_WORK_PER_BYTE 32
+#endif
+#ifndef FUZZTEST_WORK_INIT
+#define FUZZTEST_WORK_INIT 8
+#endif
+
+static double g_worst_work;
+
+static uint32_t decode_work(void)
+{
+    pb_stats_t stats;
+    uint32_t work;
+    int i;
+
+    pb_stats_get(&stats);
+    work = stats.iter_steps + stats.varint_bytes + stats.bytes_copied +
+           stats.bytes_skipped + stats.callbacks;
+
+    for (i = 0; i < 8; i++)
+        work += stats.fields_decoded[i];
+
+    return work;
+}
+
+static void check_complexity(size_t msglen, const pb_msgdesc_t *msgtype)
+{
+    double limit = (double)FUZZTEST_WORK_PER_BYTE * (double)msglen +
+                   (double)FUZZTEST_WORK_INIT * msgtype->field_count;
+    double work = decode_work();
+
+    if (work / limit > g_worst_work)
+        g_worst_work = work / limit;
+
+    if (work > limit)
+    {
+        fprintf(stderr, "Decoding %u bytes took %.0f units of work, limit is %.0f\n",
+                (unsigned)msglen, work, limit);
+        assert(work <= limit);
+    }
+}
+#endif
+
 static uint32_t xor32_checksum(const void *data, size_t len)
 {
     const uint8_t *buf = (const uint8_t*)data;
@@ -62,6 +119,49 @@ static uint32_t xor32_checksum(const void *data, size_t len)
     return checksum;
 }
 
+/* Check that pb_decode_iterative() agrees with pb_decode_ex(). Static
+ * messages must decode to the same contents. */
+static void check_iterative(const uint8_t *buffer, size_t msglen, size_t structsize, const pb_msgdesc_t *msgtype,
+                            unsigned flags, bool expected_status, const void *expected, pb_extension_t *ext)
+{
+    bool status;
+    pb_istream_t stream;
+    pb_decode_frame_t frames[8];
+    pb_size_t depth;
+    void *msg = malloc_with_check(structsize);
+    assert(msg);
+
+    assert(pb_decode_depth(msgtype, 8, &depth));
+
+    memset(msg, 0, structsize);
+    if (msgtype == alltypes_static_AllTypes_fields)
+    {
+        ((alltypes_static_AllTypes*)msg)->extensions = ext;
+    }
+    else if (msgtype == alltypes_pointer_AllTypes_fields)
+    {
+        ((alltypes_pointer_AllTypes*)msg)->extensions = ext;
+    }
+
+    stream = pb_istream_from_buffer(buffer, msglen);
+    status = pb_decode_iterative(&stream, msgtype, msg, flags, frames, depth);
+
+    if (status != expected_status)
+    {
+        fprintf(stderr, "pb_decode_iterative: %s\n", status ? "succeeded" : PB_GET_ERROR(&stream));
+        assert(status == expected_status);
+    }
+
+    if (status && msgtype != alltypes_pointer_AllTypes_fields &&
+        msgtype != alltypes_proto3_pointer_AllTypes_fields)
+    {
+        assert(memcmp(msg, expected, structsize) == 0);
+    }
+
+    pb_release(msgtype, msg);
+    free_with_check(msg);
+}
+
 static bool do_decode(const uint8_t *buffer, size_t msglen, size_t structsize, const pb_msgdesc_t *msgtype, unsigned flags, bool assert_success)
 {
     bool status;
@@ -88,7 +188,14 @@ static bool do_decode(const uint8_t *buffer, size_t msglen, size_t structsize, c
     }
 
     stream = pb_istream_from_buffer(buffer, msglen);
+#ifdef FUZZTEST_COMPLEXITY
+    pb_stats_reset();
+    status = pb_decode_ex(&stream, msgtype, msg, flags);
+    check_complexity(msglen, msgtype);
+#else
     status = pb_decode_ex(&stream, msgtype, msg, flags);
+#endif
+    check_iterative(buffer, msglen, structsize, msgtype, flags, status, msg, &ext);
 
     if (status)
     {
@@ -463,6 +570,10 @@ int main(int argc, char **argv)
 
         free_with_check(buffer);
     }
+
+#ifdef FUZZTEST_COMPLEXITY
+    printf("Worst decoding work: %.1f %% of limit\n", g_worst_work * 100.0);
+#endif
     
     return 0;
 }
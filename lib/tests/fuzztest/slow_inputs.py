@@ -0,0 +1,71 @@
+#!/usr/bin/env python3
+# Generate slow_inputs.zip, a corpus of inputs that make the decoder do
+# as much work per input byte as possible with the AllTypes messages.
+# The fuzztest_complexity program checks that the work stays within a
+# linear bound for these. Run this script again after changing it.
+#
+# Work per input byte with the AllTypes messages (68 fields), compared to
+# the per byte limit FUZZTEST_WORK_PER_BYTE = 32 in fuzztest.c:
+#   alternating_tags  15.0
+#   unknown_tags      23.7
+#   oneof_switching   15.6
+#   duplicate_submsgs  3.3
+#   nested_submsgs     2.5
+#   empty_packed       2.2
+# None of them exceed the limit. In alternating_tags only the lookup of
+# the last field walks the whole descriptor, once per five input bytes,
+# so a message type needs about 150 fields before it exceeds the limit.
+
+import zipfile
+
+def varint(value):
+    result = bytearray()
+    while True:
+        byte = value & 0x7F
+        value >>= 7
+        if value:
+            result.append(byte | 0x80)
+        else:
+            result.append(byte)
+            return bytes(result)
+
+def key(tag, wiretype):
+    return varint((tag << 3) | wiretype)
+
+def int_field(tag, value):
+    return key(tag, 0) + varint(value)
+
+def len_field(tag, data):
+    return key(tag, 2) + varint(len(data)) + data
+
+COUNT = 400
+
+inputs = {
+    # Alternate between the first and the last field, so that every field
+    # lookup walks through the whole descriptor.
+    "alternating_tags": b"".join(int_field(999, 1) + int_field(1, 1) for i in range(COUNT)),
+
+    # Unknown tags below the largest tag also walk the whole descriptor.
+    "unknown_tags": b"".join(int_field(20, 1) for i in range(COUNT)),
+
+    # Each empty submessage resets the previous one to its defaults.
+    "duplicate_submsgs": b"".join(len_field(16, b"") for i in range(COUNT)),
+
+    # Switching oneof members releases and initializes the submessage.
+    "oneof_switching": b"".join(len_field(60, b"") + len_field(61, b"") for i in range(COUNT)),
+
+    # Submessage merged many times, with fields in reverse order and an
+    # unknown field in each.
+    "nested_submsgs": b"".join(len_field(16, int_field(4, 1) + int_field(2, 1) + len_field(1, b"a"))
+                               for i in range(COUNT)),
+
+    # Empty packed arrays of each type.
+    "empty_packed": b"".join(len_field(tag, b"") for i in range(COUNT // 10)
+                             for tag in range(21, 34)),
+}
+
+with zipfile.ZipFile("slow_inputs.zip", "w", zipfile.ZIP_DEFLATED) as out:
+    for name in sorted(inputs):
+        info = zipfile.ZipInfo(name, date_time = (2024, 1, 1, 0, 0, 0))
+        info.compress_type = zipfile.ZIP_DEFLATED
+        out.writestr(info, inputs[name])
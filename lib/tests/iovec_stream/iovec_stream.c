@@ -0,0 +1,137 @@
+/* Encode a framed message into an iovec stream, and check that the
+ * segments give the same bytes as a buffer stream, with large fields
+ * pointing into the message structure.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <pb_encode.h>
+#include "unittests.h"
+#include "iovec_stream.pb.h"
+
+static const pb_byte_t g_header[4] = {0xAA, 0x55, 0x01, 0x00};
+static const pb_byte_t g_trailer[2] = {0x0D, 0x0A};
+
+static bool write_frame(pb_ostream_t *stream, const Upload *msg)
+{
+    return pb_write(stream, g_header, sizeof(g_header)) &&
+           pb_encode(stream, Upload_fields, msg) &&
+           pb_write(stream, g_trailer, sizeof(g_trailer));
+}
+
+/* Concatenate the segments, like writev() would */
+static size_t gather(const pb_ostream_iovec_t *state, pb_byte_t *out)
+{
+    size_t i, pos = 0;
+    for (i = 0; i < state->count; i++)
+    {
+        memcpy(out + pos, state->segments[i].ptr, state->segments[i].len);
+        pos += state->segments[i].len;
+    }
+    return pos;
+}
+
+static bool in_scratch(const pb_view_t *segment, const pb_byte_t *scratch, size_t size)
+{
+    return segment->ptr >= scratch && segment->ptr + segment->len <= scratch + size;
+}
+
+int main()
+{
+    int status = 0;
+    Upload msg = Upload_init_zero;
+    pb_byte_t expected[2048];
+    size_t expected_len;
+
+    msg.has_name = true;
+    strcpy(msg.name, "sensor-7");
+    msg.has_payload = true;
+    msg.payload.size = 1000;
+    memset(msg.payload.bytes, 0x42, 1000);
+    msg.has_chunk = true;
+    msg.chunk.has_index = true;
+    msg.chunk.index = 3;
+    msg.chunk.has_data = true;
+    msg.chunk.data.size = 200;
+    memset(msg.chunk.data.bytes, 0x17, 200);
+    msg.has_comment = true;
+    strcpy(msg.comment, "short");
+
+    {
+        pb_ostream_t stream = pb_ostream_from_buffer(expected, sizeof(expected));
+        TEST(write_frame(&stream, &msg));
+        expected_len = stream.bytes_written;
+    }
+
+    {
+        pb_view_t segments[8];
+        pb_byte_t scratch[64];
+        pb_byte_t output[2048];
+        pb_ostream_iovec_t state;
+        pb_ostream_t stream = pb_ostream_iovec(&state, segments, 8, scratch, sizeof(scratch));
+
+        COMMENT("Encode frame into segments");
+        TEST(write_frame(&stream, &msg));
+        TEST(stream.bytes_written == expected_len);
+        TEST(gather(&state, output) == expected_len);
+        TEST(memcmp(output, expected, expected_len) == 0);
+
+        COMMENT("Large fields are referenced");
+        TEST(state.count == 5);
+        TEST(in_scratch(&segments[0], scratch, sizeof(scratch)));
+        TEST(segments[1].ptr == msg.payload.bytes && segments[1].len == 1000);
+        TEST(in_scratch(&segments[2], scratch, sizeof(scratch)));
+        TEST(segments[3].ptr == msg.chunk.data.bytes && segments[3].len == 200);
+        TEST(in_scratch(&segments[4], scratch, sizeof(scratch)));
+        printf("%u bytes in %u segments, %u bytes copied\n", (unsigned)expected_len,
+               (unsigned)state.count, (unsigned)(expected_len - 1200));
+    }
+
+    {
+        pb_view_t segments[4];
+        pb_byte_t scratch[64];
+        pb_ostream_iovec_t state;
+        pb_ostream_t stream = pb_ostream_iovec(&state, segments, 4, scratch, sizeof(scratch));
+
+        COMMENT("Out of segments");
+        TEST(!write_frame(&stream, &msg));
+        TEST(strcmp(PB_GET_ERROR(&stream), "too many segments") == 0);
+    }
+
+    {
+        pb_view_t segments[8];
+        pb_byte_t scratch[16];
+        pb_ostream_iovec_t state;
+        pb_ostream_t stream = pb_ostream_iovec(&state, segments, 8, scratch, sizeof(scratch));
+
+        COMMENT("Out of scratch space");
+        TEST(!write_frame(&stream, &msg));
+        TEST(strcmp(PB_GET_ERROR(&stream), "iovec scratch full") == 0);
+    }
+
+    {
+        pb_view_t segments[2];
+        pb_byte_t scratch[64];
+        pb_byte_t output[64];
+        pb_ostream_iovec_t state;
+        pb_ostream_t stream = pb_ostream_iovec(&state, segments, 2, scratch, sizeof(scratch));
+        Upload small = Upload_init_zero;
+        pb_ostream_t ref = pb_ostream_from_buffer(expected, sizeof(expected));
+
+        COMMENT("Small message fits in one segment");
+        small.has_name = true;
+        strcpy(small.name, "x");
+        small.has_payload = true;
+        small.payload.size = 8;
+        TEST(write_frame(&ref, &small));
+        TEST(write_frame(&stream, &small));
+        TEST(state.count == 1 && segments[0].ptr == scratch);
+        TEST(gather(&state, output) == ref.bytes_written);
+        TEST(memcmp(output, expected, ref.bytes_written) == 0);
+    }
+
+    if (status != 0)
+        fprintf(stdout, "\n\nSome tests FAILED!\n");
+
+    return status;
+}
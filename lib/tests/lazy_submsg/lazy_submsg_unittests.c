@@ -0,0 +1,105 @@
+#include <stdio.h>
+#include <string.h>
+#include <pb_decode.h>
+#include <pb_encode.h>
+#include "unittests.h"
+#include "lazy_submsg.pb.h"
+
+static bool view_inside(const pb_view_t *view, const pb_byte_t *buf, size_t len)
+{
+    return view->ptr >= buf && view->ptr + view->len <= buf + len;
+}
+
+int main()
+{
+    int status = 0;
+    pb_byte_t buffer[128];
+    size_t msglen;
+
+    {
+        EagerEnvelope src = EagerEnvelope_init_zero;
+        pb_ostream_t ostream = pb_ostream_from_buffer(buffer, sizeof(buffer));
+
+        src.route = 7;
+        src.has_reading = true;
+        src.reading.sensor = 1;
+        src.reading.has_value = true;
+        src.reading.value = 6.5f;
+        src.history_count = 2;
+        src.history[0].sensor = 2;
+        src.history[1].sensor = 3;
+        src.history[1].has_unit = true;
+        strcpy(src.history[1].unit, "mS/cm");
+
+        COMMENT("Encode reference message");
+        TEST(pb_encode(&ostream, EagerEnvelope_fields, &src));
+        msglen = ostream.bytes_written;
+    }
+
+    {
+        Envelope env;
+        Envelope_reading_MSGTYPE reading = Reading_init_zero;
+        pb_istream_t istream = pb_istream_from_buffer(buffer, msglen);
+
+        COMMENT("Decode envelope without submessages");
+        TEST(pb_decode(&istream, Envelope_fields, &env));
+        TEST(env.route == 7);
+        TEST(env.has_reading && view_inside(&env.reading, buffer, msglen));
+        TEST(env.history_count == 2);
+
+        COMMENT("Decode submessages on access");
+        TEST(Envelope_decode_reading(&env, &reading));
+        TEST(reading.sensor == 1 && reading.has_value && reading.value == 6.5f);
+        TEST(strcmp(reading.unit, "pH") == 0);
+        TEST(Envelope_decode_history(&env, 0, &reading));
+        TEST(reading.sensor == 2 && !reading.has_value);
+        TEST(Envelope_decode_history(&env, 1, &reading));
+        TEST(reading.sensor == 3 && strcmp(reading.unit, "mS/cm") == 0);
+    }
+
+    {
+        Envelope env;
+        pb_byte_t buffer2[128];
+        pb_istream_t istream = pb_istream_from_buffer(buffer, msglen);
+        pb_ostream_t ostream = pb_ostream_from_buffer(buffer2, sizeof(buffer2));
+
+        COMMENT("Forward envelope without decoding submessages");
+        TEST(pb_decode(&istream, Envelope_fields, &env));
+        env.route = 8;
+        TEST(pb_encode(&ostream, Envelope_fields, &env));
+        TEST(ostream.bytes_written == msglen);
+        TEST(buffer2[1] == 8);
+        TEST(memcmp(buffer + 2, buffer2 + 2, msglen - 2) == 0);
+    }
+
+    {
+        Envelope env = Envelope_init_zero;
+        Reading reading;
+        pb_byte_t invalid[] = {0x08, 0x01, 0x12, 0x02, 0x10, 0x01};
+        pb_istream_t istream = pb_istream_from_buffer(invalid, sizeof(invalid));
+
+        COMMENT("Errors in submessage are detected on access");
+        TEST(pb_decode(&istream, Envelope_fields, &env));
+        TEST(env.has_reading);
+        TEST(!Envelope_decode_reading(&env, &reading));
+    }
+
+    {
+        Envelope env = Envelope_init_zero;
+        Reading reading;
+        /* Reading with sensor 1 and value, then another with sensor 2 */
+        pb_byte_t repeated[] = {0x08, 0x01, 0x12, 0x07, 0x08, 0x01, 0x15, 0x00, 0x00, 0xd0, 0x40,
+                                0x12, 0x02, 0x08, 0x02};
+        pb_istream_t istream = pb_istream_from_buffer(repeated, sizeof(repeated));
+
+        COMMENT("Repeated occurrences are not merged, the last one is kept");
+        TEST(pb_decode(&istream, Envelope_fields, &env));
+        TEST(Envelope_decode_reading(&env, &reading));
+        TEST(reading.sensor == 2 && !reading.has_value);
+    }
+
+    if (status != 0)
+        fprintf(stdout, "\n\nSome tests FAILED!\n");
+
+    return status;
+}
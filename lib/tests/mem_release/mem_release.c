@@ -7,6 +7,10 @@
 #include <test_helpers.h>
 #include "mem_release.pb.h"
 
+#ifdef PB_ENABLE_ARENA
+#include <arena_wrappers.h>
+#endif
+
 #define TEST(x) if (!(x)) { \
     fprintf(stderr, "Test %s on line %d failed.\n", #x, __LINE__); \
     return false; \
@@ -0,0 +1,148 @@
+/* Write a log of delimited records to a file, and read it back through
+ * pb_mmap_open() sequentially with the record iterator and randomly by
+ * byte offset.
+ */
+
+#include <stdio.h>
+#include <pb_encode.h>
+#include <pb_decode.h>
+#include <pb_mmap.h>
+#include "unittests.h"
+#include "batch_decode.pb.h"
+
+#define RECORDS 1000
+
+static size_t g_offsets[RECORDS];
+
+static bool write_log(const char *path, size_t records, size_t truncate)
+{
+    FILE *f = fopen(path, "wb");
+    pb_byte_t buf[SensorData_size + 8];
+    size_t i;
+    bool status = true;
+
+    if (!f)
+        return false;
+
+    for (i = 0; i < records && status; i++)
+    {
+        pb_ostream_t stream = pb_ostream_from_buffer(buf, sizeof(buf));
+        SensorData msg = SensorData_init_zero;
+        msg.light_level = (float)i;
+        msg.ph_levels_count = (pb_size_t)(i % 6);
+
+        g_offsets[i] = (size_t)ftell(f);
+        status = pb_encode_ex(&stream, SensorData_fields, &msg, PB_ENCODE_DELIMITED);
+
+        /* Leave out the end of the last record */
+        if (i == records - 1)
+            stream.bytes_written -= truncate;
+
+        status = status && fwrite(buf, 1, stream.bytes_written, f) == stream.bytes_written;
+    }
+
+    return fclose(f) == 0 && status;
+}
+
+int main(int argc, char **argv)
+{
+    int status = 0;
+    const char *path = (argc > 1) ? argv[1] : "mmap_log.tmp";
+    pb_mmap_file_t file;
+
+    COMMENT("Write log file");
+    TEST(write_log(path, RECORDS, 0));
+
+    {
+        pb_record_iter_t iter;
+        pb_view_t record;
+        size_t count = 0;
+        bool ok = true;
+
+        COMMENT("Iterate all records");
+        TEST(pb_mmap_open(&file, path));
+        TEST(file.size > g_offsets[RECORDS - 1]);
+
+        pb_record_iter_mmap(&iter, &file, 0);
+        while (ok && pb_record_next(&iter, &record))
+        {
+            SensorData msg;
+            ok = pb_decode_lazy(&record, SensorData_fields, &msg) &&
+                 msg.light_level == (float)count;
+            count++;
+        }
+        TEST(ok && count == RECORDS);
+        TEST(iter.offset == iter.size);
+    }
+
+    {
+        pb_record_iter_t iter;
+        pb_view_t record;
+        SensorData msg;
+
+        COMMENT("Start from a saved offset");
+        pb_record_iter_mmap(&iter, &file, g_offsets[700]);
+        TEST(pb_record_next(&iter, &record));
+        TEST(pb_decode_lazy(&record, SensorData_fields, &msg) && msg.light_level == 700);
+        TEST(iter.offset == g_offsets[701]);
+
+        COMMENT("Past the end");
+        pb_record_iter_mmap(&iter, &file, file.size + 10);
+        TEST(!pb_record_next(&iter, &record) && iter.offset == iter.size);
+    }
+
+    {
+        SensorData msg;
+        pb_istream_t stream;
+
+        COMMENT("Stream from an offset");
+        stream = pb_istream_from_mmap(&file, g_offsets[123]);
+        TEST(pb_decode_ex(&stream, SensorData_fields, &msg, PB_DECODE_DELIMITED));
+        TEST(msg.light_level == 123 && msg.ph_levels_count == 3);
+        TEST(stream.bytes_left == file.size - g_offsets[124]);
+
+        pb_mmap_close(&file);
+        TEST(file.data == NULL && file.size == 0);
+    }
+
+    {
+        pb_record_iter_t iter;
+        pb_view_t record;
+        size_t count = 0;
+
+        COMMENT("Truncated last record");
+        TEST(write_log(path, 3, 1));
+        TEST(pb_mmap_open(&file, path));
+        pb_record_iter_mmap(&iter, &file, 0);
+        while (pb_record_next(&iter, &record))
+            count++;
+        TEST(count == 2);
+        TEST(iter.offset == g_offsets[2] && iter.offset != iter.size);
+        pb_mmap_close(&file);
+    }
+
+    {
+        pb_record_iter_t iter;
+        pb_view_t record;
+        pb_istream_t stream;
+
+        COMMENT("Empty file");
+        TEST(write_log(path, 0, 0));
+        TEST(pb_mmap_open(&file, path));
+        TEST(file.data == NULL && file.size == 0);
+        pb_record_iter_mmap(&iter, &file, 0);
+        TEST(!pb_record_next(&iter, &record));
+        stream = pb_istream_from_mmap(&file, 0);
+        TEST(stream.bytes_left == 0);
+        pb_mmap_close(&file);
+    }
+
+    COMMENT("Missing file");
+    remove(path);
+    TEST(!pb_mmap_open(&file, path));
+
+    if (status != 0)
+        fprintf(stdout, "\n\nSome tests FAILED!\n");
+
+    return status;
+}
@@ -0,0 +1,187 @@
+/* Check the number of reallocations done when decoding long repeated
+ * pointer fields, and that the arrays are shrunk to the exact size. */
+
+#include <stdio.h>
+#include <string.h>
+#include <pb_decode.h>
+#include <pb_encode.h>
+#include <malloc_wrappers.h>
+#include "unittests.h"
+#include "pointer_growth.pb.h"
+
+#define ENTRIES 1000
+#define PAIRS 100
+
+static pb_byte_t g_buffer[16384];
+static StaticGrowth g_src;
+
+static size_t encode_src(pb_byte_t *buffer, size_t size)
+{
+    pb_ostream_t stream = pb_ostream_from_buffer(buffer, size);
+    if (!pb_encode(&stream, StaticGrowth_fields, &g_src))
+    {
+        fprintf(stderr, "Encode failed: %s\n", PB_GET_ERROR(&stream));
+        return 0;
+    }
+    return stream.bytes_written;
+}
+
+int main()
+{
+    int status = 0;
+    size_t msglen;
+    int i;
+
+    {
+        Growth msg = Growth_init_zero;
+        pb_istream_t stream;
+        size_t calls;
+        bool ok = true;
+
+        memset(&g_src, 0, sizeof(g_src));
+        g_src.items_count = ENTRIES;
+        for (i = 0; i < ENTRIES; i++)
+            g_src.items[i].id = i;
+        g_src.items[0].has_name = true;
+        strcpy(g_src.items[0].name, "first");
+        msglen = encode_src(g_buffer, sizeof(g_buffer));
+
+        COMMENT("Decode unpacked repeated submessages");
+        calls = get_realloc_calls();
+        stream = pb_istream_from_buffer(g_buffer, msglen);
+        TEST(pb_decode(&stream, Growth_fields, &msg));
+        calls = get_realloc_calls() - calls;
+        TEST(calls < 20);
+        TEST(msg.items_count == ENTRIES);
+        TEST(get_allocation_size(msg.items) == ENTRIES * sizeof(Item));
+        for (i = 0; i < ENTRIES; i++)
+            ok = ok && msg.items[i].id == i;
+        TEST(ok);
+        TEST(strcmp(msg.items[0].name, "first") == 0);
+        TEST(msg.items[1].name == NULL);
+
+        pb_release(Growth_fields, &msg);
+        TEST(get_alloc_count() == 0);
+    }
+
+    {
+        Growth msg = Growth_init_zero;
+        pb_istream_t stream;
+        size_t calls;
+        bool ok = true;
+
+        memset(&g_src, 0, sizeof(g_src));
+        g_src.values_count = ENTRIES;
+        for (i = 0; i < ENTRIES; i++)
+            g_src.values[i] = i * 7;
+        msglen = encode_src(g_buffer, sizeof(g_buffer));
+
+        COMMENT("Decode packed varint array");
+        calls = get_realloc_calls();
+        stream = pb_istream_from_buffer(g_buffer, msglen);
+        TEST(pb_decode(&stream, Growth_fields, &msg));
+        calls = get_realloc_calls() - calls;
+        TEST(calls < 10);
+        TEST(msg.values_count == ENTRIES);
+        TEST(get_allocation_size(msg.values) == ENTRIES * sizeof(int32_t));
+        for (i = 0; i < ENTRIES; i++)
+            ok = ok && msg.values[i] == i * 7;
+        TEST(ok);
+
+        pb_release(Growth_fields, &msg);
+        TEST(get_alloc_count() == 0);
+    }
+
+    {
+        Growth msg = Growth_init_zero;
+        pb_istream_t stream;
+
+        /* Concatenated messages are merged, so fields arrive interleaved. */
+        memset(&g_src, 0, sizeof(g_src));
+        g_src.names_count = 2;
+        strcpy(g_src.names[0], "a");
+        strcpy(g_src.names[1], "b");
+        g_src.items_count = 3;
+        g_src.items[2].id = 2;
+        msglen = encode_src(g_buffer, sizeof(g_buffer));
+
+        memset(&g_src, 0, sizeof(g_src));
+        g_src.items_count = 1;
+        g_src.items[0].id = 3;
+        g_src.names_count = 3;
+        strcpy(g_src.names[0], "c");
+        strcpy(g_src.names[1], "d");
+        strcpy(g_src.names[2], "e");
+        msglen += encode_src(g_buffer + msglen, sizeof(g_buffer) - msglen);
+
+        COMMENT("Decode interleaved repeated fields");
+        stream = pb_istream_from_buffer(g_buffer, msglen);
+        TEST(pb_decode(&stream, Growth_fields, &msg));
+        TEST(msg.items_count == 4);
+        TEST(msg.items[2].id == 2 && msg.items[3].id == 3);
+        TEST(get_allocation_size(msg.items) == 4 * sizeof(Item));
+        TEST(msg.names_count == 5);
+        TEST(strcmp(msg.names[0], "a") == 0 && strcmp(msg.names[4], "e") == 0);
+        TEST(get_allocation_size(msg.names) == 5 * sizeof(char*));
+
+        pb_release(Growth_fields, &msg);
+        TEST(get_alloc_count() == 0);
+    }
+
+    {
+        Growth msg = Growth_init_zero;
+        pb_istream_t stream;
+        size_t calls;
+        bool ok = true;
+
+        /* items { id: i } names: "x", repeated in turns */
+        msglen = 0;
+        for (i = 0; i < PAIRS; i++)
+        {
+            g_buffer[msglen++] = 0x0A;
+            g_buffer[msglen++] = 2;
+            g_buffer[msglen++] = 0x08;
+            g_buffer[msglen++] = (pb_byte_t)i;
+            g_buffer[msglen++] = 0x1A;
+            g_buffer[msglen++] = 1;
+            g_buffer[msglen++] = 'x';
+        }
+
+        COMMENT("Decode alternating repeated fields");
+        calls = get_realloc_calls();
+        stream = pb_istream_from_buffer(g_buffer, msglen);
+        TEST(pb_decode(&stream, Growth_fields, &msg));
+        calls = get_realloc_calls() - calls;
+
+        /* One allocation per entry and per string, like exact growth */
+        TEST(calls <= 3 * PAIRS);
+        TEST(msg.items_count == PAIRS && msg.names_count == PAIRS);
+        TEST(get_allocation_size(msg.items) == PAIRS * sizeof(Item));
+        TEST(get_allocation_size(msg.names) == PAIRS * sizeof(char*));
+        for (i = 0; i < PAIRS; i++)
+            ok = ok && msg.items[i].id == i && strcmp(msg.names[i], "x") == 0;
+        TEST(ok);
+
+        pb_release(Growth_fields, &msg);
+        TEST(get_alloc_count() == 0);
+    }
+
+    {
+        Growth msg = Growth_init_zero;
+        pb_istream_t stream;
+
+        memset(&g_src, 0, sizeof(g_src));
+        g_src.items_count = ENTRIES;
+        msglen = encode_src(g_buffer, sizeof(g_buffer));
+
+        COMMENT("Decode truncated message");
+        stream = pb_istream_from_buffer(g_buffer, msglen - 1);
+        TEST(!pb_decode(&stream, Growth_fields, &msg));
+        TEST(get_alloc_count() == 0);
+    }
+
+    if (status != 0)
+        fprintf(stdout, "\n\nSome tests FAILED!\n");
+
+    return status;
+}
@@ -0,0 +1,131 @@
+/* Tests for the incremental pull encoder. The message given on stdin is
+ * decoded and then encoded again, reading the output in different sized
+ * pieces. The result must match pb_encode() byte for byte.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pb_encode.h>
+#include <pb_decode.h>
+#include "alltypes.pb.h"
+#include "test_helpers.h"
+#include "unittests.h"
+
+#define MAX_OUTPUT (AllTypes_size + 16)
+
+/* Read the output in pieces of chunk bytes, or of pseudo-random sizes if
+ * chunk is 0. Returns the final status of the encoder. Every call must
+ * fill the given space completely, unless the message ends. */
+static pb_pull_status_t pull_encode(const AllTypes *msg, unsigned int flags, size_t chunk,
+                                    uint8_t *output, size_t *len)
+{
+    pb_pull_encoder_t encoder;
+    pb_pull_status_t status = PB_PULL_MORE;
+    unsigned int seed = 4321;
+    size_t pos = 0;
+
+    if (!pb_pull_encoder_init(&encoder, AllTypes_fields, msg, flags))
+        return PB_PULL_ERROR;
+
+    while (status == PB_PULL_MORE)
+    {
+        size_t n = chunk;
+        size_t written;
+
+        if (n == 0)
+        {
+            seed = seed * 1103515245 + 12345;
+            n = (seed >> 16) % 37;
+        }
+
+        if (n > MAX_OUTPUT - pos)
+            return PB_PULL_ERROR;
+
+        status = pb_pull_encode(&encoder, output + pos, n, &written);
+        pos += written;
+
+        if (status == PB_PULL_MORE && written != n)
+        {
+            fprintf(stderr, "Short write: %d of %d bytes\n", (int)written, (int)n);
+            return PB_PULL_ERROR;
+        }
+    }
+
+    *len = pos;
+    return status;
+}
+
+int main()
+{
+    int status = 0;
+    uint8_t input[MAX_OUTPUT];
+    uint8_t reference[MAX_OUTPUT];
+    uint8_t output[MAX_OUTPUT];
+    size_t input_len, reference_len, len;
+    AllTypes msg = AllTypes_init_zero;
+
+    SET_BINARY_MODE(stdin);
+    input_len = fread(input, 1, sizeof(input), stdin);
+
+    {
+        pb_istream_t stream = pb_istream_from_buffer(input, input_len);
+        TEST(pb_decode(&stream, AllTypes_fields, &msg));
+    }
+
+    {
+        size_t chunk;
+
+        COMMENT("Fixed chunk sizes");
+        for (chunk = 1; chunk <= 17; chunk++)
+        {
+            TEST(pull_encode(&msg, 0, chunk, output, &len) == PB_PULL_DONE &&
+                 len == input_len && memcmp(output, input, len) == 0);
+        }
+
+        COMMENT("Whole message at once");
+        TEST(pull_encode(&msg, 0, MAX_OUTPUT, output, &len) == PB_PULL_DONE &&
+             len == input_len && memcmp(output, input, len) == 0);
+
+        COMMENT("Random chunk sizes, including zero");
+        TEST(pull_encode(&msg, 0, 0, output, &len) == PB_PULL_DONE &&
+             len == input_len && memcmp(output, input, len) == 0);
+    }
+
+    {
+        pb_ostream_t stream;
+
+        COMMENT("Delimited message");
+        stream = pb_ostream_from_buffer(reference, sizeof(reference));
+        TEST(pb_encode_ex(&stream, AllTypes_fields, &msg, PB_ENCODE_DELIMITED));
+        reference_len = stream.bytes_written;
+        TEST(pull_encode(&msg, PB_ENCODE_DELIMITED, 3, output, &len) == PB_PULL_DONE &&
+             len == reference_len && memcmp(output, reference, len) == 0);
+
+        COMMENT("Null terminated message");
+        stream = pb_ostream_from_buffer(reference, sizeof(reference));
+        TEST(pb_encode_ex(&stream, AllTypes_fields, &msg, PB_ENCODE_NULLTERMINATED));
+        reference_len = stream.bytes_written;
+        TEST(pull_encode(&msg, PB_ENCODE_NULLTERMINATED, 5, output, &len) == PB_PULL_DONE &&
+             len == reference_len && memcmp(output, reference, len) == 0);
+    }
+
+    {
+        pb_pull_encoder_t encoder;
+        size_t written;
+
+        COMMENT("Errors are reported like in pb_encode()");
+        memset(msg.req_string, 'x', sizeof(msg.req_string));
+        TEST(pb_pull_encoder_init(&encoder, AllTypes_fields, &msg, 0));
+        TEST(pb_pull_encode(&encoder, output, sizeof(output), &written) == PB_PULL_ERROR);
+        TEST(strcmp(PB_GET_ERROR(&encoder), "unterminated string") == 0);
+
+        TEST(!pb_pull_encoder_init(&encoder, AllTypes_fields, &msg, PB_ENCODE_DELIMITED));
+        TEST(pb_pull_encode(&encoder, output, sizeof(output), &written) == PB_PULL_ERROR && written == 0);
+    }
+
+    if (status != 0)
+        fprintf(stdout, "\n\nSome tests FAILED!\n");
+
+    return status;
+}
@@ -0,0 +1,168 @@
+/* Tests for the incremental push decoder. The message given on stdin is
+ * fed in different sized pieces, and the result is compared against
+ * decoding the whole message with pb_decode().
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pb_decode.h>
+#include "alltypes.pb.h"
+#include "test_helpers.h"
+#include "unittests.h"
+
+static uint8_t g_input[AllTypes_size + 16];
+static size_t g_input_len;
+
+/* Feed the message in pieces of chunk bytes, or of pseudo-random sizes
+ * if chunk is 0. Returns the final status of the decoder. */
+static pb_push_status_t push_decode(const uint8_t *data, size_t len, size_t chunk,
+                                    unsigned int flags, AllTypes *msg, size_t *used)
+{
+    pb_push_decoder_t decoder;
+    pb_push_status_t status = PB_PUSH_NEED_MORE;
+    size_t pos = 0;
+    unsigned int seed = 1234;
+
+    memset(msg, 0, sizeof(AllTypes));
+    if (!pb_push_decoder_init(&decoder, AllTypes_fields, msg, flags))
+        return PB_PUSH_ERROR;
+
+    while (pos < len && status == PB_PUSH_NEED_MORE)
+    {
+        size_t n = chunk;
+        size_t consumed;
+
+        if (n == 0)
+        {
+            seed = seed * 1103515245 + 12345;
+            n = 1 + (seed >> 16) % 37;
+        }
+
+        if (n > len - pos)
+            n = len - pos;
+
+        status = pb_push_decode(&decoder, data + pos, n, &consumed);
+        pos += consumed;
+    }
+
+    if (status == PB_PUSH_NEED_MORE && (flags & PB_DECODE_DELIMITED) == 0)
+        status = pb_push_decode_finish(&decoder);
+
+    if (used)
+        *used = pos;
+
+    return status;
+}
+
+static bool reference_decode(const uint8_t *data, size_t len, AllTypes *msg)
+{
+    pb_istream_t stream = pb_istream_from_buffer(data, len);
+    memset(msg, 0, sizeof(AllTypes));
+    return pb_decode(&stream, AllTypes_fields, msg);
+}
+
+int main()
+{
+    int status = 0;
+    AllTypes reference, msg;
+
+    SET_BINARY_MODE(stdin);
+    g_input_len = fread(g_input, 1, sizeof(g_input), stdin);
+
+    TEST(reference_decode(g_input, g_input_len, &reference));
+
+    {
+        size_t chunk;
+
+        COMMENT("Fixed chunk sizes");
+        for (chunk = 1; chunk <= 17; chunk++)
+        {
+            TEST(push_decode(g_input, g_input_len, chunk, 0, &msg, NULL) == PB_PUSH_DONE &&
+                 memcmp(&msg, &reference, sizeof(msg)) == 0);
+        }
+
+        COMMENT("Whole message at once");
+        TEST(push_decode(g_input, g_input_len, g_input_len, 0, &msg, NULL) == PB_PUSH_DONE &&
+             memcmp(&msg, &reference, sizeof(msg)) == 0);
+
+        COMMENT("Random chunk sizes");
+        TEST(push_decode(g_input, g_input_len, 0, 0, &msg, NULL) == PB_PUSH_DONE &&
+             memcmp(&msg, &reference, sizeof(msg)) == 0);
+    }
+
+    {
+        uint8_t buffer[sizeof(g_input) + 8];
+        size_t used;
+
+        COMMENT("Delimited message followed by more data");
+        buffer[0] = (uint8_t)(0x80 | (g_input_len & 0x7F));
+        buffer[1] = (uint8_t)(g_input_len >> 7);
+        memcpy(buffer + 2, g_input, g_input_len);
+        memcpy(buffer + 2 + g_input_len, "\x01\x02\x03", 3);
+
+        TEST(push_decode(buffer, g_input_len + 5, 1, PB_DECODE_DELIMITED, &msg, &used) == PB_PUSH_DONE &&
+             used == g_input_len + 2 && memcmp(&msg, &reference, sizeof(msg)) == 0);
+        TEST(push_decode(buffer, g_input_len + 5, 0, PB_DECODE_DELIMITED, &msg, &used) == PB_PUSH_DONE &&
+             used == g_input_len + 2 && memcmp(&msg, &reference, sizeof(msg)) == 0);
+
+        COMMENT("Truncated delimited message");
+        TEST(push_decode(buffer, g_input_len + 1, 3, PB_DECODE_DELIMITED, &msg, &used) == PB_PUSH_NEED_MORE);
+
+        COMMENT("Null terminated message");
+        memcpy(buffer, g_input, g_input_len);
+        buffer[g_input_len] = 0;
+        TEST(push_decode(buffer, g_input_len + 1, 5, PB_DECODE_NULLTERMINATED, &msg, &used) == PB_PUSH_DONE &&
+             used == g_input_len + 1 && memcmp(&msg, &reference, sizeof(msg)) == 0);
+    }
+
+    {
+        size_t len;
+        int mismatches = 0;
+
+        COMMENT("Truncated messages must fail like with pb_decode()");
+        for (len = 0; len < g_input_len; len++)
+        {
+            bool ref_ok = reference_decode(g_input, len, &reference);
+            bool push_ok = push_decode(g_input, len, 3, 0, &msg, NULL) == PB_PUSH_DONE;
+            if (ref_ok != push_ok)
+                mismatches++;
+        }
+        TEST(mismatches == 0);
+    }
+
+    {
+        uint8_t buffer[sizeof(g_input)];
+        size_t i;
+        int mismatches = 0;
+
+        COMMENT("Corrupted messages must give the same result as pb_decode()");
+        for (i = 0; i < g_input_len; i++)
+        {
+            static const uint8_t patterns[] = {0x00, 0x01, 0x7F, 0x80, 0xFF};
+            size_t j;
+            for (j = 0; j < sizeof(patterns); j++)
+            {
+                bool ref_ok, push_ok;
+                memcpy(buffer, g_input, g_input_len);
+                buffer[i] = patterns[j];
+
+                ref_ok = reference_decode(buffer, g_input_len, &reference);
+                push_ok = push_decode(buffer, g_input_len, 0, 0, &msg, NULL) == PB_PUSH_DONE;
+
+                if (ref_ok != push_ok ||
+                    (ref_ok && memcmp(&msg, &reference, sizeof(msg)) != 0))
+                {
+                    fprintf(stderr, "Mismatch at byte %d pattern %02x\n", (int)i, patterns[j]);
+                    mismatches++;
+                }
+            }
+        }
+        TEST(mismatches == 0);
+    }
+
+    if (status != 0)
+        fprintf(stdout, "\n\nSome tests FAILED!\n");
+
+    return status;
+}
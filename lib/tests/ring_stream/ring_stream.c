@@ -0,0 +1,150 @@
+/* Pass telemetry frames through a small ring buffer, so that the frames
+ * wrap around the end, and check that frames that do not fit or are not
+ * complete leave the ring unchanged.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <pb_encode.h>
+#include <pb_decode.h>
+#include <pb_common.h>
+#include "unittests.h"
+#include "batch_decode.pb.h"
+
+#define RING_SIZE 128
+
+static void fill_message(SensorData *msg, unsigned int i)
+{
+    memset(msg, 0, sizeof(SensorData));
+    msg->temperature = 20.0f + (float)(i % 50) / 10.0f;
+    msg->light_level = (float)i;
+    msg->ph_levels_count = (pb_size_t)(i % 6);
+}
+
+static bool produce(pb_ring_t *ring, unsigned int i)
+{
+    SensorData msg;
+    pb_ring_cursor_t cursor;
+    pb_ostream_t stream = pb_ostream_from_ring(&cursor, ring);
+
+    fill_message(&msg, i);
+    if (!pb_encode_ex(&stream, SensorData_fields, &msg, PB_ENCODE_DELIMITED))
+        return false;
+
+    pb_ring_commit(&cursor);
+    return true;
+}
+
+static bool consume(pb_ring_t *ring, unsigned int i)
+{
+    SensorData msg;
+    pb_ring_cursor_t cursor;
+    pb_istream_t stream = pb_istream_from_ring(&cursor, ring);
+
+    if (!pb_decode_ex(&stream, SensorData_fields, &msg, PB_DECODE_DELIMITED))
+        return false;
+
+    pb_ring_consume(&cursor);
+    return msg.light_level == (float)i && msg.ph_levels_count == i % 6;
+}
+
+int main()
+{
+    int status = 0;
+    pb_byte_t buf[RING_SIZE];
+    pb_ring_t ring;
+
+    COMMENT("Size must be a power of two");
+    TEST(!pb_ring_init(&ring, buf, 100));
+    TEST(!pb_ring_init(&ring, buf, 0));
+    TEST(pb_ring_init(&ring, buf, RING_SIZE));
+    TEST(ring.head == 0 && ring.tail == 0);
+
+    {
+        unsigned int produced = 0, consumed = 0, round;
+        bool ok = true;
+
+        COMMENT("Frames wrap around the end");
+        for (round = 0; round < 50 && ok; round++)
+        {
+            /* Fill the ring until the next frame no longer fits */
+            while (produce(&ring, produced))
+                produced++;
+            ok = ring.head - ring.tail <= RING_SIZE;
+
+            /* Then drain some of it */
+            while (ok && consumed < produced && (consumed + round) % 3 != 0)
+                ok = consume(&ring, consumed++);
+            if (ok && consumed < produced)
+                ok = consume(&ring, consumed++);
+        }
+        TEST(ok);
+        TEST(ring.head > 10 * RING_SIZE);
+
+        while (ok && consumed < produced)
+            ok = consume(&ring, consumed++);
+        TEST(ok && ring.head == ring.tail);
+        printf("%u frames, %u bytes through a %u byte ring\n",
+               produced, (unsigned)ring.head, RING_SIZE);
+    }
+
+    {
+        pb_ring_cursor_t cursor;
+        pb_ostream_t stream;
+        size_t head;
+
+        COMMENT("Frame that does not fit is not published");
+        while (produce(&ring, 7))
+            ;
+        head = ring.head;
+        stream = pb_ostream_from_ring(&cursor, &ring);
+        TEST(stream.max_size == RING_SIZE - (ring.head - ring.tail));
+        TEST(!produce(&ring, 7));
+        TEST(ring.head == head);
+        TEST(consume(&ring, 7));
+        TEST(produce(&ring, 7));
+        while (ring.head != ring.tail && consume(&ring, 7))
+            ;
+        TEST(ring.head == ring.tail);
+    }
+
+    {
+        pb_ring_cursor_t cursor;
+        pb_ostream_t ostream = pb_ostream_from_ring(&cursor, &ring);
+        pb_istream_t istream;
+        pb_byte_t frame[SensorData_size + 4];
+        size_t len, tail;
+        SensorData msg;
+
+        COMMENT("Incomplete frame is not consumed");
+        fill_message(&msg, 42);
+        TEST(pb_encode_ex(&ostream, SensorData_fields, &msg, PB_ENCODE_DELIMITED));
+        len = ostream.bytes_written;
+
+        /* Publish all but the last byte, like an interrupted UART receive */
+        cursor.pos--;
+        pb_ring_commit(&cursor);
+        tail = ring.tail;
+        TEST(!consume(&ring, 42));
+        TEST(ring.tail == tail);
+
+        cursor.pos++;
+        pb_ring_commit(&cursor);
+        TEST(consume(&ring, 42));
+        TEST(ring.head == ring.tail);
+
+        COMMENT("Raw bytes can be read and skipped");
+        TEST(produce(&ring, 42));
+        istream = pb_istream_from_ring(&cursor, &ring);
+        TEST(istream.bytes_left == len);
+        TEST(pb_read(&istream, frame, 1) && frame[0] == len - 1);
+        TEST(pb_read(&istream, NULL, len - 1) && istream.bytes_left == 0);
+        pb_ring_consume(&cursor);
+        TEST(ring.head == ring.tail);
+    }
+
+    if (status != 0)
+        fprintf(stdout, "\n\nSome tests FAILED!\n");
+
+    return status;
+}
@@ -0,0 +1,162 @@
+/* Decode from a file stream that implements the skip callback with
+ * fseek(), and check that large skipped fields are not read.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <pb_encode.h>
+#include <pb_decode.h>
+#include "unittests.h"
+#include "skip_callback.pb.h"
+
+typedef struct {
+    FILE *file;
+    size_t reads;
+    size_t skips;
+    bool fail_skip;
+} file_state_t;
+
+static bool file_read(pb_istream_t *stream, pb_byte_t *buf, size_t count)
+{
+    file_state_t *state = (file_state_t*)stream->state;
+    state->reads++;
+    return fread(buf, 1, count, state->file) == count;
+}
+
+static bool file_skip(pb_istream_t *stream, size_t count)
+{
+    file_state_t *state = (file_state_t*)stream->state;
+    state->skips++;
+    return !state->fail_skip && fseek(state->file, (long)count, SEEK_CUR) == 0;
+}
+
+static pb_istream_t file_istream(file_state_t *state, FILE *file, size_t size, bool skip)
+{
+    pb_istream_t stream = PB_ISTREAM_EMPTY;
+    stream.callback = &file_read;
+    stream.state = state;
+    stream.bytes_left = size;
+    if (skip)
+        stream.skip = &file_skip;
+
+    state->file = file;
+    state->reads = 0;
+    state->skips = 0;
+    state->fail_skip = false;
+    rewind(file);
+    return stream;
+}
+
+int main(int argc, char **argv)
+{
+    int status = 0;
+    const char *path = (argc > 1) ? argv[1] : "skip_callback.tmp";
+    pb_byte_t buffer[Record_size];
+    size_t msglen;
+    FILE *file;
+    file_state_t state;
+
+    {
+        Record msg = Record_init_zero;
+        pb_ostream_t stream = pb_ostream_from_buffer(buffer, sizeof(buffer));
+
+        COMMENT("Write record with a large blob");
+        msg.has_id = true;
+        msg.id = 5;
+        msg.has_blob = true;
+        msg.blob.size = 4000;
+        memset(msg.blob.bytes, 0xAA, 4000);
+        msg.has_tail = true;
+        msg.tail = 7;
+        TEST(pb_encode(&stream, Record_fields, &msg));
+        msglen = stream.bytes_written;
+
+        file = fopen(path, "w+b");
+        TEST(file && fwrite(buffer, 1, msglen, file) == msglen);
+        if (!file)
+            return 1;
+    }
+
+    {
+        Summary msg = Summary_init_zero;
+        pb_istream_t stream = file_istream(&state, file, msglen, false);
+        size_t unskipped;
+
+        COMMENT("Unknown field without skip callback");
+        TEST(pb_decode(&stream, Summary_fields, &msg));
+        TEST(msg.id == 5 && msg.tail == 7);
+        unskipped = state.reads;
+
+        COMMENT("Unknown field with skip callback");
+        memset(&msg, 0, sizeof(msg));
+        stream = file_istream(&state, file, msglen, true);
+        TEST(pb_decode(&stream, Summary_fields, &msg));
+        TEST(msg.id == 5 && msg.tail == 7);
+        TEST(state.skips == 1);
+        TEST(state.reads < 10 && unskipped > 250);
+        printf("Read calls: %u without skip, %u with skip\n", (unsigned)unskipped, (unsigned)state.reads);
+    }
+
+    {
+        Record msg;
+        static const uint32_t tags[] = {Record_tail_tag};
+        pb_istream_t stream = file_istream(&state, file, msglen, true);
+
+        COMMENT("Field left out of projection");
+        TEST(pb_decode_projection(&stream, Record_fields, &msg, 0, tags, 1));
+        TEST(msg.has_tail && msg.tail == 7);
+        TEST(state.skips == 1 && state.reads < 10);
+    }
+
+    {
+        pb_istream_t stream = file_istream(&state, file, msglen, true);
+        pb_istream_t substream;
+        pb_byte_t byte;
+
+        COMMENT("Substreams inherit the callback");
+        TEST(pb_read(&stream, &byte, 1) && byte == 0x08);
+        TEST(pb_read(&stream, &byte, 1) && byte == 5);
+        TEST(pb_read(&stream, &byte, 1) && byte == 0x12);
+        TEST(pb_make_string_substream(&stream, &substream));
+        TEST(substream.bytes_left == 4000);
+        TEST(pb_read(&substream, NULL, 3000) && state.skips == 1);
+        TEST(pb_close_string_substream(&stream, &substream));
+        TEST(state.skips == 2);
+        TEST(pb_read(&stream, &byte, 1) && byte == 0x18);
+    }
+
+    {
+        Summary msg;
+        pb_istream_t stream = file_istream(&state, file, msglen, true);
+
+        COMMENT("Skip errors");
+        state.fail_skip = true;
+        TEST(!pb_decode(&stream, Summary_fields, &msg));
+        TEST(strcmp(PB_GET_ERROR(&stream), "io error") == 0);
+
+        stream = file_istream(&state, file, msglen - 10, true);
+        TEST(!pb_decode(&stream, Summary_fields, &msg));
+        TEST(state.skips == 0);
+    }
+
+    {
+        Summary msg = Summary_init_zero;
+        pb_byte_t buf[64];
+        pb_istream_buffer_t ibuf;
+        pb_istream_t source = file_istream(&state, file, msglen, true);
+        pb_istream_t stream = pb_istream_buffered(&ibuf, &source, buf, sizeof(buf));
+
+        COMMENT("Buffered stream passes skips to the source");
+        TEST(pb_decode(&stream, Summary_fields, &msg));
+        TEST(msg.id == 5 && msg.tail == 7);
+        TEST(state.skips == 1 && state.reads < 5);
+    }
+
+    fclose(file);
+    remove(path);
+
+    if (status != 0)
+        fprintf(stdout, "\n\nSome tests FAILED!\n");
+
+    return status;
+}
@@ -1,20 +1,45 @@
+/* Measure the stack usage of each public encoding and decoding function,
+ * and the cost of each level of recursion through callbacks.
+ *
+ * Prints one line per measurement to stdout, as "name bytes". The
+ * SConscript builds this with different configuration options and
+ * collects the results into a table.
+ */
+
 #include <pb_encode.h>
 #include <pb_decode.h>
 #include <string.h>
 #include <assert.h>
 #include <stdio.h>
 #include "stackusage.pb.h"
+#include "stackusage_ext.pb.h"
+#include "recursive.pb.h"
 
 static uint8_t g_msgbuf[256];
 static size_t g_msglen;
+static uint8_t g_delimbuf[256];
+static size_t g_delimlen;
+static uint8_t g_extbuf[64];
+static size_t g_extlen;
+
+/* Depth of the nested SingleRecursion messages */
+#define SHALLOW_DEPTH 1
+#define DEEP_DEPTH 8
+static uint8_t g_shallowbuf[64];
+static size_t g_shallowlen;
+static uint8_t g_deepbuf[64];
+static size_t g_deeplen;
+static int g_decoded_depth;
 
 /* This is a hacky way to measure actual stack usage of functions.
- * It works by copying the stack to a global variable, and then
- * finding the lowest location that has been modified.
+ * It works by filling the unused stack area with a known pattern, and
+ * then finding the lowest location that has been modified.
  * Currently this assumes that the platform uses a descending stack.
  */
-#define MAX_STACK_ENTRIES 1024
-static uint32_t g_stackbuf[MAX_STACK_ENTRIES];
+#ifndef MAX_STACK_ENTRIES
+#define MAX_STACK_ENTRIES 4096
+#endif
+#define STACK_PATTERN 0xA5C3A5C3UL
 static volatile uint32_t *g_stackptr;
 
 void start_stack_measuring()
@@ -23,7 +48,7 @@ void start_stack_measuring()
     g_stackptr = (volatile uint32_t*)((uintptr_t)&i - MAX_STACK_ENTRIES * sizeof(uint32_t));
     for (i = 0; i < MAX_STACK_ENTRIES; i++)
     {
-        g_stackbuf[i] = g_stackptr[i];
+        g_stackptr[i] = STACK_PATTERN;
     }
 }
 
@@ -32,7 +57,7 @@ int end_stack_measuring()
     uint32_t i = 0;
     for (i = 0; i < MAX_STACK_ENTRIES; i++)
     {
-        if (g_stackbuf[i] != g_stackptr[i])
+        if (g_stackptr[i] != STACK_PATTERN)
         {
             return (MAX_STACK_ENTRIES - i) * sizeof(uint32_t);
         }
@@ -41,28 +66,171 @@ int end_stack_measuring()
     return 0;
 }
 
+void fill_settings(SettingsGroup *msg)
+{
+    msg->has_settings = true;
+    msg->settings.id = 1;
+    strcpy(msg->settings.name, "abcd");
+    msg->settings.en = true;
+    msg->settings.has_begin = true;
+    msg->settings.begin.label = 1234;
+    msg->settings.begin.properties_count = 1;
+    msg->settings.begin.properties[0].which_field = Property_DeviceA_Mode_tag;
+    msg->settings.begin.properties[0].field.DeviceA_Mode = 2;
+}
+
+/* Encoding */
+
 void do_encode()
 {
     pb_ostream_t stream = pb_ostream_from_buffer(g_msgbuf, sizeof(g_msgbuf));
     SettingsGroup msg = SettingsGroup_init_zero;
     bool status;
 
-    msg.has_settings = true;
-    msg.settings.id = 1;
-    strcpy(msg.settings.name, "abcd");
-    msg.settings.en = true;
-    msg.settings.has_begin = true;
-    msg.settings.begin.label = 1234;
-    msg.settings.begin.properties_count = 1;
-    msg.settings.begin.properties[0].which_field = Property_DeviceA_Mode_tag;
-    msg.settings.begin.properties[0].field.DeviceA_Mode = 2;
-
+    fill_settings(&msg);
     status = pb_encode(&stream, SettingsGroup_fields, &msg);
     g_msglen = stream.bytes_written;
     assert(status);
     assert(g_msglen > 10);
 }
 
+void do_encode_delimited()
+{
+    pb_ostream_t stream = pb_ostream_from_buffer(g_delimbuf, sizeof(g_delimbuf));
+    SettingsGroup msg = SettingsGroup_init_zero;
+    bool status;
+
+    fill_settings(&msg);
+    status = pb_encode_ex(&stream, SettingsGroup_fields, &msg, PB_ENCODE_DELIMITED);
+    g_delimlen = stream.bytes_written;
+    assert(status);
+}
+
+void do_encode_nullterminated()
+{
+    uint8_t buffer[256];
+    pb_ostream_t stream = pb_ostream_from_buffer(buffer, sizeof(buffer));
+    SettingsGroup msg = SettingsGroup_init_zero;
+    bool status;
+
+    fill_settings(&msg);
+    status = pb_encode_ex(&stream, SettingsGroup_fields, &msg, PB_ENCODE_NULLTERMINATED);
+    assert(status);
+}
+
+void do_get_encoded_size()
+{
+    SettingsGroup msg = SettingsGroup_init_zero;
+    size_t size;
+    bool status;
+
+    fill_settings(&msg);
+    status = pb_get_encoded_size(&size, SettingsGroup_fields, &msg);
+    assert(status);
+    assert(size == g_msglen);
+}
+
+#ifndef PB_BUFFER_ONLY
+static bool write_discard(pb_ostream_t *stream, const pb_byte_t *buf, size_t count)
+{
+    (void)stream;
+    (void)buf;
+    (void)count;
+    return true;
+}
+
+void do_encode_callback_stream()
+{
+    pb_ostream_t stream = PB_OSTREAM_SIZING;
+    SettingsGroup msg = SettingsGroup_init_zero;
+    bool status;
+
+    stream.callback = &write_discard;
+    stream.max_size = (size_t)-1;
+    fill_settings(&msg);
+    status = pb_encode(&stream, SettingsGroup_fields, &msg);
+    assert(status);
+}
+#endif
+
+void do_encode_extension()
+{
+    pb_ostream_t stream = pb_ostream_from_buffer(g_extbuf, sizeof(g_extbuf));
+    Extendable msg = Extendable_init_zero;
+    ExtensionValue value = ExtensionValue_init_zero;
+    pb_extension_t ext = pb_extension_init_zero;
+    bool status;
+
+    value.has_value = true;
+    value.value = 5;
+    value.has_name = true;
+    strcpy(value.name, "ext");
+    ext.type = &ext_msg;
+    ext.dest = &value;
+    ext.found = true;
+    msg.has_id = true;
+    msg.id = 1;
+    msg.extensions = &ext;
+
+    status = pb_encode(&stream, Extendable_fields, &msg);
+    g_extlen = stream.bytes_written;
+    assert(status);
+}
+
+/* Each level encodes the next level as a submessage, until the remaining
+ * depth pointed to by arg is zero. */
+static bool encode_recursive(pb_ostream_t *stream, const pb_field_t *field, void * const *arg)
+{
+    int remaining = *(const int*)*arg;
+    int next = remaining - 1;
+    SingleRecursion msg = SingleRecursion_init_zero;
+
+    if (remaining == 0)
+        return true;
+
+    msg.msg.funcs.encode = &encode_recursive;
+    msg.msg.arg = &next;
+
+    return pb_encode_tag_for_field(stream, field) &&
+           pb_encode_submessage(stream, SingleRecursion_fields, &msg);
+}
+
+static size_t encode_recursion(uint8_t *buffer, size_t size, int depth)
+{
+    pb_ostream_t stream = pb_ostream_from_buffer(buffer, size);
+    SingleRecursion msg = SingleRecursion_init_zero;
+    bool status;
+
+    msg.msg.funcs.encode = &encode_recursive;
+    msg.msg.arg = &depth;
+    status = pb_encode(&stream, SingleRecursion_fields, &msg);
+    assert(status);
+    return stream.bytes_written;
+}
+
+void do_encode_recursion_shallow()
+{
+    g_shallowlen = encode_recursion(g_shallowbuf, sizeof(g_shallowbuf), SHALLOW_DEPTH);
+}
+
+void do_encode_recursion_deep()
+{
+    g_deeplen = encode_recursion(g_deepbuf, sizeof(g_deepbuf), DEEP_DEPTH);
+}
+
+/* Decoding */
+
+static void decode_settings(const uint8_t *buffer, size_t len, unsigned flags)
+{
+    pb_istream_t stream = pb_istream_from_buffer(buffer, len);
+    SettingsGroup msg = SettingsGroup_init_zero;
+    bool status;
+
+    status = pb_decode_ex(&stream, SettingsGroup_fields, &msg, flags);
+    assert(status);
+    assert(msg.settings.begin.properties[0].field.DeviceA_Mode == 2);
+}
+
 void do_decode()
 {
     pb_istream_t stream = pb_istream_from_buffer(g_msgbuf, g_msglen);
@@ -74,21 +242,179 @@ void do_decode()
     assert(msg.settings.begin.properties[0].field.DeviceA_Mode == 2);
 }
 
+/* The frames are counted in the stack usage */
+void do_decode_iterative()
+{
+    pb_istream_t stream = pb_istream_from_buffer(g_msgbuf, g_msglen);
+    SettingsGroup msg = SettingsGroup_init_zero;
+    pb_decode_frame_t frames[4];
+    bool status;
+
+    status = pb_decode_iterative(&stream, SettingsGroup_fields, &msg, 0, frames, 4);
+    assert(status);
+    assert(msg.settings.begin.properties[0].field.DeviceA_Mode == 2);
+}
+
+void do_decode_noinit()
+{
+    decode_settings(g_msgbuf, g_msglen, PB_DECODE_NOINIT);
+}
+
+void do_decode_delimited()
+{
+    decode_settings(g_delimbuf, g_delimlen, PB_DECODE_DELIMITED);
+}
+
+void do_decode_nullterminated()
+{
+    uint8_t buffer[256];
+    memcpy(buffer, g_msgbuf, g_msglen);
+    buffer[g_msglen] = 0;
+    decode_settings(buffer, g_msglen + 1, PB_DECODE_NULLTERMINATED);
+}
+
+#ifndef PB_BUFFER_ONLY
+static bool read_from_buffer(pb_istream_t *stream, pb_byte_t *buf, size_t count)
+{
+    const pb_byte_t *source = (const pb_byte_t*)stream->state;
+    if (buf)
+        memcpy(buf, source, count);
+    stream->state = (pb_byte_t*)stream->state + count;
+    return true;
+}
+
+void do_decode_callback_stream()
+{
+    pb_istream_t stream = PB_ISTREAM_EMPTY;
+    SettingsGroup msg = SettingsGroup_init_zero;
+    bool status;
+
+    stream.callback = &read_from_buffer;
+    stream.state = g_msgbuf;
+    stream.bytes_left = g_msglen;
+    status = pb_decode(&stream, SettingsGroup_fields, &msg);
+    assert(status);
+}
+#endif
+
+void do_decode_extension()
+{
+    pb_istream_t stream = pb_istream_from_buffer(g_extbuf, g_extlen);
+    Extendable msg = Extendable_init_zero;
+    ExtensionValue value = ExtensionValue_init_zero;
+    pb_extension_t ext = pb_extension_init_zero;
+    bool status;
+
+    ext.type = &ext_msg;
+    ext.dest = &value;
+    msg.extensions = &ext;
+
+    status = pb_decode(&stream, Extendable_fields, &msg);
+    assert(status);
+    assert(ext.found && value.value == 5);
+}
+
+static bool decode_recursive(pb_istream_t *stream, const pb_field_t *field, void **arg)
+{
+    SingleRecursion msg = SingleRecursion_init_zero;
+    (void)field;
+    (void)arg;
+
+    g_decoded_depth++;
+    msg.msg.funcs.decode = &decode_recursive;
+    return pb_decode(stream, SingleRecursion_fields, &msg);
+}
+
+static void decode_recursion(const uint8_t *buffer, size_t len, int depth)
+{
+    pb_istream_t stream = pb_istream_from_buffer(buffer, len);
+    SingleRecursion msg = SingleRecursion_init_zero;
+    bool status;
+
+    g_decoded_depth = 0;
+    msg.msg.funcs.decode = &decode_recursive;
+    status = pb_decode(&stream, SingleRecursion_fields, &msg);
+    assert(status);
+    assert(g_decoded_depth == depth);
+}
+
+void do_decode_recursion_shallow()
+{
+    decode_recursion(g_shallowbuf, g_shallowlen, SHALLOW_DEPTH);
+}
+
+void do_decode_recursion_deep()
+{
+    decode_recursion(g_deepbuf, g_deeplen, DEEP_DEPTH);
+}
+
+typedef struct {
+    const char *name;
+    void (*func)();
+} measurement_t;
+
+/* Encoding functions come first, as they produce the decoder inputs */
+static const measurement_t g_measurements[] = {
+    {"pb_encode",                    do_encode},
+    {"pb_encode_ex(DELIMITED)",      do_encode_delimited},
+    {"pb_encode_ex(NULLTERMINATED)", do_encode_nullterminated},
+    {"pb_get_encoded_size",          do_get_encoded_size},
+#ifndef PB_BUFFER_ONLY
+    {"pb_encode(callback stream)",   do_encode_callback_stream},
+#endif
+    {"pb_encode(extension)",         do_encode_extension},
+    {"pb_encode(recursion 1)",       do_encode_recursion_shallow},
+    {"pb_encode(recursion 8)",       do_encode_recursion_deep},
+    {"pb_decode",                    do_decode},
+    {"pb_decode_iterative",          do_decode_iterative},
+    {"pb_decode_ex(NOINIT)",         do_decode_noinit},
+    {"pb_decode_ex(DELIMITED)",      do_decode_delimited},
+    {"pb_decode_ex(NULLTERMINATED)", do_decode_nullterminated},
+#ifndef PB_BUFFER_ONLY
+    {"pb_decode(callback stream)",   do_decode_callback_stream},
+#endif
+    {"pb_decode(extension)",         do_decode_extension},
+    {"pb_decode(recursion 1)",       do_decode_recursion_shallow},
+    {"pb_decode(recursion 8)",       do_decode_recursion_deep},
+};
+
+#define MEASUREMENT_COUNT (sizeof(g_measurements) / sizeof(g_measurements[0]))
+
 int main()
 {
-    int stack_encode, stack_decode;
+    int results[MEASUREMENT_COUNT];
+    int encode_shallow = 0, encode_deep = 0, decode_shallow = 0, decode_deep = 0;
+    size_t i;
 
-    start_stack_measuring();
-    do_encode();
-    stack_encode = end_stack_measuring();
+    /* Run everything once first, so that the first calls to library
+     * functions do not add the stack usage of the dynamic linker. */
+    for (i = 0; i < MEASUREMENT_COUNT; i++)
+    {
+        g_measurements[i].func();
+    }
 
-    start_stack_measuring();
-    do_decode();
-    stack_decode = end_stack_measuring();
+    for (i = 0; i < MEASUREMENT_COUNT; i++)
+    {
+        start_stack_measuring();
+        g_measurements[i].func();
+        results[i] = end_stack_measuring();
+    }
 
     /* Print machine-readable to stdout and user-readable to stderr */
-    printf("%d %d\n", stack_encode, stack_decode);
-    fprintf(stderr, "Stack usage: encode %d bytes, decode %d bytes\n",
-            stack_encode, stack_decode);
+    for (i = 0; i < MEASUREMENT_COUNT; i++)
+    {
+        printf("%s %d\n", g_measurements[i].name, results[i]);
+        fprintf(stderr, "Stack usage: %-30s %5d bytes\n", g_measurements[i].name, results[i]);
+
+        if (g_measurements[i].func == do_encode_recursion_shallow) encode_shallow = results[i];
+        if (g_measurements[i].func == do_encode_recursion_deep) encode_deep = results[i];
+        if (g_measurements[i].func == do_decode_recursion_shallow) decode_shallow = results[i];
+        if (g_measurements[i].func == do_decode_recursion_deep) decode_deep = results[i];
+    }
+
+    printf("pb_encode(per recursion level) %d\n",
+           (encode_deep - encode_shallow) / (DEEP_DEPTH - SHALLOW_DEPTH));
+    printf("pb_decode(per recursion level) %d\n",
+           (decode_deep - decode_shallow) / (DEEP_DEPTH - SHALLOW_DEPTH));
     return 0;
 }
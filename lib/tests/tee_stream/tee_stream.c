@@ -0,0 +1,157 @@
+/* Encode telemetry once into a tee stream with several sinks, and check
+ * that each sink gets the same bytes and that a failing sink does not
+ * stop the others.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <pb_encode.h>
+#include "unittests.h"
+#include "tee_stream.pb.h"
+
+static int g_note_calls;
+
+static bool encode_note(pb_ostream_t *stream, const pb_field_t *field, void * const *arg)
+{
+    g_note_calls++;
+    return pb_encode_tag_for_field(stream, field) &&
+           pb_encode_string(stream, (const pb_byte_t*)*arg, strlen((const char*)*arg));
+}
+
+/* Sink that counts the calls, like a serial port */
+typedef struct {
+    pb_byte_t data[256];
+    size_t calls;
+} serial_state_t;
+
+static bool serial_write(pb_ostream_t *stream, const pb_byte_t *buf, size_t count)
+{
+    serial_state_t *state = (serial_state_t*)stream->state;
+    memcpy(state->data + stream->bytes_written, buf, count);
+    state->calls++;
+    return true;
+}
+
+static void fill_message(Telemetry *msg)
+{
+    memset(msg, 0, sizeof(Telemetry));
+    msg->seq = 1234;
+    msg->readings_count = 3;
+    msg->readings[0].sensor = 1;
+    msg->readings[0].value = 21.5f;
+    msg->readings[1].sensor = 2;
+    msg->readings[1].value = 6.8f;
+    msg->readings[2].sensor = -3;
+    msg->readings[2].value = 1000.0f;
+    msg->note.funcs.encode = &encode_note;
+    msg->note.arg = (void*)"pump cycle";
+}
+
+int main()
+{
+    int status = 0;
+    Telemetry msg;
+    pb_byte_t expected[256];
+    size_t expected_len;
+    int single_calls;
+
+    fill_message(&msg);
+
+    {
+        pb_ostream_t stream = pb_ostream_from_buffer(expected, sizeof(expected));
+
+        g_note_calls = 0;
+        TEST(pb_encode_ex(&stream, Telemetry_fields, &msg, PB_ENCODE_DELIMITED));
+        expected_len = stream.bytes_written;
+        single_calls = g_note_calls;
+    }
+
+    {
+        pb_byte_t log[256], debug[256];
+        serial_state_t serial;
+        pb_ostream_t sinks[3];
+        pb_ostream_tee_t state;
+        pb_ostream_t stream;
+
+        COMMENT("Same bytes in all sinks");
+        sinks[0] = pb_ostream_from_buffer(NULL, 0);
+        sinks[0].callback = &serial_write;
+        sinks[0].state = &serial;
+        sinks[0].max_size = sizeof(serial.data);
+        sinks[1] = pb_ostream_from_buffer(log, sizeof(log));
+        sinks[2] = pb_ostream_from_buffer(debug, sizeof(debug));
+        serial.calls = 0;
+
+        stream = pb_ostream_tee(&state, sinks, 3);
+        g_note_calls = 0;
+        TEST(pb_encode_ex(&stream, Telemetry_fields, &msg, PB_ENCODE_DELIMITED));
+        TEST(state.failed == 0);
+        TEST(stream.bytes_written == expected_len);
+        TEST(sinks[0].bytes_written == expected_len && memcmp(serial.data, expected, expected_len) == 0);
+        TEST(sinks[1].bytes_written == expected_len && memcmp(log, expected, expected_len) == 0);
+        TEST(sinks[2].bytes_written == expected_len && memcmp(debug, expected, expected_len) == 0);
+
+        COMMENT("Message is encoded only once");
+        TEST(g_note_calls == single_calls);
+        printf("%u bytes to 3 sinks, %d callback calls, %u serial writes\n",
+               (unsigned)expected_len, g_note_calls, (unsigned)serial.calls);
+    }
+
+    {
+        pb_byte_t log[256], debug[8];
+        pb_ostream_t sinks[2];
+        pb_ostream_tee_t state;
+        pb_ostream_t stream;
+
+        COMMENT("Failing sink does not stop the others");
+        sinks[0] = pb_ostream_from_buffer(log, sizeof(log));
+        sinks[1] = pb_ostream_from_buffer(debug, sizeof(debug));
+        stream = pb_ostream_tee(&state, sinks, 2);
+        TEST(pb_encode_ex(&stream, Telemetry_fields, &msg, PB_ENCODE_DELIMITED));
+        TEST(state.failed == 2);
+        TEST(sinks[0].bytes_written == expected_len && memcmp(log, expected, expected_len) == 0);
+        TEST(strcmp(PB_GET_ERROR(&sinks[1]), "stream full") == 0);
+        TEST(PB_GET_ERROR(&stream) == PB_GET_ERROR(&sinks[0]));
+    }
+
+    {
+        pb_byte_t small1[4], small2[10];
+        pb_ostream_t sinks[2];
+        pb_ostream_tee_t state;
+        pb_ostream_t stream;
+
+        COMMENT("Encoding fails when all sinks fail");
+        sinks[0] = pb_ostream_from_buffer(small1, sizeof(small1));
+        sinks[1] = pb_ostream_from_buffer(small2, sizeof(small2));
+        stream = pb_ostream_tee(&state, sinks, 2);
+        TEST(!pb_encode_ex(&stream, Telemetry_fields, &msg, PB_ENCODE_DELIMITED));
+        TEST(state.failed == 3);
+        TEST(strcmp(PB_GET_ERROR(&stream), "stream full") == 0);
+    }
+
+    {
+        pb_byte_t buffer[256];
+        pb_ostream_t sinks[PB_TEE_MAX_SINKS + 1];
+        pb_ostream_tee_t state;
+        pb_ostream_t stream;
+        int i;
+
+        COMMENT("Tee without sinks fails");
+        stream = pb_ostream_tee(&state, sinks, 0);
+        TEST(!pb_encode_ex(&stream, Telemetry_fields, &msg, PB_ENCODE_DELIMITED));
+        TEST(strcmp(PB_GET_ERROR(&stream), "no tee sinks") == 0);
+
+        COMMENT("Tee with too many sinks fails");
+        for (i = 0; i < PB_TEE_MAX_SINKS + 1; i++)
+            sinks[i] = pb_ostream_from_buffer(buffer, sizeof(buffer));
+        stream = pb_ostream_tee(&state, sinks, PB_TEE_MAX_SINKS + 1);
+        TEST(!pb_encode_ex(&stream, Telemetry_fields, &msg, PB_ENCODE_DELIMITED));
+        TEST(strcmp(PB_GET_ERROR(&stream), "too many tee sinks") == 0);
+        TEST(sinks[0].bytes_written == 0);
+    }
+
+    if (status != 0)
+        fprintf(stdout, "\n\nSome tests FAILED!\n");
+
+    return status;
+}
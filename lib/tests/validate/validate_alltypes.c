@@ -0,0 +1,116 @@
+/* Compare pb_validate() against pb_decode() for the alltypes message,
+ * and for every truncation and a set of single byte corruptions of it.
+ * Also prints the time taken by both.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <pb_decode.h>
+#include "alltypes.pb.h"
+#include "test_helpers.h"
+#include "unittests.h"
+
+#define ITERATIONS 20000
+
+static bool check_decode(const pb_byte_t *buf, size_t len)
+{
+    AllTypes msg = AllTypes_init_zero;
+    pb_istream_t stream = pb_istream_from_buffer(buf, len);
+    return pb_decode(&stream, AllTypes_fields, &msg);
+}
+
+static bool check_validate(const pb_byte_t *buf, size_t len)
+{
+    pb_istream_t stream = pb_istream_from_buffer(buf, len);
+    return pb_validate(&stream, AllTypes_fields);
+}
+
+/* Returns true if validate and decode give the same result */
+static bool compare(const pb_byte_t *buf, size_t len)
+{
+    bool decoded = check_decode(buf, len);
+    bool validated = check_validate(buf, len);
+
+    if (decoded != validated)
+    {
+        fprintf(stderr, "Mismatch for %u bytes: decode %d, validate %d\n",
+                (unsigned)len, (int)decoded, (int)validated);
+        return false;
+    }
+
+    return true;
+}
+
+int main()
+{
+    int status = 0;
+    pb_byte_t buffer[1024];
+    pb_byte_t copy[1024];
+    size_t count, i, j;
+    static const pb_byte_t masks[] = {0x01, 0x07, 0x40, 0x80, 0xFF};
+
+    SET_BINARY_MODE(stdin);
+    count = fread(buffer, 1, sizeof(buffer), stdin);
+
+    {
+        pb_istream_t stream = pb_istream_from_buffer(buffer, count);
+
+        COMMENT("Validate original message");
+        TEST(pb_validate(&stream, AllTypes_fields));
+        TEST(stream.bytes_left == 0);
+        TEST(check_decode(buffer, count));
+    }
+
+    {
+        size_t mismatches = 0;
+
+        COMMENT("Truncated messages");
+        for (i = 0; i < count; i++)
+        {
+            if (!compare(buffer, i))
+                mismatches++;
+        }
+        TEST(mismatches == 0);
+    }
+
+    {
+        size_t mismatches = 0;
+
+        COMMENT("Corrupted messages");
+        for (i = 0; i < count; i++)
+        {
+            for (j = 0; j < sizeof(masks); j++)
+            {
+                memcpy(copy, buffer, count);
+                copy[i] ^= masks[j];
+                if (!compare(copy, count))
+                    mismatches++;
+            }
+        }
+        TEST(mismatches == 0);
+    }
+
+    {
+        clock_t start;
+        double decode_us, validate_us;
+
+        start = clock();
+        for (i = 0; i < ITERATIONS; i++)
+            check_decode(buffer, count);
+        decode_us = (double)(clock() - start) * 1e6 / CLOCKS_PER_SEC / ITERATIONS;
+
+        start = clock();
+        for (i = 0; i < ITERATIONS; i++)
+            check_validate(buffer, count);
+        validate_us = (double)(clock() - start) * 1e6 / CLOCKS_PER_SEC / ITERATIONS;
+
+        printf("decode:   %8.3f us per message\n", decode_us);
+        printf("validate: %8.3f us per message\n", validate_us);
+    }
+
+    if (status != 0)
+        fprintf(stdout, "\n\nSome tests FAILED!\n");
+
+    return status;
+}
@@ -0,0 +1,100 @@
+/* Check that pb_validate() and pb_decode() agree on arrays whose
+ * entries are interleaved with other fields.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <pb_decode.h>
+#include "validate_fixed_count.pb.h"
+#include "unittests.h"
+
+/* Append count varint entries of field tag to buf */
+static size_t append(pb_byte_t *buf, size_t pos, uint32_t tag, int count)
+{
+    while (count-- > 0)
+    {
+        buf[pos++] = (pb_byte_t)(tag << 3);
+        buf[pos++] = 1;
+    }
+    return pos;
+}
+
+static bool check_decode(const pb_byte_t *buf, size_t len, const char **errmsg)
+{
+    FixedCount msg = FixedCount_init_zero;
+    pb_istream_t stream = pb_istream_from_buffer(buf, len);
+    bool status = pb_decode(&stream, FixedCount_fields, &msg);
+    *errmsg = PB_GET_ERROR(&stream);
+    return status;
+}
+
+static bool check_validate(const pb_byte_t *buf, size_t len, const char **errmsg)
+{
+    pb_istream_t stream = pb_istream_from_buffer(buf, len);
+    bool status = pb_validate(&stream, FixedCount_fields);
+    *errmsg = PB_GET_ERROR(&stream);
+    return status;
+}
+
+/* Returns true if validate and decode give the same result and error */
+static bool compare(const pb_byte_t *buf, size_t len, bool expected)
+{
+    const char *decode_error, *validate_error;
+    bool decoded = check_decode(buf, len, &decode_error);
+    bool validated = check_validate(buf, len, &validate_error);
+
+    if (decoded != expected || validated != expected ||
+        strcmp(decode_error, validate_error) != 0)
+    {
+        fprintf(stderr, "Mismatch: decode %d (%s), validate %d (%s)\n",
+                (int)decoded, decode_error, (int)validated, validate_error);
+        return false;
+    }
+
+    return true;
+}
+
+int main()
+{
+    int status = 0;
+    pb_byte_t buffer[64];
+    size_t len;
+
+    COMMENT("Fixed count array repeated after another one");
+    len = append(buffer, 0, 1, 3);
+    len = append(buffer, len, 2, 3);
+    len = append(buffer, len, 1, 3);
+    TEST(compare(buffer, len, true));
+
+    COMMENT("Fixed count array interrupted by another one");
+    len = append(buffer, 0, 1, 1);
+    len = append(buffer, len, 2, 3);
+    len = append(buffer, len, 1, 2);
+    TEST(compare(buffer, len, false));
+
+    COMMENT("Fixed count array interrupted by a normal array");
+    len = append(buffer, 0, 1, 1);
+    len = append(buffer, len, 3, 2);
+    len = append(buffer, len, 1, 2);
+    TEST(compare(buffer, len, true));
+
+    COMMENT("Incomplete fixed count array at the end");
+    len = append(buffer, 0, 1, 3);
+    len = append(buffer, len, 2, 2);
+    TEST(compare(buffer, len, false));
+
+    COMMENT("Array split by other fields is counted as a whole");
+    len = append(buffer, 0, 3, 2);
+    len = append(buffer, len, 1, 3);
+    len = append(buffer, len, 3, 2);
+    TEST(compare(buffer, len, false));
+
+    COMMENT("Too long fixed count array");
+    len = append(buffer, 0, 1, 4);
+    TEST(compare(buffer, len, false));
+
+    if (status != 0)
+        fprintf(stdout, "\n\nSome tests FAILED!\n");
+
+    return status;
+}
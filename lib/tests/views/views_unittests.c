@@ -0,0 +1,122 @@
+#include <stdio.h>
+#include <string.h>
+#include <pb_decode.h>
+#include <pb_encode.h>
+#include "unittests.h"
+#include "views.pb.h"
+
+static bool view_equals(const pb_view_t *view, const char *str)
+{
+    return view->len == strlen(str) && memcmp(view->ptr, str, view->len) == 0;
+}
+
+static bool view_inside(const pb_view_t *view, const pb_byte_t *buf, size_t len)
+{
+    return view->ptr >= buf && view->ptr + view->len <= buf + len;
+}
+
+/* Stream that reads from a buffer through a user callback */
+static bool callback_read(pb_istream_t *stream, pb_byte_t *buf, size_t count)
+{
+    const pb_byte_t *source = (const pb_byte_t*)stream->state;
+    stream->state = (pb_byte_t*)stream->state + count;
+    if (buf != NULL)
+        memcpy(buf, source, count);
+    return true;
+}
+
+int main()
+{
+    int status = 0;
+    pb_byte_t buffer[128];
+    size_t msglen;
+
+    {
+        Copies src = Copies_init_zero;
+        pb_ostream_t ostream = pb_ostream_from_buffer(buffer, sizeof(buffer));
+
+        strcpy(src.text, "first");
+        src.has_data = true;
+        src.data.size = 3;
+        memcpy(src.data.bytes, "\x00\x01\x02", 3);
+        src.tags_count = 2;
+        strcpy(src.tags[0], "alpha");
+        strcpy(src.tags[1], "");
+        src.has_sub = true;
+        src.sub.has_name = true;
+        strcpy(src.sub.name, "nested");
+
+        COMMENT("Encode reference message");
+        TEST(pb_encode(&ostream, Copies_fields, &src));
+        msglen = ostream.bytes_written;
+    }
+
+    {
+        Views dest;
+        pb_istream_t istream = pb_istream_from_buffer(buffer, msglen);
+
+        COMMENT("Decode as views");
+        TEST(pb_decode(&istream, Views_fields, &dest));
+        TEST(view_equals(&dest.text, "first"));
+        TEST(view_inside(&dest.text, buffer, msglen));
+        TEST(dest.has_data && dest.data.len == 3);
+        TEST(memcmp(dest.data.ptr, "\x00\x01\x02", 3) == 0);
+        TEST(view_inside(&dest.data, buffer, msglen));
+        TEST(dest.tags_count == 2);
+        TEST(view_equals(&dest.tags[0], "alpha"));
+        TEST(dest.tags[1].len == 0);
+        TEST(dest.has_sub && view_equals(&dest.sub.name, "nested"));
+        TEST(view_inside(&dest.sub.name, buffer, msglen));
+        TEST(!dest.has_label && view_equals(&dest.label, "hello"));
+    }
+
+    {
+        Views msg;
+        pb_byte_t buffer2[128];
+        pb_istream_t istream = pb_istream_from_buffer(buffer, msglen);
+        pb_ostream_t ostream = pb_ostream_from_buffer(buffer2, sizeof(buffer2));
+        size_t size;
+
+        COMMENT("Encode views back to identical data");
+        TEST(pb_decode(&istream, Views_fields, &msg));
+        TEST(pb_encode(&ostream, Views_fields, &msg));
+        TEST(ostream.bytes_written == msglen);
+        TEST(memcmp(buffer, buffer2, msglen) == 0);
+        TEST(pb_get_encoded_size(&size, Views_fields, &msg) && size == msglen);
+    }
+
+    {
+        Views msg = Views_init_zero;
+        pb_ostream_t ostream = pb_ostream_from_buffer(buffer, sizeof(buffer));
+
+        COMMENT("Encode view with invalid pointer");
+        msg.text.len = 5;
+        TEST(!pb_encode(&ostream, Views_fields, &msg));
+        TEST(strcmp(PB_GET_ERROR(&ostream), "invalid view") == 0);
+    }
+
+    {
+        Views msg;
+        pb_istream_t istream = pb_istream_from_buffer(buffer, msglen);
+
+        COMMENT("Decode from callback stream");
+        istream.callback = &callback_read;
+        TEST(!pb_decode(&istream, Views_fields, &msg));
+        TEST(strcmp(PB_GET_ERROR(&istream), "view requires buffer stream") == 0);
+    }
+
+    {
+        Views msg;
+        pb_byte_t truncated[] = {0x0A, 0x05, 'a', 'b', 'c'};
+        pb_istream_t istream = pb_istream_from_buffer(truncated, sizeof(truncated));
+
+        COMMENT("Decode truncated view");
+        TEST(!pb_decode(&istream, Views_fields, &msg));
+        TEST(strcmp(PB_GET_ERROR(&istream), "end-of-stream") == 0);
+    }
+
+    if (status != 0)
+        fprintf(stdout, "\n\nSome tests FAILED!\n");
+
+    return status;
+}